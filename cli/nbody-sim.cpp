@@ -0,0 +1,262 @@
+/*
+ * nbody-sim: headless driver for the simulation core
+ *
+ * Description:
+ * Generates one of the initial conditions, then runs the requested number of steps back to back, with no window,
+ * frame cap or vsync, and reports the wall time of the initialization and of the steps, the interaction and tree walk
+ * counts of the last step, and the per-phase timings of the steps, which can also be written out as CSV or JSON.
+ */
+#include "ExecutionConfig.h"
+#include "MemoryPlacement.h"
+#include "Simulation.h"
+#include "PhaseTimers.h"
+#include <omp.h>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <algorithm>
+
+
+
+
+static void PrintUsage(const char* program)
+{
+    std::fprintf(stderr,
+        "usage: %s [options]\n"
+        "  -n, --bodies N        number of bodies (default 10000)\n"
+        "  -s, --steps N         number of time steps (default 100)\n"
+        "      --theta T         Barnes-Hut opening criterion (default 1.0)\n"
+        "      --dt T            time step (default 0.01)\n"
+        "  -t, --threads N       OpenMP threads, 0 for one per core (default 0)\n"
+        "      --affinity A      spread, compact or none (default spread)\n"
+        "      --smt             give threads to the SMT siblings of each core too\n"
+        "      --ic NAME         initial condition: cube, plummer or disk (default cube)\n"
+        "      --seed N          random seed of the initial condition (default 1)\n"
+        "      --hilbert         order the bodies along the Hilbert curve instead of Morton\n"
+        "      --radix-sort      re-sort from scratch every step instead of repairing the last order\n"
+        "      --layout L        node array layout the force walks read: breadth, or the experimental and slower depth (default breadth)\n"
+        "      --no-huge-pages   map the large buffers with normal pages\n"
+        "      --timings-csv F   write the per-phase, per-thread timings to F as CSV\n"
+        "      --timings-json F  write them to F as JSON\n"
+        "      --no-timers       do not time the phases\n"
+        "      --histograms      print the last step's histograms of interactions and visited nodes per body\n"
+        "  -h, --help            print this message\n",
+        program);
+}
+
+static bool ParseSize(const char* text, size_t& value)
+{
+    char* end = nullptr;
+    unsigned long long parsed = std::strtoull(text, &end, 10);
+    if (end == text || *end != '\0' || text[0] == '-')
+    {
+        return(false);
+    }
+    value = (size_t)parsed;
+    return(true);
+}
+
+static bool ParseDouble(const char* text, double& value)
+{
+    char* end = nullptr;
+    value = std::strtod(text, &end);
+    return(end != text && *end == '\0');
+}
+
+int main(int argc, char* argv[])
+{
+    SimulationParams params;
+    ExecutionConfig config;
+    size_t numSteps = 100;
+    const char* timingsCSV = nullptr;
+    const char* timingsJSON = nullptr;
+    bool printHistograms = false;
+
+    for (int a = 1; a < argc; a++)
+    {
+        const char* arg = argv[a];
+        const char* value = (a + 1 < argc) ? argv[a + 1] : nullptr;
+        bool ok = true;
+        bool takesValue = true;
+        size_t count = 0;
+        if (std::strcmp(arg, "-n") == 0 || std::strcmp(arg, "--bodies") == 0)
+        {
+            ok = value != nullptr && ParseSize(value, params.numBodies) && params.numBodies > 0;
+        }
+        else if (std::strcmp(arg, "-s") == 0 || std::strcmp(arg, "--steps") == 0)
+        {
+            ok = value != nullptr && ParseSize(value, numSteps);
+        }
+        else if (std::strcmp(arg, "--theta") == 0)
+        {
+            ok = value != nullptr && ParseDouble(value, params.theta) && params.theta >= 0.0;
+        }
+        else if (std::strcmp(arg, "--dt") == 0)
+        {
+            ok = value != nullptr && ParseDouble(value, params.dt);
+        }
+        else if (std::strcmp(arg, "-t") == 0 || std::strcmp(arg, "--threads") == 0)
+        {
+            ok = value != nullptr && ParseSize(value, count);
+            config.numThreads = (int)count;
+        }
+        else if (std::strcmp(arg, "--affinity") == 0)
+        {
+            ok = value != nullptr;
+            if (ok && std::strcmp(value, "spread") == 0) config.affinity = Affinity_Spread;
+            else if (ok && std::strcmp(value, "compact") == 0) config.affinity = Affinity_Compact;
+            else if (ok && std::strcmp(value, "none") == 0) config.affinity = Affinity_None;
+            else ok = false;
+        }
+        else if (std::strcmp(arg, "--layout") == 0)
+        {
+            ok = value != nullptr;
+            if (ok && std::strcmp(value, "breadth") == 0) params.nodeLayout = NodeLayout_BreadthFirst;
+            else if (ok && std::strcmp(value, "depth") == 0) params.nodeLayout = NodeLayout_DepthFirst;
+            else ok = false;
+        }
+        else if (std::strcmp(arg, "--ic") == 0)
+        {
+            ok = value != nullptr && ParseInitialCondition(value, params.initialCondition);
+        }
+        else if (std::strcmp(arg, "--seed") == 0)
+        {
+            ok = value != nullptr && ParseSize(value, count);
+            params.seed = (uint32_t)count;
+        }
+        else if (std::strcmp(arg, "--timings-csv") == 0)
+        {
+            ok = value != nullptr;
+            timingsCSV = value;
+        }
+        else if (std::strcmp(arg, "--timings-json") == 0)
+        {
+            ok = value != nullptr;
+            timingsJSON = value;
+        }
+        else
+        {
+            takesValue = false;
+            if (std::strcmp(arg, "--smt") == 0) config.useSMT = true;
+            else if (std::strcmp(arg, "--hilbert") == 0) params.keyOrdering = Order_Hilbert;
+            else if (std::strcmp(arg, "--radix-sort") == 0) params.adaptiveSort = false;
+            else if (std::strcmp(arg, "--no-huge-pages") == 0) SetHugePages(false);
+            else if (std::strcmp(arg, "--no-timers") == 0) SetPhaseTimersEnabled(false);
+            else if (std::strcmp(arg, "--histograms") == 0) printHistograms = true;
+            else if (std::strcmp(arg, "-h") == 0 || std::strcmp(arg, "--help") == 0)
+            {
+                PrintUsage(argv[0]);
+                return(0);
+            }
+            else
+            {
+                std::fprintf(stderr, "%s: unknown option '%s'\n", argv[0], arg);
+                PrintUsage(argv[0]);
+                return(1);
+            }
+        }
+        if (!ok)
+        {
+            std::fprintf(stderr, "%s: invalid or missing value for '%s'\n", argv[0], arg);
+            PrintUsage(argv[0]);
+            return(1);
+        }
+        if (takesValue)
+        {
+            a++;
+        }
+    }
+
+    // Size and pin the thread team before the first allocation, so the first-touch placement uses the same thread chunks as every later phase
+    SetExecutionConfig(config);
+    config = GetExecutionConfig();
+    SetMemoryPlacement(Placement_FirstTouch);
+
+    std::printf("bodies %zu, steps %zu, theta %g, dt %g, ic %s, seed %u, %s ordering, %s sort, %s nodes\n",
+        params.numBodies, numSteps, params.theta, params.dt, InitialConditionName(params.initialCondition), (unsigned)params.seed,
+        params.keyOrdering == Order_Hilbert ? "Hilbert" : "Morton", params.adaptiveSort ? "adaptive" : "radix",
+        params.nodeLayout == NodeLayout_DepthFirst ? "depth-first (experimental)" : "breadth-first");
+    std::printf("threads %d (%s%s), %d cores, %d hardware threads, huge pages %s\n", config.numThreads,
+        config.affinity == Affinity_None ? "unpinned" : (config.affinity == Affinity_Compact ? "compact" : "spread"), config.useSMT ? " +SMT" : "",
+        HardwareCores(), HardwareThreads(), HugePagesEnabled() ? "on" : "off");
+
+    Simulation simulation;
+    double start = omp_get_wtime();
+    simulation.initialize(params);
+    double initialized = omp_get_wtime();
+    for (size_t s = 0; s < numSteps; s++)
+    {
+        simulation.step();
+    }
+    double finished = omp_get_wtime();
+
+    double stepSeconds = finished - initialized;
+    std::printf("initialize %.3f s\n", initialized - start);
+    std::printf("steps      %.3f s, %.3f ms/step", stepSeconds, numSteps > 0 ? 1000.0 * stepSeconds / numSteps : 0.0);
+    if (stepSeconds > 0.0)
+    {
+        std::printf(", %.3g body-steps/s", (double)params.numBodies * numSteps / stepSeconds);
+    }
+    std::printf("\nnodes      %zu in the last tree\n", simulation.LHTree.nodeCount());
+
+    const TraversalStatistics& traversal = simulation.traversalStatistics;
+    if (traversal.numBodies > 0)
+    {
+        std::printf("interact   %.1f per body, %.1f%% body-cell, at most %llu\n", traversal.interactionsPerBody(),
+            100.0 * traversal.bodyCellInteractions / (double)std::max<uint64_t>(traversal.interactions(), 1), (unsigned long long)traversal.maxInteractions);
+        std::printf("walk       %.1f nodes per body, at most %llu, walk list depth %u\n", traversal.visitedNodesPerBody(),
+            (unsigned long long)traversal.maxVisitedNodes, (unsigned)traversal.maxStackDepth);
+        if (printHistograms)
+        {
+            std::printf("\nper body            interactions      visited\n");
+            for (int b = 0; b < TRAVERSAL_HISTOGRAM_BINS; b++)
+            {
+                if (traversal.interactionHistogram[b] == 0 && traversal.visitedHistogram[b] == 0)
+                {
+                    continue;
+                }
+                unsigned long long low = (b == 0) ? 0 : (1ull << (b - 1));
+                unsigned long long high = (b == 0) ? 0 : (1ull << b) - 1;
+                std::printf("%8llu-%-8llu %14llu %12llu\n", low, high, (unsigned long long)traversal.interactionHistogram[b], (unsigned long long)traversal.visitedHistogram[b]);
+            }
+        }
+    }
+
+    if (PhaseTimersEnabled() && PhaseTimerSteps() > 0)
+    {
+        // The slowest thread's time per step, over the last PHASE_TIMER_WINDOW steps
+        std::printf("\nphase        min ms    mean ms     p99 ms\n");
+        for (int phase = 0; phase < NUM_PHASES; phase++)
+        {
+            PhaseStatistics statistics = GetPhaseStatistics((PhaseEnum)phase);
+            if (statistics.samples > 0)
+            {
+                std::printf("%-10s %8.3f %10.3f %10.3f\n", PhaseName((PhaseEnum)phase), 1000.0 * statistics.minSeconds, 1000.0 * statistics.meanSeconds, 1000.0 * statistics.p99Seconds);
+            }
+        }
+    }
+    const char* timingsFiles[2] = { timingsCSV, timingsJSON };
+    for (int f = 0; f < 2; f++)
+    {
+        if (timingsFiles[f] == nullptr)
+        {
+            continue;
+        }
+        std::ofstream out(timingsFiles[f]);
+        if (!out)
+        {
+            std::fprintf(stderr, "%s: cannot write '%s'\n", argv[0], timingsFiles[f]);
+            return(1);
+        }
+        if (f == 0)
+        {
+            WritePhaseTimingsCSV(out);
+        }
+        else
+        {
+            WritePhaseTimingsJSON(out);
+        }
+    }
+    return(0);
+}
@@ -1,298 +1,488 @@
-/*
- * Body Class: the n-bodies in the n-body simulation
- *
- * Description:
- * This file defines the Body class, which is used to represent 3D bodies in this program's
- * Barnes Hut n-body simulation. They are the objects to be inserted into the hashed octree.
- * Will be computed with random initial conditions, from which a hashed octree that encompasses all bodies
- * will be generated. Because the bodies will be sorted according to their Morton Keys (Morton Ordering),
- * only the number of bodies need to be stored in the hashed octree, which can then be accessed using the linear indexing system
- * that results from the Morton Ordering of bodies
- *
- */
-#pragma once
-#include "Containers.h"
-#include "SequenceContainers.h"
-#include "MortonKeys.h"
-#include "ofMain.h"
-
-
-
-
-
-
- /**
-  *  Body class representing a physical body with position, velocity, and mass properties
-  */
-class Body
-{
-public:
-    // ------------- Constructors and Assignment operators -------------
-    Body();
-    Body(Vec3D _position, Vec3D _velocity, double _mass);
-    Body(Vec3D _position, Vec3D _velocity, double _mass, const double _size);  //compute bodies based on an inputted position and a defined bounding box
-    Body(const Body& other);
-    Body& operator=(const Body& other);
-
-
-
-
-    // ------------- Setter and getter for Morton key -------------
-    void setBodyKey(spatialKey _bodyKey);
-    spatialKey getBodyKey() const;
-
-
-
-
-    // ------------- Debug utility to print the body's details -------------
-    void printBodies(string label);
-
-
-
-
-    // ------------- Member variables -------------
-    //private:
-    Vec3D position;
-    Vec3D velocity;
-    double mass;
-
-    //private:
-    spatialKey bodyKey; // Morton key associated with the body's position
-};
-
-
-
-
-// ------------- Helper functions for sorting bodies by their Morton keys using Merge Sort, a divide and conquer algorithm. -------------
-static inline void MergeBodies(Body* bodies, spatialKey* keys, size_t left, size_t middle, size_t right); // Utility function to merge two sorted body arrays based on Morton keys
-static inline void MergeSortBodies(Body* bodies, spatialKey* keys, size_t left, size_t right); // Recursive utility function to sort bodies based on Morton keys using merge sort
-static inline void MergeSortBodiesByMortonKey(const size_t numBodies, Body* bodies); // Main function to sort an array of bodies based on Morton keys
-
-
-// New function to reorder the bodies using the radix sorted key indices
-static inline void ReorderBodiesByIndexes(Body* bodies, size_t* indexes, size_t numBodies);
-static inline void RadixSortBodies(Body* bodies, size_t numBodies);
-
-
-//Helper functions to integrate forces into bodies
-static inline void ComputePositionAtHalfTimeStep(double dt, Body*& bodies, size_t numBodies);  // Drift every body once before resetting acceleration
-static inline void ComputeVelocityAndPosition(double dt, Body*& bodies, size_t numBodies, Vec3D*& bodiesAccelerations);   //Kick-Drift-Kick Leap-Frog integration scheme
-
-
-
-//Helper functions visualize bodies
-static inline void VisualizeBodies(Body *&bodies, size_t numBodies);
-
-
-static inline void MergeBodies(Body* bodies, spatialKey* keys, size_t left, size_t middle, size_t right)
-{
-    size_t i, j, k;
-    size_t size1 = middle - left + 1;
-    size_t size2 = right - middle;
-
-    // Create temp arrays
-    Body* leftTempBodies = new Body[size1];
-    spatialKey* leftTempKeys = new spatialKey[size1];
-
-    Body* rightTempBodies = new Body[size2];
-    spatialKey* rightTempKeys = new spatialKey[size2];
-
-    // Copy data to temp arrays
-    for (i = 0; i < size1; i++)
-    {
-        leftTempKeys[i] = keys[left + i];
-        leftTempBodies[i] = bodies[left + i];
-    }
-    for (j = 0; j < size2; j++)
-    {
-        rightTempKeys[j] = keys[middle + 1 + j];
-        rightTempBodies[j] = bodies[middle + 1 + j];
-    }
-
-    // Merge the arrays back into keys[left..right]
-    i = 0;
-    j = 0;
-    k = left;
-    while (i < size1 && j < size2)
-    {
-        if (leftTempKeys[i] <= rightTempKeys[j])
-        {
-            keys[k] = leftTempKeys[i];
-            bodies[k] = leftTempBodies[i];
-            i++;
-        }
-        else
-        {
-            keys[k] = rightTempKeys[j];
-            bodies[k] = rightTempBodies[j];
-            j++;
-        }
-        k++;
-    }
-    while (i < size1)  // Copy the remaining elements of leftTemp
-    {
-        keys[k] = leftTempKeys[i];
-        bodies[k] = leftTempBodies[i];
-        i++;
-        k++;
-    }
-    while (j < size2)  // Copy the remaining elements of rightTemp
-    {
-        keys[k] = rightTempKeys[j];
-        bodies[k] = rightTempBodies[j];
-        j++;
-        k++;
-    }
-
-    // Clean up
-    delete[] leftTempBodies;
-    delete[] leftTempKeys;
-    delete[] rightTempBodies;
-    delete[] rightTempKeys;
-}
-
-static inline void MergeSortBodies(Body* bodies, spatialKey* keys, size_t left, size_t right)
-{
-    if (left < right)
-    {
-        size_t middle = left + (right - left) / 2; // Same as (left+right)/2, but avoids overflow for large left and right
-
-        // Recursively Sort first and second halves until the sub-arrays are small enough to be solved directly
-        MergeSortBodies(bodies, keys, left, middle);
-        MergeSortBodies(bodies, keys, middle + 1, right);
-
-        //merge the sorted halves
-        MergeBodies(bodies, keys, left, middle, right);
-    }
-}
-
-static inline void MergeSortBodiesByMortonKey(const size_t numBodies, Body* bodies)
-{
-    if (bodies == nullptr)
-    {
-        throw std::invalid_argument("bodies is a null pointer");
-    }
-
-    // Extract Morton keys
-    spatialKey* keys = new spatialKey[numBodies];
-    for (size_t i = 0; i < numBodies; ++i)
-    {
-        keys[i] = bodies[i].bodyKey;
-    }
-    MergeSortBodies(bodies, keys, 0, numBodies - 1);
-    // Clean up
-    delete[] keys;
-}
-
-
-
-
-// New function to reorder the bodies using the sorted indexes
-static inline void ReorderBodiesByIndexes(Body* bodies, size_t* indexes, size_t numBodies)
-{
-    Body* tempBodies = new Body[numBodies];
-    for (size_t i = 0; i < numBodies; ++i)
-    {
-        tempBodies[i] = bodies[indexes[i]];
-    }
-
-    // Copy the sorted bodies back
-    for (size_t i = 0; i < numBodies; ++i)
-    {
-        bodies[i] = tempBodies[i];
-    }
-
-    // Clean up
-    delete[] tempBodies;
-}
-
-static inline void RadixSortBodies(Body* bodies, size_t numBodies)
-{
-    // We'll extract the MortonKeys to a separate array for sorting
-    spatialKey* keys = new spatialKey[numBodies];
-    size_t* indexes = new size_t[numBodies];
-    for (size_t i = 0; i < numBodies; ++i)
-    {
-        keys[i] = bodies[i].bodyKey;
-        indexes[i] = i;  // Store the original indexes
-    }
-
-    // Sort the keys and their original indexes using ThreePassRadixSortMortonKeys
-    ThreePassRadixSortMortonKeys(keys, indexes, numBodies);
-
-
-    // Reorder bodies based on the sorted keys using the indexes
-    ReorderBodiesByIndexes(bodies, indexes, numBodies);
-
-
-    // Clean up
-    delete[] keys;
-    delete[] indexes;
-}
-
-inline void ComputePositionAtHalfTimeStep(double dt, Body*& bodies, size_t numBodies)
-{
-    for (size_t i = 0; i < numBodies; i++)
-    {
-        bodies[i].position = bodies[i].position + bodies[i].velocity * (dt / 2);
-    }
-}
-
-inline void ComputeVelocityAndPosition(double dt, Body*& bodies, size_t numBodies, Vec3D*& bodiesAccelerations)
-{
-    for (size_t i = 0; i < numBodies; i++)
-    {
-        //KDK Leap Frog 
-        bodies[i].velocity = bodies[i].velocity + bodiesAccelerations[i] * (dt); // Kick
-        bodies[i].position = bodies[i].position + bodies[i].velocity * (dt / 2); // Drift   
-    }
-}
-
-inline void VisualizeBodies(Body*& bodies, size_t numBodies)
-{
-    ofSetColor(31.875, 223.125, 63.75);
-    ofFill();
-    for (size_t i = 0; i < numBodies; i++)
-    {
-
-        ofDrawSphere(bodies[i].position.x, bodies[i].position.y, bodies[i].position.z, bodies[i].mass * 4);
-        //ofSetColor(66, 66, 255);
-        //ofDrawBitmapString("bodiesAccelerations: (" + ofToString(bodiesAccelerations[i].x) + ", " + ofToString(bodiesAccelerations[i].y) + ", " + ofToString(bodiesAccelerations[i].z) + ")", bodies[i].position.x, bodies[i].position.y, bodies[i].position.z);
-    }
-}
-
-
-/* ---------------- PERFORMANCE BENCHMARRKS ----------------
-NOTE: time is recorded in seconds. Time to sort bodies equals:
-                (time taken to sort bodies) - (time taken to initialize simulation) = time to sort bodies
-
-benchmarks are tracked for each of the functions that sort morton keys
-
-
------------- BENCHMARKS FOR MORTON KEY SORTING OF BODIES ------------
-
-
---- MergeSortBodies ---
-For 2097152 Bodies
-    - Sorting Bodies by MortonKeys Time: (5.43043 - 1.93317) seconds
-    - Sorting Bodies by MortonKeys Time: (5.47774 - 1.92111) seconds
-
-For 20971520 Bodies
-    - Sorting Bodies by MortonKeys Time: (66.6898 - 13.7062) seconds
-
-
-
-
-
---- RadixSortBodies ---
-For 2097152 Bodies
-    - Sorting Bodies by MortonKeys Time: (2.31742 - 1.90053) seconds
-    - Sorting Bodies by MortonKeys Time: (2.3267 - 1.89934) seconds
-
-For 20971520 Bodies
-    - Sorting Bodies by MortonKeys Time: (18.7694 - 13.4233) seconds
-
-
-
-
-*/
\ No newline at end of file
+/*
+ * Body Class: the n-bodies in the n-body simulation
+ *
+ * Description:
+ * This file defines the Body class, which is used to represent 3D bodies in this program's
+ * Barnes Hut n-body simulation. They are the objects to be inserted into the hashed octree.
+ * Will be computed with random initial conditions, from which a hashed octree that encompasses all bodies
+ * will be generated. Because the bodies will be sorted according to their Morton Keys (Morton Ordering),
+ * only the number of bodies need to be stored in the hashed octree, which can then be accessed using the linear indexing system
+ * that results from the Morton Ordering of bodies
+ *
+ */
+#pragma once
+#include "Containers.h"
+#include "SequenceContainers.h"
+#include "MortonKeys.h"
+#include <cfloat>
+
+#if defined(_M_X64) || defined(__x86_64__) || defined(__SSE2__) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define BODY_BOUNDS_SSE2 1
+#include <emmintrin.h>
+#endif
+
+
+
+
+
+
+ /**
+  *  Body class representing a physical body with position, velocity, and mass properties
+  */
+class Body
+{
+public:
+    // ------------- Constructors and Assignment operators -------------
+    Body();
+    Body(Vec3D _position, Vec3D _velocity, double _mass);
+    Body(Vec3D _position, Vec3D _velocity, double _mass, const double _size);  //compute bodies based on an inputted position and a defined bounding box
+    Body(const Body& other) = default;  // memberwise, so sorting and reordering may move bodies as plain memory
+    Body& operator=(const Body& other) = default;
+
+
+
+
+    // ------------- Setter and getter for Morton key -------------
+    void setBodyKey(spatialKey _bodyKey);
+    spatialKey getBodyKey() const;
+
+
+
+
+    // ------------- Debug utility to print the body's details -------------
+    void printBodies(std::string label);
+
+
+
+
+    // ------------- Member variables -------------
+    //private:
+    Vec3D position;
+    Vec3D velocity;
+    double mass;
+
+    //private:
+    spatialKey bodyKey; // Morton key associated with the body's position
+};
+
+
+
+
+/**
+ *  BodySortBuffers: persistent storage for sorting the bodies into Morton order.
+ *
+ *  The sort only moves keys and indexes; the resulting permutation is applied once by gathering
+ *  the bodies into bodyBuffer, after which the live body array and bodyBuffer trade places.
+ *  Auxiliary per-body arrays are permuted the same way against their own back buffers.
+ */
+class BodySortBuffers
+{
+public:
+    BodySortBuffers() : bodyBuffer(nullptr), accelerationBuffer(nullptr), capacity(0) {}
+    ~BodySortBuffers()
+    {
+        delete[] bodyBuffer;
+        FreePlacedArray(accelerationBuffer);
+    }
+    BodySortBuffers(const BodySortBuffers& other) = delete;
+    BodySortBuffers& operator=(const BodySortBuffers& other) = delete;
+
+    void reserve(size_t numBodies) //grows the buffers to hold at least numBodies, never shrinks them
+    {
+        keyBuffers.reserve(numBodies);
+        if (numBodies <= capacity)
+        {
+            return;
+        }
+        delete[] bodyBuffer;
+        FreePlacedArray(accelerationBuffer);
+        bodyBuffer = new Body[numBodies];
+        accelerationBuffer = AllocatePlacedArray<Vec3D>(numBodies);
+        capacity = numBodies;
+    }
+
+    KeySortBuffers keyBuffers; // keys, permutation and radix/merge scratch
+    Body* bodyBuffer;          // back buffer the sorted bodies are gathered into
+    Vec3D* accelerationBuffer; // back buffer for the per-body accelerations, trades places with an array from AllocatePlacedArray
+    size_t capacity;
+};
+
+
+
+
+// ------------- Bounding box of the bodies -------------
+/**
+ * BoundsAccumulator: running minimum and maximum corner of the positions added to it.
+ * On x86 the x and y components share one SSE2 register, so a position costs two vector and two scalar min/max.
+ */
+class BoundsAccumulator
+{
+public:
+    BoundsAccumulator()
+    {
+        reset();
+    }
+
+    void reset()
+    {
+#if BODY_BOUNDS_SSE2
+        minXY = _mm_set1_pd(DBL_MAX);
+        maxXY = _mm_set1_pd(-DBL_MAX);
+#else
+        minX = minY = DBL_MAX;
+        maxX = maxY = -DBL_MAX;
+#endif
+        minZ = DBL_MAX;
+        maxZ = -DBL_MAX;
+    }
+
+    void add(const Vec3D& position)
+    {
+#if BODY_BOUNDS_SSE2
+        __m128d xy = _mm_loadu_pd(&position.x);
+        minXY = _mm_min_pd(minXY, xy);
+        maxXY = _mm_max_pd(maxXY, xy);
+#else
+        minX = (position.x < minX) ? position.x : minX;
+        minY = (position.y < minY) ? position.y : minY;
+        maxX = (position.x > maxX) ? position.x : maxX;
+        maxY = (position.y > maxY) ? position.y : maxY;
+#endif
+        minZ = (position.z < minZ) ? position.z : minZ;
+        maxZ = (position.z > maxZ) ? position.z : maxZ;
+    }
+
+    void add(double x, double y, double z) // for positions whose components are not adjacent in memory (BodySystem)
+    {
+#if BODY_BOUNDS_SSE2
+        __m128d xy = _mm_set_pd(y, x);
+        minXY = _mm_min_pd(minXY, xy);
+        maxXY = _mm_max_pd(maxXY, xy);
+#else
+        minX = (x < minX) ? x : minX;
+        minY = (y < minY) ? y : minY;
+        maxX = (x > maxX) ? x : maxX;
+        maxY = (y > maxY) ? y : maxY;
+#endif
+        minZ = (z < minZ) ? z : minZ;
+        maxZ = (z > maxZ) ? z : maxZ;
+    }
+
+    void merge(const BoundsAccumulator& other)
+    {
+#if BODY_BOUNDS_SSE2
+        minXY = _mm_min_pd(minXY, other.minXY);
+        maxXY = _mm_max_pd(maxXY, other.maxXY);
+#else
+        minX = (other.minX < minX) ? other.minX : minX;
+        minY = (other.minY < minY) ? other.minY : minY;
+        maxX = (other.maxX > maxX) ? other.maxX : maxX;
+        maxY = (other.maxY > maxY) ? other.maxY : maxY;
+#endif
+        minZ = (other.minZ < minZ) ? other.minZ : minZ;
+        maxZ = (other.maxZ > maxZ) ? other.maxZ : maxZ;
+    }
+
+    void getCorners(Vec3D& minCorner, Vec3D& maxCorner) const
+    {
+#if BODY_BOUNDS_SSE2
+        double xy[2];
+        _mm_storeu_pd(xy, minXY);
+        minCorner = Vec3D(xy[0], xy[1], minZ);
+        _mm_storeu_pd(xy, maxXY);
+        maxCorner = Vec3D(xy[0], xy[1], maxZ);
+#else
+        minCorner = Vec3D(minX, minY, minZ);
+        maxCorner = Vec3D(maxX, maxY, maxZ);
+#endif
+    }
+
+private:
+#if BODY_BOUNDS_SSE2
+    __m128d minXY;
+    __m128d maxXY;
+#else
+    double minX, minY, maxX, maxY;
+#endif
+    double minZ;
+    double maxZ;
+};
+
+static inline void ComputeBodyBounds(const Body* bodies, size_t numBodies, Vec3D& minCorner, Vec3D& maxCorner); // Parallel min/max reduction over the body positions
+static const size_t BODY_KEY_TILE = 256; // Bodies encoded per step by ComputeBodyKeys, small enough that the bounds and bookkeeping pass reads them from L1
+
+
+
+
+// ------------- Helper functions for sorting bodies by their Morton keys. Only keys and indexes are sorted, the bodies are gathered once. -------------
+static inline size_t ComputeStridedKeys(const double* x, const double* y, const double* z, size_t strideBytes, spatialKey* bodyKeys, size_t keyStrideBytes, size_t numBodies, const Vec3D& center, const double size, KeySortBuffers& sortBuffers, Vec3D& minCorner, Vec3D& maxCorner, KeyOrderingEnum ordering); // ComputeBodyKeys on strided position components, shared by the Body array and BodySystem
+static inline size_t ComputeBodyKeys(Body* bodies, size_t numBodies, const Vec3D& center, const double size, KeySortBuffers& sortBuffers, Vec3D& minCorner, Vec3D& maxCorner, KeyOrderingEnum ordering = Order_Morton); // Compute every body's key into the body and the sort buffers, measuring the bodies' bounding box in the same pass, returning the number of out-of-order keys
+static inline size_t ComputeBodyKeys(Body* bodies, size_t numBodies, const Vec3D& center, const double size, KeySortBuffers& sortBuffers, KeyOrderingEnum ordering = Order_Morton); // Compute every body's key into the body and the sort buffers, returning the number of out-of-order keys
+static inline void LoadBodyKeys(const Body* bodies, size_t numBodies, KeySortBuffers& sortBuffers); // Copy the body keys into the sort buffers along with the identity permutation
+static inline void MergeSortBodiesByMortonKey(Body*& bodies, const size_t numBodies, BodySortBuffers& sortBuffers); // Sort bodies based on Morton keys using merge sort on keys and indexes
+static inline void RadixSortBodies(Body*& bodies, size_t numBodies, BodySortBuffers& sortBuffers); // Sort bodies based on Morton keys using the three-pass radix sort on keys and indexes
+static inline AdaptiveSortEnum AdaptiveSortBodies(Body*& bodies, size_t numBodies, BodySortBuffers& sortBuffers, size_t keyDescents); // Re-sort bodies whose keys were computed by ComputeBodyKeys, exploiting last frame's order
+
+
+// Applying a sorted permutation to the body data and to any auxiliary per-body array
+template <typename T> static inline void GatherByIndexes(const T* source, T* destination, const size_t* indexes, size_t count);
+template <typename T> static inline void PermuteByIndexes(T*& data, T*& backBuffer, const size_t* indexes, size_t count);
+static inline void PermuteBodyAccelerations(Vec3D*& bodiesAccelerations, BodySortBuffers& sortBuffers, size_t numBodies);
+
+
+//Helper functions to integrate forces into bodies
+static inline void ComputePositionAtHalfTimeStep(double dt, Body*& bodies, size_t numBodies);  // Drift every body once before resetting acceleration
+static inline void ComputeVelocityAndPosition(double dt, Body*& bodies, size_t numBodies, Vec3D*& bodiesAccelerations);   //Kick-Drift-Kick Leap-Frog integration scheme
+
+
+
+
+/**
+ * Minimum and maximum corner of the axis aligned box enclosing every body, each thread reduces its GetThreadChunk share.
+ */
+static inline void ComputeBodyBounds(const Body* bodies, size_t numBodies, Vec3D& minCorner, Vec3D& maxCorner)
+{
+    BoundsAccumulator bounds;
+#pragma omp parallel
+    {
+        size_t start, end;
+        GetThreadChunk(numBodies, omp_get_thread_num(), omp_get_num_threads(), start, end);
+        BoundsAccumulator threadBounds;
+        for (size_t i = start; i < end; ++i)
+        {
+            threadBounds.add(bodies[i].position);
+        }
+#pragma omp critical
+        bounds.merge(threadBounds);
+    }
+    bounds.getCorners(minCorner, maxCorner);
+}
+
+
+
+
+/**
+ * Compute the spatial key (Morton or Hilbert) of every body, storing it in the body and in the sort buffers along with the identity permutation.
+ * The keys map the cube [center - size, center + size] onto the key grid, bodies outside it are clamped to its faces.
+ *
+ * Each thread encodes its static chunk of the bodies and counts the descents (keys smaller than their predecessor)
+ * on the fly; the chunk boundaries are checked afterwards. Morton keys go through the batch encoder (EncodeMortonKeyBlock). Since the bodies are still in last frame's Morton order,
+ * the descent count measures how far the order has drifted and lets AdaptiveSortBodies pick a cheap repair.
+ *
+ * The bodies' bounding box is reduced in the same pass, tile by tile right after the tile is encoded, so the body
+ * data is streamed from memory once. The same sweep counts each thread's first radix digits, which the radix sort
+ * (ParallelRadixSortKeyIndexes) picks up instead of re-reading the keys, and RadixSortBodies then sorts the keys
+ * straight from the sort buffers without reloading them from the bodies. A caller keeping a padded root cube across frames checks the box afterwards
+ * and only regenerates the keys in the (rare) frames where a body left the cube.
+ *
+ * @return the number of i with key[i] < key[i - 1].
+ */
+static inline size_t ComputeBodyKeys(Body* bodies, size_t numBodies, const Vec3D& center, const double size, KeySortBuffers& sortBuffers, Vec3D& minCorner, Vec3D& maxCorner, KeyOrderingEnum ordering)
+{
+    return(ComputeStridedKeys(&bodies->position.x, &bodies->position.y, &bodies->position.z, sizeof(Body), &bodies->bodyKey, sizeof(Body), numBodies, center, size, sortBuffers, minCorner, maxCorner, ordering));
+}
+
+/**
+ * The body of ComputeBodyKeys, reading the i-th position from x/y/z + i * strideBytes and storing the i-th key at
+ * bodyKeys + i * keyStrideBytes, so the same pass serves an array of Body records and the separate arrays of a BodySystem.
+ */
+static inline size_t ComputeStridedKeys(const double* x, const double* y, const double* z, size_t strideBytes, spatialKey* bodyKeys, size_t keyStrideBytes, size_t numBodies, const Vec3D& center, const double size, KeySortBuffers& sortBuffers, Vec3D& minCorner, Vec3D& maxCorner, KeyOrderingEnum ordering)
+{
+    sortBuffers.reserve(numBodies);
+    sortBuffers.reserveThreadHistograms(omp_get_max_threads());
+    spatialKey* keys = sortBuffers.keys;
+    size_t* indexes = sortBuffers.indexes;
+
+    long long keyDescents = 0;
+    int numChunks = 1;
+    BoundsAccumulator bounds;
+#pragma omp parallel reduction(+:keyDescents)
+    {
+        int id = omp_get_thread_num();
+        int numThreads = omp_get_num_threads();
+        if (id == 0)
+        {
+            numChunks = numThreads;
+        }
+        size_t start, end;
+        GetThreadChunk(numBodies, id, numThreads, start, end);
+        BoundsAccumulator threadBounds;
+        size_t* histogram = sortBuffers.threadHistograms + (size_t)id * NUM_BINS; // digit counts of the first radix pass (bits 0-7)
+        for (int b = 0; b < NUM_BINS; b++)
+        {
+            histogram[b] = 0;
+        }
+        for (size_t tileStart = start; tileStart < end; tileStart += BODY_KEY_TILE)
+        {
+            size_t tileEnd = std::min(tileStart + BODY_KEY_TILE, end);
+            if (ordering == Order_Morton)
+            {
+                EncodeMortonKeyBlock(StridedPointer(x, strideBytes, tileStart), StridedPointer(y, strideBytes, tileStart), StridedPointer(z, strideBytes, tileStart), strideBytes, tileEnd - tileStart, center, size, keys + tileStart);
+            }
+            for (size_t i = tileStart; i < tileEnd; ++i)
+            {
+                double px = StridedValue(x, strideBytes, i), py = StridedValue(y, strideBytes, i), pz = StridedValue(z, strideBytes, i);
+                spatialKey key = (ordering == Order_Morton) ? keys[i] : computeSpatialKey(Vec3D(px - center.x, py - center.y, pz - center.z), size, ordering);
+                *StridedPointer(bodyKeys, keyStrideBytes, i) = key;
+                keys[i] = key;
+                indexes[i] = i;
+                threadBounds.add(px, py, pz);
+                histogram[KeyRadixDigit(key, 0)]++;
+                if (i > start && key < keys[i - 1])
+                {
+                    keyDescents++;
+                }
+            }
+        }
+#pragma omp critical
+        bounds.merge(threadBounds);
+    }
+    bounds.getCorners(minCorner, maxCorner);
+    sortBuffers.firstPassHistogramThreads = numChunks;
+    for (int c = 1; c < numChunks; c++) // descents across the chunk boundaries
+    {
+        size_t start, end;
+        GetThreadChunk(numBodies, c, numChunks, start, end);
+        if (start > 0 && start < numBodies && keys[start] < keys[start - 1])
+        {
+            keyDescents++;
+        }
+    }
+    return((size_t)keyDescents);
+}
+
+static inline size_t ComputeBodyKeys(Body* bodies, size_t numBodies, const Vec3D& center, const double size, KeySortBuffers& sortBuffers, KeyOrderingEnum ordering)
+{
+    Vec3D minCorner, maxCorner;
+    return(ComputeBodyKeys(bodies, numBodies, center, size, sortBuffers, minCorner, maxCorner, ordering));
+}
+
+static inline void LoadBodyKeys(const Body* bodies, size_t numBodies, KeySortBuffers& sortBuffers)
+{
+    for (size_t i = 0; i < numBodies; ++i)
+    {
+        sortBuffers.keys[i] = bodies[i].bodyKey;
+        sortBuffers.indexes[i] = i;  // Store the original indexes
+    }
+    sortBuffers.firstPassHistogramThreads = 0;
+}
+
+static inline void MergeSortBodiesByMortonKey(Body*& bodies, const size_t numBodies, BodySortBuffers& sortBuffers)
+{
+    if (bodies == nullptr)
+    {
+        throw std::invalid_argument("bodies is a null pointer");
+    }
+    if (numBodies == 0)
+    {
+        return;
+    }
+    sortBuffers.reserve(numBodies);
+    KeySortBuffers& keyBuffers = sortBuffers.keyBuffers;
+
+    LoadBodyKeys(bodies, numBodies, keyBuffers);
+    MergeSortKeyIndexes(keyBuffers.keys, keyBuffers.indexes, keyBuffers.tempKeys, keyBuffers.tempIndexes, 0, numBodies - 1);
+
+    // Apply the permutation with a single gather into the back buffer
+    PermuteByIndexes(bodies, sortBuffers.bodyBuffer, keyBuffers.indexes, numBodies);
+}
+
+
+
+
+/**
+ * Gather source[indexes[i]] into destination[i] for every i.
+ *
+ * Each destination element is written exactly once by exactly one thread, so the gather is split
+ * across threads without synchronization.
+ */
+template <typename T>
+static inline void GatherByIndexes(const T* source, T* destination, const size_t* indexes, size_t count)
+{
+#pragma omp parallel for schedule(static)
+    for (long long i = 0; i < (long long)count; ++i)
+    {
+        destination[i] = source[indexes[i]];
+    }
+}
+
+/**
+ * Apply a sort permutation to a per-body array by gathering it into its back buffer and swapping the
+ * two pointers, so the data is moved once and never copied back.
+ *
+ * @param data        The live array, replaced by the permuted array on return.
+ * @param backBuffer  An array of at least count elements, replaced by the old live array on return.
+ * @param indexes     The permutation produced by the key sort (indexes[i] is the old position of the new element i).
+ * @param count       The number of elements.
+ */
+template <typename T>
+static inline void PermuteByIndexes(T*& data, T*& backBuffer, const size_t* indexes, size_t count)
+{
+    GatherByIndexes(data, backBuffer, indexes, count);
+    std::swap(data, backBuffer);
+}
+
+// Carry last step's accelerations along with their bodies, using the permutation from the latest body sort
+static inline void PermuteBodyAccelerations(Vec3D*& bodiesAccelerations, BodySortBuffers& sortBuffers, size_t numBodies)
+{
+    PermuteByIndexes(bodiesAccelerations, sortBuffers.accelerationBuffer, sortBuffers.keyBuffers.indexes, numBodies);
+}
+
+static inline void RadixSortBodies(Body*& bodies, size_t numBodies, BodySortBuffers& sortBuffers)
+{
+    if (bodies == nullptr)
+    {
+        throw std::invalid_argument("bodies is a null pointer");
+    }
+    sortBuffers.reserve(numBodies);
+
+    // Sort the keys and their original indexes in the persistent buffers. Keys fresh from ComputeBodyKeys are already there
+    if (sortBuffers.keyBuffers.firstPassHistogramThreads == 0)
+    {
+        LoadBodyKeys(bodies, numBodies, sortBuffers.keyBuffers);
+    }
+    RadixSortKeyIndexes(sortBuffers.keyBuffers, numBodies);
+
+    // Reorder bodies based on the sorted keys using the indexes
+    PermuteByIndexes(bodies, sortBuffers.bodyBuffer, sortBuffers.keyBuffers.indexes, numBodies);
+}
+
+/**
+ * Re-sort bodies into Morton order using the keys ComputeBodyKeys left in the sort buffers.
+ *
+ * When the keys are still in order the bodies are not touched at all, otherwise the repaired (or radix sorted)
+ * permutation is applied with a single gather. Callers permute their auxiliary per-body arrays unless Sort_InOrder is returned.
+ */
+static inline AdaptiveSortEnum AdaptiveSortBodies(Body*& bodies, size_t numBodies, BodySortBuffers& sortBuffers, size_t keyDescents)
+{
+    if (bodies == nullptr)
+    {
+        throw std::invalid_argument("bodies is a null pointer");
+    }
+    sortBuffers.reserve(numBodies);
+
+    AdaptiveSortEnum sortResult = AdaptiveSortKeyIndexes(sortBuffers.keyBuffers, numBodies, keyDescents);
+    if (sortResult != Sort_InOrder)
+    {
+        PermuteByIndexes(bodies, sortBuffers.bodyBuffer, sortBuffers.keyBuffers.indexes, numBodies);
+    }
+    return(sortResult);
+}
+
+inline void ComputePositionAtHalfTimeStep(double dt, Body*& bodies, size_t numBodies)
+{
+    for (size_t i = 0; i < numBodies; i++)
+    {
+        bodies[i].position = bodies[i].position + bodies[i].velocity * (dt / 2);
+    }
+}
+
+inline void ComputeVelocityAndPosition(double dt, Body*& bodies, size_t numBodies, Vec3D*& bodiesAccelerations)
+{
+    for (size_t i = 0; i < numBodies; i++)
+    {
+        //KDK Leap Frog 
+        bodies[i].velocity = bodies[i].velocity + bodiesAccelerations[i] * (dt); // Kick
+        bodies[i].position = bodies[i].position + bodies[i].velocity * (dt / 2); // Drift   
+    }
+}
@@ -0,0 +1,395 @@
+/*
+ * BodySystem Class: structure-of-arrays storage for the n-bodies
+ *
+ * Description:
+ * A Body record interleaves position, velocity, mass and key, so a loop that only needs the positions (key generation,
+ * tree build, force evaluation) still drags the velocities and keys through the cache. BodySystem keeps each field in
+ * its own cache line aligned array (x, y, z, vx, vy, vz, m, key), so every hot loop streams just the one or two fields it
+ * touches, reordering the bodies is a gather of plain doubles, and the arrays can be handed to the batch key encoder
+ * and to vectorized loops directly. The arrays come from AllocatePlacedArray, so under Placement_FirstTouch each
+ * thread's GetThreadChunk slice of every field sits on that thread's NUMA node.
+ *
+ * The Body* API stays the reference interface: a BodySystem is filled from, or written back to, a Body array with
+ * loadBodies/storeBodies, and setBody/getBody convert single records.
+ */
+#pragma once
+#include "Body.h"
+#include "PhaseTimers.h"
+
+#include <cstring>
+
+
+
+
+/**
+ *  BodySystem: the bodies as separate aligned arrays of positions, velocities, masses and keys.
+ */
+class BodySystem
+{
+public:
+    BodySystem() : x(nullptr), y(nullptr), z(nullptr), vx(nullptr), vy(nullptr), vz(nullptr), m(nullptr), key(nullptr), numBodies(0), capacity(0) {}
+    explicit BodySystem(size_t _numBodies) : BodySystem()
+    {
+        resize(_numBodies);
+    }
+    ~BodySystem()
+    {
+        release();
+    }
+    BodySystem(const BodySystem& other) = delete;
+    BodySystem& operator=(const BodySystem& other) = delete;
+
+    void reserve(size_t numElements) //grows the arrays to hold at least numElements, keeping the current bodies, never shrinks them
+    {
+        if (numElements <= capacity)
+        {
+            return;
+        }
+        growArray(x, numElements);
+        growArray(y, numElements);
+        growArray(z, numElements);
+        growArray(vx, numElements);
+        growArray(vy, numElements);
+        growArray(vz, numElements);
+        growArray(m, numElements);
+        growArray(key, numElements);
+        capacity = numElements;
+    }
+
+    void resize(size_t numElements) //new bodies are left uninitialized
+    {
+        reserve(numElements);
+        numBodies = numElements;
+    }
+
+    void release()
+    {
+        FreePlacedArray(x);  FreePlacedArray(y);  FreePlacedArray(z);
+        FreePlacedArray(vx);  FreePlacedArray(vy);  FreePlacedArray(vz);
+        FreePlacedArray(m);
+        FreePlacedArray(key);
+        x = y = z = nullptr;
+        vx = vy = vz = nullptr;
+        m = nullptr;
+        key = nullptr;
+        numBodies = 0;
+        capacity = 0;
+    }
+
+    void swap(BodySystem& other) //trade arrays with another system, used to flip a permuted back buffer into place
+    {
+        std::swap(x, other.x);  std::swap(y, other.y);  std::swap(z, other.z);
+        std::swap(vx, other.vx);  std::swap(vy, other.vy);  std::swap(vz, other.vz);
+        std::swap(m, other.m);
+        std::swap(key, other.key);
+        std::swap(numBodies, other.numBodies);
+        std::swap(capacity, other.capacity);
+    }
+
+    size_t size() const { return(numBodies); }
+    Vec3D getPosition(size_t i) const { return(Vec3D(x[i], y[i], z[i])); }
+    Vec3D getVelocity(size_t i) const { return(Vec3D(vx[i], vy[i], vz[i])); }
+
+
+    // ------------- AoS compatibility -------------
+    void setBody(size_t i, const Body& body)
+    {
+        x[i] = body.position.x;  y[i] = body.position.y;  z[i] = body.position.z;
+        vx[i] = body.velocity.x;  vy[i] = body.velocity.y;  vz[i] = body.velocity.z;
+        m[i] = body.mass;
+        key[i] = body.bodyKey;
+    }
+
+    Body getBody(size_t i) const
+    {
+        Body body(getPosition(i), getVelocity(i), m[i]);
+        body.bodyKey = key[i];
+        return(body);
+    }
+
+    void loadBodies(const Body* bodies, size_t count) //replace the contents with a copy of a Body array
+    {
+        if (bodies == nullptr && count > 0)
+        {
+            throw std::invalid_argument("bodies is a null pointer");
+        }
+        resize(count);
+        for (size_t i = 0; i < count; ++i)
+        {
+            setBody(i, bodies[i]);
+        }
+    }
+
+    void storeBodies(Body* bodies) const //write every body back into a Body array of at least size() records
+    {
+        if (bodies == nullptr && numBodies > 0)
+        {
+            throw std::invalid_argument("bodies is a null pointer");
+        }
+        for (size_t i = 0; i < numBodies; ++i)
+        {
+            bodies[i] = getBody(i);
+        }
+    }
+
+
+    // ------------- Member variables -------------
+    double* x;
+    double* y;
+    double* z;
+    double* vx;
+    double* vy;
+    double* vz;
+    double* m;
+    spatialKey* key;
+    size_t numBodies;
+    size_t capacity;
+
+private:
+    template <typename T>
+    void growArray(T*& data, size_t numElements)
+    {
+        T* grown = AllocatePlacedArray<T>(numElements); // first touched by thread chunk under Placement_FirstTouch
+        if (data != nullptr)
+        {
+            std::memcpy((void*)grown, (const void*)data, numBodies * sizeof(T));
+            FreePlacedArray(data);
+        }
+        data = grown;
+    }
+};
+
+
+
+
+/**
+ *  BodySystemSortBuffers: persistent storage for sorting a BodySystem into Morton order,
+ *  the counterpart of BodySortBuffers with a whole BodySystem as the back buffer.
+ */
+class BodySystemSortBuffers
+{
+public:
+    BodySystemSortBuffers() : accelerationBuffer(nullptr), capacity(0) {}
+    ~BodySystemSortBuffers()
+    {
+        FreePlacedArray(accelerationBuffer);
+    }
+    BodySystemSortBuffers(const BodySystemSortBuffers& other) = delete;
+    BodySystemSortBuffers& operator=(const BodySystemSortBuffers& other) = delete;
+
+    void reserve(size_t numBodies) //grows the buffers to hold at least numBodies, never shrinks them
+    {
+        keyBuffers.reserve(numBodies);
+        bodyBuffer.reserve(numBodies);
+        if (numBodies <= capacity)
+        {
+            return;
+        }
+        FreePlacedArray(accelerationBuffer);
+        accelerationBuffer = AllocatePlacedArray<Vec3D>(numBodies);
+        capacity = numBodies;
+    }
+
+    KeySortBuffers keyBuffers; // keys, permutation and radix/merge scratch
+    BodySystem bodyBuffer;     // back buffer the sorted fields are gathered into
+    Vec3D* accelerationBuffer; // back buffer for the per-body accelerations, trades places with an array from AllocatePlacedArray
+    size_t capacity;
+};
+
+
+
+
+// ------------- Key generation and sorting on a BodySystem, the counterparts of the Body* functions in Body.h -------------
+static inline void ComputeBodyBounds(const BodySystem& bodies, Vec3D& minCorner, Vec3D& maxCorner); // Parallel min/max reduction over x, y and z
+static inline size_t ComputeBodyKeys(BodySystem& bodies, const Vec3D& center, const double size, KeySortBuffers& sortBuffers, Vec3D& minCorner, Vec3D& maxCorner, KeyOrderingEnum ordering = Order_Morton); // Keys into bodies.key and the sort buffers, with the bounding box, returning the number of out-of-order keys
+static inline size_t ComputeBodyKeys(BodySystem& bodies, const Vec3D& center, const double size, KeySortBuffers& sortBuffers, KeyOrderingEnum ordering = Order_Morton);
+static inline void LoadBodyKeys(const BodySystem& bodies, KeySortBuffers& sortBuffers); // Copy bodies.key into the sort buffers along with the identity permutation
+static inline void PermuteBodySystem(BodySystem& bodies, BodySystem& backBuffer, const spatialKey* sortedKeys, const size_t* indexes); // Gather every field by the sort permutation and swap the back buffer in
+static inline void MergeSortBodiesByMortonKey(BodySystem& bodies, BodySystemSortBuffers& sortBuffers);
+static inline void RadixSortBodies(BodySystem& bodies, BodySystemSortBuffers& sortBuffers);
+static inline AdaptiveSortEnum AdaptiveSortBodies(BodySystem& bodies, BodySystemSortBuffers& sortBuffers, size_t keyDescents);
+static inline void PermuteBodyAccelerations(Vec3D*& bodiesAccelerations, BodySystemSortBuffers& sortBuffers, size_t numBodies);
+
+
+//Helper functions to integrate forces into a BodySystem
+static inline void ComputePositionAtHalfTimeStep(double dt, BodySystem& bodies);
+static inline void ComputeVelocityAndPosition(double dt, BodySystem& bodies, Vec3D*& bodiesAccelerations);
+
+
+
+
+static inline void ComputeBodyBounds(const BodySystem& bodies, Vec3D& minCorner, Vec3D& maxCorner)
+{
+    ScopedPhaseTimer timer(Phase_Bounds);
+    BoundsAccumulator bounds;
+#pragma omp parallel
+    {
+        size_t start, end;
+        GetThreadChunk(bodies.numBodies, omp_get_thread_num(), omp_get_num_threads(), start, end);
+        BoundsAccumulator threadBounds;
+        for (size_t i = start; i < end; ++i)
+        {
+            threadBounds.add(bodies.x[i], bodies.y[i], bodies.z[i]);
+        }
+#pragma omp critical
+        bounds.merge(threadBounds);
+    }
+    bounds.getCorners(minCorner, maxCorner);
+}
+
+/**
+ * ComputeBodyKeys for a BodySystem: the batch encoder reads x, y and z as unit stride arrays and the keys land in bodies.key,
+ * with the bounding box, descent count and first radix histograms produced in the same pass exactly as for a Body array.
+ */
+static inline size_t ComputeBodyKeys(BodySystem& bodies, const Vec3D& center, const double size, KeySortBuffers& sortBuffers, Vec3D& minCorner, Vec3D& maxCorner, KeyOrderingEnum ordering)
+{
+    ScopedPhaseTimer timer(Phase_Keys);
+    return(ComputeStridedKeys(bodies.x, bodies.y, bodies.z, sizeof(double), bodies.key, sizeof(spatialKey), bodies.numBodies, center, size, sortBuffers, minCorner, maxCorner, ordering));
+}
+
+static inline size_t ComputeBodyKeys(BodySystem& bodies, const Vec3D& center, const double size, KeySortBuffers& sortBuffers, KeyOrderingEnum ordering)
+{
+    Vec3D minCorner, maxCorner;
+    return(ComputeBodyKeys(bodies, center, size, sortBuffers, minCorner, maxCorner, ordering));
+}
+
+static inline void LoadBodyKeys(const BodySystem& bodies, KeySortBuffers& sortBuffers)
+{
+    std::memcpy((void*)sortBuffers.keys, (const void*)bodies.key, bodies.numBodies * sizeof(spatialKey));
+    for (size_t i = 0; i < bodies.numBodies; ++i)
+    {
+        sortBuffers.indexes[i] = i;
+    }
+    sortBuffers.firstPassHistogramThreads = 0;
+}
+
+/**
+ * Apply a sort permutation to every field of a BodySystem.
+ *
+ * Each thread gathers its GetThreadChunk share one field at a time, so it streams one source and one destination array
+ * while its slice of the permutation stays in cache. The keys are not gathered: the sort already left them in order.
+ *
+ * @param bodies      The live system, replaced by the permuted system on return.
+ * @param backBuffer  A system with capacity for bodies.size() bodies, replaced by the old live system on return.
+ * @param sortedKeys  The sorted keys (sortedKeys[i] is the key of the new body i).
+ * @param indexes     The permutation produced by the key sort (indexes[i] is the old position of the new body i).
+ */
+static inline void PermuteBodySystem(BodySystem& bodies, BodySystem& backBuffer, const spatialKey* sortedKeys, const size_t* indexes)
+{
+    ScopedPhaseTimer timer(Phase_Reorder);
+    size_t numBodies = bodies.numBodies;
+    backBuffer.resize(numBodies);
+    const double* sourceFields[7] = { bodies.x, bodies.y, bodies.z, bodies.vx, bodies.vy, bodies.vz, bodies.m };
+    double* destinationFields[7] = { backBuffer.x, backBuffer.y, backBuffer.z, backBuffer.vx, backBuffer.vy, backBuffer.vz, backBuffer.m };
+#pragma omp parallel
+    {
+        size_t start, end;
+        GetThreadChunk(numBodies, omp_get_thread_num(), omp_get_num_threads(), start, end);
+        for (int field = 0; field < 7; field++)
+        {
+            const double* source = sourceFields[field];
+            double* destination = destinationFields[field];
+            for (size_t i = start; i < end; ++i)
+            {
+                destination[i] = source[indexes[i]];
+            }
+        }
+        std::memcpy((void*)(backBuffer.key + start), (const void*)(sortedKeys + start), (end - start) * sizeof(spatialKey));
+    }
+    bodies.swap(backBuffer);
+}
+
+static inline void MergeSortBodiesByMortonKey(BodySystem& bodies, BodySystemSortBuffers& sortBuffers)
+{
+    size_t numBodies = bodies.numBodies;
+    if (numBodies == 0)
+    {
+        return;
+    }
+    sortBuffers.reserve(numBodies);
+    KeySortBuffers& keyBuffers = sortBuffers.keyBuffers;
+
+    {
+        ScopedPhaseTimer timer(Phase_Sort);
+        LoadBodyKeys(bodies, keyBuffers);
+        MergeSortKeyIndexes(keyBuffers.keys, keyBuffers.indexes, keyBuffers.tempKeys, keyBuffers.tempIndexes, 0, numBodies - 1);
+    }
+    PermuteBodySystem(bodies, sortBuffers.bodyBuffer, keyBuffers.keys, keyBuffers.indexes);
+}
+
+static inline void RadixSortBodies(BodySystem& bodies, BodySystemSortBuffers& sortBuffers)
+{
+    size_t numBodies = bodies.numBodies;
+    sortBuffers.reserve(numBodies);
+
+    {
+        ScopedPhaseTimer timer(Phase_Sort);
+        // Keys fresh from ComputeBodyKeys are already in the sort buffers
+        if (sortBuffers.keyBuffers.firstPassHistogramThreads == 0)
+        {
+            LoadBodyKeys(bodies, sortBuffers.keyBuffers);
+        }
+        RadixSortKeyIndexes(sortBuffers.keyBuffers, numBodies);
+    }
+    PermuteBodySystem(bodies, sortBuffers.bodyBuffer, sortBuffers.keyBuffers.keys, sortBuffers.keyBuffers.indexes);
+}
+
+static inline AdaptiveSortEnum AdaptiveSortBodies(BodySystem& bodies, BodySystemSortBuffers& sortBuffers, size_t keyDescents)
+{
+    size_t numBodies = bodies.numBodies;
+    sortBuffers.reserve(numBodies);
+
+    AdaptiveSortEnum sortResult;
+    {
+        ScopedPhaseTimer timer(Phase_Sort);
+        sortResult = AdaptiveSortKeyIndexes(sortBuffers.keyBuffers, numBodies, keyDescents);
+    }
+    if (sortResult != Sort_InOrder)
+    {
+        PermuteBodySystem(bodies, sortBuffers.bodyBuffer, sortBuffers.keyBuffers.keys, sortBuffers.keyBuffers.indexes);
+    }
+    return(sortResult);
+}
+
+static inline void PermuteBodyAccelerations(Vec3D*& bodiesAccelerations, BodySystemSortBuffers& sortBuffers, size_t numBodies)
+{
+    ScopedPhaseTimer timer(Phase_Reorder);
+    PermuteByIndexes(bodiesAccelerations, sortBuffers.accelerationBuffer, sortBuffers.keyBuffers.indexes, numBodies);
+}
+
+inline void ComputePositionAtHalfTimeStep(double dt, BodySystem& bodies)
+{
+    ScopedPhaseTimer timer(Phase_Integrate);
+    double halfStep = dt / 2;
+    long long numBodies = (long long)bodies.numBodies;
+    double* x = bodies.x;  double* y = bodies.y;  double* z = bodies.z;
+    const double* vx = bodies.vx;  const double* vy = bodies.vy;  const double* vz = bodies.vz;
+#pragma omp parallel for schedule(static)
+    for (long long i = 0; i < numBodies; i++)
+    {
+        x[i] += vx[i] * halfStep;
+        y[i] += vy[i] * halfStep;
+        z[i] += vz[i] * halfStep;
+    }
+}
+
+inline void ComputeVelocityAndPosition(double dt, BodySystem& bodies, Vec3D*& bodiesAccelerations)
+{
+    ScopedPhaseTimer timer(Phase_Integrate);
+    double halfStep = dt / 2;
+    long long numBodies = (long long)bodies.numBodies;
+    double* x = bodies.x;  double* y = bodies.y;  double* z = bodies.z;
+    double* vx = bodies.vx;  double* vy = bodies.vy;  double* vz = bodies.vz;
+    const Vec3D* accelerations = bodiesAccelerations;
+#pragma omp parallel for schedule(static)
+    for (long long i = 0; i < numBodies; i++)
+    {
+        //KDK Leap Frog
+        vx[i] += accelerations[i].x * dt; // Kick
+        vy[i] += accelerations[i].y * dt;
+        vz[i] += accelerations[i].z * dt;
+        x[i] += vx[i] * halfStep; // Drift
+        y[i] += vy[i] * halfStep;
+        z[i] += vz[i] * halfStep;
+    }
+}
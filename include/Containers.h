@@ -1,63 +1,86 @@
-/**
- * Vec3D Class: provides an abstraction for three-dimensional vectors, encapsulating the vector's components (x, y, z)
- *
- * This class encapsulates a 3D vector's components (x, y, z),  and provides methods
- * to perform basic vector operations and manipulate vector data.
- */
-#pragma once
-
-
-
-
- // Vec3D class representing a 3D Vector 
-class Vec3D
-{
-public:
-    // ------------- Constructors -------------
-    Vec3D();
-    Vec3D(double _x, double _y, double _z);
-
-
-
-
-    // ------------- Comparison operators -------------
-    bool operator!=(const Vec3D& other);
-
-
-
-
-    // ------------- Accessors (Return new Vec3D based on current one) -------------
-    Vec3D operator+(const Vec3D& other);
-    Vec3D operator-(const Vec3D& other);
-    Vec3D operator*(const double scalar);
-
-
-
-
-    // ------------- Modifiers (Modify the current Vec3D and return reference) -------------
-    Vec3D& operator=(const Vec3D& other);
-    void operator+=(const Vec3D& other);
-    void operator-=(const Vec3D& other);
-    void operator/=(const double scalar);
-
-
-
-
-    // ------------- Vector operations (do not modify the internal state) -------------
-    Vec3D scaleVector(double scalar) const;
-    double vectorLength() const;
-    double vectorSquareLength() const;
-    Vec3D vectorNormalize() const;
-    double vectorDistance(const Vec3D& other);
-
-
-
-    // ------------- Member variables -------------
-    //private:
-    double x;
-    double y;
-    double z;
-};
-
-
-
+/**
+ * Vec3D Class: provides an abstraction for three-dimensional vectors, encapsulating the vector's components (x, y, z)
+ *
+ * This class encapsulates a 3D vector's components (x, y, z),  and provides methods
+ * to perform basic vector operations and manipulate vector data.
+ *
+ * Every operation is defined here, inline and constexpr where the standard library allows, so the drift, kick, MAC
+ * and barycenter loops see straight-line component arithmetic they can keep in registers and vectorize. The class
+ * has no user-defined copy operations, so it (and Body) stays trivially copyable and can be moved as plain memory.
+ *
+ * Vec3T is templated on the scalar type and an optional alignment: Vec3D is the unpadded double vector used for
+ * storage, Vec3DA is padded to 32 bytes so each vector fills exactly one aligned AVX register.
+ */
+#pragma once
+#include <math.h>
+#include <stddef.h>
+
+
+
+
+ // Vec3T class representing a 3D Vector
+template <typename T, size_t Align = alignof(T)>
+class alignas(Align) Vec3T
+{
+public:
+    // ------------- Constructors -------------
+    constexpr Vec3T() : x(0), y(0), z(0) {}
+    constexpr Vec3T(T _x, T _y, T _z) : x(_x), y(_y), z(_z) {}
+
+
+
+
+    // ------------- Comparison operators -------------
+    constexpr bool operator==(const Vec3T& other) const { return(x == other.x && y == other.y && z == other.z); }
+    constexpr bool operator!=(const Vec3T& other) const { return(x != other.x || y != other.y || z != other.z); }
+
+
+
+
+    // ------------- Accessors (Return new Vec3T based on current one) -------------
+    constexpr Vec3T operator+(const Vec3T& other) const { return(Vec3T(x + other.x, y + other.y, z + other.z)); }
+    constexpr Vec3T operator-(const Vec3T& other) const { return(Vec3T(x - other.x, y - other.y, z - other.z)); }
+    constexpr Vec3T operator-() const { return(Vec3T(-x, -y, -z)); }
+    constexpr Vec3T operator*(const T scalar) const { return(Vec3T(x * scalar, y * scalar, z * scalar)); }
+    constexpr Vec3T operator/(const T scalar) const { return(Vec3T(x / scalar, y / scalar, z / scalar)); }
+    friend constexpr Vec3T operator*(const T scalar, const Vec3T& vector) { return(vector * scalar); }
+
+
+
+
+    // ------------- Modifiers (Modify the current Vec3T and return reference) -------------
+    constexpr Vec3T& operator+=(const Vec3T& other) { x += other.x; y += other.y; z += other.z; return(*this); }
+    constexpr Vec3T& operator-=(const Vec3T& other) { x -= other.x; y -= other.y; z -= other.z; return(*this); }
+    constexpr Vec3T& operator*=(const T scalar) { x *= scalar; y *= scalar; z *= scalar; return(*this); }
+    constexpr Vec3T& operator/=(const T scalar) { x /= scalar; y /= scalar; z /= scalar; return(*this); } // no zero check, callers guard a possibly empty divisor
+
+
+
+
+    // ------------- Vector operations (do not modify the internal state) -------------
+    constexpr Vec3T scaleVector(T scalar) const { return(Vec3T(x * scalar, y * scalar, z * scalar)); }
+    T vectorLength() const { return(sqrt(vectorSquareLength())); }
+    constexpr T vectorSquareLength() const { return(x * x + y * y + z * z); }
+    constexpr T dotProduct(const Vec3T& other) const { return(x * other.x + y * other.y + z * other.z); }
+    Vec3T vectorNormalize() const
+    {
+        T length = vectorLength();
+        return((length != 0) ? scaleVector(1 / length) : *this);
+    }
+    T vectorDistance(const Vec3T& other) const { return((*this - other).vectorLength()); }
+
+
+
+    // ------------- Member variables -------------
+    //private:
+    T x;
+    T y;
+    T z;
+};
+
+typedef Vec3T<double> Vec3D;       // 24 bytes, the storage type of positions, velocities and accelerations
+typedef Vec3T<double, 32> Vec3DA;  // padded to 32 bytes and 32-byte aligned
+typedef Vec3T<float> Vec3F;        // 12 bytes, positions handed to the renderer
+
+
+
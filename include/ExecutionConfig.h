@@ -0,0 +1,57 @@
+/*
+ * ExecutionConfig: size of the OpenMP thread team and where its threads run
+ *
+ * Description:
+ * Every parallel phase (key generation, sort, build, barycenters, force, integration) splits the Morton-ordered
+ * bodies with GetThreadChunk, so thread t works on the same slice of bodies in every phase. That only keeps the slice
+ * in thread t's caches (and, under Placement_FirstTouch, on its socket) if thread t stays on the same core, and only
+ * uses the machine if the team is as large as the machine.
+ *
+ * SetExecutionConfig sizes the team once, at run time, and pins each of its threads to a hardware thread chosen from
+ * the detected topology:
+ *      Affinity_None: threads are left to the OS scheduler (or to OMP_PROC_BIND/OMP_PLACES)
+ *      Affinity_Compact: consecutive threads fill a socket core by core, the SMT siblings of a core next to each other
+ *      Affinity_Spread: consecutive threads alternate between sockets, one per core before any core gets a second
+ * Without SMT only the first hardware thread of each core is used. OpenMP keeps the threads of a team alive between
+ * parallel regions, so the pinning holds for every later region of the same size; the phases therefore leave the
+ * team size alone instead of setting it themselves.
+ *
+ * The topology comes from /sys/devices/system/cpu on Linux and GetLogicalProcessorInformationEx on Windows (all
+ * processor groups). Elsewhere, or when it cannot be read, every logical processor counts as a core and threads are
+ * not pinned.
+ */
+#pragma once
+#include <omp.h>
+
+
+
+
+/**
+ * Thread placement policies, see the description above.
+ */
+enum AffinityEnum
+{
+    Affinity_None = 0x0,
+    Affinity_Compact = 0x1,
+    Affinity_Spread = 0x2
+};
+
+struct ExecutionConfig
+{
+    ExecutionConfig() : numThreads(0), affinity(Affinity_Spread), useSMT(false) {}
+    ExecutionConfig(int _numThreads, AffinityEnum _affinity, bool _useSMT) : numThreads(_numThreads), affinity(_affinity), useSMT(_useSMT) {}
+
+    int numThreads; // 0 for one thread per usable hardware thread, i.e. per core without SMT
+    AffinityEnum affinity;
+    bool useSMT; // whether the SMT siblings of a core take threads too
+};
+
+
+
+
+// ------------- Thread team (ExecutionConfig.cpp) -------------
+void SetExecutionConfig(const ExecutionConfig& config); // Size and pin the team of the parallel regions the calling thread starts, call from that thread before the first placed allocation
+ExecutionConfig GetExecutionConfig(); // The applied config, numThreads resolved
+int ExecutionThreads(); // Threads in the team every parallel phase uses
+int HardwareCores(); // Physical cores available to the process
+int HardwareThreads(); // Logical processors available to the process
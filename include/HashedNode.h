@@ -1,226 +1,408 @@
-
-#pragma once
-#include "Containers.h"
-#include "SequenceContainers.h"
-#include "MortonKeys.h"
-#include "ObjectPool.h"
-#include "Body.h"
-#include "ofMain.h"
-
-
-/* GLOBAL CONSTANTS & ENUMERATIONS */
-static const int  DEFAULT_HASHED_OCTREE = 14; // Default capacity for the hashed octree
-static const size_t CHILD_OCTANTS = 8; // Number of child octants in an octree node
-static const spatialKey ROOT_KEY = 1; // Root key for the tree
-
-
-// OctantEnum: Defines the octant ordering in a 3D coordinate space based on Morton ordering (x > y > z).
-enum OctantEnum
-{
-	Oct_0 = 0x0, //---
-	Oct_1 = 0x1, //--+
-	Oct_2 = 0x2, //-+-
-	Oct_3 = 0x3, //-++
-	Oct_4 = 0x4, //+--
-	Oct_5 = 0x5, //+-+
-	Oct_6 = 0x6, //++-
-	Oct_7 = 0x7, //+++
-};
-// Lookup table for octant directions.
-static const double OctantDir[] =
-{
-	-1.0, -1.0, -1.0,
-	-1.0, -1.0,  1.0,
-	-1.0,  1.0, -1.0,
-	-1.0,  1.0,  1.0,
-	 1.0, -1.0, -1.0,
-	 1.0, -1.0,  1.0,
-	 1.0,  1.0, -1.0,
-	 1.0,  1.0,  1.0
-};
-
-
-
-
-// Helper Functions: These functions aid in manipulating and determining octant-specific properties.
-static inline bool HasOctChild(uint8_t childByte, OctantEnum octant) // Checks if a specific octant is marked as having a child node. If non-zero, this octant has a child.
-{
-	return (childByte & (1 << octant)) != 0;
-}
-static inline void SetOctChild(uint8_t& childByte, OctantEnum octant) //set a specific bit in the childByte representing the existence of a child in the given octant, sets the corresponding bit to 1.
-{
-	childByte |= (1 << octant);
-}
-static inline void UnsetOctChild(uint8_t& childByte, OctantEnum octant)// unset a specific bit in the childByte, indicating the removal of a child in the given octant, sets the corresponding bit to 0
-{
-	childByte &= ~(1 << octant);
-}
-static inline OctantEnum DetermineOctant(const Vec3D& center, const Vec3D& bodyPosition) // Determines the octant for a body based on its position and the center of the current node.
-{
-	unsigned posX = (bodyPosition.x > center.x);
-	unsigned posY = (bodyPosition.y > center.y);
-	unsigned posZ = (bodyPosition.z > center.z);
-	return static_cast<OctantEnum>((posX << 2) | (posY << 1) | posZ);
-}
-
-
-static inline Vec3D DetermineOctantCenter(const Vec3D& parentCenter, const double& parentSize, OctantEnum octant) // Retrieves the direction for a given octant based on the lookup table.
-{
-	double halfSize = parentSize * 0.5;
-	Vec3D octantCenter;
-	octantCenter.x = parentCenter.x + (halfSize * OctantDir[3 * octant]);
-	octantCenter.y = parentCenter.y + (halfSize * OctantDir[3 * octant + 1]);
-	octantCenter.z = parentCenter.z + (halfSize * OctantDir[3 * octant + 2]);
-	return(octantCenter);
-}
-
-
-static inline Vec3D DetermineOctantDirection(OctantEnum octant) // Retrieves the direction for a given octant based on the lookup table.
-{
-	Vec3D octantDir;
-	octantDir.x = OctantDir[3 * octant];
-	octantDir.y = OctantDir[3 * octant + 1];
-	octantDir.z = OctantDir[3 * octant + 2];
-	return(octantDir);
-}
-static inline spatialKey GetParentKey(const spatialKey childKey) // shifts the childKey three places to the right to get the parent key
-{
-	const spatialKey parentKey = childKey >> 3;
-	return(parentKey);
-}
-static inline spatialKey GetChildKey(const spatialKey parentKey, OctantEnum octant) //generates the key for a child node by shifting the parentKey three places to the left and adding the octant index
-{
-	const spatialKey childKey = ((parentKey) << 3 | (octant));
-	return(childKey);
-}
-static inline OctantEnum GetOctantFromKey(spatialKey key) //Retrieves the octant enumeration from a key by taking the last three bits of the key. This is done by taking the key modulo 8, i.e., a bitwise-AND with 7, which gives the last three bits of the key.
-{
-	OctantEnum octant = static_cast<OctantEnum>(key & static_cast <spatialKey>(7));
-	return(octant);
-}
-
-
-
-
-
-class OctantBounds
-{
-public:
-	OctantBounds();
-	OctantBounds(Body* nBodies, size_t numBodies); //returns a BoundingBox which has its center at the average position and encloses all bodies
-	OctantBounds(Body* localBodies, size_t start, size_t end); //returns a BoundingBox which has its center at the average position and encloses all bodies
-	OctantBounds(Vec3D _center, double _size);
-	OctantBounds(const OctantBounds& other);
-	OctantBounds& operator=(const OctantBounds& other);
-	Vec3D center;
-	double size;
-};
-
-
-
-
-// HOTNode Class: Represents an individual node in the hashed octree structure.
-class HOTNode
-{
-public:
-	// Constructors and Destructor
-	HOTNode();
-	HOTNode(const HOTNode& other);
-	HOTNode& operator=(const HOTNode& other);
-	HOTNode(HOTNode* parentNode, OctantEnum targetOctant, const Vec3D& _baryCenter, const double& _mass);
-	HOTNode(const Vec3D& _position, const double _size);
-	HOTNode(const OctantBounds _nodeBounds);
-	HOTNode(const OctantBounds _nodeBounds, const spatialKey rootKey);
-	HOTNode(const double _size, const spatialKey rootKey);
-	~HOTNode();
-
-
-	bool containsBody(const Vec3D& bodyPosition);
-
-
-	void reset();
-	void updateCenterOfMass();
-	void initializeNode(const OctantBounds _nodeBounds, const spatialKey rootKey);
-	void insertBodyDirectly(spatialKey parentKey, OctantEnum targetOctant, const Vec3D bodyPosition, const double bodyMass);
-	void parameterizeChildNode(HOTNode* parentNode, const OctantEnum targetOctant, const Vec3D& _baryCenter, const double& _mass);
-
-	//Upper triangle of quadrupole moment tensor Q ordered as
-	//Qxx, Qxy, Qxz, Qyy, Qyz, Qzz
-	double quadrupoleMoment[6];
-
-	Vec3D baryCenter;  	double mass;// the center of mass and total mass of all bodies at or below this node
-	long N; //number of bodies at or below this node.
-	uint8_t childByte; //a bitfield encoding which children actually exist, each of the 8 bits can represent the existence of one of the 8 children in the octree (where a set bit indicates that the child exists and an unset bit indicates the opposite).
-	//private:
-		//OctantEnum octant; //compute the octant on the fly
-	OctantBounds nodeBounds;
-	spatialKey nodeKey; //the spatial key for this node/body
-};
-
-
-
-
-
-
-
-
-
-
-
-
-
-
-
-
-
-
-
-
-class HOTNodePool
-{
-private:
-	DynamicBufferArray<HOTNode*> nodePool;
-	size_t currentIndex;
-
-public:
-	HOTNodePool(size_t capacity) : currentIndex(0)
-	{
-		nodePool.resizeDBA(capacity, nullptr);
-		for (size_t i = 0; i < capacity; ++i)
-		{
-			nodePool[i] = new HOTNode();
-		}
-	}
-
-	~HOTNodePool()
-	{
-		for (size_t i = 0; i < nodePool.listData.size; ++i)
-		{
-			delete nodePool[i];
-		}
-	}
-
-	HOTNode* acquireNode()
-	{
-		if (currentIndex >= nodePool.listData.size)
-		{
-			// No free nodes available in the pool. Return nullptr or handle it differently
-			return nullptr;
-		}
-		return nodePool[currentIndex++];
-	}
-
-	void releaseNode(HOTNode* node)
-	{
-		if (currentIndex == 0)
-		{
-			// Pool is already fully released. Handle this condition or ignore.
-			return;
-		}
-		node->reset();
-		nodePool[--currentIndex] = node;
-	}
-};
-
-
-
+
+#pragma once
+#include "Containers.h"
+#include "SequenceContainers.h"
+#include "MortonKeys.h"
+#include "ObjectPool.h"
+#include "Body.h"
+#include <unordered_map>
+
+
+/* GLOBAL CONSTANTS & ENUMERATIONS */
+static const int  DEFAULT_HASHED_OCTREE = 14; // Default capacity for the hashed octree
+static const size_t CHILD_OCTANTS = 8; // Number of child octants in an octree node
+static const spatialKey ROOT_KEY = 1; // Root key for the tree
+static const uint32_t NO_NODE_INDEX = 0xFFFFFFFF; // firstChild of a leaf, or of a node not yet in a compacted node array
+static const double ROOT_BOUNDS_PADDING = 1.0 / 16.0; // Slack added around the bodies' bounding box so the root cube can be kept for several frames
+static const int MAX_TREE_DEPTH = MortonKeyDim; // Deepest level whose node keys (sentinel + 3 bits per level) still fit in a spatialKey, see SPATIAL_KEY_BITS
+static const int DENSE_TREE_LEVELS = 5; // Levels 0..DENSE_TREE_LEVELS of a HybridKeyMap are direct-indexed, 2 * 8^5 slots
+static const int SUBTREE_SPLIT_LEVELS = 2; // A parallel build fills the subtrees of the 8^2 level 2 cells concurrently, so at most 64 threads insert at once (see BuildHOTSubtrees)
+static const int SUBTREE_CELLS = 1 << (3 * SUBTREE_SPLIT_LEVELS);
+static const int KEY_SHARDS = SUBTREE_CELLS + 1; // HybridKeyMap shards: the levels above the cells, then one per cell
+
+
+// OctantEnum: Defines the octant ordering in a 3D coordinate space based on Morton ordering (x > y > z).
+enum OctantEnum
+{
+	Oct_0 = 0x0, //---
+	Oct_1 = 0x1, //--+
+	Oct_2 = 0x2, //-+-
+	Oct_3 = 0x3, //-++
+	Oct_4 = 0x4, //+--
+	Oct_5 = 0x5, //+-+
+	Oct_6 = 0x6, //++-
+	Oct_7 = 0x7, //+++
+};
+// Lookup table for octant directions.
+static const double OctantDir[] =
+{
+	-1.0, -1.0, -1.0,
+	-1.0, -1.0,  1.0,
+	-1.0,  1.0, -1.0,
+	-1.0,  1.0,  1.0,
+	 1.0, -1.0, -1.0,
+	 1.0, -1.0,  1.0,
+	 1.0,  1.0, -1.0,
+	 1.0,  1.0,  1.0
+};
+
+
+
+
+// Helper Functions: These functions aid in manipulating and determining octant-specific properties.
+static inline bool HasOctChild(uint8_t childByte, OctantEnum octant) // Checks if a specific octant is marked as having a child node. If non-zero, this octant has a child.
+{
+	return (childByte & (1 << octant)) != 0;
+}
+static inline void SetOctChild(uint8_t& childByte, OctantEnum octant) //set a specific bit in the childByte representing the existence of a child in the given octant, sets the corresponding bit to 1.
+{
+	childByte |= (1 << octant);
+}
+static inline void UnsetOctChild(uint8_t& childByte, OctantEnum octant)// unset a specific bit in the childByte, indicating the removal of a child in the given octant, sets the corresponding bit to 0
+{
+	childByte &= ~(1 << octant);
+}
+static inline int CountOctChildren(uint8_t childByte) // number of set bits in childByte, i.e. how many children the node has
+{
+	childByte = childByte - ((childByte >> 1) & 0x55);
+	childByte = (childByte & 0x33) + ((childByte >> 2) & 0x33);
+	return((childByte + (childByte >> 4)) & 0x0F);
+}
+static inline int OctChildOffset(uint8_t childByte, OctantEnum octant) // position of the octant's child among the existing children, which a compacted node array stores in octant order
+{
+	return(CountOctChildren(childByte & ((1 << octant) - 1)));
+}
+static inline OctantEnum DetermineOctant(const Vec3D& center, const Vec3D& bodyPosition) // Determines the octant for a body based on its position and the center of the current node.
+{
+	unsigned posX = (bodyPosition.x > center.x);
+	unsigned posY = (bodyPosition.y > center.y);
+	unsigned posZ = (bodyPosition.z > center.z);
+	return static_cast<OctantEnum>((posX << 2) | (posY << 1) | posZ);
+}
+static inline void AddPointQuadrupole(double* quadrupole, const Vec3D& offset, double mass) // Adds mass * (3 r r - r^2 I) of a point mass at offset from the reference point, in HOTNode::quadrupoleMoment order
+{
+	double d2 = offset.x * offset.x + offset.y * offset.y + offset.z * offset.z;
+	quadrupole[0] += mass * (3.0 * offset.x * offset.x - d2);
+	quadrupole[1] += 3.0 * mass * offset.x * offset.y;
+	quadrupole[2] += 3.0 * mass * offset.x * offset.z;
+	quadrupole[3] += mass * (3.0 * offset.y * offset.y - d2);
+	quadrupole[4] += 3.0 * mass * offset.y * offset.z;
+	quadrupole[5] += mass * (3.0 * offset.z * offset.z - d2);
+}
+
+
+static inline Vec3D DetermineOctantCenter(const Vec3D& parentCenter, const double& parentSize, OctantEnum octant) // Center of the child cube in octant: the parent's center moved by the child's half-width, parentSize / 2, along each axis of the octant's direction
+{
+	double halfSize = parentSize * 0.5;
+	Vec3D octantCenter;
+	octantCenter.x = parentCenter.x + (halfSize * OctantDir[3 * octant]);
+	octantCenter.y = parentCenter.y + (halfSize * OctantDir[3 * octant + 1]);
+	octantCenter.z = parentCenter.z + (halfSize * OctantDir[3 * octant + 2]);
+	return(octantCenter);
+}
+
+
+static inline Vec3D DetermineOctantDirection(OctantEnum octant) // Retrieves the direction for a given octant based on the lookup table.
+{
+	Vec3D octantDir;
+	octantDir.x = OctantDir[3 * octant];
+	octantDir.y = OctantDir[3 * octant + 1];
+	octantDir.z = OctantDir[3 * octant + 2];
+	return(octantDir);
+}
+template <typename KeyT>
+static inline KeyT GetParentKey(const KeyT childKey) // shifts the childKey three places to the right to get the parent key
+{
+	const KeyT parentKey = childKey >> 3;
+	return(parentKey);
+}
+template <typename KeyT>
+static inline KeyT GetChildKey(const KeyT parentKey, OctantEnum octant) //generates the key for a child node by shifting the parentKey three places to the left and adding the octant index
+{
+	const KeyT childKey = ((parentKey) << 3 | (KeyT)(octant));
+	return(childKey);
+}
+template <typename KeyT>
+static inline OctantEnum GetOctantFromKey(KeyT key) //Retrieves the octant enumeration from a key by taking the last three bits of the key. This is done by taking the key modulo 8, i.e., a bitwise-AND with 7, which gives the last three bits of the key.
+{
+	OctantEnum octant = static_cast<OctantEnum>(KeyLow64(key) & 7);
+	return(octant);
+}
+static inline int KeyShardIndex(const spatialKey& key) // 0 above level SUBTREE_SPLIT_LEVELS, otherwise 1 + the index of the key's level SUBTREE_SPLIT_LEVELS cell
+{
+	int level = KeyHighestBit(key) / 3; // the sentinel bit
+	if (level < SUBTREE_SPLIT_LEVELS)
+	{
+		return(0);
+	}
+	return(1 + (int)(KeyLow64(key >> (3 * (level - SUBTREE_SPLIT_LEVELS))) & (SUBTREE_CELLS - 1)));
+}
+static inline bool IsMaxDepthKey(const spatialKey key) // true for keys of nodes at MAX_TREE_DEPTH, which cannot be split without overflowing the key
+{
+	return(!(key < keySentinel));
+}
+
+
+
+
+
+/**
+ * HybridKeyMap: node key -> V, direct-indexed for the top tree levels and hashed below.
+ *
+ * A key at level l lies in [8^l, 2 * 8^l), so every key of levels 0..DENSE_TREE_LEVELS is below 2 * 8^DENSE_TREE_LEVELS
+ * and indexes a flat array without hashing. These levels are almost always fully populated and every insertion
+ * descends through them, so the unordered_maps only see the sparse deeper levels. Absent marks an empty slot and is
+ * what find() returns for a missing key (nullptr for nodes, NO_NODE_INDEX for array indices).
+ *
+ * The hashed keys are sharded by their level SUBTREE_SPLIT_LEVELS ancestor (KeyShardIndex), each shard counting its
+ * own dense entries too, so threads that each fill a different subtree never write to the same container. Calls for
+ * keys of different shards may run concurrently; size(), empty(), clear() and forEach() touch every shard.
+ */
+template <typename V, V Absent>
+class HybridKeyMap
+{
+public:
+	HybridKeyMap() : denseLimit((spatialKey)2 << (3 * DENSE_TREE_LEVELS))
+	{
+		dense = new V[(size_t)KeyLow64(denseLimit)];
+		std::fill_n(dense, (size_t)KeyLow64(denseLimit), Absent);
+	}
+	~HybridKeyMap()
+	{
+		delete[] dense;
+	}
+	HybridKeyMap(const HybridKeyMap& other) = delete;
+	HybridKeyMap& operator=(const HybridKeyMap& other) = delete;
+
+	V find(const spatialKey& key) const
+	{
+		if (key < denseLimit)
+		{
+			return(dense[(size_t)KeyLow64(key)]);
+		}
+		const Shard& shard = shards[KeyShardIndex(key)];
+		const auto iter = shard.sparse.find(key);
+		return(iter == shard.sparse.end() ? Absent : iter->second);
+	}
+
+	V insert(const spatialKey& key, V value) // set key's value, returns the value it replaced (Absent if none)
+	{
+		V previous;
+		Shard& shard = shards[KeyShardIndex(key)];
+		if (key < denseLimit)
+		{
+			V& slot = dense[(size_t)KeyLow64(key)];
+			previous = slot;
+			shard.denseCount += (previous == Absent) ? 1 : 0;
+			slot = value;
+			return(previous);
+		}
+		V& slot = shard.sparse.emplace(key, Absent).first->second;
+		previous = slot;
+		slot = value;
+		return(previous);
+	}
+
+	void erase(const spatialKey& key)
+	{
+		Shard& shard = shards[KeyShardIndex(key)];
+		if (key < denseLimit)
+		{
+			V& slot = dense[(size_t)KeyLow64(key)];
+			shard.denseCount -= (slot != Absent) ? 1 : 0;
+			slot = Absent;
+			return;
+		}
+		shard.sparse.erase(key);
+	}
+
+	void clear()
+	{
+		bool denseUsed = false;
+		for (int s = 0; s < KEY_SHARDS; s++)
+		{
+			denseUsed = denseUsed || (shards[s].denseCount > 0);
+			shards[s].denseCount = 0;
+			shards[s].sparse.clear();
+		}
+		if (denseUsed)
+		{
+			std::fill_n(dense, (size_t)KeyLow64(denseLimit), Absent);
+		}
+	}
+
+	void reserve(size_t count) // spread evenly over the subtree shards
+	{
+		for (int s = 1; s < KEY_SHARDS; s++)
+		{
+			shards[s].sparse.reserve(count / (KEY_SHARDS - 1) + 1);
+		}
+	}
+	void reserve(const spatialKey& key, size_t count) { shards[KeyShardIndex(key)].sparse.reserve(count); } // room for count entries in key's shard
+	size_t size() const
+	{
+		size_t count = 0;
+		for (int s = 0; s < KEY_SHARDS; s++)
+		{
+			count += shards[s].denseCount + shards[s].sparse.size();
+		}
+		return(count);
+	}
+	bool empty() const { return(size() == 0); }
+	size_t bucket_count() const
+	{
+		size_t count = 0;
+		for (int s = 0; s < KEY_SHARDS; s++)
+		{
+			count += shards[s].sparse.bucket_count();
+		}
+		return(count);
+	}
+
+	template <typename F> void forEach(F visit) const // visit(key, value) for every entry, the dense levels first in key order
+	{
+		size_t denseEntries = 0;
+		for (int s = 0; s < KEY_SHARDS; s++)
+		{
+			denseEntries += shards[s].denseCount;
+		}
+		for (size_t k = 0; k < (size_t)KeyLow64(denseLimit) && denseEntries > 0; k++)
+		{
+			if (dense[k] != Absent)
+			{
+				visit(spatialKey(k), dense[k]);
+			}
+		}
+		for (int s = 0; s < KEY_SHARDS; s++)
+		{
+			for (const auto& pair : shards[s].sparse)
+			{
+				visit(pair.first, pair.second);
+			}
+		}
+	}
+
+private:
+	struct alignas(64) Shard // a cache line apart, the counts of shards filled by different threads would otherwise share one
+	{
+		Shard() : denseCount(0) {}
+		std::unordered_map<spatialKey, V> sparse;
+		size_t denseCount;
+	};
+
+	V* dense;
+	spatialKey denseLimit;
+	Shard shards[KEY_SHARDS];
+};
+
+
+
+
+class OctantBounds
+{
+public:
+	OctantBounds();
+	OctantBounds(Body* nBodies, size_t numBodies); //returns the tightest cube enclosing all bodies, centered on their bounding box
+	OctantBounds(Body* localBodies, size_t start, size_t end); //returns the tightest cube enclosing the bodies in [start, end)
+	OctantBounds(const Vec3D& minCorner, const Vec3D& maxCorner, double padding); //returns the cube enclosing the box [minCorner, maxCorner], its half-size enlarged by the relative padding
+	OctantBounds(Vec3D _center, double _size);
+	OctantBounds(const OctantBounds& other);
+	OctantBounds& operator=(const OctantBounds& other);
+	bool fitsBox(const Vec3D& minCorner, const Vec3D& maxCorner, double padding) const; //true if the cube encloses the box and is no larger than OctantBounds(minCorner, maxCorner, 2 * padding)
+	Vec3D center;
+	double size; //half the edge length, the cube spans center +/- size on each axis
+};
+
+
+
+
+// HOTNode Class: Represents an individual node in the hashed octree structure.
+class HOTNode
+{
+public:
+	// Constructors and Destructor
+	HOTNode();
+	HOTNode(const HOTNode& other);
+	HOTNode& operator=(const HOTNode& other);
+	HOTNode(HOTNode* parentNode, OctantEnum targetOctant, const Vec3D& _baryCenter, const double& _mass);
+	HOTNode(const Vec3D& _position, const double _size);
+	HOTNode(const OctantBounds _nodeBounds);
+	HOTNode(const OctantBounds _nodeBounds, const spatialKey rootKey);
+	HOTNode(const double _size, const spatialKey rootKey);
+	~HOTNode();
+
+
+	bool containsBody(const Vec3D& bodyPosition);
+
+
+	void reset();
+	void updateCenterOfMass();
+	void initializeNode(const OctantBounds _nodeBounds, const spatialKey rootKey);
+	void insertBodyDirectly(spatialKey parentKey, OctantEnum targetOctant, const Vec3D bodyPosition, const double bodyMass);
+	void addBucketBody(const Vec3D& bodyPosition, const double bodyMass); // Merge a body into a MAX_TREE_DEPTH bucket: combined mass, barycenter, and the quadrupole about it
+	void parameterizeChildNode(HOTNode* parentNode, const OctantEnum targetOctant, const Vec3D& _baryCenter, const double& _mass);
+
+	//Upper triangle of quadrupole moment tensor Q ordered as
+	//Qxx, Qxy, Qxz, Qyy, Qyz, Qzz
+	double quadrupoleMoment[6];
+
+	Vec3D baryCenter;  	double mass;// the center of mass and total mass of all bodies at or below this node
+	long N; //number of bodies at or below this node.
+	uint8_t childByte; //a bitfield encoding which children actually exist, each of the 8 bits can represent the existence of one of the 8 children in the octree (where a set bit indicates that the child exists and an unset bit indicates the opposite).
+	union // one link per compacted layout, a node lives in only one of them
+	{
+		uint32_t firstChild; //breadth-first layout: index of the first child, the others follow in octant order (NO_NODE_INDEX before compaction and for leaves)
+		uint32_t skip; //depth-first layout: index one past this node's subtree, i.e. the next node a walk visits once the node is accepted
+	};
+	//private:
+		//OctantEnum octant; //compute the octant on the fly
+	OctantBounds nodeBounds;
+	spatialKey nodeKey; //the spatial key for this node/body
+};
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+// HOTNodePool: thread-safe node pool, acquireNode grows the pool instead of failing and releaseAll recycles every node at once
+class HOTNodePool
+{
+private:
+	ConcurrentObjectPool<HOTNode> nodePool;
+
+public:
+	HOTNodePool(size_t capacity) : nodePool(capacity) {}
+
+	HOTNode* acquireNode()
+	{
+		return(nodePool.create());
+	}
+
+	void releaseNode(HOTNode* node)
+	{
+		nodePool.destroy(node);
+	}
+
+	void releaseAll()
+	{
+		nodePool.reset();
+	}
+};
+
+
+
@@ -1,446 +1,826 @@
-#pragma once
-#include "Containers.h"
-#include "SequenceContainers.h"
-#include "MortonKeys.h"
-#include "ObjectPool.h"
-#include "Body.h"
-#include "HashedNode.h"
-#include "ofMain.h"
-
-#include <stdio.h>
-#include <omp.h>
-#define NUM_THREADS 8
-
-
-class LinearHashedOctree
-{
-public:
-	LinearHashedOctree();
-	LinearHashedOctree(const OctantBounds& rootBounds); //create octree based on rootBounds
-	~LinearHashedOctree();
-
-
-
-	// Octree Operations: Functions to interact with the tree
-	size_t GetNodeTreeDepth(const spatialKey nodeKey); // Function to get the depth of the tree
-	HOTNode* getParentNode(const HOTNode* childNode); // Get the parentNode of a node
-	HOTNode* getChildNode(const HOTNode* parentNode); // Get the childNode of a node
-	HOTNode* lookUpNode(const spatialKey code);// Lookup a node by its Morton key
-	void traverseTree(HOTNode* node);
-	bool descendantOf(spatialKey nodeKey, spatialKey parentKey); //checks if a key is contained within a parent key
-	bool leafNodeExistsForBody(const Vec3D& bodyPosition);
-
-	std::vector<OctantEnum> getPathToLeafNode(const Vec3D& bodyPosition);
-
-
-
-	// Insertion Functions: Add nodes or bodies to the octree
-	void insertHOTNode(HOTNode*& node);  // Insert a node into the Octree with a specified Morton code. If the node already exists, overwrite it.
-
-	void insertBody(HOTNode*& node, const Vec3D bodyPosition, const double bodyMass);
-	void pushHOTNodeBodyToChild(HOTNode* node);
-	void processNodeInsertion(HOTNode*& node, OctantEnum& targetOctant, spatialKey& currentKey, const Vec3D bodyPosition, const double bodyMass);
-	void pruneEmptyNodes(HOTNode* node);
-	void deleteNode(spatialKey nodeCode);
-	void clear();
-	void deleteTree();
-
-	void createChildNode(HOTNode*& node, OctantEnum& targetOctant, const Vec3D& bodyPosition, const double& bodyMass);
-
-	void computeNodeBaryCenters(HOTNode*& node);
-	void computeTreeBaryCenters(HOTNode*& node);
-
-
-
-	// Debug utility to print the HashedOctree's details
-	void printHashedOctree();
-
-	// Rendering utility to visualize the HashedOctree's node's octant bounds
-	void visualizeTree();
-	void visualizeNode(const HOTNode* node);
-
-
-	// Traverse down the tree until we reach the lowest level or a leaf node.
-	// Your hashing function should determine the path to the leaf node.
-
-
-	//private:
-
-	// Hash map to store the Octree nodes with Morton code as key
-	std::unordered_map<spatialKey, HOTNode*> nodes;
-};
-
-
-
-
-static inline int BarnesHutHOTMAC(HOTNode* node, Vec3D bodyPosition, double theta);
-static inline HOTNode* LookUpNode(LinearHashedOctree& HTree, spatialKey code);// Lookup a node by its Morton key
-static inline void buildLinearHashedOctreeInPlace(LinearHashedOctree& HTree, Body*& bodies, const size_t& numBodies, OctantBounds& domainBounds);
-//static inline void buildHashedOctreePool(LinearHashedOctree &HTree, ObjectPool<HOTNode> nodePool, Body* bodies, const size_t numBodies, OctantBounds domainBounds);
-static inline void PruneEmptyNodesFromTree(LinearHashedOctree& HTree);
-static inline void ComputeHOTOctreeBaryCenters(LinearHashedOctree& HTree, HOTNode* rootNode);
-static inline long TraverseHOTInteractionList(LinearHashedOctree& LHTree, Vec3D& bodyPosition, double theta, HOTNode**& walkList, HOTNode**& interactList);
-static inline void ComputeHOTOctreeForce(LinearHashedOctree& HTree, Body*& bodies, Vec3D*& bodiesAccelerations, const size_t& numBodies, HOTNode**& walkList, HOTNode**& interactList, double thetaMAC);
-static inline void ComputeHOTForceInteractionList(Vec3D& bodyPosition, double& bodyMass, Vec3D& acceleration, HOTNode**& interactList, long listLength);
-const double SOFTENING = 0.025;
-
-
-inline int BarnesHutHOTMAC(HOTNode* node, Vec3D bodyPosition, double theta)
-{
-	// node's diamater / distance-to-bodyPosition < theta
-	Vec3D distance = node->baryCenter - bodyPosition;
-
-	double distSquared = distance.x * distance.x + distance.y * distance.y + distance.z * distance.z;
-
-	return(4.0 * node->nodeBounds.size * node->nodeBounds.size < distSquared * theta * theta);
-}
-
-inline HOTNode* LookUpNode(LinearHashedOctree& HTree, const spatialKey code)
-{
-	const auto iter = HTree.nodes.find(code);
-	return (iter == HTree.nodes.end() ? nullptr : iter->second);
-}
-static inline void buildLinearHashedOctreeInPlace(LinearHashedOctree& HTree, Body*& bodies, const size_t& numBodies, OctantBounds& domainBounds)
-{
-
-	HTree.clear();
-	//HTree = LinearHashedOctree(domainBounds);
-	//HOTNode* rootNode = HTree.lookUpNode(ROOT_KEY);//LookUpNode(HTree, ROOT_KEY);//new HOTNode(domainBounds, ROOT_KEY);
-
-
-
-	HOTNode* rootNode = new HOTNode(domainBounds, ROOT_KEY);
-	//HTree.nodes[rootNode->nodeKey] = rootNode;
-	HTree.insertHOTNode(rootNode);
-	for (size_t i = 0; i < numBodies; i++)
-	{
-		HTree.insertBody(rootNode, bodies[i].position, bodies[i].mass);
-	}
-
-
-	PruneEmptyNodesFromTree(HTree);
-	if (numBodies > 0)
-	{
-		ComputeHOTOctreeBaryCenters(HTree, rootNode);
-	}
-	//HTree.visualizeTree();
-
-	//HTree.printHashedOctree();
-
-	//HTree.deleteTree();
-	delete rootNode;
-
-}
-
-
-
-inline void PruneEmptyNodesFromTree(LinearHashedOctree& HTree)
-{
-
-	HTree.pruneEmptyNodes(HTree.lookUpNode(ROOT_KEY));
-}
-
-inline void ComputeHOTOctreeBaryCenters(LinearHashedOctree& HTree, HOTNode* rootNode)
-{
-	HTree.computeTreeBaryCenters(rootNode);
-}
-
-inline void ComputeHOTOctreeForce(LinearHashedOctree& LHTree, Body*& bodies, Vec3D*& bodiesAccelerations, const size_t& numBodies, HOTNode**& walkList, HOTNode**& interactList, double thetaMAC)
-{
-	omp_set_num_threads(NUM_THREADS);
-	long interactionListLength = 0;
-
-
-
-
-#pragma omp parallel
-	{
-		int id = omp_get_thread_num(); // current thread
-		int numThreads = omp_get_num_threads(); // Get the number of threads inside parallel section
-
-
-		// Calculate start and end indices based on id and numThreads
-		int bodiesPerThread = numBodies / numThreads;
-		int remainderBodies = numBodies % numThreads;//(int)numBodies - (numThreads * bodiesPerThread);
-
-
-
-		// Thread-local copies of walkList and interactList.
-
-	// Thread assignment: Distribute extra bodies to the first 'remainderBodies' threads.
-		size_t start = id * bodiesPerThread;
-		size_t end = start + bodiesPerThread;
-
-		if (id < remainderBodies) 
-		{
-			start += id;  // One extra body for this thread.
-			end += (id + 1);  // End index will be one more.
-		}
-		else 
-		{
-			start += remainderBodies; // All extra bodies distributed before this thread.
-			end += remainderBodies; // Same here.
-		}
-
-
-
-		// Thread-local copies of walkList and interactList.
-		HOTNode** localWalkList = new HOTNode * [end - start];  // Set your maximum size
-		HOTNode** localInteractList = new HOTNode * [end - start];  // Set your maximum size
-
-
-
-#pragma omp for
-		for (int i = start; i < end; i++)
-		{
-
-			interactionListLength = TraverseHOTInteractionList(LHTree, bodies[i].position, thetaMAC, localWalkList, localInteractList);//walkList, interactList);
-
-			// Create a local copy of acceleration for each thread to update
-			//Vec3D localAcceleration;
-			ComputeHOTForceInteractionList(bodies[i].position, bodies[i].mass, bodiesAccelerations[i], localInteractList, interactionListLength);
-			//bodiesAccelerations[i] = localAcceleration;
-//
-/*
-#pragma omp critical
-			{
-				bodiesAccelerations[i] = localAcceleration;
-				//walkList[i] = localWalkList[i];
-				//interactList[i] = localInteractList[i];
-			}
-			//*/
-		}
-		// Free thread-local storage
-		delete[] localWalkList;
-		delete[] localInteractList;
-	}
-}
-
-inline void ComputeHOTForceInteractionList(Vec3D& bodyPosition, double& bodyMass, Vec3D& acceleration, HOTNode**& interactList, long listLength)
-{
-	acceleration = {0,0,0};
-
-
-	HOTNode* node;
-	//node = new HOTNode();
-	double dx = 0, dy = 0, dz = 0, D1 = 0, D2 = 0;
-	double qx = 0, qy = 0, qz = 0;
-
-
-	for (int i = 0; i < listLength; i++)
-	{
-
-		node = interactList[i];
-
-
-		//convert r to c.o.m. referece frame of the node.
-		dx = node->baryCenter.x - bodyPosition.x;
-		dy = node->baryCenter.y - bodyPosition.y;
-		dz = node->baryCenter.z - bodyPosition.z;
-
-
-		// m*r / |r|^3 : normal monopole part/direct interaction
-		D2 = dx * dx + dy * dy + dz * dz;
-		D2 += SOFTENING * SOFTENING;
-
-		D1 = 1.0 / sqrt(D2); //hopefully compiler catches the one over sqrt
-		D2 = 1.0 / D2;
-		D1 = D1 * D2; // 1/D3
-
-		//m*r / |r|^3
-		acceleration.x += node->mass * dx * D1;
-		acceleration.y += node->mass * dy * D1;
-		acceleration.z += node->mass * dz * D1;
-
-
-		if (node->N > 1)//just did monopole so now quadrupole approximate
-		{
-
-			//Q.r / |r|^5; recall quadMom is only the upper triangle of symmetric tensor
-			qx = node->quadrupoleMoment[0] * dx + node->quadrupoleMoment[1] * dy + node->quadrupoleMoment[2] * dz;
-			qy = node->quadrupoleMoment[1] * dx + node->quadrupoleMoment[3] * dy + node->quadrupoleMoment[4] * dz;
-			qz = node->quadrupoleMoment[2] * dx + node->quadrupoleMoment[4] * dy + node->quadrupoleMoment[5] * dz;
-
-			D1 *= D2; // 1/D5 now
-			acceleration.x -= qx * D1;
-			acceleration.y -= qy * D1;
-			acceleration.z -= qz * D1;
-
-
-
-			//5*r.Q.r*r / 2*|r|^7
-			qx = dx * qx + dy * qy + dz * qz;
-			qx *= 2.5;
-			D1 *= D2; // 1/D7 now
-
-
-			acceleration.x += qx * dx * D1;
-			acceleration.y += qx * dy * D1;
-			acceleration.z += qx * dz * D1;
-		}
-	}
-
-	//delete node;
-
-}
-
-
-
-/*
-intended to generate the interaction list for a given bodyPosition
-The list will include either leaf nodes (individual bodies) or internal nodes (groups of bodies)
-that satisfy the MAC (multipole acceptance criterion) for approximation.
-*/
-static inline long TraverseHOTInteractionList(LinearHashedOctree& LHTree, Vec3D& bodyPosition, double theta, HOTNode**& walkList, HOTNode**& interactList)
-{
-	if (LHTree.nodes.empty())
-	{
-		return 0;
-	}
-
-	//if my parallel call of TraverseHOTInteractionList tries to call LHTree in a wrong order, the root node has not been initialized
-	//if (LHTree.lookUpNode(ROOT_KEY) == nullptr)
-	//{
-	//	cout << "\n\nUH-OH, gay \n\n";
-	//}
-
-	HOTNode* node;
-	HOTNode* child;
-	walkList[0] = LHTree.lookUpNode(ROOT_KEY);
-	long walkIdx = 1;
-	long intIdx = 0;
-	while (walkIdx > 0)
-	{
-		node = walkList[--walkIdx];
-		if (node->childByte != 0)
-		{
-			for (int i = 0; i < 8; ++i)
-			{
-				if (!HasOctChild(node->childByte, static_cast<OctantEnum>(i))) //	if (!node->childByte & (1 << i))// See if the ith child exist
-				{
-					continue;
-				}
-				child = LHTree.lookUpNode(GetChildKey(node->nodeKey, static_cast<OctantEnum>(i)));
-				if (BarnesHutHOTMAC(child, bodyPosition, theta))
-				{
-					interactList[intIdx++] = child;
-				}
-				else
-				{
-					walkList[walkIdx++] = child;
-				}
-			}
-		}
-		else if (node->baryCenter != bodyPosition)
-		{
-			interactList[intIdx++] = node;
-		}
-	}
-
-	//delete node;
-	//delete child;
-	return intIdx;
-}
-
-
-
-
-
-
-
-
-
-
-
-
-
-
-
-
-
-
-/*
-
-bool HashedOctree::findLeafNodeAndPath(const Body& body, HOTNode*& leafNode, std::vector<OctantEnum>& path) {
-	// Ensure the root node is initialized.
-	assert(!nodes.empty());
-
-	// Start from the root.
-	spatialKey currentKey = ROOT_KEY;
-	HOTNode* node = lookUpNode(currentKey);
-
-	// Initialize path.
-	path.clear();
-
-	// Traverse the tree to find the appropriate leaf node for the body.
-	while (node != nullptr) {
-		// Determine the spatial subdivision for the body.
-		OctantEnum targetOctant = DetermineOctant(node->nodeBounds.center, body.position);
-
-		// Add to path.
-		path.push_back(targetOctant);
-
-		// Check if there's an existing child node in the target octant.
-		if (HasOctChild(node->childByte, targetOctant)) {
-			// Update the current key to the child's.
-			spatialKey childKey = GetChildKey(currentKey, targetOctant);
-			currentKey = childKey;
-
-			// Fetch the child node from the HOT (Hashed Octree).
-			node = lookUpNode(currentKey);
-		}
-		// If no child exists, then it's the leaf node we're looking for.
-		else {
-			leafNode = node;
-			return true;
-		}
-	}
-
-	// If we've reached here, no suitable leaf node was found.
-	leafNode = nullptr;
-	return false;
-}
-
-
-
-
-
-
-
-
-
-std::vector<OctantEnum> HashedOctree::getPathToLeafNode(const Vec3D& bodyPosition)
-{
-	std::vector<OctantEnum> path;
-
-	// Start with the root node
-	HOTNode* currentNode = lookUpNode(ROOT_KEY);
-
-	// Traverse the tree until we reach a leaf node or an empty node
-	while(currentNode && currentNode->N != 0)
-	{
-		OctantEnum octant = DetermineOctant(currentNode->nodeBounds.center, bodyPosition);
-		path.push_back(octant);
-
-		spatialKey childKey = GetChildKey(currentNode->nodeKey, octant);
-
-		if (nodes.find(childKey) != nodes.end())
-		{
-			currentNode = lookUpNode(childKey);
-		}
-		else
-		{
-			break;  // Leaf node or empty node found
-		}
-	}
-
-	return path;
-}
-
-*/
-
-
-
-
-
-
+#pragma once
+#include "Containers.h"
+#include "SequenceContainers.h"
+#include "MortonKeys.h"
+#include "ObjectPool.h"
+#include "Body.h"
+#include "BodySystem.h"
+#include "HashedNode.h"
+#include "ExecutionConfig.h"
+#include "PhaseTimers.h"
+#include "TraversalStatistics.h"
+
+#include <stdio.h>
+#include <utility>
+#include <algorithm>
+#include <omp.h>
+
+
+/**
+ * Layouts of the compacted node array.
+ *      NodeLayout_BreadthFirst: level by level, a node's children are contiguous from firstChild
+ *      NodeLayout_DepthFirst: pre-order in Morton (octant) order, a node's first child is the next node and skip
+ *                             jumps past its subtree, so a tree walk is a single forward scan without a stack
+ *
+ * Breadth-first is the default: with full HOTNodes in the array each step of the depth-first scan waits on the
+ * previous MAC before it knows which node to load, while the breadth-first walk loads a node's children together.
+ * Depth-first is experimental: it has been slower in every case measured so far, so it is kept only to compare the two.
+ * SimulationParams::nodeLayout selects one for each step's tree (nbody-sim --layout, the app's 'n' key).
+ */
+enum NodeLayoutEnum
+{
+	NodeLayout_BreadthFirst = 0x0,
+	NodeLayout_DepthFirst = 0x1
+};
+
+/**
+ * InsertionPath: the nodes the last insertBodySorted call descended through. nodes[0] is where every insertion along
+ * the path starts (the root, or a subtree root of a parallel build), nodes[depth] the deepest node reached; the path
+ * is empty while depth < 0.
+ */
+struct InsertionPath
+{
+	InsertionPath() : depth(-1) {}
+	HOTNode* nodes[MAX_TREE_DEPTH + 1];
+	int depth;
+};
+
+static const size_t SUBTREE_BUILD_MIN_BODIES = 4096; // Fewer bodies are inserted serially, binning them would cost more than it saves
+static const size_t WALK_LIST_CAPACITY = 8 * (MAX_TREE_DEPTH + 1); // The breadth-first walk pops a node before pushing its (at most 8) children, so it holds at most 7 per level plus one
+
+class LinearHashedOctree
+{
+public:
+	LinearHashedOctree();
+	LinearHashedOctree(const OctantBounds& rootBounds); //create octree based on rootBounds
+	~LinearHashedOctree();
+
+
+
+	// Octree Operations: Functions to interact with the tree
+	size_t GetNodeTreeDepth(const spatialKey nodeKey); // Function to get the depth of the tree
+	HOTNode* getParentNode(const HOTNode* childNode); // Get the parentNode of a node
+	HOTNode* getChildNode(const HOTNode* parentNode); // Get the childNode of a node
+	HOTNode* lookUpNode(const spatialKey code);// Lookup a node by its Morton key
+	void traverseTree(HOTNode* node);
+	bool descendantOf(spatialKey nodeKey, spatialKey parentKey); //checks if a key is contained within a parent key
+	bool leafNodeExistsForBody(const Vec3D& bodyPosition);
+
+	std::vector<OctantEnum> getPathToLeafNode(const Vec3D& bodyPosition);
+
+
+
+	// Insertion Functions: Add nodes or bodies to the octree
+	void insertHOTNode(HOTNode*& node);  // Insert a node into the Octree with a specified Morton code. If the node already exists, overwrite it.
+
+	void insertBody(HOTNode*& node, const Vec3D bodyPosition, const double bodyMass);
+	void insertBodySorted(const Vec3D bodyPosition, const double bodyMass); // insertBody from the root for bodies arriving in Morton (or Hilbert) order, resuming from the previous body's path
+	void insertBodySorted(InsertionPath& path, const Vec3D bodyPosition, const double bodyMass); // The same below path.nodes[0], for a body that lies in its subtree
+	void pushHOTNodeBodyToChild(HOTNode* node);
+	void processNodeInsertion(HOTNode*& node, OctantEnum& targetOctant, spatialKey& currentKey, const Vec3D bodyPosition, const double bodyMass);
+	void pruneEmptyNodes(HOTNode* node);
+	void deleteNode(spatialKey nodeCode);
+	void clear();
+	void deleteTree();
+
+	void createChildNode(HOTNode*& node, OctantEnum& targetOctant, const Vec3D& bodyPosition, const double& bodyMass);
+
+	void computeNodeBaryCenters(HOTNode*& node); // rebuilds mass, N and barycenter from the children (insertion's running sums are overwritten, not added to), then the quadrupole
+	void computeTreeBaryCenters(HOTNode*& node);
+
+
+
+	// Node storage: under Placement_FirstTouch a build takes its nodes from nodeArena, one partition per thread chunk of bodies,
+	// otherwise from nodePool, which any thread may allocate from and release to concurrently
+	void prepareNodeStorage(size_t numBodies); // Called by the builds after clear(), before the first node is created
+	void selectNodePartition(int partition); // Nodes created from now on belong to this thread chunk
+	int nodePartitions() const;
+	template <typename... Args> HOTNode* createNode(Args&&... args)
+	{
+		// inside a parallel build each thread allocates from its own arena partition
+		return(useNodeArena ? new (nodeArena.allocate(omp_in_parallel() ? omp_get_thread_num() : nodeArena.partition())) HOTNode(std::forward<Args>(args)...) : nodePool.create(std::forward<Args>(args)...));
+	}
+	void releaseNode(HOTNode* node); // return a node to nodePool, arena nodes are recycled with the whole arena
+
+
+
+	// Subtree-parallel build (BuildHOTSubtrees): the bodies are binned by their level SUBTREE_SPLIT_LEVELS cell, the levels
+	// above the cells are created serially and the subtree below each cell is filled by a single thread
+	struct SubtreeTask { HOTNode* root; uint32_t begin; uint32_t end; }; // subtreeBodies[begin, end) are inserted below root
+	void splitTopLevels(HOTNode* node, int level, uint32_t firstCell); // creates the nodes above the cells from cellStart, filling subtreeTasks and topNodes
+
+
+
+	// Compacted node array: the last step of a build copies the finished tree into nodeArray in nodeLayout order.
+	// Node 0 is the root and a walk follows uint32_t indices (firstChild or skip) instead of hashing keys.
+	// Afterwards nodeIndex maps keys to indices and the hashed build nodes are released; the compacted tree is
+	// read-only until the next build clears it. Each node is copied by the thread whose body chunk it starts in.
+	struct CompactEntry { const HOTNode* node; uint32_t link; uint32_t firstBody; }; // build node of a nodeArray index, its firstChild or skip, and the sorted index of its first body
+	void compactNodes();
+	void setNodeLayout(NodeLayoutEnum layout) { buildLayout = layout; } // takes effect at the next build
+	bool isCompacted() const { return(numNodes > 0); }
+	size_t nodeCount() const { return(isCompacted() ? numNodes : nodes.size()); }
+	uint32_t childIndex(uint32_t nodeIdx, OctantEnum octant) const; // NO_NODE_INDEX if that child does not exist
+
+
+
+	// Debug utility to print the HashedOctree's details
+	void printHashedOctree();
+
+
+
+	// Traverse down the tree until we reach the lowest level or a leaf node.
+	// Your hashing function should determine the path to the leaf node.
+
+
+	//private:
+
+	// Map from Morton code to the Octree's build nodes, direct-indexed for the top levels and hashed below
+	HybridKeyMap<HOTNode*, nullptr> nodes;
+	NodeArena<HOTNode> nodeArena;
+	ConcurrentObjectPool<HOTNode> nodePool;
+
+	HOTNode* nodeArray; // contiguous copy of the tree in nodeLayout order, valid while isCompacted()
+	uint32_t numNodes;
+	uint32_t nodeArrayCapacity;
+	HybridKeyMap<uint32_t, NO_NODE_INDEX> nodeIndex; // key -> position in nodeArray
+
+	// insertBodySorted: the path of the last body inserted from the root
+	InsertionPath insertionPath;
+
+	// BuildHOTSubtrees scratch, kept between builds
+	HugePageVector<uint16_t> bodyCell; // per body, its level SUBTREE_SPLIT_LEVELS cell in octant digit order
+	HugePageVector<uint32_t> subtreeBodies; // body indices grouped by cell, in their sorted order within a cell
+	std::vector<uint32_t> cellStart; // cell c's bodies are subtreeBodies[cellStart[c], cellStart[c + 1])
+	std::vector<SubtreeTask> subtreeTasks;
+	std::vector<HOTNode*> topNodes; // internal nodes above the subtrees, each listed after its parent
+	NodeLayoutEnum nodeLayout; // layout of the current nodeArray, what the walks read
+	NodeLayoutEnum buildLayout; // layout the next compactNodes() will use
+	// compactNodes scratch, kept between builds
+	HugePageVector<CompactEntry> compactEntries; // per nodeArray index
+	std::vector<uint32_t> compactSegments; // index ranges along which firstBody never decreases: every level breadth-first, the whole array depth-first
+	uint32_t compactSubtree(const HOTNode* node, uint32_t index, uint32_t firstBody); // depth-first order of node's subtree into compactEntries[index...], returns its skip
+
+	// ComputeHOTForces scratch, kept between force passes: thread t's walk and interaction lists, each grown by thread t
+	struct alignas(64) WalkLists { HugePageVector<uint32_t> walkList; HugePageVector<uint32_t> interactList; };
+	std::vector<WalkLists> walkLists;
+	bool useNodeArena; // whether the nodes in the map came from nodeArena
+};
+
+
+
+
+static inline int BarnesHutHOTMAC(const HOTNode* node, Vec3D bodyPosition, double theta);
+static inline HOTNode* LookUpNode(LinearHashedOctree& HTree, spatialKey code);// Lookup a node by its Morton key
+static inline void buildLinearHashedOctreeInPlace(LinearHashedOctree& HTree, Body*& bodies, const size_t& numBodies, OctantBounds& domainBounds);
+static inline void buildLinearHashedOctreeInPlace(LinearHashedOctree& HTree, const BodySystem& bodies, OctantBounds& domainBounds); // Same tree, positions and masses read from the BodySystem arrays
+//static inline void buildHashedOctreePool(LinearHashedOctree &HTree, ObjectPool<HOTNode> nodePool, Body* bodies, const size_t numBodies, OctantBounds domainBounds);
+template <typename PositionOf, typename MassOf> static inline void BuildHOTOctree(LinearHashedOctree& HTree, size_t numBodies, PositionOf positionOf, MassOf massOf, const OctantBounds& domainBounds); // Clear, insert, prune, sum and compact, positionOf(i)/massOf(i) give body i
+template <typename PositionOf, typename MassOf> static inline void BuildHOTSubtrees(LinearHashedOctree& HTree, size_t numBodies, PositionOf positionOf, MassOf massOf); // Parallel insertion and barycenters below the root, positionOf(i)/massOf(i) give body i
+static inline bool UseSubtreeBuild(size_t numBodies);
+static inline void PruneEmptyNodesFromTree(LinearHashedOctree& HTree);
+static inline void ComputeHOTOctreeBaryCenters(LinearHashedOctree& HTree, HOTNode* rootNode);
+static inline void CountHOTWalk(const HOTNode* nodeArray, const uint32_t* interactList, long listLength, uint64_t visitedNodes, uint32_t stackDepth, WalkCounts& counts); // Split an interaction list into body-cell and body-body terms
+static inline long TraverseHOTInteractionList(LinearHashedOctree& LHTree, Vec3D& bodyPosition, double theta, uint32_t*& walkList, uint32_t*& interactList, WalkCounts* counts = nullptr); // Lists hold nodeArray indices, counts (if given) receives what the walk did
+template <typename PositionOf, typename MassOf> static inline void ComputeHOTForces(LinearHashedOctree& LHTree, size_t numBodies, PositionOf positionOf, MassOf massOf, Vec3D* bodiesAccelerations, double thetaMAC, TraversalStatistics* statistics); // Walks and kernel of every body, positionOf(i)/massOf(i) give body i
+static inline void ComputeHOTOctreeForce(LinearHashedOctree& HTree, Body*& bodies, Vec3D*& bodiesAccelerations, const size_t& numBodies, double thetaMAC, TraversalStatistics* statistics = nullptr);
+static inline void ComputeHOTOctreeForce(LinearHashedOctree& HTree, const BodySystem& bodies, Vec3D*& bodiesAccelerations, double thetaMAC, TraversalStatistics* statistics = nullptr); // Accelerations of a BodySystem, each thread walking its own lists; statistics (if given) receives the walks' counts
+static inline bool BucketWithoutBody(const HOTNode* node, const Vec3D& bodyPosition, double bodyMass, double& restMass, Vec3D& restCenter, double* restQuadrupole); // node is the body's own MAX_TREE_DEPTH bucket: its other bodies' mass, barycenter and quadrupole
+static inline void ComputeHOTForceInteractionList(Vec3D& bodyPosition, double& bodyMass, Vec3D& acceleration, const HOTNode* nodeArray, uint32_t*& interactList, long listLength);
+const double SOFTENING = 0.025;
+
+
+inline int BarnesHutHOTMAC(const HOTNode* node, Vec3D bodyPosition, double theta)
+{
+	// node's diamater / distance-to-bodyPosition < theta
+	Vec3D distance = node->baryCenter - bodyPosition;
+
+	double distSquared = distance.x * distance.x + distance.y * distance.y + distance.z * distance.z;
+
+	return(4.0 * node->nodeBounds.size * node->nodeBounds.size < distSquared * theta * theta);
+}
+
+inline HOTNode* LookUpNode(LinearHashedOctree& HTree, const spatialKey code)
+{
+	return(HTree.lookUpNode(code));
+}
+/**
+ * Rebuilds the tree over numBodies sorted bodies, the build shared by both body layouts.
+ *
+ * From SUBTREE_BUILD_MIN_BODIES bodies on, with several threads, BuildHOTSubtrees fills the subtrees in parallel. Otherwise the bodies
+ * are inserted partition by partition, the empty nodes pruned and the barycenters summed from the root. Either way the tree
+ * is then compacted into nodeArray.
+ */
+template <typename PositionOf, typename MassOf>
+inline void BuildHOTOctree(LinearHashedOctree& HTree, size_t numBodies, PositionOf positionOf, MassOf massOf, const OctantBounds& domainBounds)
+{
+	HOTNode* rootNode;
+	{
+		ScopedPhaseTimer timer(Phase_Build);
+		HTree.clear();
+		HTree.prepareNodeStorage(numBodies);
+		rootNode = HTree.createNode(domainBounds, ROOT_KEY);
+		HTree.insertHOTNode(rootNode);
+	}
+	if (UseSubtreeBuild(numBodies))
+	{
+		BuildHOTSubtrees(HTree, numBodies, positionOf, massOf);
+	}
+	else
+	{
+		{
+			ScopedPhaseTimer timer(Phase_Build);
+			int partitions = HTree.nodePartitions();
+			for (int p = 0; p < partitions; p++) // bodies are inserted in Morton order, thread chunk by thread chunk
+			{
+				size_t start, end;
+				GetThreadChunk(numBodies, p, partitions, start, end);
+				HTree.selectNodePartition(p);
+				for (size_t i = start; i < end; i++)
+				{
+					HTree.insertBodySorted(positionOf(i), massOf(i));
+				}
+			}
+		}
+
+		{
+			ScopedPhaseTimer timer(Phase_Prune);
+			PruneEmptyNodesFromTree(HTree);
+		}
+		if (numBodies > 0)
+		{
+			ScopedPhaseTimer timer(Phase_Moments);
+			ComputeHOTOctreeBaryCenters(HTree, rootNode); // the root createNode returned, still in the tree, which owns and frees it
+		}
+	}
+	ScopedPhaseTimer timer(Phase_Build);
+	HTree.compactNodes();
+}
+
+inline void buildLinearHashedOctreeInPlace(LinearHashedOctree& HTree, Body*& bodies, const size_t& numBodies, OctantBounds& domainBounds)
+{
+	Body* bodyArray = bodies;
+	BuildHOTOctree(HTree, numBodies, [bodyArray](size_t i) { return(bodyArray[i].position); }, [bodyArray](size_t i) { return(bodyArray[i].mass); }, domainBounds);
+}
+
+inline void buildLinearHashedOctreeInPlace(LinearHashedOctree& HTree, const BodySystem& bodies, OctantBounds& domainBounds)
+{
+	const double* x = bodies.x;
+	const double* y = bodies.y;
+	const double* z = bodies.z;
+	const double* m = bodies.m;
+	BuildHOTOctree(HTree, bodies.numBodies, [x, y, z](size_t i) { return(Vec3D(x[i], y[i], z[i])); }, [m](size_t i) { return(m[i]); }, domainBounds);
+}
+
+
+
+inline void PruneEmptyNodesFromTree(LinearHashedOctree& HTree)
+{
+
+	HTree.pruneEmptyNodes(HTree.lookUpNode(ROOT_KEY));
+}
+
+/**
+ * Subtree-parallel insertion of numBodies bodies into a tree that holds only its root, followed by the barycenters.
+ *
+ * Each body is binned by the level SUBTREE_SPLIT_LEVELS cell it falls in, found with the same center comparisons
+ * insertion makes (the keys were computed before the drift, and Hilbert keys do not name octants anyway). A stable
+ * counting sort groups the bodies by cell without disturbing their sorted order within a cell. splitTopLevels creates
+ * the few nodes above the cells, and each cell with bodies, or higher node holding a single body, becomes a task: one
+ * thread inserts the task's bodies below its root and sums the subtree's barycenters, touching only that subtree's
+ * nodes, its HybridKeyMap shard and its own node partition. The nodes above the cells are summed last. The tree is the
+ * one serial insertion builds; nothing in it is empty, so it needs no pruning.
+ *
+ * The parallelism is capped by the cells: there are at most SUBTREE_CELLS (64) tasks, and a task takes as long as its
+ * cell's share of the bodies. The cells are not split further, because a cell's nodes all go to one HybridKeyMap shard
+ * (KeyShardIndex), which a single thread must own while it inserts. For uniform bodies the 64 cells keep any team busy.
+ * A centrally concentrated distribution is different: in a Plummer sphere the 8 cells around the root's center hold
+ * about 98% of the bodies and the largest alone about 18%, so the insertions stop scaling at 5 to 6 threads whatever
+ * the team size, and the largest cell sets the build time. Largest-first scheduling only keeps the small cells from
+ * adding to it.
+ *
+ * Each thread's insertions count as Phase_Build and its barycenter sums as Phase_Moments, the binning and the nodes
+ * above the cells as the calling thread's.
+ */
+template <typename PositionOf, typename MassOf>
+inline void BuildHOTSubtrees(LinearHashedOctree& HTree, size_t numBodies, PositionOf positionOf, MassOf massOf)
+{
+	ScopedPhaseTimer binTimer(Phase_Build);
+	HOTNode* rootNode = HTree.lookUpNode(ROOT_KEY);
+	const OctantBounds rootBounds = rootNode->nodeBounds;
+	HTree.bodyCell.resize(numBodies);
+	HTree.subtreeBodies.resize(numBodies);
+	HTree.cellStart.assign(SUBTREE_CELLS + 1, 0);
+	uint16_t* bodyCell = HTree.bodyCell.data();
+	uint32_t* subtreeBodies = HTree.subtreeBodies.data();
+	uint32_t* cellStart = HTree.cellStart.data();
+
+#pragma omp parallel
+	{
+		size_t start, end;
+		GetThreadChunk(numBodies, omp_get_thread_num(), omp_get_num_threads(), start, end);
+		for (size_t i = start; i < end; i++)
+		{
+			Vec3D bodyPosition = positionOf(i);
+			Vec3D center = rootBounds.center;
+			double size = rootBounds.size;
+			int cell = 0;
+			for (int level = 0; level < SUBTREE_SPLIT_LEVELS; level++) // the octants insertion would pick, with the node centers it would compute
+			{
+				OctantEnum octant = DetermineOctant(center, bodyPosition);
+				cell = (cell << 3) | octant;
+				center = DetermineOctantCenter(center, size, octant);
+				size = size * 0.5;
+			}
+			bodyCell[i] = (uint16_t)cell;
+		}
+	}
+
+	for (size_t i = 0; i < numBodies; i++)
+	{
+		cellStart[bodyCell[i] + 1]++;
+	}
+	for (int c = 0; c < SUBTREE_CELLS; c++)
+	{
+		cellStart[c + 1] += cellStart[c];
+	}
+	uint32_t cursor[SUBTREE_CELLS];
+	std::copy(cellStart, cellStart + SUBTREE_CELLS, cursor);
+	for (size_t i = 0; i < numBodies; i++)
+	{
+		subtreeBodies[cursor[bodyCell[i]]++] = (uint32_t)i;
+	}
+
+	HTree.subtreeTasks.clear();
+	HTree.topNodes.clear();
+	HTree.splitTopLevels(rootNode, 0, 0);
+	std::sort(HTree.subtreeTasks.begin(), HTree.subtreeTasks.end(), [](const LinearHashedOctree::SubtreeTask& a, const LinearHashedOctree::SubtreeTask& b) { return(a.end - a.begin > b.end - b.begin); }); // largest first, so no thread is left with a big cell at the end
+	binTimer.stop();
+
+	int numTasks = (int)HTree.subtreeTasks.size();
+	int threads = HTree.useNodeArena ? HTree.nodePartitions() : omp_get_max_threads(); // at most one thread per arena partition
+#pragma omp parallel for schedule(dynamic, 1) num_threads(threads)
+	for (int t = 0; t < numTasks; t++)
+	{
+		const LinearHashedOctree::SubtreeTask task = HTree.subtreeTasks[t];
+		if (task.end - task.begin > 1)
+		{
+			HTree.nodes.reserve(task.root->nodeKey, 2 * (task.end - task.begin)); // only this task writes to the cell's shard
+		}
+		InsertionPath path;
+		path.nodes[0] = task.root;
+		path.depth = 0;
+		ScopedPhaseTimer insertTimer(Phase_Build);
+		for (uint32_t k = task.begin; k < task.end; k++)
+		{
+			size_t i = subtreeBodies[k];
+			HTree.insertBodySorted(path, positionOf(i), massOf(i));
+		}
+		insertTimer.stop();
+		ScopedPhaseTimer momentTimer(Phase_Moments);
+		HOTNode* subtreeRoot = task.root;
+		HTree.computeTreeBaryCenters(subtreeRoot);
+	}
+
+	ScopedPhaseTimer momentTimer(Phase_Moments);
+	for (size_t n = HTree.topNodes.size(); n > 0; n--) // every node after its children
+	{
+		HTree.computeNodeBaryCenters(HTree.topNodes[n - 1]);
+	}
+}
+
+inline bool UseSubtreeBuild(size_t numBodies)
+{
+	return(numBodies >= SUBTREE_BUILD_MIN_BODIES && omp_get_max_threads() > 1);
+}
+
+inline void ComputeHOTOctreeBaryCenters(LinearHashedOctree& HTree, HOTNode* rootNode)
+{
+	HTree.computeTreeBaryCenters(rootNode);
+}
+
+/**
+ * Barnes-Hut accelerations for every body, the loop shared by both body layouts.
+ *
+ * Each thread takes its GetThreadChunk share of the (Morton ordered) bodies, so neighbouring bodies with similar
+ * interaction lists are walked by the same thread. The walk and interaction lists are per thread and kept on the tree
+ * between passes. The walk list has the fixed WALK_LIST_CAPACITY; the interaction list is bounded by the node count,
+ * as a node is accepted at most once per body, and the owning thread grows it (with some headroom) only when the
+ * tree has outgrown it, so the list is allocated, and its pages placed, by the thread that reads it.
+ * The walk and the kernel alternate per body, so each thread times both around every body and adds the two sums
+ * to Phase_Walk and Phase_Force once, two clock reads per body. With statistics, each thread also counts its walks
+ * into a TraversalStatistics of its own and merges it into the pass's totals once, without a lock.
+ */
+template <typename PositionOf, typename MassOf>
+inline void ComputeHOTForces(LinearHashedOctree& LHTree, size_t numBodies, PositionOf positionOf, MassOf massOf, Vec3D* bodiesAccelerations, double thetaMAC, TraversalStatistics* statistics)
+{
+	size_t listCapacity = LHTree.nodeCount() + 1;
+	TraversalAccumulator traversal;
+	if (LHTree.walkLists.size() < (size_t)omp_get_max_threads())
+	{
+		LHTree.walkLists.resize(omp_get_max_threads());
+	}
+
+#pragma omp parallel
+	{
+		size_t start, end;
+		GetThreadChunk(numBodies, omp_get_thread_num(), omp_get_num_threads(), start, end);
+
+		LinearHashedOctree::WalkLists& lists = LHTree.walkLists[omp_get_thread_num()];
+		if (lists.walkList.size() < WALK_LIST_CAPACITY)
+		{
+			lists.walkList.resize(WALK_LIST_CAPACITY);
+		}
+		if (lists.interactList.size() < listCapacity)
+		{
+			lists.interactList.resize(listCapacity + listCapacity / 4);
+		}
+		uint32_t* localWalkList = lists.walkList.data();
+		uint32_t* localInteractList = lists.interactList.data();
+		bool timed = PhaseTimersEnabled();
+		double walkSeconds = 0.0, forceSeconds = 0.0;
+		double mark = timed ? omp_get_wtime() : 0.0;
+		TraversalStatistics localTraversal;
+		WalkCounts walkCounts;
+		WalkCounts* counts = (statistics != nullptr) ? &walkCounts : nullptr;
+		for (size_t i = start; i < end; i++)
+		{
+			Vec3D bodyPosition = positionOf(i);
+			double bodyMass = massOf(i);
+			long interactionListLength = TraverseHOTInteractionList(LHTree, bodyPosition, thetaMAC, localWalkList, localInteractList, counts);
+			if (counts != nullptr)
+			{
+				localTraversal.addBody(walkCounts);
+			}
+			double walked = timed ? omp_get_wtime() : 0.0;
+			ComputeHOTForceInteractionList(bodyPosition, bodyMass, bodiesAccelerations[i], LHTree.nodeArray, localInteractList, interactionListLength);
+			if (timed)
+			{
+				double forced = omp_get_wtime();
+				walkSeconds += walked - mark;
+				forceSeconds += forced - walked;
+				mark = forced;
+			}
+		}
+		if (timed)
+		{
+			AddPhaseTime(Phase_Walk, walkSeconds);
+			AddPhaseTime(Phase_Force, forceSeconds);
+		}
+		if (counts != nullptr)
+		{
+			traversal.merge(localTraversal);
+		}
+	}
+	if (statistics != nullptr)
+	{
+		traversal.store(*statistics);
+	}
+}
+
+inline void ComputeHOTOctreeForce(LinearHashedOctree& LHTree, Body*& bodies, Vec3D*& bodiesAccelerations, const size_t& numBodies, double thetaMAC, TraversalStatistics* statistics)
+{
+	Body* bodyArray = bodies;
+	ComputeHOTForces(LHTree, numBodies, [bodyArray](size_t i) { return(bodyArray[i].position); }, [bodyArray](size_t i) { return(bodyArray[i].mass); }, bodiesAccelerations, thetaMAC, statistics);
+}
+
+inline void ComputeHOTOctreeForce(LinearHashedOctree& LHTree, const BodySystem& bodies, Vec3D*& bodiesAccelerations, double thetaMAC, TraversalStatistics* statistics)
+{
+	const double* x = bodies.x;
+	const double* y = bodies.y;
+	const double* z = bodies.z;
+	const double* m = bodies.m;
+	ComputeHOTForces(LHTree, bodies.numBodies, [x, y, z](size_t i) { return(Vec3D(x[i], y[i], z[i])); }, [m](size_t i) { return(m[i]); }, bodiesAccelerations, thetaMAC, statistics);
+}
+
+/**
+ * A bucket leaf holds several bodies but only their sums, so a body's own bucket would pull it with its own mass.
+ * The body lies in the bucket's cell (as DetermineOctant splits space, (center - size, center + size] on each axis)
+ * exactly when the bucket is its own; its share is then removed from the mass and barycenter, and from the quadrupole
+ * by the parallel axis theorem, as in HOTNode::addBucketBody.
+ */
+inline bool BucketWithoutBody(const HOTNode* node, const Vec3D& bodyPosition, double bodyMass, double& restMass, Vec3D& restCenter, double* restQuadrupole)
+{
+	const Vec3D& center = node->nodeBounds.center;
+	double size = node->nodeBounds.size;
+	if (!(bodyPosition.x > center.x - size && bodyPosition.x <= center.x + size &&
+		bodyPosition.y > center.y - size && bodyPosition.y <= center.y + size &&
+		bodyPosition.z > center.z - size && bodyPosition.z <= center.z + size))
+	{
+		return(false);
+	}
+	restMass = node->mass - bodyMass;
+	if (restMass <= 0.0)
+	{
+		restMass = 0.0;
+		return(true);
+	}
+	restCenter = (node->baryCenter.scaleVector(node->mass) - bodyPosition.scaleVector(bodyMass)).scaleVector(1.0 / restMass);
+	for (int q = 0; q < 6; q++)
+	{
+		restQuadrupole[q] = node->quadrupoleMoment[q];
+	}
+	AddPointQuadrupole(restQuadrupole, bodyPosition - node->baryCenter, -bodyMass);
+	AddPointQuadrupole(restQuadrupole, restCenter - node->baryCenter, -restMass);
+	return(true);
+}
+
+inline void ComputeHOTForceInteractionList(Vec3D& bodyPosition, double& bodyMass, Vec3D& acceleration, const HOTNode* nodeArray, uint32_t*& interactList, long listLength)
+{
+	acceleration = {0,0,0};
+
+
+	const HOTNode* node;
+	//node = new HOTNode();
+	double dx = 0, dy = 0, dz = 0, D1 = 0, D2 = 0;
+	double qx = 0, qy = 0, qz = 0;
+	double mass;
+	Vec3D center;
+	const double* Q;
+	double restQuadrupole[6];
+
+
+	for (int i = 0; i < listLength; i++)
+	{
+
+		node = &nodeArray[interactList[i]];
+		mass = node->mass;
+		center = node->baryCenter;
+		Q = node->quadrupoleMoment;
+		if (node->N > 1 && node->childByte == 0 && BucketWithoutBody(node, bodyPosition, bodyMass, mass, center, restQuadrupole))
+		{
+			if (mass == 0.0)
+			{
+				continue;
+			}
+			Q = restQuadrupole;
+		}
+
+
+		//convert r to c.o.m. referece frame of the node.
+		dx = center.x - bodyPosition.x;
+		dy = center.y - bodyPosition.y;
+		dz = center.z - bodyPosition.z;
+
+
+		// m*r / |r|^3 : normal monopole part/direct interaction
+		D2 = dx * dx + dy * dy + dz * dz;
+		D2 += SOFTENING * SOFTENING;
+
+		D1 = 1.0 / sqrt(D2); //hopefully compiler catches the one over sqrt
+		D2 = 1.0 / D2;
+		D1 = D1 * D2; // 1/D3
+
+		//m*r / |r|^3
+		acceleration.x += mass * dx * D1;
+		acceleration.y += mass * dy * D1;
+		acceleration.z += mass * dz * D1;
+
+
+		if (node->N > 1)//just did monopole so now quadrupole approximate
+		{
+
+			//Q.r / |r|^5; recall quadMom is only the upper triangle of symmetric tensor
+			qx = Q[0] * dx + Q[1] * dy + Q[2] * dz;
+			qy = Q[1] * dx + Q[3] * dy + Q[4] * dz;
+			qz = Q[2] * dx + Q[4] * dy + Q[5] * dz;
+
+			D1 *= D2; // 1/D5 now
+			acceleration.x -= qx * D1;
+			acceleration.y -= qy * D1;
+			acceleration.z -= qz * D1;
+
+
+
+			//5*r.Q.r*r / 2*|r|^7
+			qx = dx * qx + dy * qy + dz * qz;
+			qx *= 2.5;
+			D1 *= D2; // 1/D7 now
+
+
+			acceleration.x += qx * dx * D1;
+			acceleration.y += qx * dy * D1;
+			acceleration.z += qx * dz * D1;
+		}
+	}
+
+	//delete node;
+
+}
+
+
+
+// Splits a finished interaction list into body-cell and body-body terms and records the walk's effort
+static inline void CountHOTWalk(const HOTNode* nodeArray, const uint32_t* interactList, long listLength, uint64_t visitedNodes, uint32_t stackDepth, WalkCounts& counts)
+{
+	uint64_t bodyCell = 0;
+	for (long i = 0; i < listLength; i++) // the nodes were just read by the walk and are about to be read by the kernel
+	{
+		bodyCell += (nodeArray[interactList[i]].N > 1);
+	}
+	counts.bodyCellInteractions = bodyCell;
+	counts.bodyBodyInteractions = (uint64_t)listLength - bodyCell;
+	counts.visitedNodes = visitedNodes;
+	counts.stackDepth = stackDepth;
+}
+
+
+
+
+/*
+intended to generate the interaction list for a given bodyPosition
+The list will include either leaf nodes (individual bodies) or internal nodes (groups of bodies)
+that satisfy the MAC (multipole acceptance criterion) for approximation.
+*/
+static inline long TraverseHOTInteractionList(LinearHashedOctree& LHTree, Vec3D& bodyPosition, double theta, uint32_t*& walkList, uint32_t*& interactList, WalkCounts* counts)
+{
+	if (!LHTree.isCompacted())
+	{
+		if (counts != nullptr)
+		{
+			*counts = WalkCounts();
+		}
+		return 0;
+	}
+
+	const HOTNode* nodeArray = LHTree.nodeArray;
+	const HOTNode* node;
+	uint32_t nodeIdx;
+	long intIdx = 0;
+	uint64_t visited = 1; // the root
+	if (LHTree.nodeLayout == NodeLayout_DepthFirst)
+	{
+		// Forward scan: opening a node moves on to its first child (the next node), accepting it jumps to skip.
+		// The root is always opened, as in the stack walk, so its own MAC is never tested.
+		uint32_t numNodes = LHTree.numNodes;
+		nodeIdx = (nodeArray[0].childByte != 0) ? 1 : 0;
+		visited = nodeIdx; // counted with the others when it is a leaf
+		while (nodeIdx < numNodes)
+		{
+			visited++;
+			node = &nodeArray[nodeIdx];
+			if (node->childByte == 0)
+			{
+				if (node->N > 1 || node->baryCenter != bodyPosition) // a bucket goes to the kernel, which takes the body out of its own
+				{
+					interactList[intIdx++] = nodeIdx;
+				}
+				nodeIdx++;
+			}
+			else if (BarnesHutHOTMAC(node, bodyPosition, theta))
+			{
+				interactList[intIdx++] = nodeIdx;
+				nodeIdx = node->skip;
+			}
+			else
+			{
+				nodeIdx++;
+			}
+		}
+		if (counts != nullptr)
+		{
+			CountHOTWalk(nodeArray, interactList, intIdx, visited, 0, *counts);
+		}
+		return intIdx;
+	}
+
+	walkList[0] = 0; // the root is the first node of the compacted array
+	long walkIdx = 1;
+	long maxWalkIdx = 1;
+	while (walkIdx > 0)
+	{
+		nodeIdx = walkList[--walkIdx];
+		node = &nodeArray[nodeIdx];
+		if (node->childByte != 0)
+		{
+			// The children are stored next to each other, no per-octant lookup needed
+			uint32_t lastChild = node->firstChild + CountOctChildren(node->childByte);
+			for (uint32_t child = node->firstChild; child < lastChild; ++child)
+			{
+				if (BarnesHutHOTMAC(&nodeArray[child], bodyPosition, theta))
+				{
+					interactList[intIdx++] = child;
+				}
+				else
+				{
+					walkList[walkIdx++] = child;
+				}
+			}
+			visited += lastChild - node->firstChild;
+			maxWalkIdx = (walkIdx > maxWalkIdx) ? walkIdx : maxWalkIdx;
+		}
+		else if (node->N > 1 || node->baryCenter != bodyPosition) // a bucket goes to the kernel, which takes the body out of its own
+		{
+			interactList[intIdx++] = nodeIdx;
+		}
+	}
+
+	if (counts != nullptr)
+	{
+		CountHOTWalk(nodeArray, interactList, intIdx, visited, (uint32_t)maxWalkIdx, *counts);
+	}
+	return intIdx;
+}
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+/*
+
+bool HashedOctree::findLeafNodeAndPath(const Body& body, HOTNode*& leafNode, std::vector<OctantEnum>& path) {
+	// Ensure the root node is initialized.
+	assert(!nodes.empty());
+
+	// Start from the root.
+	spatialKey currentKey = ROOT_KEY;
+	HOTNode* node = lookUpNode(currentKey);
+
+	// Initialize path.
+	path.clear();
+
+	// Traverse the tree to find the appropriate leaf node for the body.
+	while (node != nullptr) {
+		// Determine the spatial subdivision for the body.
+		OctantEnum targetOctant = DetermineOctant(node->nodeBounds.center, body.position);
+
+		// Add to path.
+		path.push_back(targetOctant);
+
+		// Check if there's an existing child node in the target octant.
+		if (HasOctChild(node->childByte, targetOctant)) {
+			// Update the current key to the child's.
+			spatialKey childKey = GetChildKey(currentKey, targetOctant);
+			currentKey = childKey;
+
+			// Fetch the child node from the HOT (Hashed Octree).
+			node = lookUpNode(currentKey);
+		}
+		// If no child exists, then it's the leaf node we're looking for.
+		else {
+			leafNode = node;
+			return true;
+		}
+	}
+
+	// If we've reached here, no suitable leaf node was found.
+	leafNode = nullptr;
+	return false;
+}
+
+
+
+
+
+
+
+
+
+std::vector<OctantEnum> HashedOctree::getPathToLeafNode(const Vec3D& bodyPosition)
+{
+	std::vector<OctantEnum> path;
+
+	// Start with the root node
+	HOTNode* currentNode = lookUpNode(ROOT_KEY);
+
+	// Traverse the tree until we reach a leaf node or an empty node
+	while(currentNode && currentNode->N != 0)
+	{
+		OctantEnum octant = DetermineOctant(currentNode->nodeBounds.center, bodyPosition);
+		path.push_back(octant);
+
+		spatialKey childKey = GetChildKey(currentNode->nodeKey, octant);
+
+		if (nodes.find(childKey) != nodes.end())
+		{
+			currentNode = lookUpNode(childKey);
+		}
+		else
+		{
+			break;  // Leaf node or empty node found
+		}
+	}
+
+	return path;
+}
+
+*/
+
+
+
+
+
+
@@ -0,0 +1,336 @@
+/*
+ * MemoryPlacement: thread partitioning and NUMA-aware placement of the large arrays
+ *
+ * Description:
+ * Operating systems place a page on the NUMA node of the thread that first writes it. An array allocated and filled
+ * by one thread therefore lives entirely on that thread's socket, and every thread on the other socket reads it
+ * across the interconnect for the rest of the run.
+ *
+ * Every parallel phase (key generation, sorting passes, force evaluation, integration) splits the Morton-ordered
+ * bodies with GetThreadChunk, so thread t always works on the same contiguous slice. In Placement_FirstTouch mode
+ * the large arrays are first written in parallel with that same partition, which puts each slice on the socket of
+ * the thread that will use it. Tree nodes are built in a NodeArena whose per-thread slabs are placed the same way, and
+ * the compacted node array the force walks read is copied node by node by the thread that owns the node's bodies.
+ * Nothing beyond OpenMP and the OS first-touch policy is used (no libnuma). The placement only holds while threads
+ * stay on their cores, which SetExecutionConfig (ExecutionConfig.h) arranges by pinning the team.
+ *
+ * Arrays of HUGE_PAGE_THRESHOLD bytes or more (the body fields, key/index sort buffers, node slabs, the compacted node
+ * array and the force walk lists at large N) are mapped as 2 MB aligned blocks with a transparent huge page hint
+ * (MADV_HUGEPAGE, or MEM_LARGE_PAGES on Windows when the process holds SeLockMemoryPrivilege), so the random node
+ * accesses of the tree walk need far fewer TLB entries. Without huge page support the blocks silently use normal
+ * pages. The buffers that use them only grow and are kept by their owners from frame to frame, so a block is mapped
+ * once and a freed block goes straight back to the OS; a new block is always a fresh mapping, which its first writer
+ * places. With huge pages the first-touch granularity becomes 2 MB, which is still far below a thread's slice at the
+ * body counts where either matters.
+ */
+#pragma once
+#include <omp.h>
+#include <new>
+#include <vector>
+#include <cstring>
+#include <algorithm>
+#ifdef _MSC_VER
+#include <malloc.h>
+#else
+#include <stdlib.h>
+#endif
+
+
+static const size_t MEMORY_ALIGNMENT = 64; // a cache line, also the widest vector load (AVX-512)
+static const size_t HUGE_PAGE_SIZE = (size_t)2 << 20;
+static const size_t HUGE_PAGE_THRESHOLD = HUGE_PAGE_SIZE; // arrays at least this large are mapped as huge-page blocks
+
+
+/**
+ * Placement modes for the arrays allocated through AllocatePlacedArray and the tree's node arena.
+ *      Placement_Default: pages land wherever the first (usually serial) writer runs
+ *      Placement_FirstTouch: each thread touches the GetThreadChunk slice it will later process
+ */
+enum PlacementEnum
+{
+    Placement_Default = 0x0,
+    Placement_FirstTouch = 0x1
+};
+
+
+
+
+// ------------- Static partition of Morton-ordered arrays across threads -------------
+/**
+ * Split count elements into numThreads contiguous chunks, the first (count % numThreads) chunks getting one extra element.
+ * Every phase that walks the Morton-ordered bodies in parallel uses this partition, so a thread keeps working on the same bodies.
+ */
+static inline void GetThreadChunk(size_t count, int id, int numThreads, size_t& start, size_t& end)
+{
+    size_t perThread = count / numThreads;
+    size_t remainder = count % numThreads;
+    start = id * perThread + std::min((size_t)id, remainder);
+    end = start + perThread + (((size_t)id < remainder) ? 1 : 0);
+}
+
+
+
+
+// ------------- Placement mode, shared by every translation unit -------------
+inline PlacementEnum& MemoryPlacementMode()
+{
+    static PlacementEnum placement = Placement_Default;
+    return(placement);
+}
+
+inline void SetMemoryPlacement(PlacementEnum placement) // affects arrays allocated from now on, existing arrays keep their pages
+{
+    MemoryPlacementMode() = placement;
+}
+
+
+
+
+// ------------- Huge-page blocks (MemoryPlacement.cpp) -------------
+void* AllocateLargeBlock(size_t bytes); // 2 MB aligned and hinted for huge pages, a fresh untouched mapping. Throws std::bad_alloc
+bool FreeLargeBlock(void* block); // Unmap a block from AllocateLargeBlock, false if block did not come from it
+void SetHugePages(bool enabled); // Whether new blocks ask for huge pages, on by default
+bool HugePagesEnabled();
+
+
+
+
+// ------------- Cache line aligned arrays -------------
+template <typename T> static inline T* AllocateAlignedArray(size_t count); // Uninitialized, throws std::bad_alloc on failure
+template <typename T> static inline void FreeAlignedArray(T* data);
+template <typename T> static inline T* AllocateLargeArray(size_t count); // Huge-page block from HUGE_PAGE_THRESHOLD bytes up, AllocateAlignedArray below
+template <typename T> static inline void FreeLargeArray(T* data);
+template <typename T> static inline void FirstTouchArray(T* data, size_t count); // Zero the array in parallel, thread t writing its GetThreadChunk slice
+template <typename T> static inline T* AllocatePlacedArray(size_t count); // AllocateLargeArray, first touched in parallel under Placement_FirstTouch
+template <typename T> static inline void FreePlacedArray(T* data);
+
+template <typename T>
+static inline T* AllocateAlignedArray(size_t count)
+{
+    size_t bytes = (count > 0 ? count : 1) * sizeof(T);
+    void* data = nullptr;
+#ifdef _MSC_VER
+    data = _aligned_malloc(bytes, MEMORY_ALIGNMENT);
+#else
+    if (posix_memalign(&data, MEMORY_ALIGNMENT, bytes) != 0)
+    {
+        data = nullptr;
+    }
+#endif
+    if (data == nullptr)
+    {
+        throw std::bad_alloc();
+    }
+    return((T*)data);
+}
+
+template <typename T>
+static inline void FreeAlignedArray(T* data)
+{
+#ifdef _MSC_VER
+    _aligned_free((void*)data);
+#else
+    free((void*)data);
+#endif
+}
+
+template <typename T>
+static inline T* AllocateLargeArray(size_t count)
+{
+    if (count * sizeof(T) < HUGE_PAGE_THRESHOLD)
+    {
+        return(AllocateAlignedArray<T>(count));
+    }
+    return((T*)AllocateLargeBlock(count * sizeof(T)));
+}
+
+template <typename T>
+static inline void FreeLargeArray(T* data)
+{
+    if (!FreeLargeBlock((void*)data))
+    {
+        FreeAlignedArray(data);
+    }
+}
+
+template <typename T>
+static inline void FirstTouchArray(T* data, size_t count)
+{
+#pragma omp parallel
+    {
+        size_t start, end;
+        GetThreadChunk(count, omp_get_thread_num(), omp_get_num_threads(), start, end);
+        std::memset((void*)(data + start), 0, (end - start) * sizeof(T));
+    }
+}
+
+template <typename T>
+static inline T* AllocatePlacedArray(size_t count)
+{
+    T* data = AllocateLargeArray<T>(count);
+    if (MemoryPlacementMode() == Placement_FirstTouch)
+    {
+        FirstTouchArray(data, count);
+    }
+    return(data);
+}
+
+template <typename T>
+static inline void FreePlacedArray(T* data)
+{
+    FreeLargeArray(data);
+}
+
+
+
+
+/**
+ * HugePageAllocator: standard allocator interface over AllocateLargeArray, for std containers.
+ * A std::vector value-initializes what it grows by, so the thread that grows a HugePageVector places the new pages.
+ */
+template <typename T>
+class HugePageAllocator
+{
+public:
+    typedef T value_type;
+
+    HugePageAllocator() {}
+    template <typename U> HugePageAllocator(const HugePageAllocator<U>&) {}
+
+    T* allocate(size_t count) { return(AllocateLargeArray<T>(count)); }
+    void deallocate(T* data, size_t) { FreeLargeArray(data); }
+
+    template <typename U> bool operator==(const HugePageAllocator<U>&) const { return(true); }
+    template <typename U> bool operator!=(const HugePageAllocator<U>&) const { return(false); }
+};
+
+template <typename T> using HugePageVector = std::vector<T, HugePageAllocator<T>>; // large per-body or per-node scratch
+
+/**
+ * NodeArena: bump allocator for tree nodes, one slab per thread partition.
+ *
+ * The tree is built by inserting the Morton-ordered bodies, so the nodes created while inserting thread t's
+ * GetThreadChunk slice of bodies are (apart from the few shared ancestors) the nodes thread t's bodies walk through.
+ * The build selects partition t for that slice, and partition t's slab was first touched by thread t, so those nodes
+ * sit on thread t's socket. A partition that runs out spills into extra slabs, and the next reserve() grows every
+ * slab to the largest partition seen so that the spill is a one-off.
+ *
+ * Nodes are never freed one at a time: reset() recycles the whole arena once the tree no longer refers to its nodes.
+ * T must be trivially destructible in the sense that skipping its destructor is harmless.
+ *
+ * allocate(partition) may be called concurrently for different partitions (a subtree-parallel build passes the
+ * thread number); each partition keeps its count and spill blocks on its own cache line.
+ */
+template <typename T>
+class NodeArena
+{
+public:
+    NodeArena() : slabs(nullptr), numPartitions(0), slabCapacity(0), currentPartition(0), highWater(0) {}
+    ~NodeArena()
+    {
+        release();
+    }
+    NodeArena(const NodeArena& other) = delete;
+    NodeArena& operator=(const NodeArena& other) = delete;
+
+    void reserve(int partitions, size_t nodesPerPartition) //empties the arena, reallocating (first touched in parallel) if any partition would be too small
+    {
+        reset();
+        nodesPerPartition = std::max(nodesPerPartition, highWater);
+        if (partitions != numPartitions || nodesPerPartition > slabCapacity)
+        {
+            release();
+            slabCapacity = nodesPerPartition + nodesPerPartition / 4;
+            numPartitions = partitions;
+            slabs = new Partition[numPartitions];
+            for (int p = 0; p < numPartitions; p++)
+            {
+                slabs[p].slab = AllocateLargeArray<T>(slabCapacity);
+            }
+            if (MemoryPlacementMode() == Placement_FirstTouch)
+            {
+#pragma omp parallel for schedule(static, 1)
+                for (int p = 0; p < numPartitions; p++)
+                {
+                    std::memset((void*)slabs[p].slab, 0, slabCapacity * sizeof(T));
+                }
+            }
+        }
+    }
+
+    void reset() //every node handed out so far becomes invalid
+    {
+        for (int p = 0; p < numPartitions; p++)
+        {
+            highWater = std::max(highWater, slabs[p].used);
+            slabs[p].used = 0;
+            for (size_t s = 0; s < slabs[p].spill.size(); s++)
+            {
+                FreeLargeArray(slabs[p].spill[s]);
+            }
+            slabs[p].spill.clear();
+        }
+        currentPartition = 0;
+    }
+
+    void setPartition(int partition) //subsequent allocate() calls take from this partition's slab
+    {
+        currentPartition = std::min(std::max(partition, 0), numPartitions - 1);
+    }
+    int partition() const { return(currentPartition); }
+
+    void* allocate() //storage for one T, construct it with placement new
+    {
+        if (numPartitions == 0)
+        {
+            reserve(1, 1024);
+        }
+        return(allocate(currentPartition));
+    }
+
+    void* allocate(int partition) //storage from the given partition, which only the calling thread may be using
+    {
+        Partition& part = slabs[partition];
+        size_t count = part.used++;
+        if (count < slabCapacity)
+        {
+            return(part.slab + count);
+        }
+        size_t spilled = count - slabCapacity; // a partition past its slab continues in slab-sized spill blocks
+        if (spilled / slabCapacity == part.spill.size())
+        {
+            part.spill.push_back(AllocateLargeArray<T>(slabCapacity));
+        }
+        return(part.spill[spilled / slabCapacity] + spilled % slabCapacity);
+    }
+
+    void release()
+    {
+        reset();
+        for (int p = 0; p < numPartitions; p++)
+        {
+            FreeLargeArray(slabs[p].slab);
+        }
+        delete[] slabs;
+        slabs = nullptr;
+        numPartitions = 0;
+        slabCapacity = 0;
+    }
+
+    int partitions() const { return(numPartitions); }
+
+private:
+    struct alignas(64) Partition
+    {
+        Partition() : slab(nullptr), used(0) {}
+        T* slab;
+        size_t used;  // nodes handed out, including those that spilled
+        std::vector<T*> spill;
+    };
+
+    Partition* slabs;
+    int numPartitions;
+    size_t slabCapacity;
+    int currentPartition;
+    size_t highWater; // largest partition seen so far, the minimum slab size for the next reserve
+};
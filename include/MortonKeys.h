@@ -1,479 +1,1071 @@
-/*
- * MortonKey code: for Spatial Encoding and Decoding
- *
- * Description:
- * This file defines the MortonKey code, which is used to encode and decode
- * 3D positions into a Morton key (a linear indexing system that preserves
- * spatial locality) and sort them into Morton Ordering. This technique is particularly useful for optimizing algorithms
- * requiring spatial coherence by reducing cache misses and improving data access patterns.
- * Performance Notes:
- *     - The "Magic Bits" method for bit shifting is used for the encoding/decoding of Morton keys.
- *     - MergeSort is faster than BubbleSort for sorting the keys.
- *     - Radix sorting is optimized
- */
-#pragma once
-#include "Containers.h"
-#include "SequenceContainers.h"
-#include "ofMain.h"
-
-
-
-
- // ------------- Constants and typedefs  -------------
-typedef uint64_t spatialKey;
-static const int MortonKeyDim = 21; //Use 21 bits for each dimension, resulting in a 63-bit Morton code (21*3 = 63).
-static const spatialKey maxKeyDimension = (1ull << 21);
-static const double maxKeyDimension_d = (double)(1ull << 21);
-static const int NUM_BINS = 256;  // Number of bins used in binning optimization
-
-
-
-
-// ------------- Masks for the morton bit swizzle. -------------
-static const spatialKey sepMasks[] =
-{
-    0x1f00000000ffff,// shift left 32 bits, OR with self, and 00011111000000000000000000000000000000001111111111111111
-    0x1f0000ff0000ff,// shift left 32 bits, OR with self, and 00011111000000000000000011111111000000000000000011111111
-    0x100f00f00f00f00f,// shift left 32 bits, OR with self, and 0001000000001111000000001111000000001111000000001111000000000000
-    0x10c30c30c30c30c3,// shift left 32 bits, OR with self, and 0001000011000011000011000011000011000011000011000011000100000000
-    0x1249249249249249
-};
-
-
-
-
-// ------------- Helper functions for MortonKey Encoding and Decoding -------------
-static inline spatialKey interleaveBits(spatialKey xInt, spatialKey yInt, spatialKey zInt); //Interleave the bits of values representing the integer coordinates
-static inline spatialKey computeMortonKey(const Vec3D& _position, const double _size);   // Compute the Morton key from integer coordinates
-static inline Vec3D decodeMortonKey(const spatialKey _mortonKey, const double _size); //Decoding Function
-
-
-
-
-// ------------- Helper functions for MortonKey sorting -------------
-static inline void Merge(spatialKey* keys, size_t left, size_t middle, size_t right); // Merges two sub-arrays of keys
-static inline void MergeSort(spatialKey* keys, size_t left, size_t right); // Recursive merge sort function
-static inline void MergeSortMortonKeys(const size_t numKeys, spatialKey* unsortedKeys); // Merge sorting Morton keys
-static inline void RadixSortMortonKeys(spatialKey* keys, size_t numKeys); //Radix sorting of morton keys
-static inline void RadixSortPass(spatialKey* keys, size_t* indexes, size_t numKeys, spatialKey* tempKeys, size_t* tempIndexes, int shift, size_t* histogram, size_t* offsets); // Radix sort pass on specified bits
-static inline void ThreePassRadixSortMortonKeys(spatialKey* keys, size_t* indexes, size_t numKeys); // Three-pass radix sort with binning optimization
-
-
-
-
-
-/**
- * Interleave the bits of three spatialKey values representing the integer coordinates in 3D space.
- *
- * This function interleaves the bits of xInt, yInt, and zInt to produce a single 63-bit Morton key, which is a linear index for 3D points that preserves spatial locality.
- * The interleaving of bits is achieved through a series of bit-wise manipulations, essentially spreading the bits of each integer across the entire 63-bit range.
- *
- *  @param xInt: X-coordinate integer representation.
- *  @param yInt: Y-coordinate integer representation.
- *  @param zInt: Z-coordinate integer representation.
- *
- *  @return Morton key interleaved from xInt, yInt, and zInt.
- */
-inline spatialKey interleaveBits(spatialKey xInt, spatialKey yInt, spatialKey zInt)
-{
-    spatialKey _mortonKey = 0;
-
-    //morton code swizzle
-    xInt = (xInt | xInt << 32) & sepMasks[0];
-    xInt = (xInt | xInt << 16) & sepMasks[1];
-    xInt = (xInt | xInt << 8) & sepMasks[2];
-    xInt = (xInt | xInt << 4) & sepMasks[3];
-    xInt = (xInt | xInt << 2) & sepMasks[4];
-
-    yInt = (yInt | yInt << 32) & sepMasks[0];
-    yInt = (yInt | yInt << 16) & sepMasks[1];
-    yInt = (yInt | yInt << 8) & sepMasks[2];
-    yInt = (yInt | yInt << 4) & sepMasks[3];
-    yInt = (yInt | yInt << 2) & sepMasks[4];
-
-    zInt = (zInt | zInt << 32) & sepMasks[0];
-    zInt = (zInt | zInt << 16) & sepMasks[1];
-    zInt = (zInt | zInt << 8) & sepMasks[2];
-    zInt = (zInt | zInt << 4) & sepMasks[3];
-    zInt = (zInt | zInt << 2) & sepMasks[4];
-
-    _mortonKey = ((uint64_t)1 << 64) | (xInt << 2) | (yInt << 1) | zInt;
-    return(_mortonKey);
-}
-/**
-* Compute the Morton key for a given 3D position and spatial size (_size)..
-*
-* This function first scales and converts the floating-point 3D position
-* values into the integer domain. After this conversion, it calls the `interleaveBits` method to create the Morton key
-* which is stored as the instance variable.
-*
-*  @param _position: 3D position to be encoded into a Morton key.
-*  @param _size: Maximum spatial extent of the positions. This value is used to scale the positions to [0, 1) range.
-*
-*  @return Encoded morton key
-*/
-inline spatialKey computeMortonKey(const Vec3D& _position, const double _size) //computeMortonCode based on the position of a point within a bounding box _size 
-{
-    // Rescale the coordinates to [0, 1)
-    double xScaled = _position.x + _size;
-    double yScaled = _position.y + _size;
-    double zScaled = _position.z + _size;
-    double frac = maxKeyDimension_d / (2.0 * _size);
-    xScaled *= frac;
-    yScaled *= frac;
-    zScaled *= frac;
-
-    // Convert to integer coordinates in the range [0, 2^bits)
-    spatialKey xInt = std::min((spatialKey)(xScaled), maxKeyDimension - 1);
-    spatialKey yInt = std::min((spatialKey)(yScaled), maxKeyDimension - 1);
-    spatialKey zInt = std::min((spatialKey)(zScaled), maxKeyDimension - 1);
-
-    spatialKey _mortonKey = interleaveBits(xInt, yInt, zInt);
-    return(_mortonKey);
-}
-/**
-* Takes a Morton key and decodes it back into a 3D position.
-*
-* The function decodeMortonKey is designed to reverse the operation performed by interleaveBits, effectively 'de-interleaving' the bits of the Morton key back into three separate x, y, and z components.
-* These integer values are then scaled back into the floating-point domain to retrieve the original 3D position.
-*
-* A loop is performed over the number of bits used for each dimension(21). For each bit index i, we extract the i-th bit from the Morton key for each dimension using bitwise AND (&) and shifting (<<, >>).
-* This is done by: bitwise ANDing (&) the Morton key with a mask that has a 1 in the position corresponding to the i-th bit of the given dimension and 0s everywhere else.
-* For x, this is (1ull << ((3*i) + 2)) - i, for y, this is (1ull << ((3*i) + 1)) - i, and for z, this is (1ull << (3*i)) - i. This operation will yield a number
-* where only the i-th bit of the dimension is potentially non-zero. Bitwise ORing (|=) the result with the accumulated result for the dimension. This 'keeps' the bits that were already set in the dimension
-* and potentially sets the i-th bit if it was set in the Morton key.
-*
-* It then scales these integer values back into the floating-point domain to retrieve the original 3D position.
-*
-*  @param _mortonKey: Morton key to be decoded.
-*  @param _size: Maximum spatial extent of the positions. This value is used to scale back the decoded position to its original range.
-*
-*  @return Decoded 3D position from the Morton key.
-*/
-inline Vec3D decodeMortonKey(const spatialKey _mortonKey, const double _size)
-{
-    spatialKey xInt = 0, yInt = 0, zInt = 0;
-    for (int i = 0; i < MortonKeyDim; ++i)
-    {
-        xInt |= (_mortonKey & ((uint64_t)1 << (3 * i + 2))) >> ((3 * i) + 2) - i;
-        yInt |= (_mortonKey & ((uint64_t)1 << (3 * i + 1))) >> ((3 * i) + 1) - i;
-        zInt |= (_mortonKey & ((uint64_t)1 << (3 * i))) >> (3 * i) - i;
-    }
-    double xScaled = (double)(xInt);
-    double yScaled = (double)(yInt);
-    double zScaled = (double)(zInt);
-    xScaled = xScaled / maxKeyDimension_d * 2.0 * _size - _size;
-    yScaled = yScaled / maxKeyDimension_d * 2.0 * _size - _size;
-    zScaled = zScaled / maxKeyDimension_d * 2.0 * _size - _size;
-    return Vec3D(xScaled, yScaled, zScaled);
-}
-
-
-
-
-
-
-
-
-static inline void Merge(spatialKey* keys, size_t left, size_t middle, size_t right)
-{
-    size_t i, j, k;
-    size_t size1 = middle - left + 1;
-    size_t size2 = right - middle;
-    // Create temp arrays
-    spatialKey* leftTemp = new spatialKey[size1];
-    spatialKey* rightTemp = new spatialKey[size2];
-    // Copy data to temp arrays
-    for (i = 0; i < size1; i++)
-    {
-        leftTemp[i] = keys[left + i];
-    }
-    for (j = 0; j < size2; j++)
-    {
-        rightTemp[j] = keys[middle + 1 + j];
-    }
-    // Merge the temp arrays back into keys[left..right]
-    i = 0;
-    j = 0;
-    k = left;
-    while (i < size1 && j < size2)
-    {
-        if (leftTemp[i] <= rightTemp[j])
-        {
-            keys[k] = leftTemp[i];
-            i++;
-        }
-        else
-        {
-            keys[k] = rightTemp[j];
-            j++;
-        }
-        k++;
-    }
-    while (i < size1)  // Copy the remaining elements of leftTemp
-    {
-        keys[k] = leftTemp[i];
-        i++;
-        k++;
-    }
-    while (j < size2)    // Copy the remaining elements of rightTemp
-    {
-        keys[k] = rightTemp[j];
-        j++;
-        k++;
-    }
-    // Clean up
-    delete[] leftTemp;
-    delete[] rightTemp;
-}
-static inline void MergeSort(spatialKey* keys, size_t left, size_t right)
-{
-    if (left < right)
-    {
-        size_t middle = left + (right - left) / 2;  // Same as (left+right)/2, but avoids overflow for large left and right
-        // Sort first and second halves 
-        MergeSort(keys, left, middle);
-        MergeSort(keys, middle + 1, right);
-        Merge(keys, left, middle, right);
-    }
-}
-static inline void MergeSortMortonKeys(const size_t numKeys, spatialKey* unsortedKeys)
-{
-    if (unsortedKeys == nullptr)
-    {
-        throw std::invalid_argument("unsortedKeys is a null pointer");
-    }
-    MergeSort(unsortedKeys, 0, numKeys - 1);
-}
-
-
-
-
-
-
-
-
-/**
-* Radix sort is a non-comparative integer sorting algorithm that sorts numbers
-* digit by digit, starting from the least significant digit (LSD) to the most
-* significant digit (MSD) or vice-versa. Here we're using it for Morton keys.
-*/
-static inline void RadixSortMortonKeys(spatialKey* keys, size_t numKeys)
-{
-    spatialKey* temp = new spatialKey[numKeys];
-    for (int shift = 0; shift < 64; shift += 8)
-    {
-        size_t counts[256] = { 0 };
-        size_t offsets[256] = { 0 };
-        for (size_t i = 0; i < numKeys; i++)  // Counting occurrences
-        {
-            size_t index = (keys[i] >> shift) & 0xFF;
-            counts[index]++;
-        }
-        for (size_t i = 1; i < 256; i++)   // Calculate offsets
-        {
-            offsets[i] = offsets[i - 1] + counts[i - 1];
-        }
-        for (size_t i = 0; i < numKeys; i++)    // Reorder
-        {
-            size_t index = (keys[i] >> shift) & 0xFF;
-            temp[offsets[index]] = keys[i];
-            offsets[index]++;
-        }
-        for (size_t i = 0; i < numKeys; i++)    // Copy the temporary array to the original one
-        {
-            keys[i] = temp[i];
-        }
-    }
-    delete[] temp;
-}
-
-
-
-
-
-
-
-
-/**
- * Radix sort a single pass on the specified bits.
- *
-* This function handles a single pass of radix sort based on the bits indicated by the 'shift' parameter.
- *
- * It uses a histogram-based approach, calculating the occurrence of
- * each value in the histogram, then using these values to determine the
- * correct position of each key in the output.
- *
- * @param keys       The Morton keys to be sorted.
- * @param numKeys    The number of keys.
- * @param temp       Temporary storage for the sorted keys.
- * @param shift      The number of bits to shift to access the target bits.
- * @param histogram  The histogram storing the count of occurrences for each value.
- * @param offsets    The calculated positions for placing each key in the output.
- */
-static inline void RadixSortPass(spatialKey* keys, size_t* indexes, size_t numKeys, spatialKey* tempKeys, size_t* tempIndexes, int shift, size_t* histogram, size_t* offsets)
-{
-    // Initialize histogram to zeros
-    for (int i = 0; i < NUM_BINS; ++i)
-    {
-        histogram[i] = 0;
-    }
-
-    // Populate the histogram based on the values of the current bits, i.e., the bits at the 'shift' position
-    // This counts how many keys belong to each bin.
-    for (size_t i = 0; i < numKeys; ++i)
-    {
-        size_t index = (keys[i] >> shift) & 0xFF; // Extracting the relevant byte from Morton key
-        histogram[index]++;
-    }
-
-    // Compute offsets for each bin. This determines the starting index in the sorted array for each bin.
-    offsets[0] = 0;
-    for (size_t i = 1; i < NUM_BINS; ++i)
-    {
-        offsets[i] = offsets[i - 1] + histogram[i - 1];
-    }
-
-    // Reorder the Morton keys and their corresponding indexes according to the current byte values based on the histogram and offsets
-    for (size_t i = 0; i < numKeys; ++i)
-    {
-        size_t index = (keys[i] >> shift) & 0xFF;
-        tempKeys[offsets[index]] = keys[i];
-        tempIndexes[offsets[index]] = indexes[i]; // Sort the indexes in the same way as the keys
-        offsets[index]++;
-    }
-
-    // Copy sorted keys from the temp array back to the original Morton keys array
-    for (size_t i = 0; i < numKeys; ++i)
-    {
-        keys[i] = tempKeys[i];
-        indexes[i] = tempIndexes[i];
-    }
-}
-
-
-
-
-/**
- * Three-pass radix sort with binning optimization.
- *
- * This function performs a three-pass radix sort on the Morton keys.
- * Since we know that the precedence is x > y > z, we modify the
- * radix sort to prioritize bits from the x coordinate,
- * followed by bits from the y coordinate, and then bits from the z coordinate.
- * This ensures the Morton keys are sorted by x, then y, and then z.
- *
- * The function reduces cache misses by splitting the Morton code into three parts and sorting each part separately.
- * Because our Morton code is 63 bits long (manually offset by 1), each pass sorts based on 63/3 bits.
- * The first pass sorts bits 0-20 (representing x), the second sorts bits 21-41 (representing y),
- * and the third sorts bits 42-62 (representing z).
- *
- *
- * Before initiating the radix sorting passes, Morton keys are categorized into coarse bins
- * based on their high-order bits. By leveraging spatial coherence, this optimization ensures
- * nearby objects are likely to fall into the same bin, which, when sorted, will minimize cache misses.
- *
- *
- * @param keys     The Morton keys to be sorted.
- * @param numKeys  The number of keys.
- */
-static inline void ThreePassRadixSortMortonKeys(spatialKey* keys, size_t* indexes, size_t numKeys) // Three-pass radix sort with binning optimization
-{
-    spatialKey* tempKeys = new spatialKey[numKeys];
-    size_t* tempIndexes = new size_t[numKeys];  // Temporary storage for indexes
-
-    // Histogram and offset tables for each bin (used in each pass)
-    size_t* histograms = new size_t[NUM_BINS * NUM_BINS];
-    size_t* offsets = new size_t[NUM_BINS * NUM_BINS];
-
-    // Sorting based on bits representing x-coordinates (bits 0-20)
-    for (int shift = 0; shift <= 20; shift += 8)
-    {
-        RadixSortPass(keys, indexes, numKeys, tempKeys, tempIndexes, shift, histograms, offsets);
-    }
-
-    // Sorting based on bits representing y-coordinates (bits 21-41)
-    for (int shift = 21; shift <= 41; shift += 8)
-    {
-        RadixSortPass(keys, indexes, numKeys, tempKeys, tempIndexes, shift, histograms, offsets);
-    }
-
-    // Sorting based on bits representing z-coordinates (bits 42-62)
-    for (int shift = 42; shift <= 62; shift += 8)
-    {
-        RadixSortPass(keys, indexes, numKeys, tempKeys, tempIndexes, shift, histograms, offsets);
-    }
-
-    delete[] tempKeys;
-    delete[] tempIndexes;
-    delete[] histograms;
-    delete[] offsets;
-}
-
-
-
-
-
-
-
-
-
-
-
-
-
-
-/* ---------------- PERFORMANCE BENCHMARRKS ----------------     NOTE: time is recorded in seconds, benchmarks are tracked for each of the functions that sort morton keys
-
-
------------- BENCHMARKS FOR MORTON KEY ENCODING ------------
---- Magic Bits method ---
-For 2097152 keys
-    - Computing morton keys: 1.92861 seconds
-
-
-
-
-
-
------------- BENCHMARKS FOR MORTON KEY SORTING ------------
---- MergeSortMortonKeys ---
-For 2097152 keys
-    - Creating morton keys: 1.91779 seconds
-    - Sorting MortonKeys Time: 3.13582 seconds
-    - Creating morton keys: 1.80638 seconds
-    - Sorting MortonKeys Time: 2.98662 seconds
-
-For 20971520 keys
-    - Creating morton keys: 13.5163 seconds
-    - Sorting MortonKeys Time: 26.4151 seconds
-
-
-
-
---- RadixSortMortonKeys ---
-For 2097152 keys
-    - Creating morton keys: 2.00174 seconds
-    - Sorting MortonKeys Time: 2.17463 seconds
-    - Creating morton keys: 1.81512 seconds
-    - Sorting MortonKeys Time: 1.97575 seconds
-
-For 20971520 keys
-    - Creating morton keys: 13.6232 seconds
-    - Sorting MortonKeys Time: 15.3477 seconds
-
-
-
-
---- ThreePassRadixSortMortonKeys ---
-For 2097152 keys
-    - Creating morton keys: 1.93241 seconds
-    - Sorting MortonKeys Time: 2.10793 seconds
-    - Creating morton keys: 1.88512 seconds
-    - Sorting MortonKeys Time: 2.04663 seconds
-
-For 20971520 keys
-    - Creating morton keys: 13.653 seconds
-    - Sorting MortonKeys Time: 15.35 seconds
-
-*/
+/*
+ * MortonKey code: for Spatial Encoding and Decoding
+ *
+ * Description:
+ * This file defines the MortonKey code, which is used to encode and decode
+ * 3D positions into a Morton key (a linear indexing system that preserves
+ * spatial locality) and sort them into Morton Ordering. This technique is particularly useful for optimizing algorithms
+ * requiring spatial coherence by reducing cache misses and improving data access patterns.
+ * Hilbert keys with the same layout (sentinel bit + one 3-bit digit per tree level) are provided as an alternative ordering.
+ * Performance Notes:
+ *     - The "Magic Bits" method for bit shifting is used for the encoding/decoding of Morton keys.
+ *     - MergeSort is faster than BubbleSort for sorting the keys.
+ *     - Radix sorting is optimized
+ */
+#pragma once
+#include "Containers.h"
+#include "SequenceContainers.h"
+#include "SpatialKeys.h"
+#include "MemoryPlacement.h"
+
+#include <omp.h>
+#include <type_traits>
+
+
+
+
+ // ------------- Constants and typedefs  -------------
+#ifndef SPATIAL_KEY_BITS
+#define SPATIAL_KEY_BITS 64 // 64-bit keys resolve 21 tree levels, build with SPATIAL_KEY_BITS=128 for 42 levels in highly clustered distributions
+#endif
+typedef SpatialKeyTraits<SPATIAL_KEY_BITS>::KeyType spatialKey;
+static const int MortonKeyDim = SpatialKeyTraits<SPATIAL_KEY_BITS>::levels; //Bits per dimension: 21 for a 63-bit Morton code (21*3 = 63), 42 for a 126-bit one
+static const spatialKey maxKeyDimension = (spatialKey)1 << MortonKeyDim;
+static const double maxKeyDimension_d = (double)(1ull << MortonKeyDim);
+static const spatialKey keySentinel = (spatialKey)1 << (3 * MortonKeyDim); // Leading 1 bit above the key bits, so a body key is a full-depth tree key (ROOT_KEY followed by MortonKeyDim octant digits)
+static const int NUM_BINS = 256;  // Number of bins used in binning optimization
+static const int MAX_RADIX_PASSES = 3 * ((MortonKeyDim + 7) / 8); // 8-bit passes over each third of the key bits
+static const size_t ADAPTIVE_SORT_DESCENT_LIMIT = 32; // Re-sort from scratch once more than 1 in 32 keys is smaller than its predecessor
+static const size_t ADAPTIVE_SORT_MOVE_BUDGET = 8; // Average number of slots a key may be shifted by insertion sort before giving up on the repair
+static const size_t ADAPTIVE_SORT_MIN_CHUNK = 4096; // Smallest run handed to a thread by the adaptive sort
+
+
+// KeyOrderingEnum: the space-filling curve used to order the bodies.
+enum KeyOrderingEnum
+{
+    Order_Morton = 0x0,  // Z-order, the 3-bit digit at each level is the octant (x > y > z)
+    Order_Hilbert = 0x1, // Hilbert order, consecutive cells are always face-adjacent, the digit at each level is the cell's rank along the curve
+};
+
+
+// KeyCodecEnum: implementation used by the batch Morton encoder/decoder (MortonKeys.cpp)
+enum KeyCodecEnum
+{
+    Codec_Auto = 0x0,      // fastest codec this CPU supports, queried once at runtime
+    Codec_MagicBits = 0x1, // portable shift-and-mask swizzle, same as interleaveBits/compactBits
+    Codec_LUT = 0x2,       // byte lookup tables, portable
+    Codec_BMI2 = 0x3,      // one pdep/pext per axis
+    Codec_AVX2 = 0x4,      // magic bits on four keys at once
+};
+
+
+// Outcome of an adaptive key sort, tells the caller whether a permutation has to be applied
+enum AdaptiveSortEnum
+{
+    Sort_InOrder = 0x0,  // keys were already in order, indexes are the identity and nothing was moved
+    Sort_Repaired = 0x1, // nearly sorted keys were repaired by per-thread insertion sort and a run merge
+    Sort_Radix = 0x2,    // disorder was too high, keys were radix sorted from scratch
+};
+
+
+
+
+// ------------- Masks for the morton bit swizzle. -------------
+static const uint64_t sepMasks[] = // operate on 21-bit coordinates, 128-bit keys are assembled from two 63-bit halves
+{
+    0x1f00000000ffff,// shift left 32 bits, OR with self, and 00011111000000000000000000000000000000001111111111111111
+    0x1f0000ff0000ff,// shift left 32 bits, OR with self, and 00011111000000000000000011111111000000000000000011111111
+    0x100f00f00f00f00f,// shift left 32 bits, OR with self, and 0001000000001111000000001111000000001111000000001111000000000000
+    0x10c30c30c30c30c3,// shift left 32 bits, OR with self, and 0001000011000011000011000011000011000011000011000011000100000000
+    0x1249249249249249
+};
+
+
+
+
+// ------------- Persistent scratch storage for sorting keys -------------
+/**
+ * KeySortBuffers: the key/index arrays and their ping-pong partners used by the radix and merge sorts.
+ *
+ * The buffers are retained across frames and only grow, so sorting a body array of the same size every
+ * frame does not touch the allocator. After a sort, keys/indexes hold the sorted keys and the permutation
+ * (indexes[i] is the pre-sort position of the i-th sorted key); the temp arrays are scratch.
+ */
+class KeySortBuffers
+{
+public:
+    KeySortBuffers() : keys(nullptr), indexes(nullptr), tempKeys(nullptr), tempIndexes(nullptr), histograms(nullptr), offsets(nullptr), capacity(0),
+        threadHistograms(nullptr), histogramThreadCapacity(0), firstPassHistogramThreads(0) {}
+    ~KeySortBuffers()
+    {
+        release();
+    }
+    KeySortBuffers(const KeySortBuffers& other) = delete;
+    KeySortBuffers& operator=(const KeySortBuffers& other) = delete;
+
+    void reserve(size_t numKeys) //grows the buffers to hold at least numKeys, never shrinks them
+    {
+        if (histograms == nullptr)
+        {
+            histograms = new size_t[NUM_BINS];
+            offsets = new size_t[NUM_BINS];
+        }
+        if (numKeys <= capacity)
+        {
+            return;
+        }
+        FreePlacedArray(keys);
+        FreePlacedArray(indexes);
+        FreePlacedArray(tempKeys);
+        FreePlacedArray(tempIndexes);
+        keys = AllocatePlacedArray<spatialKey>(numKeys); // placed by thread chunk, like the bodies they are sorted with
+        indexes = AllocatePlacedArray<size_t>(numKeys);
+        tempKeys = AllocatePlacedArray<spatialKey>(numKeys);
+        tempIndexes = AllocatePlacedArray<size_t>(numKeys);
+        capacity = numKeys;
+        firstPassHistogramThreads = 0;
+    }
+
+    void reserveThreadHistograms(int numThreads) //one NUM_BINS histogram per thread for the parallel radix passes, never shrinks
+    {
+        if (numThreads <= histogramThreadCapacity)
+        {
+            return;
+        }
+        delete[] threadHistograms;
+        threadHistograms = new size_t[(size_t)numThreads * NUM_BINS];
+        histogramThreadCapacity = numThreads;
+    }
+
+    void release()
+    {
+        FreePlacedArray(keys);
+        FreePlacedArray(indexes);
+        FreePlacedArray(tempKeys);
+        FreePlacedArray(tempIndexes);
+        delete[] histograms;
+        delete[] offsets;
+        delete[] threadHistograms;
+        threadHistograms = nullptr;
+        histogramThreadCapacity = 0;
+        firstPassHistogramThreads = 0;
+        keys = nullptr;  indexes = nullptr;
+        tempKeys = nullptr;  tempIndexes = nullptr;
+        histograms = nullptr;  offsets = nullptr;
+        capacity = 0;
+    }
+
+    spatialKey* keys;
+    size_t* indexes;
+    spatialKey* tempKeys;
+    size_t* tempIndexes;
+    size_t* histograms;
+    size_t* offsets;
+    size_t capacity;
+    size_t* threadHistograms;      // histogramThreadCapacity x NUM_BINS counts, then scatter offsets, of the parallel radix passes
+    int histogramThreadCapacity;
+    int firstPassHistogramThreads; // > 0 when ComputeBodyKeys filled keys/indexes and already counted the first radix digit of each of this many thread chunks
+};
+
+
+
+
+// ------------- Strided access to one field of an array of records (or of a plain array, strideBytes == sizeof(T)) -------------
+static inline const double& StridedValue(const double* values, size_t strideBytes, size_t i)
+{
+    return(*(const double*)((const char*)values + i * strideBytes));
+}
+
+static inline double& StridedValue(double* values, size_t strideBytes, size_t i)
+{
+    return(*(double*)((char*)values + i * strideBytes));
+}
+
+template <typename T>
+static inline T* StridedPointer(T* values, size_t strideBytes, size_t i) // address of the i-th value, not dereferenced so i may be one past the end
+{
+    return((T*)((typename std::conditional<std::is_const<T>::value, const char*, char*>::type)values + i * strideBytes));
+}
+
+
+
+
+// ------------- Helper functions for MortonKey Encoding and Decoding -------------
+static inline uint64_t spreadBits(uint64_t xInt); //Spread the low 21 bits of a coordinate to every third bit
+static inline uint64_t interleaveBits(uint64_t xInt, uint64_t yInt, uint64_t zInt); //Interleave the bits of values representing the integer coordinates
+static inline UInt128Key interleaveBits(const UInt128Key& xInt, const UInt128Key& yInt, const UInt128Key& zInt); //Interleave 42-bit coordinates into a 128-bit key
+static inline spatialKey computeMortonKey(const Vec3D& _position, const double _size);   // Compute the Morton key from integer coordinates
+static inline Vec3D decodeMortonKey(const spatialKey _mortonKey, const double _size); //Decoding Function
+static inline uint64_t compactBits(uint64_t interleavedBits); //Gather every third bit of a key back into a contiguous integer coordinate, the inverse of the interleave swizzle
+static inline UInt128Key compactBits(const UInt128Key& interleavedBits); //compactBits for 128-bit keys, gathers 42 bits
+static inline double clampToKeyGrid(double scaled); //Clamp a coordinate scaled to the key grid into [0, maxKeyDimension - 1], so truncating it to an integer is defined
+static inline void quantizePosition(const Vec3D& _position, const double _size, spatialKey& xInt, spatialKey& yInt, spatialKey& zInt); //Scale a position into the integer key grid
+
+
+
+
+// ------------- Helper functions for Hilbert key Encoding -------------
+static inline void hilbertAxesToTranspose(spatialKey& xInt, spatialKey& yInt, spatialKey& zInt, int bits); //Transform integer coordinates into the transposed Hilbert index
+static inline spatialKey computeHilbertKey(const Vec3D& _position, const double _size); // Compute the Hilbert key of a position
+static inline spatialKey computeSpatialKey(const Vec3D& _position, const double _size, KeyOrderingEnum ordering); // Compute the key of a position for the selected ordering
+
+
+
+
+// ------------- Batch MortonKey Encoding and Decoding (MortonKeys.cpp) -------------
+KeyCodecEnum SelectKeyCodec(); // The codec Codec_Auto resolves to on this CPU
+bool KeyCodecSupported(KeyCodecEnum codec); // Whether this CPU (and OS) can run the codec
+const char* KeyCodecName(KeyCodecEnum codec);
+void EncodeMortonKeyBlock(const double* x, const double* y, const double* z, size_t strideBytes, size_t count, const Vec3D& center, double size, spatialKey* keys, KeyCodecEnum codec = Codec_Auto); // Encode on the calling thread
+void DecodeMortonKeyBlock(const spatialKey* keys, size_t count, const Vec3D& center, double size, double* x, double* y, double* z, size_t strideBytes, KeyCodecEnum codec = Codec_Auto); // Decode on the calling thread
+void EncodeMortonKeys(const double* x, const double* y, const double* z, size_t strideBytes, size_t count, const Vec3D& center, double size, spatialKey* keys, KeyCodecEnum codec = Codec_Auto); // Encode split across the OpenMP threads
+void DecodeMortonKeys(const spatialKey* keys, size_t count, const Vec3D& center, double size, double* x, double* y, double* z, size_t strideBytes, KeyCodecEnum codec = Codec_Auto); // Decode split across the OpenMP threads
+
+
+
+
+// ------------- Helper functions for MortonKey sorting -------------
+static inline void Merge(spatialKey* keys, size_t left, size_t middle, size_t right); // Merges two sub-arrays of keys
+static inline void MergeSort(spatialKey* keys, size_t left, size_t right); // Recursive merge sort function
+static inline void MergeSortMortonKeys(const size_t numKeys, spatialKey* unsortedKeys); // Merge sorting Morton keys
+static inline void MergeKeyIndexes(spatialKey* keys, size_t* indexes, spatialKey* tempKeys, size_t* tempIndexes, size_t left, size_t middle, size_t right); // Merges two sorted runs of keys, carrying their indexes along
+static inline void MergeSortKeyIndexes(spatialKey* keys, size_t* indexes, spatialKey* tempKeys, size_t* tempIndexes, size_t left, size_t right); // Merge sorts keys and indexes using preallocated scratch
+static inline void RadixSortMortonKeys(spatialKey* keys, size_t numKeys); //Radix sorting of morton keys
+static inline bool RadixSortPass(const spatialKey* keys, const size_t* indexes, size_t numKeys, spatialKey* tempKeys, size_t* tempIndexes, int shift, size_t* histogram, size_t* offsets); // Radix sort pass on specified bits
+static inline int GetRadixPassShifts(int* shifts); // Bit offsets of the radix passes, least significant first
+static inline void RadixSortKeyIndexPasses(spatialKey*& keys, size_t*& indexes, spatialKey*& tempKeys, size_t*& tempIndexes, size_t numKeys, size_t* histogram, size_t* offsets); // All radix passes, ping-ponging the buffers
+static inline void ParallelRadixSortKeyIndexes(KeySortBuffers& sortBuffers, size_t numKeys); // All radix passes split across threads, reusing the first-pass histograms of ComputeBodyKeys
+static inline void ThreePassRadixSortMortonKeys(spatialKey* keys, size_t* indexes, size_t numKeys); // Three-pass radix sort with binning optimization
+static inline void RadixSortKeyIndexes(KeySortBuffers& sortBuffers, size_t numKeys); // Three-pass radix sort on persistent buffers, no copy back
+static inline bool BoundedInsertionSortKeyIndexes(spatialKey* keys, size_t* indexes, size_t start, size_t end, size_t moveBudget); // Insertion sort of a nearly sorted run, gives up past moveBudget shifts
+static inline void MergeKeyIndexRuns(const spatialKey* keys, const size_t* indexes, spatialKey* outKeys, size_t* outIndexes, size_t left, size_t middle, size_t right); // Merges [left, middle) and [middle, right) into the out arrays
+static inline AdaptiveSortEnum AdaptiveSortKeyIndexes(KeySortBuffers& sortBuffers, size_t numKeys, size_t keyDescents); // Repairs nearly sorted keys, falling back to radix sort
+
+
+
+
+
+/**
+ * Spread the low 21 bits of a coordinate so that bit i moves to bit 3*i, the "magic bits" swizzle shared by every key width.
+ */
+inline uint64_t spreadBits(uint64_t xInt)
+{
+    xInt &= 0x1fffff;
+    xInt = (xInt | xInt << 32) & sepMasks[0];
+    xInt = (xInt | xInt << 16) & sepMasks[1];
+    xInt = (xInt | xInt << 8) & sepMasks[2];
+    xInt = (xInt | xInt << 4) & sepMasks[3];
+    xInt = (xInt | xInt << 2) & sepMasks[4];
+    return(xInt);
+}
+/**
+ * Interleave the bits of three integer coordinates in 3D space.
+ *
+ * This function interleaves the bits of xInt, yInt, and zInt to produce a single 63-bit Morton key, which is a linear index for 3D points that preserves spatial locality.
+ * The interleaving of bits is achieved through a series of bit-wise manipulations, essentially spreading the bits of each integer across the entire 63-bit range.
+ * The 128-bit overload interleaves 42-bit coordinates: the low 21 bits of each fill the low 63 key bits, the high 21 bits the next 63.
+ *
+ *  @param xInt: X-coordinate integer representation.
+ *  @param yInt: Y-coordinate integer representation.
+ *  @param zInt: Z-coordinate integer representation.
+ *
+ *  @return Morton key interleaved from xInt, yInt, and zInt, with the sentinel bit set above the interleaved bits.
+ */
+inline uint64_t interleaveBits(uint64_t xInt, uint64_t yInt, uint64_t zInt)
+{
+    uint64_t _mortonKey = 0;
+
+    //morton code swizzle
+    _mortonKey = ((uint64_t)1 << 63) | (spreadBits(xInt) << 2) | (spreadBits(yInt) << 1) | spreadBits(zInt);
+    return(_mortonKey);
+}
+
+inline UInt128Key interleaveBits(const UInt128Key& xInt, const UInt128Key& yInt, const UInt128Key& zInt)
+{
+    uint64_t lowBits = (spreadBits(xInt.lo) << 2) | (spreadBits(yInt.lo) << 1) | spreadBits(zInt.lo);
+    uint64_t highBits = (spreadBits(xInt.lo >> 21) << 2) | (spreadBits(yInt.lo >> 21) << 1) | spreadBits(zInt.lo >> 21);
+    return(((UInt128Key)1 << 126) | (UInt128Key(highBits) << 63) | UInt128Key(lowBits));
+}
+/**
+* Compute the Morton key for a given 3D position and spatial size (_size)..
+*
+* This function first scales and converts the floating-point 3D position
+* values into the integer domain. After this conversion, it calls the `interleaveBits` method to create the Morton key
+* which is stored as the instance variable.
+*
+*  @param _position: 3D position to be encoded into a Morton key.
+*  @param _size: Maximum spatial extent of the positions. This value is used to scale the positions to [0, 1) range.
+*
+*  @return Encoded morton key
+*/
+inline spatialKey computeMortonKey(const Vec3D& _position, const double _size) //computeMortonCode based on the position of a point within a bounding box _size 
+{
+    // Rescale the coordinates to [0, 1)
+    double xScaled = _position.x + _size;
+    double yScaled = _position.y + _size;
+    double zScaled = _position.z + _size;
+    double frac = maxKeyDimension_d / (2.0 * _size);
+    xScaled *= frac;
+    yScaled *= frac;
+    zScaled *= frac;
+
+    // Convert to integer coordinates in the range [0, 2^bits)
+    spatialKey xInt = (spatialKey)clampToKeyGrid(xScaled);
+    spatialKey yInt = (spatialKey)clampToKeyGrid(yScaled);
+    spatialKey zInt = (spatialKey)clampToKeyGrid(zScaled);
+
+    spatialKey _mortonKey = interleaveBits(xInt, yInt, zInt);
+    return(_mortonKey);
+}
+/**
+* Takes a Morton key and decodes it back into a 3D position.
+*
+* The function decodeMortonKey is designed to reverse the operation performed by interleaveBits, effectively 'de-interleaving' the bits of the Morton key back into three separate x, y, and z components.
+* These integer values are then scaled back into the floating-point domain to retrieve the original 3D position.
+*
+* The key is shifted right by 2, 1 and 0 bits to line up the x, y and z bits at positions 0, 3, 6, ..., which compactBits then
+* gathers into contiguous integers by running the magic bits swizzle backwards. This works for either key width.
+*
+* It then scales these integer values back into the floating-point domain to retrieve the original 3D position.
+*
+*  @param _mortonKey: Morton key to be decoded.
+*  @param _size: Maximum spatial extent of the positions. This value is used to scale back the decoded position to its original range.
+*
+*  @return Decoded 3D position from the Morton key.
+*/
+inline Vec3D decodeMortonKey(const spatialKey _mortonKey, const double _size)
+{
+    spatialKey xInt = compactBits(_mortonKey >> 2);
+    spatialKey yInt = compactBits(_mortonKey >> 1);
+    spatialKey zInt = compactBits(_mortonKey);
+    double xScaled = (double)KeyLow64(xInt);
+    double yScaled = (double)KeyLow64(yInt);
+    double zScaled = (double)KeyLow64(zInt);
+    xScaled = xScaled / maxKeyDimension_d * 2.0 * _size - _size;
+    yScaled = yScaled / maxKeyDimension_d * 2.0 * _size - _size;
+    zScaled = zScaled / maxKeyDimension_d * 2.0 * _size - _size;
+    return Vec3D(xScaled, yScaled, zScaled);
+}
+
+/**
+ * Gather the bits at positions 0, 3, 6, ... of interleavedBits into the low 21 bits (42 for 128-bit keys), undoing the swizzle of interleaveBits.
+ * Shift the key right by 2, 1 or 0 beforehand to extract the x, y or z coordinate.
+ */
+inline uint64_t compactBits(uint64_t interleavedBits)
+{
+    interleavedBits &= sepMasks[4];
+    interleavedBits = (interleavedBits | interleavedBits >> 2) & sepMasks[3];
+    interleavedBits = (interleavedBits | interleavedBits >> 4) & sepMasks[2];
+    interleavedBits = (interleavedBits | interleavedBits >> 8) & sepMasks[1];
+    interleavedBits = (interleavedBits | interleavedBits >> 16) & sepMasks[0];
+    interleavedBits = (interleavedBits | interleavedBits >> 32) & 0x1fffff;
+    return(interleavedBits);
+}
+
+inline UInt128Key compactBits(const UInt128Key& interleavedBits)
+{
+    uint64_t lowBits = compactBits(interleavedBits.lo & 0x7fffffffffffffffull);
+    uint64_t highBits = compactBits((interleavedBits >> 63).lo);
+    return(UInt128Key((highBits << 21) | lowBits));
+}
+
+/**
+ * Clamp a coordinate scaled to the key grid, (position + size) * frac, into [0, maxKeyDimension - 1].
+ *
+ * The clamp is done on the double: keys are computed in last step's cube before it is refitted, so a body that drifted
+ * out past a face scales below 0 or beyond the grid, and converting such a double to an unsigned integer is undefined.
+ * A NaN clamps to 0. Every encoder, scalar or batch, quantizes through this, so they all give the same keys.
+ */
+inline double clampToKeyGrid(double scaled)
+{
+    return(std::min(std::max(0.0, scaled), maxKeyDimension_d - 1.0));
+}
+
+inline void quantizePosition(const Vec3D& _position, const double _size, spatialKey& xInt, spatialKey& yInt, spatialKey& zInt)
+{
+    double frac = maxKeyDimension_d / (2.0 * _size);
+    xInt = (spatialKey)clampToKeyGrid((_position.x + _size) * frac);
+    yInt = (spatialKey)clampToKeyGrid((_position.y + _size) * frac);
+    zInt = (spatialKey)clampToKeyGrid((_position.z + _size) * frac);
+}
+
+
+
+
+/**
+ * Transform integer coordinates in place into the "transposed" Hilbert index (J. Skilling, Programming the Hilbert curve, 2004).
+ *
+ * Afterwards, interleaving the bits of (xInt, yInt, zInt) with x most significant gives the Hilbert index,
+ * so the same swizzle as the Morton key is reused to assemble the key.
+ * The first loop undoes the rotations/reflections of each sub-cube level by level, the rest Gray-encodes.
+ *
+ *  @param bits: Number of bits per coordinate (the depth of the curve).
+ */
+inline void hilbertAxesToTranspose(spatialKey& xInt, spatialKey& yInt, spatialKey& zInt, int bits)
+{
+    spatialKey* X[3] = { &xInt, &yInt, &zInt };
+    spatialKey M = (spatialKey)1 << (bits - 1);
+    spatialKey P, Q, t;
+
+    // Inverse undo
+    for (Q = M; Q > 1; Q >>= 1)
+    {
+        P = Q - 1;
+        for (int i = 0; i < 3; i++)
+        {
+            if (*X[i] & Q)
+            {
+                *X[0] ^= P; // invert
+            }
+            else
+            {
+                t = (*X[0] ^ *X[i]) & P; // exchange
+                *X[0] ^= t;
+                *X[i] ^= t;
+            }
+        }
+    }
+
+    // Gray encode
+    *X[1] ^= *X[0];
+    *X[2] ^= *X[1];
+    t = 0;
+    for (Q = M; Q > 1; Q >>= 1)
+    {
+        if (*X[2] & Q)
+        {
+            t ^= Q - 1;
+        }
+    }
+    *X[0] ^= t;
+    *X[1] ^= t;
+    *X[2] ^= t;
+}
+
+/**
+ * Compute the Hilbert key for a given 3D position and spatial size (_size).
+ *
+ * Uses the same integer grid and the same key layout as computeMortonKey: a leading sentinel bit followed by
+ * MortonKeyDim three-bit digits, one per tree level. Because the Hilbert curve visits every cell of a level contiguously,
+ * the key shifted right by 3*k is the Hilbert key of the enclosing cell k levels up, exactly like GetParentKey
+ * on Morton keys, so every octree node still owns a contiguous range of the sorted bodies. The curve never jumps
+ * between distant cells, which keeps the ranges handed to each thread spatially compact.
+ *
+ *  @param _position: 3D position to be encoded into a Hilbert key.
+ *  @param _size: Maximum spatial extent of the positions.
+ *
+ *  @return Encoded Hilbert key
+ */
+inline spatialKey computeHilbertKey(const Vec3D& _position, const double _size)
+{
+    spatialKey xInt, yInt, zInt;
+    quantizePosition(_position, _size, xInt, yInt, zInt);
+    hilbertAxesToTranspose(xInt, yInt, zInt, MortonKeyDim);
+    return(interleaveBits(xInt, yInt, zInt));
+}
+
+inline spatialKey computeSpatialKey(const Vec3D& _position, const double _size, KeyOrderingEnum ordering)
+{
+    if (ordering == Order_Hilbert)
+    {
+        return(computeHilbertKey(_position, _size));
+    }
+    return(computeMortonKey(_position, _size));
+}
+
+
+
+
+
+
+
+
+static inline void Merge(spatialKey* keys, size_t left, size_t middle, size_t right)
+{
+    size_t i, j, k;
+    size_t size1 = middle - left + 1;
+    size_t size2 = right - middle;
+    // Create temp arrays
+    spatialKey* leftTemp = new spatialKey[size1];
+    spatialKey* rightTemp = new spatialKey[size2];
+    // Copy data to temp arrays
+    for (i = 0; i < size1; i++)
+    {
+        leftTemp[i] = keys[left + i];
+    }
+    for (j = 0; j < size2; j++)
+    {
+        rightTemp[j] = keys[middle + 1 + j];
+    }
+    // Merge the temp arrays back into keys[left..right]
+    i = 0;
+    j = 0;
+    k = left;
+    while (i < size1 && j < size2)
+    {
+        if (leftTemp[i] <= rightTemp[j])
+        {
+            keys[k] = leftTemp[i];
+            i++;
+        }
+        else
+        {
+            keys[k] = rightTemp[j];
+            j++;
+        }
+        k++;
+    }
+    while (i < size1)  // Copy the remaining elements of leftTemp
+    {
+        keys[k] = leftTemp[i];
+        i++;
+        k++;
+    }
+    while (j < size2)    // Copy the remaining elements of rightTemp
+    {
+        keys[k] = rightTemp[j];
+        j++;
+        k++;
+    }
+    // Clean up
+    delete[] leftTemp;
+    delete[] rightTemp;
+}
+static inline void MergeSort(spatialKey* keys, size_t left, size_t right)
+{
+    if (left < right)
+    {
+        size_t middle = left + (right - left) / 2;  // Same as (left+right)/2, but avoids overflow for large left and right
+        // Sort first and second halves 
+        MergeSort(keys, left, middle);
+        MergeSort(keys, middle + 1, right);
+        Merge(keys, left, middle, right);
+    }
+}
+static inline void MergeSortMortonKeys(const size_t numKeys, spatialKey* unsortedKeys)
+{
+    if (unsortedKeys == nullptr)
+    {
+        throw std::invalid_argument("unsortedKeys is a null pointer");
+    }
+    MergeSort(unsortedKeys, 0, numKeys - 1);
+}
+
+
+/**
+ * Merge the sorted runs keys[left..middle] and keys[middle+1..right], moving each key's index with it.
+ * Only the 8-byte key and index are moved, the bodies themselves are permuted once after the sort.
+ */
+static inline void MergeKeyIndexes(spatialKey* keys, size_t* indexes, spatialKey* tempKeys, size_t* tempIndexes, size_t left, size_t middle, size_t right)
+{
+    size_t i, j, k;
+    // Copy the range into the scratch buffers
+    for (i = left; i <= right; i++)
+    {
+        tempKeys[i] = keys[i];
+        tempIndexes[i] = indexes[i];
+    }
+    // Merge the scratch runs back into keys[left..right]
+    i = left;
+    j = middle + 1;
+    k = left;
+    while (i <= middle && j <= right)
+    {
+        if (tempKeys[i] <= tempKeys[j])
+        {
+            keys[k] = tempKeys[i];
+            indexes[k] = tempIndexes[i];
+            i++;
+        }
+        else
+        {
+            keys[k] = tempKeys[j];
+            indexes[k] = tempIndexes[j];
+            j++;
+        }
+        k++;
+    }
+    while (i <= middle)  // Copy the remaining elements of the left run
+    {
+        keys[k] = tempKeys[i];
+        indexes[k] = tempIndexes[i];
+        i++;
+        k++;
+    }
+    while (j <= right)  // Copy the remaining elements of the right run
+    {
+        keys[k] = tempKeys[j];
+        indexes[k] = tempIndexes[j];
+        j++;
+        k++;
+    }
+}
+static inline void MergeSortKeyIndexes(spatialKey* keys, size_t* indexes, spatialKey* tempKeys, size_t* tempIndexes, size_t left, size_t right)
+{
+    if (left < right)
+    {
+        size_t middle = left + (right - left) / 2;  // Same as (left+right)/2, but avoids overflow for large left and right
+        MergeSortKeyIndexes(keys, indexes, tempKeys, tempIndexes, left, middle);
+        MergeSortKeyIndexes(keys, indexes, tempKeys, tempIndexes, middle + 1, right);
+        MergeKeyIndexes(keys, indexes, tempKeys, tempIndexes, left, middle, right);
+    }
+}
+
+
+
+
+
+
+
+
+/**
+* Radix sort is a non-comparative integer sorting algorithm that sorts numbers
+* digit by digit, starting from the least significant digit (LSD) to the most
+* significant digit (MSD) or vice-versa. Here we're using it for Morton keys.
+*/
+static inline void RadixSortMortonKeys(spatialKey* keys, size_t numKeys)
+{
+    spatialKey* temp = new spatialKey[numKeys];
+    for (int shift = 0; shift < SPATIAL_KEY_BITS; shift += 8)
+    {
+        size_t counts[256] = { 0 };
+        size_t offsets[256] = { 0 };
+        for (size_t i = 0; i < numKeys; i++)  // Counting occurrences
+        {
+            size_t index = KeyRadixDigit(keys[i], shift);
+            counts[index]++;
+        }
+        for (size_t i = 1; i < 256; i++)   // Calculate offsets
+        {
+            offsets[i] = offsets[i - 1] + counts[i - 1];
+        }
+        for (size_t i = 0; i < numKeys; i++)    // Reorder
+        {
+            size_t index = KeyRadixDigit(keys[i], shift);
+            temp[offsets[index]] = keys[i];
+            offsets[index]++;
+        }
+        for (size_t i = 0; i < numKeys; i++)    // Copy the temporary array to the original one
+        {
+            keys[i] = temp[i];
+        }
+    }
+    delete[] temp;
+}
+
+
+
+
+
+
+
+
+/**
+ * Radix sort a single pass on the specified bits.
+ *
+* This function handles a single pass of radix sort based on the bits indicated by the 'shift' parameter.
+ *
+ * It uses a histogram-based approach, calculating the occurrence of
+ * each value in the histogram, then using these values to determine the
+ * correct position of each key in the output. The sorted pass is written to the temp arrays
+ * and is not copied back, the caller swaps the buffer pointers instead.
+ *
+ * @param keys       The Morton keys to be sorted.
+ * @param numKeys    The number of keys.
+ * @param temp       Temporary storage for the sorted keys.
+ * @param shift      The number of bits to shift to access the target bits.
+ * @param histogram  The histogram storing the count of occurrences for each value.
+ * @param offsets    The calculated positions for placing each key in the output.
+ *
+ * @return false if every key has the same value in these bits, in which case the pass is skipped and nothing is written.
+ */
+static inline bool RadixSortPass(const spatialKey* keys, const size_t* indexes, size_t numKeys, spatialKey* tempKeys, size_t* tempIndexes, int shift, size_t* histogram, size_t* offsets)
+{
+    // Initialize histogram to zeros
+    for (int i = 0; i < NUM_BINS; ++i)
+    {
+        histogram[i] = 0;
+    }
+
+    // Populate the histogram based on the values of the current bits, i.e., the bits at the 'shift' position
+    // This counts how many keys belong to each bin.
+    for (size_t i = 0; i < numKeys; ++i)
+    {
+        size_t index = KeyRadixDigit(keys[i], shift); // Extracting the relevant byte from Morton key
+        histogram[index]++;
+    }
+
+    // A pass where all keys land in one bin would reproduce the input order
+    if (numKeys == 0 || histogram[KeyRadixDigit(keys[0], shift)] == numKeys)
+    {
+        return(false);
+    }
+
+    // Compute offsets for each bin. This determines the starting index in the sorted array for each bin.
+    offsets[0] = 0;
+    for (size_t i = 1; i < NUM_BINS; ++i)
+    {
+        offsets[i] = offsets[i - 1] + histogram[i - 1];
+    }
+
+    // Reorder the Morton keys and their corresponding indexes according to the current byte values based on the histogram and offsets
+    for (size_t i = 0; i < numKeys; ++i)
+    {
+        size_t index = KeyRadixDigit(keys[i], shift);
+        tempKeys[offsets[index]] = keys[i];
+        tempIndexes[offsets[index]] = indexes[i]; // Sort the indexes in the same way as the keys
+        offsets[index]++;
+    }
+    return(true);
+}
+
+
+
+
+/**
+ * Bit offsets of the 8-bit radix passes, least significant first: each third of the key bits (the x, y and z
+ * thirds of the original 63-bit layout, bits 0-20, 21-41 and 42-62 for 64-bit keys) is sorted in 8-bit steps.
+ *
+ * @return the number of passes written to shifts, at most MAX_RADIX_PASSES.
+ */
+static inline int GetRadixPassShifts(int* shifts)
+{
+    int numPasses = 0;
+    for (int third = 0; third < 3; third++)
+    {
+        for (int shift = third * MortonKeyDim; shift < (third + 1) * MortonKeyDim; shift += 8)
+        {
+            shifts[numPasses++] = shift;
+        }
+    }
+    return(numPasses);
+}
+
+/**
+ * Runs every pass of the three-pass radix sort, swapping the key/index pointers with their temp partners
+ * after each pass that moved data. On return keys/indexes point at whichever buffer holds the sorted result.
+ */
+static inline void RadixSortKeyIndexPasses(spatialKey*& keys, size_t*& indexes, spatialKey*& tempKeys, size_t*& tempIndexes, size_t numKeys, size_t* histogram, size_t* offsets)
+{
+    int shifts[MAX_RADIX_PASSES];
+    int numPasses = GetRadixPassShifts(shifts);
+    for (int pass = 0; pass < numPasses; pass++)
+    {
+        if (RadixSortPass(keys, indexes, numKeys, tempKeys, tempIndexes, shifts[pass], histogram, offsets))
+        {
+            std::swap(keys, tempKeys);
+            std::swap(indexes, tempIndexes);
+        }
+    }
+}
+
+/**
+ * Parallel version of RadixSortKeyIndexPasses on the persistent buffers, in a single parallel region.
+ *
+ * Each pass, every thread counts the digits of its GetThreadChunk share, one thread turns the per-thread counts into
+ * per-thread scatter offsets (bin-major, thread-minor, which keeps the scatter stable) and every thread then scatters
+ * its share. When ComputeBodyKeys already counted the first digit per chunk while generating the keys, the first
+ * counting sweep is skipped, so the first pass reads the keys only once.
+ */
+static inline void ParallelRadixSortKeyIndexes(KeySortBuffers& sortBuffers, size_t numKeys)
+{
+    int shifts[MAX_RADIX_PASSES];
+    int numPasses = GetRadixPassShifts(shifts);
+    int firstPassThreads = sortBuffers.firstPassHistogramThreads;
+    int requestedThreads = (firstPassThreads > 0) ? firstPassThreads : omp_get_max_threads();
+    sortBuffers.reserveThreadHistograms(requestedThreads);
+    sortBuffers.firstPassHistogramThreads = 0; // the keys are about to move
+
+    spatialKey* keys = sortBuffers.keys;
+    size_t* indexes = sortBuffers.indexes;
+    spatialKey* tempKeys = sortBuffers.tempKeys;
+    size_t* tempIndexes = sortBuffers.tempIndexes;
+    size_t* threadHistograms = sortBuffers.threadHistograms;
+    bool passMovesKeys = false;
+#pragma omp parallel num_threads(requestedThreads)
+    {
+        int id = omp_get_thread_num();
+        int numThreads = omp_get_num_threads();
+        size_t start, end;
+        GetThreadChunk(numKeys, id, numThreads, start, end);
+        size_t* histogram = threadHistograms + (size_t)id * NUM_BINS;
+
+        for (int pass = 0; pass < numPasses; pass++)
+        {
+            int shift = shifts[pass];
+            if (pass > 0 || numThreads != firstPassThreads)
+            {
+                for (int b = 0; b < NUM_BINS; b++)
+                {
+                    histogram[b] = 0;
+                }
+                for (size_t i = start; i < end; ++i)
+                {
+                    histogram[KeyRadixDigit(keys[i], shift)]++;
+                }
+            }
+#pragma omp barrier
+#pragma omp single
+            {
+                passMovesKeys = true;
+                size_t offset = 0;
+                for (int b = 0; b < NUM_BINS; b++)
+                {
+                    size_t binCount = 0;
+                    for (int t = 0; t < numThreads; t++)
+                    {
+                        size_t count = threadHistograms[(size_t)t * NUM_BINS + b];
+                        threadHistograms[(size_t)t * NUM_BINS + b] = offset;
+                        offset += count;
+                        binCount += count;
+                    }
+                    if (binCount == numKeys) // every key in one bin, the pass would reproduce the input order
+                    {
+                        passMovesKeys = false;
+                    }
+                }
+            }
+            if (passMovesKeys)
+            {
+                for (size_t i = start; i < end; ++i)
+                {
+                    size_t destination = histogram[KeyRadixDigit(keys[i], shift)]++;
+                    tempKeys[destination] = keys[i];
+                    tempIndexes[destination] = indexes[i];
+                }
+            }
+#pragma omp barrier
+#pragma omp single
+            {
+                if (passMovesKeys)
+                {
+                    std::swap(keys, tempKeys);
+                    std::swap(indexes, tempIndexes);
+                }
+            }
+        }
+    }
+    sortBuffers.keys = keys;
+    sortBuffers.indexes = indexes;
+    sortBuffers.tempKeys = tempKeys;
+    sortBuffers.tempIndexes = tempIndexes;
+}
+
+
+
+
+/**
+ * Three-pass radix sort with binning optimization.
+ *
+ * This function performs a three-pass radix sort on the Morton keys.
+ * Since we know that the precedence is x > y > z, we modify the
+ * radix sort to prioritize bits from the x coordinate,
+ * followed by bits from the y coordinate, and then bits from the z coordinate.
+ * This ensures the Morton keys are sorted by x, then y, and then z.
+ *
+ * The function reduces cache misses by splitting the Morton code into three parts and sorting each part separately.
+ * Because our Morton code is 63 bits long (manually offset by 1), each pass sorts based on 63/3 bits.
+ * The first pass sorts bits 0-20 (representing x), the second sorts bits 21-41 (representing y),
+ * and the third sorts bits 42-62 (representing z). With 128-bit keys each third is 42 bits wide.
+ *
+ *
+ * Before initiating the radix sorting passes, Morton keys are categorized into coarse bins
+ * based on their high-order bits. By leveraging spatial coherence, this optimization ensures
+ * nearby objects are likely to fall into the same bin, which, when sorted, will minimize cache misses.
+ *
+ *
+ * @param keys     The Morton keys to be sorted.
+ * @param numKeys  The number of keys.
+ */
+static inline void ThreePassRadixSortMortonKeys(spatialKey* keys, size_t* indexes, size_t numKeys) // Three-pass radix sort with binning optimization
+{
+    KeySortBuffers sortBuffers;
+    sortBuffers.reserve(numKeys);
+
+    spatialKey* sortedKeys = keys;
+    size_t* sortedIndexes = indexes;
+    spatialKey* tempKeys = sortBuffers.tempKeys;
+    size_t* tempIndexes = sortBuffers.tempIndexes;
+    RadixSortKeyIndexPasses(sortedKeys, sortedIndexes, tempKeys, tempIndexes, numKeys, sortBuffers.histograms, sortBuffers.offsets);
+
+    // An odd number of moving passes leaves the result in the scratch buffers
+    if (sortedKeys != keys)
+    {
+        std::copy(sortedKeys, sortedKeys + numKeys, keys);
+        std::copy(sortedIndexes, sortedIndexes + numKeys, indexes);
+    }
+}
+
+/**
+ * Three-pass radix sort on persistent buffers.
+ *
+ * Sorts sortBuffers.keys and carries sortBuffers.indexes along. The buffers are swapped with their temp
+ * partners rather than copied back, so afterwards sortBuffers.keys/indexes hold the sorted keys and the permutation.
+ * The passes run in parallel, see ParallelRadixSortKeyIndexes.
+ *
+ * @param sortBuffers  Buffers reserved for at least numKeys, with keys and indexes filled in.
+ * @param numKeys      The number of keys.
+ */
+static inline void RadixSortKeyIndexes(KeySortBuffers& sortBuffers, size_t numKeys)
+{
+    ParallelRadixSortKeyIndexes(sortBuffers, numKeys);
+}
+
+
+
+
+
+
+
+
+
+/**
+ * Insertion sort of keys[start..end), carrying the indexes along.
+ *
+ * Runs in O(n + inversions), which is close to a single pass for keys that were sorted last frame and only
+ * drifted slightly. Stops early once more than moveBudget element shifts have been made; the run is then
+ * only partially sorted, but every key is still paired with its own index.
+ *
+ * @return true if the run is sorted, false if the budget was exhausted.
+ */
+static inline bool BoundedInsertionSortKeyIndexes(spatialKey* keys, size_t* indexes, size_t start, size_t end, size_t moveBudget)
+{
+    size_t moves = 0;
+    for (size_t i = start + 1; i < end; ++i)
+    {
+        if (!(keys[i] < keys[i - 1]))
+        {
+            continue;
+        }
+        spatialKey key = keys[i];
+        size_t index = indexes[i];
+        size_t j = i;
+        while (j > start && key < keys[j - 1])
+        {
+            keys[j] = keys[j - 1];
+            indexes[j] = indexes[j - 1];
+            j--;
+        }
+        keys[j] = key;
+        indexes[j] = index;
+
+        moves += i - j;
+        if (moves > moveBudget)
+        {
+            return(false);
+        }
+    }
+    return(true);
+}
+
+static inline void MergeKeyIndexRuns(const spatialKey* keys, const size_t* indexes, spatialKey* outKeys, size_t* outIndexes, size_t left, size_t middle, size_t right)
+{
+    size_t i = left, j = middle, k = left;
+    while (i < middle && j < right)
+    {
+        if (!(keys[j] < keys[i])) // take from the left run on ties to keep the merge stable
+        {
+            outKeys[k] = keys[i];
+            outIndexes[k] = indexes[i];
+            i++;
+        }
+        else
+        {
+            outKeys[k] = keys[j];
+            outIndexes[k] = indexes[j];
+            j++;
+        }
+        k++;
+    }
+    for (; i < middle; i++, k++)
+    {
+        outKeys[k] = keys[i];
+        outIndexes[k] = indexes[i];
+    }
+    for (; j < right; j++, k++)
+    {
+        outKeys[k] = keys[j];
+        outIndexes[k] = indexes[j];
+    }
+}
+
+/**
+ * Adaptive sort exploiting the temporal coherence of the Morton order.
+ *
+ * The keys are computed in the order the bodies were sorted into last frame, so between frames only a few
+ * keys step out of order. keyDescents, the number of positions where a key is smaller than its predecessor,
+ * is counted while the keys are computed and decides the strategy:
+ *     - no descents: the keys are already sorted, nothing is moved and the permutation is the identity.
+ *     - few descents: each thread insertion sorts its static chunk under a move budget, then the sorted chunks
+ *       are merged pairwise in parallel (log2(threads) levels, skipped entirely if the chunk boundaries are in order).
+ *     - many descents, or a chunk exceeding its move budget: full radix sort.
+ *
+ * @param sortBuffers  Buffers holding the keys and the identity permutation.
+ * @param numKeys      The number of keys.
+ * @param keyDescents  The number of i with keys[i] < keys[i - 1].
+ *
+ * @return which of the three strategies was used.
+ */
+static inline AdaptiveSortEnum AdaptiveSortKeyIndexes(KeySortBuffers& sortBuffers, size_t numKeys, size_t keyDescents)
+{
+    if (keyDescents == 0)
+    {
+        return(Sort_InOrder);
+    }
+    if (keyDescents * ADAPTIVE_SORT_DESCENT_LIMIT > numKeys)
+    {
+        RadixSortKeyIndexes(sortBuffers, numKeys);
+        return(Sort_Radix);
+    }
+
+    // Repair each thread's chunk independently. Keys move within the chunks, so the first-pass histograms of ComputeBodyKeys no longer apply
+    sortBuffers.firstPassHistogramThreads = 0;
+    int numChunks = (int)std::max((size_t)1, std::min((size_t)omp_get_max_threads(), numKeys / ADAPTIVE_SORT_MIN_CHUNK));
+    std::vector<size_t> chunkStarts(numChunks + 1);
+    for (int c = 0; c < numChunks; c++)
+    {
+        size_t end;
+        GetThreadChunk(numKeys, c, numChunks, chunkStarts[c], end);
+    }
+    chunkStarts[numChunks] = numKeys;
+
+    bool withinBudget = true;
+#pragma omp parallel for schedule(static) reduction(&&:withinBudget)
+    for (int c = 0; c < numChunks; c++)
+    {
+        size_t moveBudget = (chunkStarts[c + 1] - chunkStarts[c]) * ADAPTIVE_SORT_MOVE_BUDGET;
+        withinBudget = BoundedInsertionSortKeyIndexes(sortBuffers.keys, sortBuffers.indexes, chunkStarts[c], chunkStarts[c + 1], moveBudget) && withinBudget;
+    }
+    if (!withinBudget)
+    {
+        RadixSortKeyIndexes(sortBuffers, numKeys);
+        return(Sort_Radix);
+    }
+
+    // Merge the sorted chunks, unless every boundary is already in order
+    bool boundariesInOrder = true;
+    for (int c = 1; c < numChunks; c++)
+    {
+        if (sortBuffers.keys[chunkStarts[c]] < sortBuffers.keys[chunkStarts[c] - 1])
+        {
+            boundariesInOrder = false;
+            break;
+        }
+    }
+    for (int width = 1; !boundariesInOrder && width < numChunks; width *= 2)
+    {
+        int numPairs = (numChunks + 2 * width - 1) / (2 * width);
+#pragma omp parallel for schedule(static)
+        for (int p = 0; p < numPairs; p++)
+        {
+            size_t left = chunkStarts[p * 2 * width];
+            size_t middle = chunkStarts[std::min(p * 2 * width + width, numChunks)];
+            size_t right = chunkStarts[std::min(p * 2 * width + 2 * width, numChunks)];
+            MergeKeyIndexRuns(sortBuffers.keys, sortBuffers.indexes, sortBuffers.tempKeys, sortBuffers.tempIndexes, left, middle, right);
+        }
+        std::swap(sortBuffers.keys, sortBuffers.tempKeys);
+        std::swap(sortBuffers.indexes, sortBuffers.tempIndexes);
+    }
+    return(Sort_Repaired);
+}
+
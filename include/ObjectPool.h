@@ -1,114 +1,451 @@
-#pragma once
-#include "ofMain.h"
-#include <atomic>
-#include <future>
-#include <thread>
-#include <functional>
-#include <stdexcept>
-
-
-template <class T>
-class ObjectPool
-{
-public:
-    ObjectPool() {}
-
-    ObjectPool(size_t size)
-    {
-        for (size_t i = 0; i < size; ++i)
-        {
-            auto object = new T();
-            pool.push(object);
-        }
-    }
-
-    void releaseAll()
-    {
-        while (!pool.empty())
-        {
-            delete pool.top();
-            pool.pop();
-        }
-    }
-
-
-    ~ObjectPool()
-    {
-        releaseAll();
-    }
-
-    T* acquire()
-    {
-        if (pool.empty())
-        {
-            // Consider either dynamically growing the pool or return nullptr.
-            // Here's an example of growing the pool:
-            auto object = new T();
-            pool.push(object);
-
-            //std::cout << "\n\nThe object pool is empty";
-            //return nullptr; // if you don't want to grow the pool
-        }
-
-        auto obj = pool.top();
-        pool.pop();
-        return obj;
-    }
-
-
-
-    void adjustPoolSize(size_t newSize)
-    {
-        size_t currentSize = pool.size();
-
-        // If the new size is greater than the current size, allocate more objects
-        if (newSize > currentSize)
-        {
-            allocate(newSize - currentSize);
-        }
-        // If the new size is smaller than the current size, delete extra objects
-        else if (newSize < currentSize)
-        {
-            for (size_t i = 0; i < (currentSize - newSize); ++i)
-            {
-                delete pool.top();
-                pool.pop();
-            }
-        }
-
-    }
-    void release(T* obj) //reset the state of the objects before you reinsert them into the pool.
-    {
-        if (obj) // ensure the object is not nullptr
-        {
-            obj->reset();
-            pool.push(obj);
-        }
-    }
-
-    size_t size()
-    {
-        return(pool.size());
-    }
-
-
-private:
-    std::stack<T*> pool; //data structure of available/reusable pre-allocated  objects. efficient way to add objects (when they are created or returned), and to remove objects (when they are acquired) in constant time, O(1).
-
-    void allocate(size_t _size)
-    {
-        for (size_t i = 0; i < _size; ++i)
-        {
-            auto object = new T();
-            pool.push(object);
-        }
-
-    }
-
-
-};
-
-
-
-
-
+#pragma once
+#include <atomic>
+#include <future>
+#include <thread>
+#include <functional>
+#include <stdexcept>
+#include <stack>
+#include <mutex>
+#include <cstdint>
+#include <type_traits>
+#include "MemoryPlacement.h"
+
+
+template <class T>
+class ObjectPool
+{
+public:
+    ObjectPool() {}
+
+    ObjectPool(size_t size)
+    {
+        for (size_t i = 0; i < size; ++i)
+        {
+            auto object = new T();
+            pool.push(object);
+        }
+    }
+
+    void releaseAll()
+    {
+        while (!pool.empty())
+        {
+            delete pool.top();
+            pool.pop();
+        }
+    }
+
+
+    ~ObjectPool()
+    {
+        releaseAll();
+    }
+
+    T* acquire()
+    {
+        if (pool.empty())
+        {
+            // Consider either dynamically growing the pool or return nullptr.
+            // Here's an example of growing the pool:
+            auto object = new T();
+            pool.push(object);
+
+            //std::cout << "\n\nThe object pool is empty";
+            //return nullptr; // if you don't want to grow the pool
+        }
+
+        auto obj = pool.top();
+        pool.pop();
+        return obj;
+    }
+
+
+
+    void adjustPoolSize(size_t newSize)
+    {
+        size_t currentSize = pool.size();
+
+        // If the new size is greater than the current size, allocate more objects
+        if (newSize > currentSize)
+        {
+            allocate(newSize - currentSize);
+        }
+        // If the new size is smaller than the current size, delete extra objects
+        else if (newSize < currentSize)
+        {
+            for (size_t i = 0; i < (currentSize - newSize); ++i)
+            {
+                delete pool.top();
+                pool.pop();
+            }
+        }
+
+    }
+    void release(T* obj) //reset the state of the objects before you reinsert them into the pool.
+    {
+        if (obj) // ensure the object is not nullptr
+        {
+            obj->reset();
+            pool.push(obj);
+        }
+    }
+
+    size_t size()
+    {
+        return(pool.size());
+    }
+
+
+private:
+    std::stack<T*> pool; //data structure of available/reusable pre-allocated  objects. efficient way to add objects (when they are created or returned), and to remove objects (when they are acquired) in constant time, O(1).
+
+    void allocate(size_t _size)
+    {
+        for (size_t i = 0; i < _size; ++i)
+        {
+            auto object = new T();
+            pool.push(object);
+        }
+
+    }
+
+
+};
+
+
+
+
+
+// ------------- Thread slots for the per-thread caches -------------
+static const int MAX_POOL_THREADS = 128; // live threads with a private cache in each ConcurrentObjectPool, further threads share one locked cache
+
+int AcquirePoolThreadSlot(); // lowest slot no live thread holds (ObjectPool.cpp)
+void ReleasePoolThreadSlot(int slot); // the holding thread exits, its slot can be handed out again
+
+/**
+ * Holds the calling thread's slot and gives it back when the thread exits. Threads come and go: SimulationThread::start
+ * creates a worker per run, and each worker brings up its own OpenMP team. They reuse the slots of threads that left
+ * instead of pushing every later thread onto the locked overflow cache. The next holder of a slot inherits the free
+ * objects its last holder cached in each pool; the registry's lock orders the two threads' accesses to them.
+ */
+struct PoolThreadSlotHolder
+{
+    PoolThreadSlotHolder() : slot(AcquirePoolThreadSlot()) {}
+    ~PoolThreadSlotHolder() { ReleasePoolThreadSlot(slot); }
+    int slot;
+};
+
+inline int PoolThreadSlot() // small id, fixed for the life of the calling thread
+{
+    static thread_local PoolThreadSlotHolder holder;
+    return(holder.slot);
+}
+
+
+
+
+/**
+ * ConcurrentObjectPool: thread-safe pool of T for allocating from inside parallel regions.
+ *
+ * Each thread keeps a private cache of up to two magazines (MAGAZINE_SIZE free objects each), so allocate() and
+ * deallocate() normally touch no shared state. An empty cache refills with a whole magazine, popped from a lock-free
+ * stack of full magazines or, when that is empty, carved from the current slab with one fetch_add. A full cache
+ * pushes its coldest magazine back. Slabs are HUGE_PAGE_SIZE blocks that are never returned until release(), and
+ * the thread that carves a slab is the first to touch it, so under OpenMP the nodes a thread builds land on its socket.
+ *
+ * The two magazine stacks use (tag, index) heads in one 64-bit word, so a pop racing a pop-then-push of the same
+ * magazine fails its compare-exchange instead of corrupting the stack (ABA).
+ *
+ * reset() forgets every object in O(1) by rewinding the slab and magazine cursors and bumping a generation that the
+ * thread caches check lazily; as in NodeArena, skipping T's destructor must be harmless. reset(), reserve() and
+ * release() must not run concurrently with allocation.
+ */
+template <typename T>
+class ConcurrentObjectPool
+{
+public:
+    static const uint32_t MAGAZINE_SIZE = 64;
+
+    ConcurrentObjectPool() { initialize(); }
+    ConcurrentObjectPool(size_t capacity) { initialize(); reserve(capacity); }
+    ~ConcurrentObjectPool()
+    {
+        release();
+        delete[] slabs;
+        delete[] magazineBlocks;
+        FreeAlignedArray(caches);
+    }
+    ConcurrentObjectPool(const ConcurrentObjectPool& other) = delete;
+    ConcurrentObjectPool& operator=(const ConcurrentObjectPool& other) = delete;
+
+    template <typename... Args> T* create(Args&&... args)
+    {
+        return(new (allocate()) T(std::forward<Args>(args)...));
+    }
+
+    void destroy(T* object)
+    {
+        if (object)
+        {
+            object->~T();
+            deallocate(object);
+        }
+    }
+
+    void* allocate() //storage for one T, construct it with placement new
+    {
+        int slot = PoolThreadSlot();
+        if (slot >= MAX_POOL_THREADS)
+        {
+            std::lock_guard<std::mutex> guard(overflowLock);
+            return(allocateFrom(caches[MAX_POOL_THREADS]));
+        }
+        return(allocateFrom(caches[slot]));
+    }
+
+    void deallocate(void* object)
+    {
+        int slot = PoolThreadSlot();
+        if (slot >= MAX_POOL_THREADS)
+        {
+            std::lock_guard<std::mutex> guard(overflowLock);
+            deallocateTo(caches[MAX_POOL_THREADS], object);
+            return;
+        }
+        deallocateTo(caches[slot], object);
+    }
+
+    void reserve(size_t capacity) //map enough slabs up front for capacity objects
+    {
+        if (capacity > 0)
+        {
+            ensureSlab((capacity - 1) / slabObjects);
+        }
+    }
+
+    void reset() //every object handed out so far becomes invalid, the slabs are kept
+    {
+        generation++;
+        slotCursor.store(0, std::memory_order_relaxed);
+        magazineCursor.store(0, std::memory_order_relaxed);
+        fullMagazines.store(EmptyHead(fullMagazines.load(std::memory_order_relaxed)), std::memory_order_relaxed);
+        emptyMagazines.store(EmptyHead(emptyMagazines.load(std::memory_order_relaxed)), std::memory_order_relaxed);
+    }
+
+    void release() //reset and unmap every slab
+    {
+        reset();
+        for (uint32_t s = 0; s < slabCount.load(std::memory_order_relaxed); s++)
+        {
+            FreeLargeArray(slabs[s].load(std::memory_order_relaxed));
+            slabs[s].store(nullptr, std::memory_order_relaxed);
+        }
+        for (uint32_t b = 0; b < magazineBlockCount.load(std::memory_order_relaxed); b++)
+        {
+            FreeAlignedArray(magazineBlocks[b].load(std::memory_order_relaxed));
+            magazineBlocks[b].store(nullptr, std::memory_order_relaxed);
+        }
+        slabCount.store(0, std::memory_order_relaxed);
+        magazineBlockCount.store(0, std::memory_order_relaxed);
+    }
+
+    size_t capacity() const { return((size_t)slabCount.load(std::memory_order_relaxed) * slabObjects); }
+
+private:
+    static const uint32_t MAX_SLABS = 4096; // 8 GB of objects
+    static const uint32_t MAGAZINES_PER_BLOCK = 256;
+    static const uint32_t NO_MAGAZINE = 0xFFFFFFFF;
+
+    typedef typename std::aligned_storage<sizeof(T), alignof(T)>::type Slot;
+
+    struct Magazine
+    {
+        std::atomic<uint32_t> next; // next magazine on the stack this one sits on
+        uint32_t count;
+        void* objects[MAGAZINE_SIZE];
+    };
+
+    struct alignas(MEMORY_ALIGNMENT) ThreadCache
+    {
+        uint64_t generation;
+        uint32_t count;
+        void* objects[2 * MAGAZINE_SIZE]; // objects[count - 1] is the most recently freed, and the next handed out
+    };
+
+    void initialize()
+    {
+        slabObjects = std::max<size_t>(MAGAZINE_SIZE, (HUGE_PAGE_SIZE / sizeof(Slot)) / MAGAZINE_SIZE * MAGAZINE_SIZE);
+        slabs = new std::atomic<unsigned char*>[MAX_SLABS]();
+        magazineBlocks = new std::atomic<Magazine*>[MAX_SLABS]();
+        slabCount.store(0);
+        magazineBlockCount.store(0);
+        slotCursor.store(0);
+        magazineCursor.store(0);
+        fullMagazines.store(NO_MAGAZINE);
+        emptyMagazines.store(NO_MAGAZINE);
+        generation = 1;
+        caches = AllocateAlignedArray<ThreadCache>(MAX_POOL_THREADS + 1); // the extra cache is shared, under overflowLock
+        for (int t = 0; t <= MAX_POOL_THREADS; t++)
+        {
+            caches[t].generation = 0;
+            caches[t].count = 0;
+        }
+    }
+
+    void* allocateFrom(ThreadCache& cache)
+    {
+        if (cache.generation != generation) // the pool was reset since this thread last used it
+        {
+            cache.generation = generation;
+            cache.count = 0;
+        }
+        if (cache.count == 0)
+        {
+            refill(cache);
+        }
+        return(cache.objects[--cache.count]);
+    }
+
+    void deallocateTo(ThreadCache& cache, void* object)
+    {
+        if (cache.generation != generation)
+        {
+            cache.generation = generation;
+            cache.count = 0;
+        }
+        if (cache.count == 2 * MAGAZINE_SIZE) // hand the older half back to the other threads
+        {
+            uint32_t index = popMagazine(emptyMagazines);
+            if (index == NO_MAGAZINE)
+            {
+                index = newMagazine();
+            }
+            Magazine& magazine = magazineAt(index);
+            std::memcpy(magazine.objects, cache.objects, MAGAZINE_SIZE * sizeof(void*));
+            magazine.count = MAGAZINE_SIZE;
+            pushMagazine(fullMagazines, index);
+            std::memmove(cache.objects, cache.objects + MAGAZINE_SIZE, MAGAZINE_SIZE * sizeof(void*));
+            cache.count = MAGAZINE_SIZE;
+        }
+        cache.objects[cache.count++] = object;
+    }
+
+    void refill(ThreadCache& cache)
+    {
+        uint32_t index = popMagazine(fullMagazines);
+        if (index != NO_MAGAZINE)
+        {
+            Magazine& magazine = magazineAt(index);
+            std::memcpy(cache.objects, magazine.objects, magazine.count * sizeof(void*));
+            cache.count = magazine.count;
+            pushMagazine(emptyMagazines, index);
+            return;
+        }
+
+        // Carve a fresh magazine from the slabs, slabObjects is a multiple of MAGAZINE_SIZE so it never straddles two
+        size_t first = slotCursor.fetch_add(MAGAZINE_SIZE, std::memory_order_relaxed);
+        size_t slab = first / slabObjects;
+        ensureSlab(slab);
+        unsigned char* slot = slabs[slab].load(std::memory_order_relaxed) + (first % slabObjects) * sizeof(Slot);
+        for (uint32_t i = 0; i < MAGAZINE_SIZE; i++) // reversed so the objects are handed out in address order
+        {
+            cache.objects[MAGAZINE_SIZE - 1 - i] = slot + i * sizeof(Slot);
+        }
+        cache.count = MAGAZINE_SIZE;
+    }
+
+    void ensureSlab(size_t slab)
+    {
+        if (slab < slabCount.load(std::memory_order_acquire))
+        {
+            return;
+        }
+        std::lock_guard<std::mutex> guard(growLock);
+        while (slabCount.load(std::memory_order_relaxed) <= slab)
+        {
+            uint32_t count = slabCount.load(std::memory_order_relaxed);
+            if (count == MAX_SLABS)
+            {
+                throw std::bad_alloc();
+            }
+            slabs[count].store(AllocateLargeArray<unsigned char>(std::max(HUGE_PAGE_SIZE, slabObjects * sizeof(Slot))), std::memory_order_relaxed); // a whole huge page
+            slabCount.store(count + 1, std::memory_order_release);
+        }
+    }
+
+    uint32_t newMagazine()
+    {
+        uint32_t index = magazineCursor.fetch_add(1, std::memory_order_relaxed);
+        uint32_t block = index / MAGAZINES_PER_BLOCK;
+        if (block >= magazineBlockCount.load(std::memory_order_acquire))
+        {
+            std::lock_guard<std::mutex> guard(growLock);
+            while (magazineBlockCount.load(std::memory_order_relaxed) <= block)
+            {
+                uint32_t count = magazineBlockCount.load(std::memory_order_relaxed);
+                if (count == MAX_SLABS)
+                {
+                    throw std::bad_alloc();
+                }
+                Magazine* magazines = AllocateAlignedArray<Magazine>(MAGAZINES_PER_BLOCK);
+                for (uint32_t m = 0; m < MAGAZINES_PER_BLOCK; m++)
+                {
+                    new (&magazines[m].next) std::atomic<uint32_t>(NO_MAGAZINE);
+                }
+                magazineBlocks[count].store(magazines, std::memory_order_relaxed);
+                magazineBlockCount.store(count + 1, std::memory_order_release);
+            }
+        }
+        return(index);
+    }
+
+    Magazine& magazineAt(uint32_t index)
+    {
+        return(magazineBlocks[index / MAGAZINES_PER_BLOCK].load(std::memory_order_relaxed)[index % MAGAZINES_PER_BLOCK]);
+    }
+
+    // ------------- Tagged lock-free magazine stacks: head = (tag << 32) | index -------------
+    static uint64_t EmptyHead(uint64_t head) { return((((head >> 32) + 1) << 32) | NO_MAGAZINE); }
+
+    void pushMagazine(std::atomic<uint64_t>& stack, uint32_t index)
+    {
+        uint64_t head = stack.load(std::memory_order_relaxed);
+        uint64_t newHead;
+        do
+        {
+            magazineAt(index).next.store((uint32_t)head, std::memory_order_relaxed);
+            newHead = (((head >> 32) + 1) << 32) | index;
+        } while (!stack.compare_exchange_weak(head, newHead, std::memory_order_release, std::memory_order_relaxed));
+    }
+
+    uint32_t popMagazine(std::atomic<uint64_t>& stack)
+    {
+        uint64_t head = stack.load(std::memory_order_acquire);
+        uint64_t newHead;
+        do
+        {
+            uint32_t index = (uint32_t)head;
+            if (index == NO_MAGAZINE)
+            {
+                return(NO_MAGAZINE);
+            }
+            uint32_t next = magazineAt(index).next.load(std::memory_order_relaxed); // may be stale, the tag then fails the exchange
+            newHead = (((head >> 32) + 1) << 32) | next;
+        } while (!stack.compare_exchange_weak(head, newHead, std::memory_order_acquire, std::memory_order_acquire));
+        return((uint32_t)head);
+    }
+
+    size_t slabObjects;
+    std::atomic<unsigned char*>* slabs;
+    std::atomic<Magazine*>* magazineBlocks;
+    std::atomic<uint32_t> slabCount;
+    std::atomic<uint32_t> magazineBlockCount;
+    std::atomic<size_t> slotCursor;     // objects carved from the slabs since the last reset
+    std::atomic<uint32_t> magazineCursor;
+    std::atomic<uint64_t> fullMagazines;
+    std::atomic<uint64_t> emptyMagazines;
+    uint64_t generation;
+    ThreadCache* caches;
+    std::mutex growLock;
+    std::mutex overflowLock;
+};
@@ -0,0 +1,102 @@
+/*
+ * PhaseTimers: wall time of every phase of a step, per thread, over a rolling window of steps
+ *
+ * Description:
+ * A ScopedPhaseTimer placed in a phase adds the time until the end of its scope to the calling thread's total for that
+ * phase in the current step. Threads are told apart by their OpenMP thread number, so a phase timed inside a parallel
+ * region gets one total per team thread and a phase timed in serial code is thread 0, the thread driving the step.
+ * Adding is a store into the thread's own cache line, without atomics or locks.
+ *
+ * At the end of a step, after every parallel region has joined, the driving thread calls CommitPhaseTimings, which
+ * appends each thread's totals to that thread's window of the last PHASE_TIMER_WINDOW steps. It also appends the
+ * slowest thread's total to the phase's "all threads" window: with the threads of a phase running side by side, that
+ * is the time the phase held up the step. GetPhaseStatistics gives the min, mean and 99th percentile of a window and
+ * may be called from any thread, e.g. the renderer, while the simulation keeps stepping.
+ *
+ * The phases follow the pipeline. The bounding box is measured in the same pass as the keys, so Phase_Keys includes
+ * it and Phase_Bounds only counts the separate bounds reduction and root refits. The tree walk and the force kernel
+ * alternate body by body, so each thread sums its share of both and adds them once per step.
+ *
+ * Thread numbers are per team, so the timings are only meaningful while one simulation steps at a time in the process.
+ */
+#pragma once
+#include <omp.h>
+#include <cstddef>
+#include <ostream>
+
+
+
+
+/**
+ * Phases of a step, in pipeline order.
+ */
+enum PhaseEnum
+{
+    Phase_Bounds = 0x0,     // bounding box reduction and root cube refit
+    Phase_Keys = 0x1,       // key generation, with the fused bounding box and first radix histograms
+    Phase_Sort = 0x2,       // key and index sort
+    Phase_Reorder = 0x3,    // gather of the body fields and accelerations by the sort permutation
+    Phase_Build = 0x4,      // node insertion and compaction into the node array
+    Phase_Prune = 0x5,      // removal of empty nodes (serial build only)
+    Phase_Moments = 0x6,    // barycenters and quadrupole moments
+    Phase_Walk = 0x7,       // interaction list traversals
+    Phase_Force = 0x8,      // force kernel over the interaction lists
+    Phase_Integrate = 0x9   // drift and kick + drift
+};
+
+static const int NUM_PHASES = 10;
+static const int PHASE_TIMER_WINDOW = 256; // steps the statistics are taken over
+static const int MAX_PHASE_THREADS = 256; // threads beyond this team size are not timed
+static const int PHASE_ALL_THREADS = -1;
+
+struct PhaseStatistics
+{
+    size_t samples = 0; // steps in the window, at most PHASE_TIMER_WINDOW
+    double minSeconds = 0.0;
+    double meanSeconds = 0.0;
+    double p99Seconds = 0.0;
+    double lastSeconds = 0.0;
+};
+
+
+
+
+// ------------- Phase timers (PhaseTimers.cpp) -------------
+void SetPhaseTimersEnabled(bool enabled); // On by default
+bool PhaseTimersEnabled();
+void AddPhaseTime(PhaseEnum phase, double seconds); // Add to the calling thread's total of phase in this step
+void CommitPhaseTimings(); // End the step: append the totals to the windows, call from the thread driving the step outside parallel regions
+void ResetPhaseTimings(); // Drop every window and the current step's totals
+PhaseStatistics GetPhaseStatistics(PhaseEnum phase, int thread = PHASE_ALL_THREADS); // Statistics of one thread's window, or of the slowest thread per step
+int PhaseTimerThreads(); // Threads with a window, the valid thread arguments are 0 to this - 1
+size_t PhaseTimerSteps(); // Steps committed since the last reset
+const char* PhaseName(PhaseEnum phase); // "bounds", "keys", ...
+void WritePhaseTimingsCSV(std::ostream& out); // One row per phase and thread, the all-threads row first, times in ms
+void WritePhaseTimingsJSON(std::ostream& out);
+
+
+
+
+/**
+ * Adds the wall time of its scope to the calling thread's total of a phase.
+ */
+class ScopedPhaseTimer
+{
+public:
+    explicit ScopedPhaseTimer(PhaseEnum _phase) : phase(_phase), start(PhaseTimersEnabled() ? omp_get_wtime() : -1.0) {}
+    ~ScopedPhaseTimer() { stop(); }
+    void stop() // Add the time so far and disarm, for a phase that ends before the scope does
+    {
+        if (start >= 0.0)
+        {
+            AddPhaseTime(phase, omp_get_wtime() - start);
+            start = -1.0;
+        }
+    }
+    ScopedPhaseTimer(const ScopedPhaseTimer& other) = delete;
+    ScopedPhaseTimer& operator=(const ScopedPhaseTimer& other) = delete;
+
+private:
+    PhaseEnum phase;
+    double start; // negative while the timers are off or once stopped
+};
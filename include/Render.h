@@ -0,0 +1,222 @@
+/*
+ * Render: openFrameworks drawing of the bodies and the hashed octree
+ *
+ * Description:
+ * The simulation core (keys, sorts, tree, force kernels and integrators) does not include ofMain.h, so it builds
+ * without a window or a GL context, e.g. into the headless nbody-sim executable. Everything that draws lives in
+ * this header (and src/Render.cpp), which only the openFrameworks app includes.
+ *
+ * VisualizeBodies issues one immediate-mode ofDrawSphere per body, so at a few thousand bodies drawing costs more
+ * than a step. BodyRenderer draws a snapshot in a single call instead: either one instanced draw of a low-poly
+ * sphere, the instances reading their position and mass from per-instance vertex attributes, or one GL_POINTS draw
+ * of the positions. The buffers persist between frames and only grow, a smaller set of bodies or sprites is written
+ * into the front of them and drawn by count; only the positions are uploaded, and only when a new snapshot arrives.
+ * The masses (and with them the radii) are uploaded again only when the body count changes.
+ *
+ * When zoomed out most bodies cover less than a pixel. The level-of-detail path walks the snapshot's tree with a
+ * camera-distance MAC, the screen-space analogue of BarnesHutHOTMAC: a node whose cube spans fewer than
+ * pixelThreshold pixels as seen from the eye is drawn as one sprite at its barycenter, so the number of sprites
+ * depends on the screen size rather than on N. A sprite's radius grows with the cube root of its mass, so for
+ * unit-mass bodies it keeps the total volume of the spheres it replaces and a single body looks the same as in the
+ * full drawing.
+ *
+ * VisualizeTree draws one immediate-mode box per node, about 2N draw calls, which makes the tree view unusable past a
+ * few thousand bodies. TreeWireframe turns the snapshot's tree into a single GL_LINES vertex buffer instead, 24
+ * vertices per node, built on its own worker thread and drawn in one call. The worker shares the snapshot's node
+ * vector instead of copying it, so handing it a tree costs the render thread nothing. It is rebuilt only when a
+ * snapshot with a new step (and so a new tree) arrives or the depth range changes; in between the same buffer is
+ * redrawn. The depth range selects which levels are drawn, and maxNodes caps the buffer: levels are dropped from the
+ * deepest up until the rest fits, so a capped wireframe still covers the whole domain evenly.
+ */
+#pragma once
+#include "ofMain.h"
+#include "Body.h"
+#include "BodySystem.h"
+#include "LinearHashedOctree.h"
+#include "SimulationThread.h"
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+
+
+
+//Helper functions visualize bodies
+static inline void VisualizeBodies(Body*& bodies, size_t numBodies);
+static inline void VisualizeBodies(const BodySystem& bodies);
+static inline void VisualizeBodies(const BodySnapshot& snapshot);
+
+
+//Helper functions visualize the tree, the octant bounds of every node
+static inline void VisualizeTree(const LinearHashedOctree& LHTree);
+static inline void VisualizeNode(const HOTNode* node);
+static inline void VisualizeTree(const BodySnapshot& snapshot); // the node bounds the snapshot captured, one draw call per node; TreeWireframe draws them in one
+static inline void VisualizeOctant(const OctantBounds& bounds);
+
+
+
+
+/**
+ * How BodyRenderer draws the bodies.
+ */
+enum BodyRenderEnum
+{
+    BodyRender_Immediate = 0x0, // VisualizeBodies, one ofDrawSphere per body
+    BodyRender_Instanced = 0x1, // one instanced draw of an icosphere, radius from the mass
+    BodyRender_Points = 0x2     // one GL_POINTS draw, fixed point size
+};
+
+static const int BODY_POSITION_ATTRIBUTE = 4; // attribute locations of the per-instance data, after openFrameworks' position, color, normal and texcoord
+static const int BODY_MASS_ATTRIBUTE = 5;
+static const float BODY_RADIUS_PER_MASS = 4.0f; // same radius as VisualizeBodies
+static const float BODY_POINT_SIZE = 2.0f;
+static const float LOD_PIXEL_THRESHOLD = 1.0f; // nodes narrower than this on screen are drawn as one sprite
+static const size_t WIREFRAME_MAX_NODES = 1 << 15; // 786432 line vertices, 9 MB
+
+class BodyRenderer
+{
+public:
+    BodyRenderer();
+
+    void setup(); // Compile the sphere shader and upload the sphere mesh, needs the GL context
+    void draw(const BodySnapshot& snapshot, BodyRenderEnum mode);
+    void drawLevelOfDetail(const BodySnapshot& snapshot, BodyRenderEnum mode, const Vec3F& eye, float focalPixels, float pixelThreshold); // eye in world coordinates, focalPixels = pixels per unit of size / distance; falls back to draw() without a captured tree
+    size_t drawnCount() const { return(lastDrawnCount); } // spheres or points the last draw produced
+
+private:
+    void drawSprites(const Vec3F* positions, const float* masses, size_t count, size_t step, BodyRenderEnum mode); // step SIZE_MAX: not a snapshot's bodies, upload everything
+
+    ofVbo sphereVbo; // icosphere vertices and indices, plus the per-instance position and mass attributes
+    ofVbo pointVbo;
+    ofShader sphereShader;
+    int sphereIndices;
+    size_t instanceCapacity; // bodies the instance attributes were allocated for, the most drawn so far
+    size_t pointCapacity;
+    size_t instanceCount; // bodies last uploaded to each buffer
+    size_t pointCount;
+    size_t instanceStep; // stepCount of the snapshot last uploaded to each buffer, SIZE_MAX after level-of-detail sprites
+    size_t pointStep;
+    size_t lastDrawnCount;
+    std::vector<Vec3F> lodPositions; // the sprites the level-of-detail walk selected
+    std::vector<float> lodMasses;
+    bool ready;
+};
+
+class TreeWireframe
+{
+public:
+    TreeWireframe();
+    ~TreeWireframe();
+    TreeWireframe(const TreeWireframe& other) = delete;
+    TreeWireframe& operator=(const TreeWireframe& other) = delete;
+
+    void update(const BodySnapshot& snapshot, uint32_t minDepth, uint32_t maxDepth, size_t maxNodes); // Hand the snapshot's tree to the worker if it is new or the filter changed, and the worker is idle
+    void draw(); // Upload the newest finished wireframe, if any, and draw the current one in a single GL_LINES call
+    size_t nodeCount() const { return(drawnNodes); } // nodes in the buffer being drawn
+    uint32_t depthLimit() const { return(drawnDepth); } // deepest level in it, below maxDepth when the cap cut levels off
+
+private:
+    void run();
+
+    std::thread worker;
+    std::mutex lock; // guards the fields up to resultDepth
+    std::condition_variable wake;
+    bool stopping;
+    bool busy; // a job is queued or being built, the worker owns jobNodes
+    bool resultReady;
+    std::shared_ptr<const std::vector<SnapshotNode>> jobNodes;
+    uint32_t jobMinDepth;
+    uint32_t jobMaxDepth;
+    size_t jobMaxNodes;
+    std::vector<Vec3F> resultVertices;
+    size_t resultNodes;
+    uint32_t resultDepth;
+
+    // Render thread only
+    size_t requestedStep; // stepCount of the tree last handed to the worker
+    uint32_t requestedMinDepth;
+    uint32_t requestedMaxDepth;
+    size_t requestedMaxNodes;
+    std::vector<Vec3F> uploadVertices;
+    ofVbo lineVbo;
+    size_t vertexCapacity;
+    size_t vertexCount;
+    size_t drawnNodes;
+    uint32_t drawnDepth;
+};
+
+
+
+
+// ------------- Level of detail and wireframe (Render.cpp) -------------
+void SelectLevelOfDetail(const BodySnapshot& snapshot, const Vec3F& eye, float focalPixels, float pixelThreshold, std::vector<Vec3F>& positions, std::vector<float>& masses); // The sprites of the camera-distance MAC walk, masses already cube rooted
+size_t BuildTreeWireframe(const std::vector<SnapshotNode>& nodes, uint32_t minDepth, uint32_t maxDepth, size_t maxNodes, std::vector<Vec3F>& vertices, uint32_t& depthLimit); // GL_LINES vertices of the cube edges of the selected nodes, returns the number of nodes
+
+
+
+
+inline void VisualizeBodies(Body*& bodies, size_t numBodies)
+{
+    ofSetColor(31.875, 223.125, 63.75);
+    ofFill();
+    for (size_t i = 0; i < numBodies; i++)
+    {
+        ofDrawSphere(bodies[i].position.x, bodies[i].position.y, bodies[i].position.z, bodies[i].mass * 4);
+    }
+}
+
+inline void VisualizeBodies(const BodySystem& bodies)
+{
+    ofSetColor(31.875, 223.125, 63.75);
+    ofFill();
+    for (size_t i = 0; i < bodies.numBodies; i++)
+    {
+        ofDrawSphere(bodies.x[i], bodies.y[i], bodies.z[i], bodies.m[i] * 4);
+    }
+}
+
+inline void VisualizeBodies(const BodySnapshot& snapshot)
+{
+    ofSetColor(31.875, 223.125, 63.75);
+    ofFill();
+    for (size_t i = 0; i < snapshot.positions.size(); i++)
+    {
+        ofDrawSphere(snapshot.positions[i].x, snapshot.positions[i].y, snapshot.positions[i].z, snapshot.masses[i] * 4);
+    }
+}
+
+inline void VisualizeTree(const LinearHashedOctree& LHTree)
+{
+    for (uint32_t n = 0; n < LHTree.numNodes; n++)
+    {
+        VisualizeNode(&LHTree.nodeArray[n]);
+    }
+    LHTree.nodes.forEach([](const spatialKey& key, HOTNode* node) { VisualizeNode(node); });
+}
+
+inline void VisualizeNode(const HOTNode* node)
+{
+    if (node == nullptr)
+    {
+        return;
+    }
+    VisualizeOctant(node->nodeBounds);
+}
+
+inline void VisualizeTree(const BodySnapshot& snapshot)
+{
+    for (size_t n = 0; n < snapshot.nodes->size(); n++)
+    {
+        const SnapshotNode& node = (*snapshot.nodes)[n];
+        VisualizeOctant(OctantBounds(Vec3D(node.center.x, node.center.y, node.center.z), node.size));
+    }
+}
+
+inline void VisualizeOctant(const OctantBounds& bounds)
+{
+    ofNoFill();
+    ofSetColor(255, 255, 255, 63.75);
+    ofDrawBox(bounds.center.x, bounds.center.y, bounds.center.z, 2.0 * bounds.size); //uses the passed-in coordinates as the center of the cube, size is the half-width
+}
@@ -0,0 +1,92 @@
+/*
+ * Simulation: the n-body system and everything one time step of it needs, without any rendering
+ *
+ * Description:
+ * Simulation owns the bodies, their persistent accelerations and sort buffers, the root cube and the hashed octree,
+ * and advances them one time step at a time: re-key and re-sort the bodies, drift half a step, build the tree,
+ * compute the accelerations and kick + drift the rest of the step. It depends on no windowing or GL code, so the
+ * openFrameworks app and the headless nbody-sim executable drive the same engine; the app only draws the bodies and
+ * the tree the last step() left behind.
+ *
+ * The size of the OpenMP team and the memory placement are process wide (SetExecutionConfig, SetMemoryPlacement) and
+ * are set by the caller before initialize(), so the first-touch placement of the arrays uses the final team.
+ *
+ * Every step() ends with CommitPhaseTimings, so the phase timers (PhaseTimers.h) hold the last steps of this simulation.
+ */
+#pragma once
+#include "Containers.h"
+#include "MortonKeys.h"
+#include "Body.h"
+#include "BodySystem.h"
+#include "LinearHashedOctree.h"
+#include "PhaseTimers.h"
+#include "TraversalStatistics.h"
+#include <cstdint>
+
+
+
+
+/**
+ * Initial conditions, each with unit masses and G = 1 as in the force kernel, spread over about IC_RADIUS:
+ *      IC_UniformCube: positions uniform in a cube of half-width IC_RADIUS, velocities uniform in [-1, 1]
+ *      IC_Plummer: Plummer sphere of scale radius IC_RADIUS / 4 in virial equilibrium, truncated at 10 scale radii
+ *      IC_Disk: thin disk of radius IC_RADIUS, uniform surface density, every body on a circular orbit around the center
+ */
+enum InitialConditionEnum
+{
+    IC_UniformCube = 0x0,
+    IC_Plummer = 0x1,
+    IC_Disk = 0x2
+};
+
+static const double IC_RADIUS = 1500.0;
+
+struct SimulationParams
+{
+    size_t numBodies = 10000;
+    double theta = 1.0; // Barnes-Hut opening criterion
+    double dt = 0.01;
+    InitialConditionEnum initialCondition = IC_UniformCube;
+    uint32_t seed = 1; // the same seed, body count and IC always give the same bodies
+    KeyOrderingEnum keyOrdering = Order_Morton; // space-filling curve the bodies are ordered along
+    bool adaptiveSort = true; // repair last step's order instead of re-sorting from scratch
+    NodeLayoutEnum nodeLayout = NodeLayout_BreadthFirst; // layout of the compacted node array the force walks read
+};
+
+
+
+
+class Simulation
+{
+public:
+    Simulation();
+    ~Simulation();
+    Simulation(const Simulation& other) = delete;
+    Simulation& operator=(const Simulation& other) = delete;
+
+    void initialize(const SimulationParams& _params); // Generate params.numBodies bodies, fit the root cube around them and sort them
+    void step(); // Advance the bodies by params.dt, leaving the tree of the half-step positions built
+
+
+    SimulationParams params; // theta, dt, keyOrdering and adaptiveSort may be changed between steps
+    BodySystem bodies; // positions, velocities, masses and keys in separate arrays
+    Vec3D* bodiesAccelerations; // persistent, permuted along with the bodies whenever they are re-sorted
+    BodySystemSortBuffers bodySortBuffers;
+    AdaptiveSortEnum lastSortResult;
+    OctantBounds rootNodeBounds;
+    LinearHashedOctree LHTree;
+    TraversalStatistics traversalStatistics; // interactions and tree walks of the last step's force pass
+    size_t stepCount;
+    double time;
+
+private:
+    void sortBodies();
+};
+
+
+
+
+// ------------- Initial conditions (Simulation.cpp) -------------
+void GenerateInitialConditions(BodySystem& bodies, size_t numBodies, InitialConditionEnum initialCondition, uint32_t seed); // Resize and fill the bodies
+const char* InitialConditionName(InitialConditionEnum initialCondition);
+bool ParseInitialCondition(const char* name, InitialConditionEnum& initialCondition); // "cube", "plummer" or "disk", false for anything else
@@ -0,0 +1,143 @@
+/*
+ * SimulationThread: the simulation stepping on its own thread, publishing snapshots for the renderer
+ *
+ * Description:
+ * A Simulation step (sort, build, force, integrate) takes far longer than a frame at large N, so stepping it from
+ * the draw loop ties the frame rate, and with it the camera, to the step time. SimulationThread owns a Simulation
+ * and steps it back to back on a worker thread; the worker is the master of the OpenMP team every phase uses, so
+ * the team is sized and pinned from it (SetExecutionConfig is per calling thread) and the render thread stays free.
+ *
+ * After every step the worker copies what the renderer needs (float positions, masses, optionally the tree) into a
+ * BodySnapshot and publishes it through a triple buffer: the worker always owns one slot to fill, the
+ * renderer always owns the slot it is drawing, and the third holds the newest complete snapshot. Publishing and
+ * picking up are a single atomic exchange each, so neither side ever waits for the other; the renderer simply
+ * redraws its snapshot when no newer one has arrived, and steps the renderer never saw are overwritten.
+ *
+ * Parameter and thread-team changes from the UI are queued under a mutex and applied by the worker between steps.
+ */
+#pragma once
+#include "Containers.h"
+#include "HashedNode.h"
+#include "ExecutionConfig.h"
+#include "Simulation.h"
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+
+
+
+/**
+ * One node of a snapshot's tree. The nodes are stored in pre-order (Morton order of the children), so a node's
+ * first child is the next node and skip is one past its subtree: a leaf has skip == its index + 1, and a walk that
+ * accepts a node continues at skip, as in the depth-first node layout.
+ */
+struct SnapshotNode
+{
+    Vec3F baryCenter;
+    float mass;
+    Vec3F center; // the node's cube spans center +/- size
+    float size;
+    uint32_t skip;
+    uint32_t depth; // 0 for the root
+};
+
+/**
+ * What the renderer sees of one step. Immutable once published, until the renderer lets go of it.
+ */
+struct BodySnapshot
+{
+    std::vector<Vec3F> positions;
+    std::vector<float> masses;
+    std::shared_ptr<std::vector<SnapshotNode>> nodes = std::make_shared<std::vector<SnapshotNode>>(); // the step's tree, filled only while tree capture is on; shared so the wireframe worker can keep it past the snapshot
+    OctantBounds rootBounds;
+    SimulationParams params; // the parameters the step ran with
+    AdaptiveSortEnum lastSortResult = Sort_Radix;
+    TraversalStatistics traversal; // the step's force pass
+    size_t stepCount = 0;
+    double time = 0.0;
+    double stepSeconds = 0.0; // wall time of the step, snapshot copy excluded
+};
+
+
+
+
+/**
+ * Lock-free single producer, single consumer triple buffer. The producer fills writeBuffer() and publish()es it,
+ * the consumer calls readBuffer() to get the newest published slot, which stays untouched until its next call.
+ */
+template <typename T>
+class TripleBuffer
+{
+public:
+    TripleBuffer() : middle(1), back(2), front(0) {}
+    TripleBuffer(const TripleBuffer& other) = delete;
+    TripleBuffer& operator=(const TripleBuffer& other) = delete;
+
+    T& writeBuffer() { return(slots[back]); }
+    void publish() // hand the filled slot over and take the middle one, whatever the consumer left in it
+    {
+        back = middle.exchange(back | FRESH_BIT, std::memory_order_acq_rel) & INDEX_MASK;
+    }
+
+    const T& readBuffer()
+    {
+        if (middle.load(std::memory_order_relaxed) & FRESH_BIT)
+        {
+            front = middle.exchange(front, std::memory_order_acq_rel) & INDEX_MASK;
+        }
+        return(slots[front]);
+    }
+
+private:
+    static const int INDEX_MASK = 0x3;
+    static const int FRESH_BIT = 0x4; // set while the middle slot holds a snapshot the consumer has not picked up
+
+    T slots[3];
+    std::atomic<int> middle; // slot index and FRESH_BIT, the only state both sides touch
+    int back;  // producer only
+    int front; // consumer only
+};
+
+
+
+
+class SimulationThread
+{
+public:
+    SimulationThread();
+    ~SimulationThread();
+    SimulationThread(const SimulationThread& other) = delete;
+    SimulationThread& operator=(const SimulationThread& other) = delete;
+
+    void start(const SimulationParams& params, const ExecutionConfig& config); // Size the team, initialize the bodies on the worker and publish the first snapshot, returns once it is available
+    void stop(); // Finish the current step and join the worker
+
+    void setParams(const SimulationParams& params); // theta, dt, keyOrdering, adaptiveSort and nodeLayout take effect at the next step, the rest is ignored
+    SimulationParams params() const; // including any change not yet applied
+    void setExecutionConfig(const ExecutionConfig& config); // the worker resizes and re-pins its team before the next step
+    ExecutionConfig executionConfig() const; // the requested config while a change is pending, the applied one otherwise
+    void setCaptureTree(bool capture); // whether the following snapshots carry the tree
+
+    const BodySnapshot& latestSnapshot(); // Render thread only: newest published snapshot, valid until the next call
+
+private:
+    void run();
+    void applyPendingChanges();
+    void publishSnapshot(double stepSeconds);
+
+    Simulation simulation; // touched by the worker only
+    TripleBuffer<BodySnapshot> snapshots;
+    std::thread worker;
+    std::atomic<bool> running;
+    std::atomic<bool> captureTree;
+
+    mutable std::mutex commandLock; // guards everything below
+    SimulationParams requestedParams;
+    ExecutionConfig requestedConfig;
+    ExecutionConfig appliedConfig;
+    bool paramsChanged;
+    bool configChanged;
+};
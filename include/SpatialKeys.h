@@ -0,0 +1,158 @@
+/*
+ * SpatialKeys: integer types used to hold Morton/Hilbert keys
+ *
+ * Description:
+ * A spatial key is a leading sentinel bit followed by one 3-bit digit per tree level, so the key width bounds
+ * the depth of the octree. 64-bit keys give 21 levels, which a tightly clustered distribution (or two bodies
+ * closer than 2^-21 of the domain) exhausts quickly. SpatialKeyTraits maps a key width to its integer type and
+ * level count; UInt128Key is a portable 128-bit unsigned integer (MSVC has no __int128) giving 42 levels.
+ *
+ * Only the operations the encoders, sorts and the hashed octree use are provided: shifts, bitwise operators,
+ * add/subtract, comparisons, std::hash and printing. KeyLow64/KeyRadixDigit/KeyHighestBit give both key widths a
+ * common way to read the low bits, the byte a radix pass sorts on and the position of the sentinel.
+ */
+#pragma once
+#include <cstdint>
+#include <cstddef>
+#include <functional>
+#include <ostream>
+#include <iomanip>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+
+
+
+class UInt128Key
+{
+public:
+    constexpr UInt128Key() : lo(0), hi(0) {}
+    constexpr UInt128Key(uint64_t _lo) : lo(_lo), hi(0) {}
+    constexpr UInt128Key(uint64_t _hi, uint64_t _lo) : lo(_lo), hi(_hi) {}
+
+    explicit operator bool() const { return((lo | hi) != 0); }
+    explicit operator uint64_t() const { return(lo); } // truncates to the low 64 bits
+
+    friend UInt128Key operator<<(const UInt128Key& a, int shift)
+    {
+        if (shift == 0) return(a);
+        if (shift >= 128) return(UInt128Key());
+        if (shift >= 64) return(UInt128Key(a.lo << (shift - 64), 0));
+        return(UInt128Key((a.hi << shift) | (a.lo >> (64 - shift)), a.lo << shift));
+    }
+    friend UInt128Key operator>>(const UInt128Key& a, int shift)
+    {
+        if (shift == 0) return(a);
+        if (shift >= 128) return(UInt128Key());
+        if (shift >= 64) return(UInt128Key(0, a.hi >> (shift - 64)));
+        return(UInt128Key(a.hi >> shift, (a.lo >> shift) | (a.hi << (64 - shift))));
+    }
+    friend UInt128Key operator|(const UInt128Key& a, const UInt128Key& b) { return(UInt128Key(a.hi | b.hi, a.lo | b.lo)); }
+    friend UInt128Key operator&(const UInt128Key& a, const UInt128Key& b) { return(UInt128Key(a.hi & b.hi, a.lo & b.lo)); }
+    friend UInt128Key operator^(const UInt128Key& a, const UInt128Key& b) { return(UInt128Key(a.hi ^ b.hi, a.lo ^ b.lo)); }
+    friend UInt128Key operator~(const UInt128Key& a) { return(UInt128Key(~a.hi, ~a.lo)); }
+    friend UInt128Key operator+(const UInt128Key& a, const UInt128Key& b)
+    {
+        uint64_t sumLo = a.lo + b.lo;
+        return(UInt128Key(a.hi + b.hi + (sumLo < a.lo ? 1 : 0), sumLo));
+    }
+    friend UInt128Key operator-(const UInt128Key& a, const UInt128Key& b)
+    {
+        return(UInt128Key(a.hi - b.hi - (a.lo < b.lo ? 1 : 0), a.lo - b.lo));
+    }
+
+    UInt128Key& operator<<=(int shift) { *this = *this << shift; return(*this); }
+    UInt128Key& operator>>=(int shift) { *this = *this >> shift; return(*this); }
+    UInt128Key& operator|=(const UInt128Key& b) { hi |= b.hi; lo |= b.lo; return(*this); }
+    UInt128Key& operator&=(const UInt128Key& b) { hi &= b.hi; lo &= b.lo; return(*this); }
+    UInt128Key& operator^=(const UInt128Key& b) { hi ^= b.hi; lo ^= b.lo; return(*this); }
+
+    friend bool operator==(const UInt128Key& a, const UInt128Key& b) { return(a.hi == b.hi && a.lo == b.lo); }
+    friend bool operator!=(const UInt128Key& a, const UInt128Key& b) { return(!(a == b)); }
+    friend bool operator<(const UInt128Key& a, const UInt128Key& b) { return(a.hi < b.hi || (a.hi == b.hi && a.lo < b.lo)); }
+    friend bool operator>(const UInt128Key& a, const UInt128Key& b) { return(b < a); }
+    friend bool operator<=(const UInt128Key& a, const UInt128Key& b) { return(!(b < a)); }
+    friend bool operator>=(const UInt128Key& a, const UInt128Key& b) { return(!(a < b)); }
+
+    friend std::ostream& operator<<(std::ostream& os, const UInt128Key& a) // printed in hex, decimal would need a 128-bit division
+    {
+        std::ios_base::fmtflags flags = os.flags();
+        os << "0x" << std::hex << std::setfill('0') << std::setw(16) << a.hi << std::setw(16) << a.lo;
+        os.flags(flags);
+        return(os);
+    }
+
+    uint64_t lo;
+    uint64_t hi;
+};
+
+namespace std
+{
+    template <> struct hash<UInt128Key>
+    {
+        size_t operator()(const UInt128Key& key) const
+        {
+            return(std::hash<uint64_t>()(key.lo ^ (key.hi * 0x9E3779B97F4A7C15ull)));
+        }
+    };
+}
+
+
+
+
+// ------------- Key width selection -------------
+/**
+ * SpatialKeyTraits<KeyBits>: the integer type holding a key of the given width and the number of tree levels
+ * (bits per axis) it encodes. One bit is left for the sentinel, so levels = (KeyBits - 1) / 3 rounded down.
+ */
+template <int KeyBits> struct SpatialKeyTraits;
+
+template <> struct SpatialKeyTraits<64>
+{
+    typedef uint64_t KeyType;
+    static const int levels = 21;
+};
+
+template <> struct SpatialKeyTraits<128>
+{
+    typedef UInt128Key KeyType;
+    static const int levels = 42;
+};
+
+
+
+
+// ------------- Width independent access to key bits -------------
+static inline uint64_t KeyLow64(uint64_t key) { return(key); }
+static inline uint64_t KeyLow64(const UInt128Key& key) { return(key.lo); }
+
+static inline size_t KeyRadixDigit(uint64_t key, int shift) { return((size_t)((key >> shift) & 0xFF)); } // byte of the key starting at bit 'shift'
+static inline size_t KeyRadixDigit(const UInt128Key& key, int shift) { return((size_t)((key >> shift).lo & 0xFF)); }
+
+static inline int KeyHighestBit(uint64_t key) // index of the most significant set bit, key must not be 0
+{
+#if defined(_MSC_VER)
+    unsigned long bit;
+    _BitScanReverse64(&bit, key);
+    return((int)bit);
+#else
+    return(63 - __builtin_clzll(key));
+#endif
+}
+static inline int KeyHighestBit(const UInt128Key& key) { return(key.hi != 0 ? 64 + KeyHighestBit(key.hi) : KeyHighestBit(key.lo)); }
+
+static inline void PrintKeyBinary(std::ostream& os, uint64_t key, int numBits) // most significant of the low numBits first
+{
+    for (int bit = numBits - 1; bit >= 0; bit--)
+    {
+        os << (char)('0' + ((key >> bit) & 1));
+    }
+}
+static inline void PrintKeyBinary(std::ostream& os, const UInt128Key& key, int numBits)
+{
+    for (int bit = numBits - 1; bit >= 0; bit--)
+    {
+        os << (char)('0' + ((key >> bit).lo & 1));
+    }
+}
@@ -0,0 +1,157 @@
+/*
+ * TraversalStatistics: what the tree walks of one force pass did
+ *
+ * Description:
+ * theta trades accuracy for interactions, and the leaf size and node layout decide how many nodes a walk has to touch
+ * to find them. TraversalStatistics counts both for every body of a force pass:
+ *      body-cell interactions: with nodes of more than one body, monopole plus quadrupole terms
+ *      body-body interactions: with single-body leaves, the direct sum
+ *      visited nodes: nodes the walk tested, every MAC evaluation plus the root
+ *      walk stack depth: the longest the breadth-first walk list grew, 0 for the stackless depth-first walk
+ * as totals, maxima and log2 histograms over the bodies. The compacted tree is walked by node index, so there are no
+ * hash lookups to count.
+ *
+ * Each thread of the force pass counts its bodies into its own TraversalStatistics, in plain integers, and merges it
+ * once at the end into a TraversalAccumulator shared by the pass. Merging is a relaxed atomic add per field (a
+ * compare-exchange loop for the maxima), so the threads never wait on a lock or on each other.
+ */
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+
+
+
+static const int TRAVERSAL_HISTOGRAM_BINS = 32; // bin 0 counts the bodies with a value of 0, bin b those in [2^(b - 1), 2^b)
+
+/**
+ * One body's walk, filled by TraverseHOTInteractionList.
+ */
+struct WalkCounts
+{
+    uint64_t bodyCellInteractions;
+    uint64_t bodyBodyInteractions;
+    uint64_t visitedNodes;
+    uint32_t stackDepth;
+};
+
+static inline int TraversalHistogramBin(uint64_t value)
+{
+    int bin = 0;
+    while (value != 0 && bin < TRAVERSAL_HISTOGRAM_BINS - 1)
+    {
+        value >>= 1;
+        bin++;
+    }
+    return(bin);
+}
+
+struct TraversalStatistics
+{
+    size_t numBodies = 0;
+    uint64_t bodyCellInteractions = 0;
+    uint64_t bodyBodyInteractions = 0;
+    uint64_t visitedNodes = 0;
+    uint64_t maxInteractions = 0; // longest interaction list of a body
+    uint64_t maxVisitedNodes = 0;
+    uint32_t maxStackDepth = 0;
+    uint64_t interactionHistogram[TRAVERSAL_HISTOGRAM_BINS] = {}; // bodies by interaction list length
+    uint64_t visitedHistogram[TRAVERSAL_HISTOGRAM_BINS] = {}; // bodies by visited nodes
+
+    void addBody(const WalkCounts& counts)
+    {
+        uint64_t interactions = counts.bodyCellInteractions + counts.bodyBodyInteractions;
+        numBodies++;
+        bodyCellInteractions += counts.bodyCellInteractions;
+        bodyBodyInteractions += counts.bodyBodyInteractions;
+        visitedNodes += counts.visitedNodes;
+        maxInteractions = (interactions > maxInteractions) ? interactions : maxInteractions;
+        maxVisitedNodes = (counts.visitedNodes > maxVisitedNodes) ? counts.visitedNodes : maxVisitedNodes;
+        maxStackDepth = (counts.stackDepth > maxStackDepth) ? counts.stackDepth : maxStackDepth;
+        interactionHistogram[TraversalHistogramBin(interactions)]++;
+        visitedHistogram[TraversalHistogramBin(counts.visitedNodes)]++;
+    }
+
+    uint64_t interactions() const { return(bodyCellInteractions + bodyBodyInteractions); }
+    double interactionsPerBody() const { return(numBodies > 0 ? (double)interactions() / numBodies : 0.0); }
+    double visitedNodesPerBody() const { return(numBodies > 0 ? (double)visitedNodes / numBodies : 0.0); }
+};
+
+
+
+
+/**
+ * The totals of one force pass, merged into by every thread of it.
+ */
+class TraversalAccumulator
+{
+public:
+    TraversalAccumulator() : numBodies(0), bodyCellInteractions(0), bodyBodyInteractions(0), visitedNodes(0), maxInteractions(0), maxVisitedNodes(0), maxStackDepth(0)
+    {
+        for (int b = 0; b < TRAVERSAL_HISTOGRAM_BINS; b++)
+        {
+            interactionHistogram[b] = 0;
+            visitedHistogram[b] = 0;
+        }
+    }
+    TraversalAccumulator(const TraversalAccumulator& other) = delete;
+    TraversalAccumulator& operator=(const TraversalAccumulator& other) = delete;
+
+    void merge(const TraversalStatistics& local) // Any thread, lock-free
+    {
+        numBodies.fetch_add(local.numBodies, std::memory_order_relaxed);
+        bodyCellInteractions.fetch_add(local.bodyCellInteractions, std::memory_order_relaxed);
+        bodyBodyInteractions.fetch_add(local.bodyBodyInteractions, std::memory_order_relaxed);
+        visitedNodes.fetch_add(local.visitedNodes, std::memory_order_relaxed);
+        updateMax(maxInteractions, local.maxInteractions);
+        updateMax(maxVisitedNodes, local.maxVisitedNodes);
+        updateMax(maxStackDepth, (uint64_t)local.maxStackDepth);
+        for (int b = 0; b < TRAVERSAL_HISTOGRAM_BINS; b++)
+        {
+            if (local.interactionHistogram[b] != 0)
+            {
+                interactionHistogram[b].fetch_add(local.interactionHistogram[b], std::memory_order_relaxed);
+            }
+            if (local.visitedHistogram[b] != 0)
+            {
+                visitedHistogram[b].fetch_add(local.visitedHistogram[b], std::memory_order_relaxed);
+            }
+        }
+    }
+
+    void store(TraversalStatistics& statistics) const // After the threads have joined
+    {
+        statistics.numBodies = (size_t)numBodies.load(std::memory_order_relaxed);
+        statistics.bodyCellInteractions = bodyCellInteractions.load(std::memory_order_relaxed);
+        statistics.bodyBodyInteractions = bodyBodyInteractions.load(std::memory_order_relaxed);
+        statistics.visitedNodes = visitedNodes.load(std::memory_order_relaxed);
+        statistics.maxInteractions = maxInteractions.load(std::memory_order_relaxed);
+        statistics.maxVisitedNodes = maxVisitedNodes.load(std::memory_order_relaxed);
+        statistics.maxStackDepth = (uint32_t)maxStackDepth.load(std::memory_order_relaxed);
+        for (int b = 0; b < TRAVERSAL_HISTOGRAM_BINS; b++)
+        {
+            statistics.interactionHistogram[b] = interactionHistogram[b].load(std::memory_order_relaxed);
+            statistics.visitedHistogram[b] = visitedHistogram[b].load(std::memory_order_relaxed);
+        }
+    }
+
+private:
+    static void updateMax(std::atomic<uint64_t>& target, uint64_t value)
+    {
+        uint64_t current = target.load(std::memory_order_relaxed);
+        while (value > current && !target.compare_exchange_weak(current, value, std::memory_order_relaxed))
+        {
+        }
+    }
+
+    std::atomic<uint64_t> numBodies;
+    std::atomic<uint64_t> bodyCellInteractions;
+    std::atomic<uint64_t> bodyBodyInteractions;
+    std::atomic<uint64_t> visitedNodes;
+    std::atomic<uint64_t> maxInteractions;
+    std::atomic<uint64_t> maxVisitedNodes;
+    std::atomic<uint64_t> maxStackDepth;
+    std::atomic<uint64_t> interactionHistogram[TRAVERSAL_HISTOGRAM_BINS];
+    std::atomic<uint64_t> visitedHistogram[TRAVERSAL_HISTOGRAM_BINS];
+};
@@ -6,21 +6,22 @@
 #include "C:\ECE-270\of_v0.11.2_vs2017_release\of_v0.11.2_vs2017_release\apps\myApps\nBody Physics 5_6\MortonKeys.h"
 #include "C:\ECE-270\of_v0.11.2_vs2017_release\of_v0.11.2_vs2017_release\apps\myApps\nBody Physics 5_6\ObjectPool.h"
 #include "C:\ECE-270\of_v0.11.2_vs2017_release\of_v0.11.2_vs2017_release\apps\myApps\nBody Physics 5_6\Body.h"
+#include "C:\ECE-270\of_v0.11.2_vs2017_release\of_v0.11.2_vs2017_release\apps\myApps\nBody Physics 5_6\BodySystem.h"
 #include "C:\ECE-270\of_v0.11.2_vs2017_release\of_v0.11.2_vs2017_release\apps\myApps\nBody Physics 5_6\HashedNode.h"
 #include "C:\ECE-270\of_v0.11.2_vs2017_release\of_v0.11.2_vs2017_release\apps\myApps\nBody Physics 5_6\LinearHashedOctree.h"
+#include "C:\ECE-270\of_v0.11.2_vs2017_release\of_v0.11.2_vs2017_release\apps\myApps\nBody Physics 5_6\PhaseTimers.h"
+#include "C:\ECE-270\of_v0.11.2_vs2017_release\of_v0.11.2_vs2017_release\apps\myApps\nBody Physics 5_6\Simulation.h"
+#include "C:\ECE-270\of_v0.11.2_vs2017_release\of_v0.11.2_vs2017_release\apps\myApps\nBody Physics 5_6\SimulationThread.h"
+#include "C:\ECE-270\of_v0.11.2_vs2017_release\of_v0.11.2_vs2017_release\apps\myApps\nBody Physics 5_6\Render.h"
 
 
 
 class ofApp : public ofBaseApp
 {
-	size_t numBodies;
-	Body* bodies;
-	OctantBounds rootNodeBounds;
-	LinearHashedOctree LHTree;
+	SimulationThread simulationThread; // steps the simulation on its own team, draw() renders its latest snapshot
+	ExecutionConfig executionConfig; // OpenMP team of the simulation thread: one thread per core, spread across the sockets, unless changed
 
-	double theta = 1;
-	long interactionCount = 0, numInteractions = 0;
-	double dt = 0.01;
+	long interactionCount = 0, numInteractions = 0; // interactions of the drawn step: in total, and per body (rounded)
 
 
 public:
@@ -39,6 +40,12 @@ public:
 	float verticalAngle = 0.0;
 	bool isDragging = false;
 	bool visualizeTree = false;
+	TreeWireframe treeWireframe; // the tree as one line buffer, rebuilt off the render thread when a new step's tree arrives
+	uint32_t wireframeMinDepth = 0, wireframeMaxDepth = MAX_TREE_DEPTH; // levels of the tree the wireframe draws
+	BodyRenderer bodyRenderer;
+	BodyRenderEnum bodyRenderMode = BodyRender_Instanced;
+	bool levelOfDetail = false; // draw nodes narrower than a pixel as one sprite, needs the snapshots to carry the tree
+	bool showPhaseTimings = true; // mean and p99 of every step phase in the HUD
 
 
 	float horizontalAngleAtMousePress;
@@ -98,7 +105,4 @@ public:
 
 
 
-*/
-
-
 */
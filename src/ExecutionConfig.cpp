@@ -0,0 +1,344 @@
+#include "ExecutionConfig.h"
+#include <vector>
+#include <map>
+#include <utility>
+#include <algorithm>
+#include <cstdio>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h>
+#elif defined(__linux__)
+#include <sched.h>
+#endif
+
+
+
+
+/**
+ * One logical processor: where it is (processor group and number within it) and which core and socket it belongs
+ * to. sibling numbers the hardware threads of a core from 0, so sibling 0 is the core's first thread.
+ */
+struct HardwareThread
+{
+    int group;
+    int cpu;
+    int core;
+    int package;
+    int sibling;
+};
+
+struct Topology
+{
+    std::vector<HardwareThread> threads;
+    int numCores = 0;
+    bool pinnable = false; // whether PinCurrentThread can work here
+#if defined(__linux__)
+    cpu_set_t processMask; // the CPUs the process was started on, what an unpinned thread gets back
+#endif
+};
+
+struct ExecutionState
+{
+    ExecutionConfig config;
+    int numThreads = 0;
+};
+
+static ExecutionState& GetExecutionState()
+{
+    static ExecutionState state;
+    return(state);
+}
+
+
+
+
+#if defined(_WIN32)
+static void DetectTopology(Topology& topology)
+{
+    DWORD length = 0;
+    GetLogicalProcessorInformationEx(RelationAll, nullptr, &length);
+    std::vector<char> buffer(length);
+    if (length == 0 || !GetLogicalProcessorInformationEx(RelationAll, (PSYSTEM_LOGICAL_PROCESSOR_INFORMATION_EX)buffer.data(), &length))
+    {
+        return;
+    }
+
+    std::vector<std::pair<GROUP_AFFINITY, int>> packageMasks; // (group mask, package)
+    int numPackages = 0;
+    for (DWORD offset = 0; offset < length;)
+    {
+        PSYSTEM_LOGICAL_PROCESSOR_INFORMATION_EX info = (PSYSTEM_LOGICAL_PROCESSOR_INFORMATION_EX)(buffer.data() + offset);
+        if (info->Relationship == RelationProcessorCore)
+        {
+            int sibling = 0;
+            const GROUP_AFFINITY& mask = info->Processor.GroupMask[0];
+            for (int bit = 0; bit < (int)(8 * sizeof(KAFFINITY)); bit++)
+            {
+                if (mask.Mask & ((KAFFINITY)1 << bit))
+                {
+                    HardwareThread thread = { (int)mask.Group, bit, topology.numCores, 0, sibling++ };
+                    topology.threads.push_back(thread);
+                }
+            }
+            topology.numCores++;
+        }
+        else if (info->Relationship == RelationProcessorPackage)
+        {
+            for (WORD g = 0; g < info->Processor.GroupCount; g++)
+            {
+                packageMasks.push_back(std::make_pair(info->Processor.GroupMask[g], numPackages));
+            }
+            numPackages++;
+        }
+        offset += info->Size;
+    }
+    for (size_t t = 0; t < topology.threads.size(); t++)
+    {
+        HardwareThread& thread = topology.threads[t];
+        for (size_t p = 0; p < packageMasks.size(); p++)
+        {
+            if (packageMasks[p].first.Group == thread.group && (packageMasks[p].first.Mask & ((KAFFINITY)1 << thread.cpu)))
+            {
+                thread.package = packageMasks[p].second;
+            }
+        }
+    }
+    topology.pinnable = !topology.threads.empty();
+}
+
+static bool PinCurrentThread(const Topology& topology, const HardwareThread* thread) // nullptr unpins
+{
+    (void)topology;
+    if (thread == nullptr)
+    {
+        DWORD_PTR processMask, systemMask;
+        return(GetProcessAffinityMask(GetCurrentProcess(), &processMask, &systemMask) && SetThreadAffinityMask(GetCurrentThread(), processMask) != 0);
+    }
+    GROUP_AFFINITY affinity = {};
+    affinity.Group = (WORD)thread->group;
+    affinity.Mask = (KAFFINITY)1 << thread->cpu;
+    return(SetThreadGroupAffinity(GetCurrentThread(), &affinity, nullptr) != 0);
+}
+#elif defined(__linux__)
+static int ReadTopologyValue(int cpu, const char* name) // -1 if the file is missing
+{
+    char path[128];
+    std::snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d/topology/%s", cpu, name);
+    std::FILE* file = std::fopen(path, "r");
+    if (file == nullptr)
+    {
+        return(-1);
+    }
+    int value = -1;
+    if (std::fscanf(file, "%d", &value) != 1)
+    {
+        value = -1;
+    }
+    std::fclose(file);
+    return(value);
+}
+
+static void DetectTopology(Topology& topology)
+{
+    CPU_ZERO(&topology.processMask);
+    if (sched_getaffinity(0, sizeof(cpu_set_t), &topology.processMask) != 0)
+    {
+        return;
+    }
+    std::map<std::pair<int, int>, int> coreIndex; // (package, core id) -> core
+    std::vector<int> coreSiblings;
+    for (int cpu = 0; cpu < CPU_SETSIZE; cpu++)
+    {
+        if (!CPU_ISSET(cpu, &topology.processMask))
+        {
+            continue;
+        }
+        int package = std::max(ReadTopologyValue(cpu, "physical_package_id"), 0);
+        int coreId = ReadTopologyValue(cpu, "core_id");
+        std::pair<int, int> key(package, coreId >= 0 ? coreId : -1 - cpu); // without a core id every CPU is its own core
+        std::map<std::pair<int, int>, int>::iterator found = coreIndex.find(key);
+        if (found == coreIndex.end())
+        {
+            found = coreIndex.insert(std::make_pair(key, (int)coreSiblings.size())).first;
+            coreSiblings.push_back(0);
+        }
+        HardwareThread thread = { 0, cpu, found->second, package, coreSiblings[found->second]++ };
+        topology.threads.push_back(thread);
+    }
+    topology.numCores = (int)coreSiblings.size();
+    topology.pinnable = !topology.threads.empty();
+}
+
+static bool PinCurrentThread(const Topology& topology, const HardwareThread* thread) // nullptr unpins
+{
+    if (thread == nullptr)
+    {
+        return(sched_setaffinity(0, sizeof(cpu_set_t), &topology.processMask) == 0);
+    }
+    cpu_set_t mask;
+    CPU_ZERO(&mask);
+    CPU_SET(thread->cpu, &mask);
+    return(sched_setaffinity(0, sizeof(cpu_set_t), &mask) == 0); // pid 0 is the calling thread
+}
+#else
+static void DetectTopology(Topology& topology)
+{
+    (void)topology;
+}
+
+static bool PinCurrentThread(const Topology& topology, const HardwareThread* thread)
+{
+    (void)topology;
+    (void)thread;
+    return(false);
+}
+#endif
+
+static const Topology& GetTopology() // detected once, before any thread of the process is pinned
+{
+    static Topology topology;
+    static bool detected = false;
+    if (!detected)
+    {
+        DetectTopology(topology);
+        if (topology.threads.empty()) // nothing readable: every logical processor is a core of one socket
+        {
+            int procs = omp_get_num_procs();
+            for (int cpu = 0; cpu < procs; cpu++)
+            {
+                HardwareThread thread = { 0, cpu, cpu, 0, 0 };
+                topology.threads.push_back(thread);
+            }
+            topology.numCores = procs;
+            topology.pinnable = false;
+        }
+        detected = true;
+    }
+    return(topology);
+}
+
+
+
+
+/**
+ * The hardware threads the team's threads go to, thread t taking entry t (modulo the count when there are more
+ * threads than entries). Compact orders by socket, core and sibling. Spread first takes the first sibling of every
+ * core, then the second, and so on, and within each round alternates between the sockets.
+ */
+static std::vector<HardwareThread> OrderHardwareThreads(const Topology& topology, AffinityEnum affinity, bool useSMT)
+{
+    std::vector<HardwareThread> slots;
+    for (size_t t = 0; t < topology.threads.size(); t++)
+    {
+        if (useSMT || topology.threads[t].sibling == 0)
+        {
+            slots.push_back(topology.threads[t]);
+        }
+    }
+    if (affinity == Affinity_Compact)
+    {
+        std::stable_sort(slots.begin(), slots.end(), [](const HardwareThread& a, const HardwareThread& b)
+        {
+            return(a.package != b.package ? a.package < b.package : (a.core != b.core ? a.core < b.core : a.sibling < b.sibling));
+        });
+    }
+    else if (affinity == Affinity_Spread)
+    {
+        std::stable_sort(slots.begin(), slots.end(), [](const HardwareThread& a, const HardwareThread& b)
+        {
+            return(a.sibling != b.sibling ? a.sibling < b.sibling : (a.package != b.package ? a.package < b.package : a.core < b.core));
+        });
+        // Deal each sibling round out across the sockets: the i-th entry of every socket before the (i+1)-th of any
+        std::vector<HardwareThread> spread;
+        spread.reserve(slots.size());
+        size_t roundStart = 0;
+        while (roundStart < slots.size())
+        {
+            size_t roundEnd = roundStart;
+            while (roundEnd < slots.size() && slots[roundEnd].sibling == slots[roundStart].sibling)
+            {
+                roundEnd++;
+            }
+            std::vector<std::vector<HardwareThread>> perPackage;
+            std::map<int, size_t> packageIndex;
+            for (size_t s = roundStart; s < roundEnd; s++)
+            {
+                std::map<int, size_t>::iterator found = packageIndex.insert(std::make_pair(slots[s].package, perPackage.size())).first;
+                if (found->second == perPackage.size())
+                {
+                    perPackage.push_back(std::vector<HardwareThread>());
+                }
+                perPackage[found->second].push_back(slots[s]);
+            }
+            for (size_t i = 0; spread.size() < roundEnd; i++)
+            {
+                for (size_t p = 0; p < perPackage.size(); p++)
+                {
+                    if (i < perPackage[p].size())
+                    {
+                        spread.push_back(perPackage[p][i]);
+                    }
+                }
+            }
+            roundStart = roundEnd;
+        }
+        slots.swap(spread);
+    }
+    return(slots);
+}
+
+void SetExecutionConfig(const ExecutionConfig& config)
+{
+    const Topology& topology = GetTopology();
+    std::vector<HardwareThread> slots = OrderHardwareThreads(topology, config.affinity, config.useSMT);
+    int numThreads = (config.numThreads > 0) ? config.numThreads : std::max((int)slots.size(), 1);
+
+    ExecutionState& state = GetExecutionState();
+    state.config = config;
+    state.config.numThreads = numThreads;
+    state.numThreads = numThreads;
+
+    omp_set_dynamic(0); // the runtime must not shrink a team, or the thread chunks would move between phases
+    omp_set_num_threads(numThreads);
+    if (!topology.pinnable || slots.empty())
+    {
+        return;
+    }
+#pragma omp parallel num_threads(numThreads)
+    {
+        int id = omp_get_thread_num();
+        PinCurrentThread(topology, (config.affinity == Affinity_None) ? nullptr : &slots[id % slots.size()]);
+    }
+}
+
+ExecutionConfig GetExecutionConfig()
+{
+    ExecutionState& state = GetExecutionState();
+    if (state.numThreads == 0) // never set: whatever OpenMP would use
+    {
+        ExecutionConfig config(omp_get_max_threads(), Affinity_None, true);
+        return(config);
+    }
+    return(state.config);
+}
+
+int ExecutionThreads()
+{
+    return(GetExecutionConfig().numThreads);
+}
+
+int HardwareCores()
+{
+    return(GetTopology().numCores);
+}
+
+int HardwareThreads()
+{
+    return((int)GetTopology().threads.size());
+}
@@ -1,609 +1,916 @@
-#include "LinearHashedOctree.h"
-
-LinearHashedOctree::LinearHashedOctree()
-{
-    nodes.reserve((1 << DEFAULT_HASHED_OCTREE) - 1); //rehash
-
-}
-
-LinearHashedOctree::LinearHashedOctree(const OctantBounds& rootBounds)
-{
-    // Insert the node into the hashmap.
-   //nodes.rehash((1 << DEFAULT_HASHED_OCTREE) - 1);
-   //HOTNode* rootNode = new HOTNode(rootBounds, ROOT_KEY);
-   //nodes[rootNode->nodeKey] = rootNode;
-   //nodes.emplace(rootNode->nodeKey, rootNode);
-
-}
-
-
-LinearHashedOctree::~LinearHashedOctree()
-{
-    deleteTree();
-    //clear();
-}
-
-
-
-
-size_t LinearHashedOctree::GetNodeTreeDepth(const spatialKey nodeKey)
-{
-    assert(nodeKey);
-    size_t depth = 0;
-    for (spatialKey locationKey = nodeKey; locationKey != 1; locationKey >>= 3) //shift locationKey right by 3 bits, i.e., moving up one level in the tree until the root node is reached
-    {
-        depth++;  //increment depth by 1, i.e., moving down one level in the tree
-    }
-    return depth;
-}
-
-
-
-HOTNode* LinearHashedOctree::getParentNode(const HOTNode* childNode)
-{
-    const spatialKey parentNode = childNode->nodeKey >> 3;
-    return lookUpNode(parentNode);
-}
-
-HOTNode* LinearHashedOctree::getChildNode(const HOTNode* parentNode)
-{
-    const spatialKey childNode = parentNode->nodeKey << 3;
-    return lookUpNode(childNode);
-}
-
-HOTNode* LinearHashedOctree::lookUpNode(const spatialKey code)
-{
-    const auto iter = nodes.find(code);
-    return (iter == nodes.end() ? nullptr : iter->second);
-}
-
-/**
- * Recursively traverse the octree, visiting all child nodes.
- * This traversal goes through all eight possible child nodes of a given node.
- *
- * @param node: Current node being traversed.
- */
-void LinearHashedOctree::traverseTree(HOTNode* node)
-{
-    for (int i = 0; i < 8; i++) //For all eight possible children
-    {
-        if (node->childByte & (1 << i))// See if the ith child exist
-        {
-            const spatialKey locCodeChild = (node->nodeKey << 3) | i; //Compute new Morton key for the child
-            auto* child = lookUpNode(locCodeChild);  //Using key, look child up in hash table and recursively visit subtree
-            traverseTree(child);
-        }
-    }
-}
-
-
-
-void LinearHashedOctree::insertHOTNode(HOTNode*& node)
-{
-    ///*
-    if (nodes.empty()) //if this is the root node
-    {
-        node->nodeKey = ROOT_KEY;
-        nodes[node->nodeKey] = node;
-    }
-    else //NOT the root node
-    {
-        if (nodes[node->nodeKey]) //this node already exists
-        {
-            //deleteNode(node->nodeKey);//delete old node
-
-            nodes.erase(node->nodeKey);   // Remove the node from the map
-            delete node;  // Release the node's memory
-
-        }
-        nodes[node->nodeKey] = node; //add node to hashmap
-    }
-    //*/
-
-    //
-    /*
-    if (nodes[node->nodeKey]) //this node already exists
-    {
-        nodes.erase(node->nodeKey);   // Remove the node from the map
-        delete node;  // Release the node's memory
-
-    }
-    nodes[node->nodeKey] = node; //add node to hashmap
-    //*/
-
-
-
-    //
-    /*
-    auto result = nodes.emplace(node->nodeKey, node);
-
-    if (!result.second) // this node already exists
-    {
-        // Overwrite the old node with the new one.
-        // Assuming ownership is transferred here, and it's safe to delete the old node.
-        delete result.first->second;  // delete old node
-        result.first->second = node;  // replace old node with new one
-    }
-    // Otherwise, the emplace has already added the new node for us
-
-    //*/
-
-
-
-
-}
-
-
-
-
-bool LinearHashedOctree::descendantOf(spatialKey nodeKey, spatialKey parentKey)
-{
-    if (parentKey == 1)  //only the root node has a key of 1, all nodes are descendants of root node
-    {
-        return(true);
-    }
-    if (nodeKey <= parentKey) //if this key is less than the parentKey, then it is an ancestor of the parent key, not a descendant (i.e., it resides higher up in the tree).
-    {
-        return(false);
-    }
-
-    size_t nodeKeyDepth = GetNodeTreeDepth(nodeKey);
-    size_t parentKeyDepth = GetNodeTreeDepth(parentKey);
-
-
-    nodeKey >>= (nodeKeyDepth - parentKeyDepth) * 3; // Bring the nodeKey to the same level as parentKey.
-    return (nodeKey == parentKey);
-}
-
-bool LinearHashedOctree::leafNodeExistsForBody(const Vec3D& bodyPosition)
-{
-    spatialKey currentKey = ROOT_KEY;
-    HOTNode* currentNode = lookUpNode(currentKey);
-
-    while (currentNode != nullptr && currentNode->N > 0)
-    {
-        OctantEnum targetOctant = DetermineOctant(currentNode->nodeBounds.center, bodyPosition);
-        currentKey = GetChildKey(currentKey, targetOctant);
-        currentNode = lookUpNode(currentKey);
-    }
-
-    return currentNode != nullptr && currentNode->N == 0; // true if it's a leaf node
-}
-
-std::vector<OctantEnum> LinearHashedOctree::getPathToLeafNode(const Vec3D& bodyPosition)
-{
-    std::vector<OctantEnum> path;
-
-    // Start with the root node
-    spatialKey currentKey = ROOT_KEY;
-    HOTNode* currentNode = lookUpNode(ROOT_KEY);
-
-
-    // Traverse the tree until we reach a leaf node or an empty node
-    while (currentNode) //&& currentNode->N != 0
-    {
-        OctantEnum octant = DetermineOctant(currentNode->nodeBounds.center, bodyPosition);
-        path.push_back(octant);
-
-        currentKey = GetChildKey(currentNode->nodeKey, octant);
-
-        if (nodes.find(currentKey) != nodes.end())
-        {
-            currentNode = lookUpNode(currentKey);
-        }
-        else
-        {
-            break;  // Leaf node or empty node found
-        }
-    }
-    return path;
-}
-
-
-
-
-
-
-
-
-
-
-
-
-
-
-
-/*
-* SEE NBODY PHYSICS 4_7 FOR DOCUMENTATION OF THESE FUNCTIONS
-*
-*/
-
-void LinearHashedOctree::insertBody(HOTNode*& node, const Vec3D bodyPosition, const double bodyMass)
-{
-    ///*
-    // Ensure the root node is initialized.
-    assert(!nodes.empty());
-    spatialKey currentKey;
-    OctantEnum targetOctant;
-
-
-    //GENERAL CASE 1
-    if (node == nullptr)
-    {
-        currentKey = ROOT_KEY;
-        node = lookUpNode(currentKey);
-    }
-    //GENERAL CASE 2
-    else
-    {
-        currentKey = node->nodeKey;
-    }
-
-
-
-    // Traverse the tree to find the appropriate insertion point for the body.
-    while (node != nullptr)
-    {
-        //GENERAL CASE 3: The target Node is empty
-        if (node->N == 0)
-        {
-            node->mass = bodyMass;
-            node->baryCenter = bodyPosition;
-            node->N = 1;
-            node->childByte = 0;
-
-            node = nullptr;  // Reset the node pointer
-        }
-        else if (node->N > 1)         //GENERAL CASE 4: The target Node has Multiple Bodies
-        {
-            // Determine the spatial subdivision for the new body.
-            targetOctant = DetermineOctant(node->nodeBounds.center, bodyPosition);
-            node->N = node->N + 1;
-            node->mass = node->mass + bodyMass;
-            processNodeInsertion(node, targetOctant, currentKey, bodyPosition, bodyMass);
-        }
-        else if (node->N == 1)       //GENERAL CASE 5: The target Node has a Single Body    
-        {
-            pushHOTNodeBodyToChild(node); // Push the existing body down to a child node, making space for a new body.
-            targetOctant = DetermineOctant(node->nodeBounds.center, bodyPosition);
-            node->N = node->N + 1;
-            node->mass = node->mass + bodyMass;
-            processNodeInsertion(node, targetOctant, currentKey, bodyPosition, bodyMass);
-        }
-    }
-
-    //pruneEmptyNodes(node);
-
-    //*/
-}
-
-void LinearHashedOctree::pushHOTNodeBodyToChild(HOTNode* node)
-{
-    if (node == nullptr || node->N != 1)
-    {
-        return;
-    }
-    //Since N == 1, com is the position of that one body.
-    //OctantEnum targetOctant = GetOctantFromKey(node->nodeKey);
-    OctantEnum targetOctant = DetermineOctant(node->nodeBounds.center, node->baryCenter);
-
-    createChildNode(node, targetOctant, node->baryCenter, node->mass);
-
-    //pruneEmptyNodes(node);
-
-    //If the node is empty after pushing body to its child, delete the node
-    //if (node->N == 0 && node->childByte == 0)
-    //{
-    //    nodes.erase(node->nodeKey);   // Remove the node from the map
-    //    delete node;  // Release the node's memory
-    //}
-}
-
-void LinearHashedOctree::processNodeInsertion(HOTNode*& node, OctantEnum& targetOctant, spatialKey& currentKey, const Vec3D bodyPosition, const double bodyMass)
-{
-    //if (node == nullptr)
-    //{
-    //    return;
-    //}
-
-
-    if (HasOctChild(node->childByte, targetOctant))
-    {
-        //updates the current key to that of the child's
-        currentKey = GetChildKey(currentKey, targetOctant);
-
-        //fetches the child node from the HOT
-        node = lookUpNode(currentKey);
-    }
-    else
-    {
-        //create a new child node with the body's information
-        createChildNode(node, targetOctant, bodyPosition, bodyMass);
-
-        // Reset the node since we're now at a leaf.
-        node = nullptr;
-    }
-
-}
-
-void LinearHashedOctree::pruneEmptyNodes(HOTNode* node)
-{
-    //if (node == nullptr)//|| node->nodeKey == 0)
-    //{
-    //    return;
-    //}
-
-
-    // Iterate over all possible child nodes
-    for (int i = 0; i < 8; ++i)
-    {
-        if (node->childByte & (1 << i))
-        {
-            spatialKey childKey = (node->nodeKey << 3) | i;
-            auto* childNode = lookUpNode(childKey);
-
-            // Recursively prune children of this child node
-            pruneEmptyNodes(childNode);
-        }
-    }
-
-
-    // Check if the current node is empty and has no children
-    if (node->N == 0 && node->childByte == 0)
-    {
-        nodes.erase(node->nodeKey);   // Remove the node from the map
-        delete node;  // Release the node's memory
-    }
-}
-
-void LinearHashedOctree::deleteNode(spatialKey nodeCode)
-{
-    auto iter = nodes.find(nodeCode);
-    if (iter != nodes.end())
-    {
-        delete iter->second;  // Deallocate the memory for the node
-        nodes.erase(iter);    // Remove the entry from the unordered_map
-    }
-}
-
-void LinearHashedOctree::clear()
-{
-    nodes.clear();
-}
-
-void LinearHashedOctree::deleteTree()
-{
-    for (auto& node_pair : nodes)
-    {
-        delete node_pair.second; // Deallocate the memory for the node
-    }
-    clear(); // Remove the entry from the unordered_map
-}
-
-void LinearHashedOctree::createChildNode(HOTNode*& node, OctantEnum& targetOctant, const Vec3D& bodyPosition, const double& bodyMass)
-{
-    spatialKey childKey = GetChildKey(node->nodeKey, targetOctant);
-
-    HOTNode* childNode = new HOTNode(node, targetOctant, bodyPosition, bodyMass);
-
-    //Update the parent node to reflect the new child's existence.
-    SetOctChild(node->childByte, targetOctant);
-
-    insertHOTNode(childNode);
-}
-
-
-
-void LinearHashedOctree::computeNodeBaryCenters(HOTNode*& node)
-{
-    //compute c.o.m. first.
-    spatialKey childKey;
-    HOTNode* childNode;
-    double mass;
-    for (size_t i = 0; i < 8; i++) //For all eight possible children
-    {
-        if (node->childByte & (1 << i))
-        {
-            childKey = (node->nodeKey << 3) | i; //Compute new Morton key for the child
-            childNode = lookUpNode(childKey);            //fetches the child node from the HOT
-            mass = childNode->mass;
-            node->mass += mass;
-            node->N += childNode->N;
-
-            node->baryCenter += (childNode->baryCenter * childNode->mass);
-        }
-        node->baryCenter /= node->mass;
-    }
-
-    //compute quadrapole moment contribution
-    node->quadrupoleMoment[0] = 0.0;
-    node->quadrupoleMoment[1] = 0.0;
-    node->quadrupoleMoment[2] = 0.0;
-    node->quadrupoleMoment[3] = 0.0;
-    node->quadrupoleMoment[4] = 0.0;
-    node->quadrupoleMoment[5] = 0.0;
-
-    Vec3D childPosition;
-    double xx, yy, zz, d2;
-
-
-    for (size_t i = 0; i < 8; i++) //For all eight possible children
-    {
-        if (node->childByte & (1 << i))
-        {
-            childKey = (node->nodeKey << 3) | i; //Compute new Morton key for the child
-            childNode = lookUpNode(childKey);            //fetches the child node from the HOT
-
-            //first, get child's pos in c.o.m. reference frame
-            childPosition = childNode->baryCenter - node->baryCenter;
-
-            mass = childNode->mass;
-
-            xx = childPosition.x * childPosition.y; //xy
-            node->quadrupoleMoment[1] += 3.0 * mass * xx;
-
-            zz = childPosition.x * childPosition.z; //xz
-            node->quadrupoleMoment[2] += 3.0 * mass * zz;
-
-
-            yy = childPosition.y * childPosition.z; //yz
-            node->quadrupoleMoment[4] += 3.0 * mass * yy;
-
-
-
-            xx = childPosition.x * childPosition.x;
-            zz = childPosition.z * childPosition.z;
-            yy = childPosition.y * childPosition.y;
-
-            d2 = xx + yy + zz;
-            d2 *= mass;
-            mass *= 3.0;
-
-
-            node->quadrupoleMoment[0] += mass * xx - d2;
-            node->quadrupoleMoment[3] += mass * yy - d2;
-            node->quadrupoleMoment[5] += mass * zz - d2;
-
-
-            //directly add child's moments also
-            if (childNode->N > 1)
-            {
-                node->quadrupoleMoment[0] += childNode->quadrupoleMoment[0];
-                node->quadrupoleMoment[1] += childNode->quadrupoleMoment[1];
-                node->quadrupoleMoment[2] += childNode->quadrupoleMoment[2];
-                node->quadrupoleMoment[3] += childNode->quadrupoleMoment[3];
-                node->quadrupoleMoment[4] += childNode->quadrupoleMoment[4];
-                node->quadrupoleMoment[5] += childNode->quadrupoleMoment[5];
-            }
-        }
-
-
-
-    }
-
-}
-
-void LinearHashedOctree::computeTreeBaryCenters(HOTNode*& node)
-{
-    if (node == nullptr || nodes.empty() || node->N == 1)
-    {
-        return;
-    }
-
-
-    //   
-    /*
-    for (auto& pair : nodes)
-    {
-        //const HOTNode* node = pair.second;
-        computeTreeBaryCenters(pair.second);
-    }
-    //*/
-
-
-    ///*
-
-
-    //do a depth-first search
-    //recursively update children first.
-    spatialKey childKey;
-    for (int i = 0; i < 8; i++) //For all eight possible children
-    {
-        if (node->childByte & (1 << i))// See if the ith child exist
-        {
-            childKey = (node->nodeKey << 3) | i; //Compute new Morton key for the child
-            auto* child = lookUpNode(childKey);  //Using key, look child up in hash table and recursively visit subtree
-            computeTreeBaryCenters(child);
-        }
-    }
-    //*/
-
-
-    computeNodeBaryCenters(node);
-
-}
-
-
-
-
-
-
-void LinearHashedOctree::printHashedOctree()
-{
-    cout << "\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n\nnodes.bucket_count(): " << nodes.bucket_count();
-    cout << "\n\nnodes.size(): " << nodes.size();
-
-
-    size_t i = 0;
-    for (auto& pair : nodes)
-    {
-        i++;
-        const spatialKey& key = pair.first;
-
-
-        // Print out key
-
-        std::cout << "\n\n\n\n\n\n\n\n\nKey: " << key;        cout << "                  i" << i;
-
-        std::bitset<64> binary(key);
-        cout << "\nBinary MortonKey: " << binary;
-
-
-
-        if (pair.second != nullptr)
-        {
-            //OctantEnum octant1 = DetermineOctant(value->nodeBounds.center, value->baryCenter); //determine which octant the new body should be placed in 
-            //cout << "\n\nDetermineOctant: " << octant1;
-
-            OctantEnum octant2 = GetOctantFromKey(pair.second->nodeKey);
-            cout << "\n\n\n\nGetOctantFromKey: " << octant2;
-
-            cout << "\nvalue->nodeBounds.size: " << pair.second->nodeBounds.size;
-            cout << "\nvalue->nodeBounds.center: (" << pair.second->nodeBounds.center.x; cout << ", " << pair.second->nodeBounds.center.y; cout << ", " << pair.second->nodeBounds.center.z; cout << ")";
-
-
-            cout << "\nvalue->baryCenter: (" << pair.second->baryCenter.x; cout << ", " << pair.second->baryCenter.y; cout << ", " << pair.second->baryCenter.z; cout << ")";
-            cout << "\nvalue->mass: " << pair.second->mass;
-
-            cout << "\nvalue->N: " << pair.second->N;
-            cout << "\nvalue->childByte: " << std::bitset<8>(pair.second->childByte);
-
-        }
-    }
-}
-
-void LinearHashedOctree::visualizeTree()
-{
-    for (auto& pair : nodes)
-    {
-        visualizeNode(pair.second);
-    }
-}
-
-void LinearHashedOctree::visualizeNode(const HOTNode* node)
-{
-    if (node == nullptr)
-    {
-        return;
-    }
-
-
-    ofNoFill();
-    // Get the center and size of the node
-    //ofVec3f center(node->nodeBounds.center.x, node->nodeBounds.center.y, node->nodeBounds.center.z);
-
-
-    // Set the box color
-    ofSetColor(255, 255, 255, 63.75);
-    //ofSetColor(255, 255, 255, 31.875);
-
-    // Draw the box
-    ofDrawBox(node->nodeBounds.center.x, node->nodeBounds.center.y, node->nodeBounds.center.z, node->nodeBounds.size); //uses the passed-in coordinates as the center of the cube
-
-
-    //ofSetColor(66, 66, 255);
-    //ofDrawBitmapString("Mass: " + ofToString(node->mass) + "\nN: " + ofToString(node->N) + "\nQuadrupole Moment[4]: " + ofToString(node->quadrupoleMoment[4]), center);
-
-    //size_t depthLevel = GetNodeTreeDepth(node->nodeKey);
-    //ofDrawBitmapString("Mass: " + ofToString(node->mass) + "\nN: " + ofToString(node->N) + "\nKey: " + ofToString(node->nodeKey) + "\nDepth: " + ofToString(depthLevel), center);
-}
+#include "LinearHashedOctree.h"
+#include <cassert>
+#include <bitset>
+
+LinearHashedOctree::LinearHashedOctree() : nodeArray(nullptr), numNodes(0), nodeArrayCapacity(0), nodeLayout(NodeLayout_BreadthFirst), buildLayout(NodeLayout_BreadthFirst), useNodeArena(false)
+{
+    nodes.reserve((1 << DEFAULT_HASHED_OCTREE) - 1); //rehash
+
+}
+
+LinearHashedOctree::LinearHashedOctree(const OctantBounds& rootBounds) : nodeArray(nullptr), numNodes(0), nodeArrayCapacity(0), nodeLayout(NodeLayout_BreadthFirst), buildLayout(NodeLayout_BreadthFirst), useNodeArena(false)
+{
+    // Insert the node into the hashmap.
+   //nodes.rehash((1 << DEFAULT_HASHED_OCTREE) - 1);
+   //HOTNode* rootNode = new HOTNode(rootBounds, ROOT_KEY);
+   //nodes[rootNode->nodeKey] = rootNode;
+   //nodes.emplace(rootNode->nodeKey, rootNode);
+
+}
+
+
+LinearHashedOctree::~LinearHashedOctree()
+{
+    deleteTree();
+    //clear();
+    FreeLargeArray(nodeArray);
+}
+
+
+
+
+size_t LinearHashedOctree::GetNodeTreeDepth(const spatialKey nodeKey)
+{
+    assert(nodeKey);
+    size_t depth = 0;
+    for (spatialKey locationKey = nodeKey; locationKey != 1; locationKey >>= 3) //shift locationKey right by 3 bits, i.e., moving up one level in the tree until the root node is reached
+    {
+        depth++;  //increment depth by 1, i.e., moving down one level in the tree
+    }
+    return depth;
+}
+
+
+
+HOTNode* LinearHashedOctree::getParentNode(const HOTNode* childNode)
+{
+    const spatialKey parentNode = childNode->nodeKey >> 3;
+    return lookUpNode(parentNode);
+}
+
+HOTNode* LinearHashedOctree::getChildNode(const HOTNode* parentNode)
+{
+    const spatialKey childNode = parentNode->nodeKey << 3;
+    return lookUpNode(childNode);
+}
+
+HOTNode* LinearHashedOctree::lookUpNode(const spatialKey code)
+{
+    if (isCompacted())
+    {
+        const uint32_t index = nodeIndex.find(code);
+        return (index == NO_NODE_INDEX ? nullptr : &nodeArray[index]);
+    }
+    return (nodes.find(code));
+}
+
+/**
+ * Recursively traverse the octree, visiting all child nodes.
+ * This traversal goes through all eight possible child nodes of a given node.
+ *
+ * @param node: Current node being traversed.
+ */
+void LinearHashedOctree::traverseTree(HOTNode* node)
+{
+    for (int i = 0; i < 8; i++) //For all eight possible children
+    {
+        if (node->childByte & (1 << i))// See if the ith child exist
+        {
+            const spatialKey locCodeChild = (node->nodeKey << 3) | i; //Compute new Morton key for the child
+            auto* child = lookUpNode(locCodeChild);  //Using key, look child up in hash table and recursively visit subtree
+            traverseTree(child);
+        }
+    }
+}
+
+
+
+void LinearHashedOctree::insertHOTNode(HOTNode*& node)
+{
+    ///*
+    if (nodes.find(ROOT_KEY) == nullptr) //if this is the root node (only the root's slot is read, other threads may be inserting into their subtrees)
+    {
+        node->nodeKey = ROOT_KEY;
+        nodes.insert(node->nodeKey, node);
+    }
+    else //NOT the root node
+    {
+        HOTNode* previous = nodes.insert(node->nodeKey, node); //add node to hashmap
+        if (previous != nullptr && previous != node) //this node already existed
+        {
+            insertionPath.depth = -1; // the old node may be on insertBodySorted's cached path
+            //deleteNode(node->nodeKey);//delete old node
+
+            releaseNode(previous);  // Release the old node's memory, the new node takes its place
+
+        }
+    }
+    //*/
+
+    //
+    /*
+    if (nodes[node->nodeKey]) //this node already exists
+    {
+        nodes.erase(node->nodeKey);   // Remove the node from the map
+        delete node;  // Release the node's memory
+
+    }
+    nodes[node->nodeKey] = node; //add node to hashmap
+    //*/
+
+
+
+    //
+    /*
+    auto result = nodes.emplace(node->nodeKey, node);
+
+    if (!result.second) // this node already exists
+    {
+        // Overwrite the old node with the new one.
+        // Assuming ownership is transferred here, and it's safe to delete the old node.
+        delete result.first->second;  // delete old node
+        result.first->second = node;  // replace old node with new one
+    }
+    // Otherwise, the emplace has already added the new node for us
+
+    //*/
+
+
+
+
+}
+
+
+
+
+bool LinearHashedOctree::descendantOf(spatialKey nodeKey, spatialKey parentKey)
+{
+    if (parentKey == 1)  //only the root node has a key of 1, all nodes are descendants of root node
+    {
+        return(true);
+    }
+    if (nodeKey <= parentKey) //if this key is less than the parentKey, then it is an ancestor of the parent key, not a descendant (i.e., it resides higher up in the tree).
+    {
+        return(false);
+    }
+
+    size_t nodeKeyDepth = GetNodeTreeDepth(nodeKey);
+    size_t parentKeyDepth = GetNodeTreeDepth(parentKey);
+
+
+    nodeKey >>= (nodeKeyDepth - parentKeyDepth) * 3; // Bring the nodeKey to the same level as parentKey.
+    return (nodeKey == parentKey);
+}
+
+bool LinearHashedOctree::leafNodeExistsForBody(const Vec3D& bodyPosition)
+{
+    spatialKey currentKey = ROOT_KEY;
+    HOTNode* currentNode = lookUpNode(currentKey);
+
+    while (currentNode != nullptr && currentNode->N > 0)
+    {
+        OctantEnum targetOctant = DetermineOctant(currentNode->nodeBounds.center, bodyPosition);
+        currentKey = GetChildKey(currentKey, targetOctant);
+        currentNode = lookUpNode(currentKey);
+    }
+
+    return currentNode != nullptr && currentNode->N == 0; // true if it's a leaf node
+}
+
+std::vector<OctantEnum> LinearHashedOctree::getPathToLeafNode(const Vec3D& bodyPosition)
+{
+    std::vector<OctantEnum> path;
+
+    // Start with the root node
+    spatialKey currentKey = ROOT_KEY;
+    HOTNode* currentNode = lookUpNode(ROOT_KEY);
+
+
+    // Traverse the tree until we reach a leaf node or an empty node
+    while (currentNode) //&& currentNode->N != 0
+    {
+        OctantEnum octant = DetermineOctant(currentNode->nodeBounds.center, bodyPosition);
+        path.push_back(octant);
+
+        currentKey = GetChildKey(currentNode->nodeKey, octant);
+
+        if (nodes.find(currentKey) != nullptr)
+        {
+            currentNode = lookUpNode(currentKey);
+        }
+        else
+        {
+            break;  // Leaf node or empty node found
+        }
+    }
+    return path;
+}
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+/*
+* SEE NBODY PHYSICS 4_7 FOR DOCUMENTATION OF THESE FUNCTIONS
+*
+*/
+
+void LinearHashedOctree::insertBody(HOTNode*& node, const Vec3D bodyPosition, const double bodyMass)
+{
+    ///*
+    // Ensure the root node is initialized.
+    assert(!nodes.empty());
+    spatialKey currentKey;
+    OctantEnum targetOctant;
+
+
+    //GENERAL CASE 1
+    if (node == nullptr)
+    {
+        currentKey = ROOT_KEY;
+        node = lookUpNode(currentKey);
+    }
+    //GENERAL CASE 2
+    else
+    {
+        currentKey = node->nodeKey;
+    }
+
+
+
+    // Traverse the tree to find the appropriate insertion point for the body.
+    while (node != nullptr)
+    {
+        //GENERAL CASE 3: The target Node is empty
+        if (node->N == 0)
+        {
+            node->mass = bodyMass;
+            node->baryCenter = bodyPosition;
+            node->N = 1;
+            node->childByte = 0;
+
+            node = nullptr;  // Reset the node pointer
+        }
+        else if (node->childByte == 0 && IsMaxDepthKey(currentKey))   //GENERAL CASE 6: The target Node is a leaf at MAX_TREE_DEPTH
+        {
+            // Bodies closer together than the finest key resolution cannot be separated, splitting the node would
+            // overflow the key into its parent's. The node becomes a bucket holding their combined mass, barycenter
+            // and quadrupole; the force kernel takes a body's own share back out of its bucket.
+            node->addBucketBody(bodyPosition, bodyMass);
+
+            node = nullptr;  // Reset the node pointer
+        }
+        else if (node->N > 1)         //GENERAL CASE 4: The target Node has Multiple Bodies
+        {
+            // Determine the spatial subdivision for the new body.
+            targetOctant = DetermineOctant(node->nodeBounds.center, bodyPosition);
+            node->N = node->N + 1;
+            node->mass = node->mass + bodyMass;
+            processNodeInsertion(node, targetOctant, currentKey, bodyPosition, bodyMass);
+        }
+        else if (node->N == 1)       //GENERAL CASE 5: The target Node has a Single Body    
+        {
+            pushHOTNodeBodyToChild(node); // Push the existing body down to a child node, making space for a new body.
+            targetOctant = DetermineOctant(node->nodeBounds.center, bodyPosition);
+            node->N = node->N + 1;
+            node->mass = node->mass + bodyMass;
+            processNodeInsertion(node, targetOctant, currentKey, bodyPosition, bodyMass);
+        }
+    }
+
+    //pruneEmptyNodes(node);
+
+    //*/
+}
+
+/**
+ * insertBody(nullptr, ...) for bodies inserted in space-filling-curve order.
+ *
+ * Consecutive sorted bodies share most of their root-to-leaf path, so instead of restarting at ROOT_KEY and looking up
+ * every level again, the previous body's path is kept in an InsertionPath. The new body keeps the part of it on which it
+ * makes the same octant choices (a few compares on nodes that are still in cache) and only the levels below that are
+ * looked up. The choices are re-derived from the node centers rather than the bodies' keys, which the drift before the
+ * build has made stale, so the result is exactly the tree insertBody builds.
+ *
+ * The ancestors that are skipped do not get their N and mass incremented. Both are only read while inserting to tell
+ * an empty node or a single body from an internal node, and an internal node already has N > 1; computeTreeBaryCenters
+ * rebuilds N, mass and the barycenter of every internal node from its children.
+ */
+void LinearHashedOctree::insertBodySorted(const Vec3D bodyPosition, const double bodyMass)
+{
+    assert(!nodes.empty());
+    if (insertionPath.depth < 0)
+    {
+        insertionPath.nodes[0] = lookUpNode(ROOT_KEY);
+        insertionPath.depth = 0;
+    }
+    insertBodySorted(insertionPath, bodyPosition, bodyMass);
+}
+
+void LinearHashedOctree::insertBodySorted(InsertionPath& path, const Vec3D bodyPosition, const double bodyMass)
+{
+    int depth = 0;
+    while (depth < path.depth && DetermineOctant(path.nodes[depth]->nodeBounds.center, bodyPosition) == GetOctantFromKey(path.nodes[depth + 1]->nodeKey))
+    {
+        depth++;
+    }
+    path.depth = depth;
+
+    HOTNode* node = path.nodes[depth];
+    spatialKey currentKey = node->nodeKey;
+    OctantEnum targetOctant;
+    while (node != nullptr)
+    {
+        if (node->N == 0) // the empty root, or an empty subtree root of a parallel build
+        {
+            node->mass = bodyMass;
+            node->baryCenter = bodyPosition;
+            node->N = 1;
+            node->childByte = 0;
+            node = nullptr;
+        }
+        else if (node->childByte == 0 && IsMaxDepthKey(currentKey)) // bucket at MAX_TREE_DEPTH, see insertBody
+        {
+            node->addBucketBody(bodyPosition, bodyMass);
+            node = nullptr;
+        }
+        else
+        {
+            if (node->N == 1)
+            {
+                pushHOTNodeBodyToChild(node); // a single body, push it down to make room
+            }
+            targetOctant = DetermineOctant(node->nodeBounds.center, bodyPosition);
+            node->N = node->N + 1;
+            node->mass = node->mass + bodyMass;
+            if (HasOctChild(node->childByte, targetOctant))
+            {
+                currentKey = GetChildKey(currentKey, targetOctant);
+                node = lookUpNode(currentKey);
+                path.nodes[++path.depth] = node;
+            }
+            else
+            {
+                createChildNode(node, targetOctant, bodyPosition, bodyMass);
+                node = nullptr;
+            }
+        }
+    }
+}
+
+void LinearHashedOctree::pushHOTNodeBodyToChild(HOTNode* node)
+{
+    if (node == nullptr || node->N != 1)
+    {
+        return;
+    }
+    //Since N == 1, com is the position of that one body.
+    //OctantEnum targetOctant = GetOctantFromKey(node->nodeKey);
+    OctantEnum targetOctant = DetermineOctant(node->nodeBounds.center, node->baryCenter);
+
+    createChildNode(node, targetOctant, node->baryCenter, node->mass);
+
+    //pruneEmptyNodes(node);
+
+    //If the node is empty after pushing body to its child, delete the node
+    //if (node->N == 0 && node->childByte == 0)
+    //{
+    //    nodes.erase(node->nodeKey);   // Remove the node from the map
+    //    delete node;  // Release the node's memory
+    //}
+}
+
+void LinearHashedOctree::processNodeInsertion(HOTNode*& node, OctantEnum& targetOctant, spatialKey& currentKey, const Vec3D bodyPosition, const double bodyMass)
+{
+    //if (node == nullptr)
+    //{
+    //    return;
+    //}
+
+
+    if (HasOctChild(node->childByte, targetOctant))
+    {
+        //updates the current key to that of the child's
+        currentKey = GetChildKey(currentKey, targetOctant);
+
+        //fetches the child node from the HOT
+        node = lookUpNode(currentKey);
+    }
+    else
+    {
+        //create a new child node with the body's information
+        createChildNode(node, targetOctant, bodyPosition, bodyMass);
+
+        // Reset the node since we're now at a leaf.
+        node = nullptr;
+    }
+
+}
+
+void LinearHashedOctree::pruneEmptyNodes(HOTNode* node)
+{
+    //if (node == nullptr)//|| node->nodeKey == 0)
+    //{
+    //    return;
+    //}
+
+
+    insertionPath.depth = -1; // pruned nodes may be on insertBodySorted's cached path
+
+    // Iterate over all possible child nodes
+    for (int i = 0; i < 8; ++i)
+    {
+        if (node->childByte & (1 << i))
+        {
+            spatialKey childKey = (node->nodeKey << 3) | i;
+            auto* childNode = lookUpNode(childKey);
+
+            // Recursively prune children of this child node
+            pruneEmptyNodes(childNode);
+        }
+    }
+
+
+    // Check if the current node is empty and has no children
+    if (node->N == 0 && node->childByte == 0)
+    {
+        nodes.erase(node->nodeKey);   // Remove the node from the map
+        releaseNode(node);  // Release the node's memory
+    }
+}
+
+void LinearHashedOctree::deleteNode(spatialKey nodeCode)
+{
+    HOTNode* node = nodes.find(nodeCode);
+    if (node != nullptr)
+    {
+        insertionPath.depth = -1;
+        releaseNode(node);  // Deallocate the memory for the node
+        nodes.erase(nodeCode);    // Remove the entry from the map
+    }
+}
+
+void LinearHashedOctree::clear()
+{
+    nodes.clear();
+    nodeIndex.clear();
+    numNodes = 0;
+    insertionPath.depth = -1;
+}
+
+void LinearHashedOctree::deleteTree()
+{
+    if (!useNodeArena)
+    {
+        nodePool.reset(); // Every node came from the pool, recycle them all at once
+    }
+    clear(); // Remove the entry from the unordered_map
+}
+
+void LinearHashedOctree::prepareNodeStorage(size_t numBodies)
+{
+    useNodeArena = (MemoryPlacementMode() == Placement_FirstTouch);
+    if (useNodeArena)
+    {
+        int partitions = omp_get_max_threads();
+        nodeArena.reserve(partitions, 2 * (numBodies / partitions) + 64); // a Morton-ordered build creates about two nodes per body
+    }
+    else
+    {
+        nodePool.reset(); // clear() has already dropped any nodes of the previous tree
+        nodePool.reserve(2 * numBodies + 64);
+    }
+}
+
+void LinearHashedOctree::selectNodePartition(int partition)
+{
+    if (useNodeArena)
+    {
+        nodeArena.setPartition(partition);
+    }
+}
+
+int LinearHashedOctree::nodePartitions() const
+{
+    return(useNodeArena ? nodeArena.partitions() : 1);
+}
+
+void LinearHashedOctree::releaseNode(HOTNode* node)
+{
+    if (!useNodeArena)
+    {
+        nodePool.destroy(node);
+    }
+}
+
+/**
+ * Create the part of the tree above the level SUBTREE_SPLIT_LEVELS cells that covers the cells' bodies (counted in
+ * cellStart), recursing from node, which covers the cells from firstCell on. A node over two or more bodies is
+ * internal in the finished tree, so it is marked as such and gets a child for every octant with bodies; a cell, or a
+ * node over a single body, is left empty and becomes a subtree task.
+ */
+void LinearHashedOctree::splitTopLevels(HOTNode* node, int level, uint32_t firstCell)
+{
+    uint32_t cells = 1u << (3 * (SUBTREE_SPLIT_LEVELS - level)); // cells below node, consecutive in octant digit order
+    uint32_t begin = cellStart[firstCell];
+    uint32_t end = cellStart[firstCell + cells];
+    if (level == SUBTREE_SPLIT_LEVELS || end - begin < 2)
+    {
+        SubtreeTask task = { node, begin, end };
+        subtreeTasks.push_back(task);
+        return;
+    }
+
+    node->N = end - begin; // so insertion never takes it for an empty node or a leaf, the barycenter pass recounts it
+    topNodes.push_back(node);
+    uint32_t childCells = cells >> 3;
+    for (int i = 0; i < 8; i++)
+    {
+        uint32_t childCell = firstCell + i * childCells;
+        if (cellStart[childCell + childCells] > cellStart[childCell])
+        {
+            OctantEnum octant = static_cast<OctantEnum>(i);
+            HOTNode* childNode = createNode(node, octant, Vec3D(), 0.0);
+            childNode->N = 0; // empty until its task inserts the bodies
+            SetOctChild(node->childByte, octant);
+            insertHOTNode(childNode);
+            splitTopLevels(childNode, level + 1, childCell);
+        }
+    }
+}
+
+/**
+ * Copy the hashed tree into nodeArray in nodeLayout order.
+ *
+ * A serial pass orders the nodes into compactEntries. Breadth-first uses the entries themselves as the queue: when
+ * node i is visited its children are appended in octant order, so they are contiguous and start at firstChild.
+ * Depth-first orders each subtree in pre-order (Morton order, the order the bodies are sorted in) and records skip
+ * once the subtree is done. Either way every node also gets the index of its first body, counted in octant order.
+ *
+ * The copy itself is parallel and follows the force pass's partition: thread t copies the nodes whose first body
+ * lies in its GetThreadChunk slice. A node's first body only grows along a level (breadth-first) or along the whole
+ * array (depth-first), so each thread's nodes are one index range per segment, found by binary search. A freshly
+ * allocated nodeArray is left untouched until this copy, so under Placement_FirstTouch the pages holding a thread's
+ * subtrees are placed on that thread's socket; the array is reused while the tree fits, and its pages keep that
+ * placement. Under Hilbert order the octant-order count only approximates the bodies' sorted positions, which
+ * changes who copies a node but not that every node is copied once. The hashed nodes are released afterwards, from
+ * here on the tree is addressed by index (or by key through nodeIndex).
+ */
+void LinearHashedOctree::compactNodes()
+{
+    numNodes = 0;
+    nodeIndex.clear();
+    HOTNode* rootNode = lookUpNode(ROOT_KEY);
+    if (rootNode == nullptr)
+    {
+        return;
+    }
+
+    size_t count = nodes.size();
+    if (count > nodeArrayCapacity)
+    {
+        FreeLargeArray(nodeArray);
+        nodeArrayCapacity = (uint32_t)(count + count / 4); // headroom so a slowly growing tree does not reallocate every frame
+        nodeArray = AllocateLargeArray<HOTNode>(nodeArrayCapacity); // first touched by the copy below
+    }
+    nodeIndex.reserve(count);
+    compactEntries.resize(count);
+    compactSegments.clear();
+    compactSegments.push_back(0);
+
+    nodeLayout = buildLayout;
+    if (nodeLayout == NodeLayout_DepthFirst)
+    {
+        numNodes = compactSubtree(rootNode, 0, 0);
+    }
+    else
+    {
+        CompactEntry root = { rootNode, NO_NODE_INDEX, 0 };
+        compactEntries[0] = root;
+        uint32_t tail = 1;
+        uint32_t levelEnd = 1;
+        for (uint32_t head = 0; head < tail; head++)
+        {
+            if (head == levelEnd) // the previous level is done, so tail is the end of this one
+            {
+                compactSegments.push_back(head);
+                levelEnd = tail;
+            }
+            CompactEntry& entry = compactEntries[head];
+            const HOTNode* node = entry.node;
+            nodeIndex.insert(node->nodeKey, head);
+            entry.link = (node->childByte != 0) ? tail : NO_NODE_INDEX;
+            uint32_t firstBody = entry.firstBody;
+            for (int i = 0; i < 8; i++)
+            {
+                if (HasOctChild(node->childByte, static_cast<OctantEnum>(i)))
+                {
+                    const HOTNode* childNode = lookUpNode(GetChildKey(node->nodeKey, static_cast<OctantEnum>(i)));
+                    CompactEntry child = { childNode, NO_NODE_INDEX, firstBody };
+                    compactEntries[tail++] = child;
+                    firstBody += (uint32_t)childNode->N;
+                }
+            }
+        }
+        numNodes = tail;
+    }
+    compactSegments.push_back(numNodes);
+
+    const CompactEntry* entries = compactEntries.data();
+    const uint32_t* segments = compactSegments.data();
+    int numSegments = (int)compactSegments.size() - 1;
+    size_t numBodies = (size_t)rootNode->N;
+    bool depthFirst = (nodeLayout == NodeLayout_DepthFirst);
+    HOTNode* array = nodeArray;
+#pragma omp parallel
+    {
+        int thread = omp_get_thread_num();
+        int numThreads = omp_get_num_threads();
+        size_t start, end;
+        GetThreadChunk(numBodies, thread, numThreads, start, end);
+        if (thread == numThreads - 1)
+        {
+            end = (size_t)UINT32_MAX + 1; // the last chunk takes anything counted past the root's bodies
+        }
+        for (int s = 0; s < numSegments; s++)
+        {
+            const CompactEntry* first = entries + segments[s];
+            const CompactEntry* last = entries + segments[s + 1];
+            auto beforeBody = [](const CompactEntry& entry, size_t body) { return(entry.firstBody < body); };
+            const CompactEntry* from = std::lower_bound(first, last, start, beforeBody);
+            const CompactEntry* to = std::lower_bound(from, last, end, beforeBody);
+            for (const CompactEntry* entry = from; entry < to; entry++)
+            {
+                HOTNode* node = new (&array[entry - entries]) HOTNode(*entry->node);
+                if (depthFirst)
+                {
+                    node->skip = entry->link;
+                }
+                else
+                {
+                    node->firstChild = entry->link;
+                }
+            }
+        }
+    }
+
+    nodes.clear();
+    insertionPath.depth = -1;
+    if (!useNodeArena)
+    {
+        nodePool.reset(); // the build nodes are no longer referenced, recycle them all at once
+    }
+}
+
+uint32_t LinearHashedOctree::compactSubtree(const HOTNode* node, uint32_t index, uint32_t firstBody)
+{
+    nodeIndex.insert(node->nodeKey, index);
+    uint32_t next = index + 1;
+    uint32_t childBody = firstBody;
+    for (int i = 0; i < 8; i++) // recursion depth is bounded by MAX_TREE_DEPTH
+    {
+        if (HasOctChild(node->childByte, static_cast<OctantEnum>(i)))
+        {
+            const HOTNode* childNode = lookUpNode(GetChildKey(node->nodeKey, static_cast<OctantEnum>(i)));
+            next = compactSubtree(childNode, next, childBody);
+            childBody += (uint32_t)childNode->N;
+        }
+    }
+    CompactEntry entry = { node, next, firstBody };
+    compactEntries[index] = entry;
+    return(next);
+}
+
+uint32_t LinearHashedOctree::childIndex(uint32_t nodeIdx, OctantEnum octant) const
+{
+    const HOTNode& node = nodeArray[nodeIdx];
+    if (!HasOctChild(node.childByte, octant))
+    {
+        return(NO_NODE_INDEX);
+    }
+    if (nodeLayout == NodeLayout_BreadthFirst)
+    {
+        return(node.firstChild + OctChildOffset(node.childByte, octant));
+    }
+    uint32_t child = nodeIdx + 1; // depth-first: step over the subtrees of the earlier siblings
+    for (int sibling = OctChildOffset(node.childByte, octant); sibling > 0; sibling--)
+    {
+        child = nodeArray[child].skip;
+    }
+    return(child);
+}
+
+void LinearHashedOctree::createChildNode(HOTNode*& node, OctantEnum& targetOctant, const Vec3D& bodyPosition, const double& bodyMass)
+{
+    spatialKey childKey = GetChildKey(node->nodeKey, targetOctant);
+
+    HOTNode* childNode = createNode(node, targetOctant, bodyPosition, bodyMass);
+
+    //Update the parent node to reflect the new child's existence.
+    SetOctChild(node->childByte, targetOctant);
+
+    insertHOTNode(childNode);
+}
+
+
+
+void LinearHashedOctree::computeNodeBaryCenters(HOTNode*& node)
+{
+    //compute c.o.m. first.
+    //insertion already summed mass and N into the node but left the first body's position as its barycenter, so all three are rebuilt from the children
+    spatialKey childKey;
+    HOTNode* childNode;
+    double mass;
+    node->mass = 0.0;
+    node->N = 0;
+    node->baryCenter = Vec3D();
+    for (size_t i = 0; i < 8; i++) //For all eight possible children
+    {
+        if (node->childByte & (1 << i))
+        {
+            childKey = (node->nodeKey << 3) | i; //Compute new Morton key for the child
+            childNode = lookUpNode(childKey);            //fetches the child node from the HOT
+            mass = childNode->mass;
+            node->mass += mass;
+            node->N += childNode->N;
+
+            node->baryCenter += childNode->baryCenter * mass;
+        }
+    }
+    if (node->mass > 0.0)
+    {
+        node->baryCenter /= node->mass;
+    }
+
+    //compute quadrapole moment contribution
+    node->quadrupoleMoment[0] = 0.0;
+    node->quadrupoleMoment[1] = 0.0;
+    node->quadrupoleMoment[2] = 0.0;
+    node->quadrupoleMoment[3] = 0.0;
+    node->quadrupoleMoment[4] = 0.0;
+    node->quadrupoleMoment[5] = 0.0;
+
+    Vec3D childPosition;
+    double xx, yy, zz, d2;
+
+
+    for (size_t i = 0; i < 8; i++) //For all eight possible children
+    {
+        if (node->childByte & (1 << i))
+        {
+            childKey = (node->nodeKey << 3) | i; //Compute new Morton key for the child
+            childNode = lookUpNode(childKey);            //fetches the child node from the HOT
+
+            //first, get child's pos in c.o.m. reference frame
+            childPosition = childNode->baryCenter - node->baryCenter;
+
+            mass = childNode->mass;
+
+            xx = childPosition.x * childPosition.y; //xy
+            node->quadrupoleMoment[1] += 3.0 * mass * xx;
+
+            zz = childPosition.x * childPosition.z; //xz
+            node->quadrupoleMoment[2] += 3.0 * mass * zz;
+
+
+            yy = childPosition.y * childPosition.z; //yz
+            node->quadrupoleMoment[4] += 3.0 * mass * yy;
+
+
+
+            xx = childPosition.x * childPosition.x;
+            zz = childPosition.z * childPosition.z;
+            yy = childPosition.y * childPosition.y;
+
+            d2 = xx + yy + zz;
+            d2 *= mass;
+            mass *= 3.0;
+
+
+            node->quadrupoleMoment[0] += mass * xx - d2;
+            node->quadrupoleMoment[3] += mass * yy - d2;
+            node->quadrupoleMoment[5] += mass * zz - d2;
+
+
+            //directly add child's moments also
+            if (childNode->N > 1)
+            {
+                node->quadrupoleMoment[0] += childNode->quadrupoleMoment[0];
+                node->quadrupoleMoment[1] += childNode->quadrupoleMoment[1];
+                node->quadrupoleMoment[2] += childNode->quadrupoleMoment[2];
+                node->quadrupoleMoment[3] += childNode->quadrupoleMoment[3];
+                node->quadrupoleMoment[4] += childNode->quadrupoleMoment[4];
+                node->quadrupoleMoment[5] += childNode->quadrupoleMoment[5];
+            }
+        }
+
+
+
+    }
+
+}
+
+void LinearHashedOctree::computeTreeBaryCenters(HOTNode*& node)
+{
+    if (node == nullptr || node->N == 1 || node->childByte == 0) // leaves, including MAX_TREE_DEPTH buckets, already hold their barycenter
+    {
+        return;
+    }
+
+
+    //   
+    /*
+    for (auto& pair : nodes)
+    {
+        //const HOTNode* node = pair.second;
+        computeTreeBaryCenters(pair.second);
+    }
+    //*/
+
+
+    ///*
+
+
+    //do a depth-first search
+    //recursively update children first.
+    spatialKey childKey;
+    for (int i = 0; i < 8; i++) //For all eight possible children
+    {
+        if (node->childByte & (1 << i))// See if the ith child exist
+        {
+            childKey = (node->nodeKey << 3) | i; //Compute new Morton key for the child
+            auto* child = lookUpNode(childKey);  //Using key, look child up in hash table and recursively visit subtree
+            computeTreeBaryCenters(child);
+        }
+    }
+    //*/
+
+
+    computeNodeBaryCenters(node);
+
+}
+
+
+
+
+
+
+void LinearHashedOctree::printHashedOctree()
+{
+    std::vector<std::pair<spatialKey, HOTNode*>> listed; // the hashed build nodes, or the compacted array in layout order
+    nodes.forEach([&listed](const spatialKey& key, HOTNode* node) { listed.push_back(std::make_pair(key, node)); });
+    for (uint32_t n = 0; n < numNodes; n++)
+    {
+        listed.push_back(std::make_pair(nodeArray[n].nodeKey, &nodeArray[n]));
+    }
+    std::cout << "\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n\nnodes.bucket_count(): " << (isCompacted() ? nodeIndex.bucket_count() : nodes.bucket_count());
+    std::cout << "\n\nnodes.size(): " << nodeCount();
+
+
+    size_t i = 0;
+    for (auto& pair : listed)
+    {
+        i++;
+        const spatialKey& key = pair.first;
+
+
+        // Print out key
+
+        std::cout << "\n\n\n\n\n\n\n\n\nKey: " << key;        std::cout << "                  i" << i;
+
+        std::cout << "\nBinary MortonKey: ";
+        PrintKeyBinary(std::cout, key, SPATIAL_KEY_BITS);
+
+
+
+        if (pair.second != nullptr)
+        {
+            //OctantEnum octant1 = DetermineOctant(value->nodeBounds.center, value->baryCenter); //determine which octant the new body should be placed in 
+            //cout << "\n\nDetermineOctant: " << octant1;
+
+            OctantEnum octant2 = GetOctantFromKey(pair.second->nodeKey);
+            std::cout << "\n\n\n\nGetOctantFromKey: " << octant2;
+
+            std::cout << "\nvalue->nodeBounds.size: " << pair.second->nodeBounds.size;
+            std::cout << "\nvalue->nodeBounds.center: (" << pair.second->nodeBounds.center.x; std::cout << ", " << pair.second->nodeBounds.center.y; std::cout << ", " << pair.second->nodeBounds.center.z; std::cout << ")";
+
+
+            std::cout << "\nvalue->baryCenter: (" << pair.second->baryCenter.x; std::cout << ", " << pair.second->baryCenter.y; std::cout << ", " << pair.second->baryCenter.z; std::cout << ")";
+            std::cout << "\nvalue->mass: " << pair.second->mass;
+
+            std::cout << "\nvalue->N: " << pair.second->N;
+            std::cout << "\nvalue->childByte: " << std::bitset<8>(pair.second->childByte);
+
+        }
+    }
+}
@@ -0,0 +1,154 @@
+#include "MemoryPlacement.h"
+#include <mutex>
+#include <unordered_map>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#endif
+
+
+
+
+/**
+ * Bookkeeping for the huge-page blocks: the size of every live block, so FreeLargeBlock can tell them from
+ * ordinary aligned arrays and knows how much to unmap. It is touched only when a large array is allocated or
+ * freed, which the grow-only buffers do rarely, so one mutex is enough.
+ */
+struct LargeBlockRegistry
+{
+    std::mutex lock;
+    std::unordered_map<void*, size_t> liveBlocks; // block -> mapped bytes
+    bool hugePages = true;
+#ifdef _WIN32
+    bool largePagesUnavailable = false; // set after the first MEM_LARGE_PAGES failure (usually a missing SeLockMemoryPrivilege)
+#endif
+};
+
+static LargeBlockRegistry& GetLargeBlockRegistry()
+{
+    static LargeBlockRegistry registry;
+    return(registry);
+}
+
+static inline size_t RoundUpToHugePage(size_t bytes)
+{
+    return((bytes + HUGE_PAGE_SIZE - 1) & ~(HUGE_PAGE_SIZE - 1));
+}
+
+
+// Map a fresh block of mappedBytes (a multiple of HUGE_PAGE_SIZE), 2 MB aligned where the platform allows it
+static void* MapLargeBlock(LargeBlockRegistry& registry, size_t mappedBytes)
+{
+#ifdef _WIN32
+    void* block = nullptr;
+    if (registry.hugePages && !registry.largePagesUnavailable)
+    {
+        size_t largePage = GetLargePageMinimum();
+        if (largePage != 0 && mappedBytes % largePage == 0)
+        {
+            block = VirtualAlloc(nullptr, mappedBytes, MEM_RESERVE | MEM_COMMIT | MEM_LARGE_PAGES, PAGE_READWRITE);
+        }
+        if (block == nullptr)
+        {
+            registry.largePagesUnavailable = true;
+        }
+    }
+    if (block == nullptr) // small pages, still 64 KB aligned and committed lazily
+    {
+        block = VirtualAlloc(nullptr, mappedBytes, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+    }
+    return(block);
+#else
+    // Over-map by one huge page and trim both ends so the block starts on a 2 MB boundary
+    size_t spanBytes = mappedBytes + HUGE_PAGE_SIZE;
+    void* span = mmap(nullptr, spanBytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (span == MAP_FAILED)
+    {
+        return(nullptr);
+    }
+    uintptr_t spanStart = (uintptr_t)span;
+    uintptr_t blockStart = (spanStart + HUGE_PAGE_SIZE - 1) & ~(uintptr_t)(HUGE_PAGE_SIZE - 1);
+    size_t head = blockStart - spanStart;
+    size_t tail = spanBytes - head - mappedBytes;
+    if (head > 0)
+    {
+        munmap(span, head);
+    }
+    if (tail > 0)
+    {
+        munmap((void*)(blockStart + mappedBytes), tail);
+    }
+#ifdef MADV_HUGEPAGE
+    if (registry.hugePages)
+    {
+        madvise((void*)blockStart, mappedBytes, MADV_HUGEPAGE); // only a hint, ignored (small pages) where THP is disabled
+    }
+#endif
+    return((void*)blockStart);
+#endif
+}
+
+static void UnmapLargeBlock(void* block, size_t mappedBytes)
+{
+#ifdef _WIN32
+    (void)mappedBytes;
+    VirtualFree(block, 0, MEM_RELEASE);
+#else
+    munmap(block, mappedBytes);
+#endif
+}
+
+
+void* AllocateLargeBlock(size_t bytes)
+{
+    LargeBlockRegistry& registry = GetLargeBlockRegistry();
+    size_t mappedBytes = RoundUpToHugePage(bytes > 0 ? bytes : 1);
+    std::lock_guard<std::mutex> guard(registry.lock);
+    void* block = MapLargeBlock(registry, mappedBytes);
+    if (block == nullptr)
+    {
+        throw std::bad_alloc();
+    }
+    registry.liveBlocks[block] = mappedBytes;
+    return(block);
+}
+
+bool FreeLargeBlock(void* block)
+{
+    if (block == nullptr)
+    {
+        return(true);
+    }
+    LargeBlockRegistry& registry = GetLargeBlockRegistry();
+    std::lock_guard<std::mutex> guard(registry.lock);
+    auto live = registry.liveBlocks.find(block);
+    if (live == registry.liveBlocks.end())
+    {
+        return(false);
+    }
+    UnmapLargeBlock(block, live->second);
+    registry.liveBlocks.erase(live);
+    return(true);
+}
+
+void SetHugePages(bool enabled)
+{
+    LargeBlockRegistry& registry = GetLargeBlockRegistry();
+    std::lock_guard<std::mutex> guard(registry.lock);
+    registry.hugePages = enabled;
+}
+
+bool HugePagesEnabled()
+{
+    LargeBlockRegistry& registry = GetLargeBlockRegistry();
+    std::lock_guard<std::mutex> guard(registry.lock);
+    return(registry.hugePages);
+}
@@ -1,53 +1,487 @@
-
-
-#include "MortonKeys.h"
-
-
-
-
-/**
- * Interleave the bits of three spatialKey values representing the integer coordinates in 3D space.
- *
- * This function interleaves the bits of xInt, yInt, and zInt to produce a single 63-bit Morton key, which is a linear index for 3D points that preserves spatial locality.
- * The interleaving of bits is achieved through a series of bit-wise manipulations, essentially spreading the bits of each integer across the entire 63-bit range.
- *
- *  @param xInt: X-coordinate integer representation.
- *  @param yInt: Y-coordinate integer representation.
- *  @param zInt: Z-coordinate integer representation.
- *
- *  @return Morton key interleaved from xInt, yInt, and zInt.
- */
-
-
- /**
- * Compute the Morton key for a given 3D position and spatial size (_size)..
- *
- * This function first scales and converts the floating-point 3D position
- * values into the integer domain. After this conversion, it calls the `interleaveBits` method to create the Morton key
- * which is stored as the instance variable.
- *
- *  @param _position: 3D position to be encoded into a Morton key.
- *  @param _size: Maximum spatial extent of the positions. This value is used to scale the positions to [0, 1) range.
- */
-
-
-
- /**
- * Takes a Morton key and decodes it back into a 3D position.
- *
- * The function decodeMortonKey is designed to reverse the operation performed by interleaveBits, effectively 'de-interleaving' the bits of the Morton key back into three separate x, y, and z components.
- * These integer values are then scaled back into the floating-point domain to retrieve the original 3D position.
- *
- * A loop is performed over the number of bits used for each dimension(21). For each bit index i, we extract the i-th bit from the Morton key for each dimension using bitwise AND (&) and shifting (<<, >>).
- * This is done by: bitwise ANDing (&) the Morton key with a mask that has a 1 in the position corresponding to the i-th bit of the given dimension and 0s everywhere else.
- * For x, this is (1ull << ((3*i) + 2)) - i, for y, this is (1ull << ((3*i) + 1)) - i, and for z, this is (1ull << (3*i)) - i. This operation will yield a number
- * where only the i-th bit of the dimension is potentially non-zero. Bitwise ORing (|=) the result with the accumulated result for the dimension. This 'keeps' the bits that were already set in the dimension
- * and potentially sets the i-th bit if it was set in the Morton key.
- *
- * It then scales these integer values back into the floating-point domain to retrieve the original 3D position.
- *
- *  @param _mortonKey: Morton key to be decoded.
- *  @param _size: Maximum spatial extent of the positions. This value is used to scale back the decoded position to its original range.
- *
- *  @return Decoded 3D position from the Morton key.
- */
+
+
+#include "MortonKeys.h"
+#include <type_traits>
+
+
+
+
+/**
+ * Interleave the bits of three spatialKey values representing the integer coordinates in 3D space.
+ *
+ * This function interleaves the bits of xInt, yInt, and zInt to produce a single 63-bit Morton key, which is a linear index for 3D points that preserves spatial locality.
+ * The interleaving of bits is achieved through a series of bit-wise manipulations, essentially spreading the bits of each integer across the entire 63-bit range.
+ *
+ *  @param xInt: X-coordinate integer representation.
+ *  @param yInt: Y-coordinate integer representation.
+ *  @param zInt: Z-coordinate integer representation.
+ *
+ *  @return Morton key interleaved from xInt, yInt, and zInt.
+ */
+
+
+ /**
+ * Compute the Morton key for a given 3D position and spatial size (_size)..
+ *
+ * This function first scales and converts the floating-point 3D position
+ * values into the integer domain. After this conversion, it calls the `interleaveBits` method to create the Morton key
+ * which is stored as the instance variable.
+ *
+ *  @param _position: 3D position to be encoded into a Morton key.
+ *  @param _size: Maximum spatial extent of the positions. This value is used to scale the positions to [0, 1) range.
+ */
+
+
+
+ /**
+ * Takes a Morton key and decodes it back into a 3D position.
+ *
+ * The function decodeMortonKey is designed to reverse the operation performed by interleaveBits, effectively 'de-interleaving' the bits of the Morton key back into three separate x, y, and z components.
+ * These integer values are then scaled back into the floating-point domain to retrieve the original 3D position.
+ *
+ * A loop is performed over the number of bits used for each dimension(21). For each bit index i, we extract the i-th bit from the Morton key for each dimension using bitwise AND (&) and shifting (<<, >>).
+ * This is done by: bitwise ANDing (&) the Morton key with a mask that has a 1 in the position corresponding to the i-th bit of the given dimension and 0s everywhere else.
+ * For x, this is (1ull << ((3*i) + 2)) - i, for y, this is (1ull << ((3*i) + 1)) - i, and for z, this is (1ull << (3*i)) - i. This operation will yield a number
+ * where only the i-th bit of the dimension is potentially non-zero. Bitwise ORing (|=) the result with the accumulated result for the dimension. This 'keeps' the bits that were already set in the dimension
+ * and potentially sets the i-th bit if it was set in the Morton key.
+ *
+ * It then scales these integer values back into the floating-point domain to retrieve the original 3D position.
+ *
+ *  @param _mortonKey: Morton key to be decoded.
+ *  @param _size: Maximum spatial extent of the positions. This value is used to scale back the decoded position to its original range.
+ *
+ *  @return Decoded 3D position from the Morton key.
+ */
+
+
+
+
+// ------------- Batch Morton encoding and decoding -------------
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define MORTON_KEYS_X86 1
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+#endif
+
+// GCC and Clang only emit BMI2/AVX2 instructions inside functions compiled for those targets, MSVC emits intrinsics anywhere
+#if defined(MORTON_KEYS_X86) && !defined(_MSC_VER)
+#define MORTON_TARGET_BMI2 __attribute__((target("bmi2")))
+#define MORTON_TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define MORTON_TARGET_BMI2
+#define MORTON_TARGET_AVX2
+#endif
+
+static const uint64_t xKeyBits = 0x4924924924924924ull; // bits 2, 5, ..., 62
+static const uint64_t yKeyBits = 0x2492492492492492ull; // bits 1, 4, ..., 61
+static const uint64_t zKeyBits = 0x1249249249249249ull; // bits 0, 3, ..., 60
+
+
+#if SPATIAL_KEY_BITS == 64
+/**
+ * Lookup tables for the LUT codec: spreadTable[b] is the byte b with its bits moved to every third position,
+ * compactTable[c] packs the x, y and z bits of a 9-bit key chunk as x | y << 8 | z << 16. 128-bit keys have no LUT
+ * codec, so there the tables are left out.
+ */
+struct MortonLookupTables
+{
+    MortonLookupTables()
+    {
+        for (uint64_t b = 0; b < 256; b++)
+        {
+            spreadTable[b] = spreadBits(b);
+        }
+        for (uint32_t c = 0; c < 512; c++)
+        {
+            compactTable[c] = (uint32_t)compactBits((uint64_t)c >> 2) | ((uint32_t)compactBits((uint64_t)c >> 1) << 8) | ((uint32_t)compactBits((uint64_t)c) << 16);
+        }
+    }
+    uint64_t spreadTable[256];
+    uint32_t compactTable[512];
+};
+
+static const MortonLookupTables& GetMortonLookupTables()
+{
+    static const MortonLookupTables tables;
+    return(tables);
+}
+#endif
+
+
+// quantization shared by the scalar codecs, identical to quantizePosition(position - center, size) so batch and scalar keys always agree
+static inline uint64_t QuantizeCoordinate(double value, double center, double size, double frac)
+{
+    return((uint64_t)clampToKeyGrid(((value - center) + size) * frac));
+}
+
+
+static bool cpuHasBMI2 = false;
+static bool cpuHasAVX2 = false;
+
+static void DetectKeyCodecSupport()
+{
+#if defined(MORTON_KEYS_X86) && defined(_MSC_VER)
+    int info[4];
+    __cpuid(info, 0);
+    int maxLeaf = info[0];
+    __cpuid(info, 1);
+    bool osUsesXSave = ((info[2] >> 27) & 1) != 0;
+    bool cpuHasAVX = ((info[2] >> 28) & 1) != 0;
+    if (maxLeaf >= 7)
+    {
+        __cpuidex(info, 7, 0);
+        cpuHasBMI2 = ((info[1] >> 8) & 1) != 0;
+        cpuHasAVX2 = ((info[1] >> 5) & 1) != 0;
+    }
+    // AVX2 also needs the OS to save the upper halves of the ymm registers
+    cpuHasAVX2 = cpuHasAVX2 && osUsesXSave && cpuHasAVX && ((_xgetbv(0) & 6) == 6);
+#elif defined(MORTON_KEYS_X86)
+    __builtin_cpu_init();
+    cpuHasBMI2 = __builtin_cpu_supports("bmi2") != 0;
+    cpuHasAVX2 = __builtin_cpu_supports("avx2") != 0;
+#endif
+}
+
+bool KeyCodecSupported(KeyCodecEnum codec)
+{
+    static const bool detected = (DetectKeyCodecSupport(), true);
+    (void)detected;
+    switch (codec)
+    {
+    case Codec_BMI2:
+        return(cpuHasBMI2);
+    case Codec_AVX2:
+        return(cpuHasAVX2);
+    default:
+        return(true);
+    }
+}
+
+KeyCodecEnum SelectKeyCodec()
+{
+    // pdep/pext do a whole axis in one instruction, the vectorized magic bits need ~15 instructions per 4 keys per axis.
+    // On AMD before Zen 3 pdep/pext are microcoded and far slower than either, but those CPUs are not told apart here.
+    if (KeyCodecSupported(Codec_BMI2))
+    {
+        return(Codec_BMI2);
+    }
+    if (KeyCodecSupported(Codec_AVX2))
+    {
+        return(Codec_AVX2);
+    }
+    return(Codec_LUT);
+}
+
+const char* KeyCodecName(KeyCodecEnum codec)
+{
+    switch (codec)
+    {
+    case Codec_MagicBits: return("magic bits");
+    case Codec_LUT:       return("LUT");
+    case Codec_BMI2:      return("BMI2");
+    case Codec_AVX2:      return("AVX2");
+    default:              return("auto");
+    }
+}
+
+static KeyCodecEnum ResolveKeyCodec(KeyCodecEnum codec)
+{
+    static const KeyCodecEnum bestCodec = SelectKeyCodec();
+    if (codec == Codec_Auto || !KeyCodecSupported(codec))
+    {
+        return(bestCodec);
+    }
+    return(codec);
+}
+
+
+
+
+#if SPATIAL_KEY_BITS == 64
+static void EncodeMagicBits(const double* x, const double* y, const double* z, size_t strideBytes, size_t count, const Vec3D& center, double size, spatialKey* keys)
+{
+    const double frac = maxKeyDimension_d / (2.0 * size);
+    for (size_t i = 0; i < count; ++i)
+    {
+        keys[i] = interleaveBits(QuantizeCoordinate(StridedValue(x, strideBytes, i), center.x, size, frac),
+                                 QuantizeCoordinate(StridedValue(y, strideBytes, i), center.y, size, frac),
+                                 QuantizeCoordinate(StridedValue(z, strideBytes, i), center.z, size, frac));
+    }
+}
+
+static void EncodeLUT(const double* x, const double* y, const double* z, size_t strideBytes, size_t count, const Vec3D& center, double size, spatialKey* keys)
+{
+    const uint64_t* spread = GetMortonLookupTables().spreadTable;
+    const double frac = maxKeyDimension_d / (2.0 * size);
+    for (size_t i = 0; i < count; ++i)
+    {
+        uint64_t xInt = QuantizeCoordinate(StridedValue(x, strideBytes, i), center.x, size, frac);
+        uint64_t yInt = QuantizeCoordinate(StridedValue(y, strideBytes, i), center.y, size, frac);
+        uint64_t zInt = QuantizeCoordinate(StridedValue(z, strideBytes, i), center.z, size, frac);
+        uint64_t key = keySentinel;
+        for (int byte = 0; byte < 3; byte++) // 21 bits per axis: bytes 0, 1 and the low 5 bits of byte 2
+        {
+            int shift = 8 * byte;
+            key |= ((spread[(xInt >> shift) & 0xFF] << 2) | (spread[(yInt >> shift) & 0xFF] << 1) | spread[(zInt >> shift) & 0xFF]) << (3 * shift);
+        }
+        keys[i] = key;
+    }
+}
+
+static void DecodeMagicBits(const spatialKey* keys, size_t count, const Vec3D& center, double size, double* x, double* y, double* z, size_t strideBytes)
+{
+    const double scale = 2.0 * size / maxKeyDimension_d;
+    for (size_t i = 0; i < count; ++i)
+    {
+        StridedValue(x, strideBytes, i) = (double)compactBits(keys[i] >> 2) * scale - size + center.x;
+        StridedValue(y, strideBytes, i) = (double)compactBits(keys[i] >> 1) * scale - size + center.y;
+        StridedValue(z, strideBytes, i) = (double)compactBits(keys[i]) * scale - size + center.z;
+    }
+}
+
+static void DecodeLUT(const spatialKey* keys, size_t count, const Vec3D& center, double size, double* x, double* y, double* z, size_t strideBytes)
+{
+    const uint32_t* compact = GetMortonLookupTables().compactTable;
+    const double scale = 2.0 * size / maxKeyDimension_d;
+    for (size_t i = 0; i < count; ++i)
+    {
+        uint64_t xInt = 0, yInt = 0, zInt = 0;
+        for (int chunk = 0; chunk < 7; chunk++) // 7 chunks of 9 bits cover the 63 key bits, each yields 3 bits per axis
+        {
+            uint32_t bits = compact[(keys[i] >> (9 * chunk)) & 0x1FF];
+            xInt |= (uint64_t)(bits & 0x7) << (3 * chunk);
+            yInt |= (uint64_t)((bits >> 8) & 0x7) << (3 * chunk);
+            zInt |= (uint64_t)((bits >> 16) & 0x7) << (3 * chunk);
+        }
+        StridedValue(x, strideBytes, i) = (double)xInt * scale - size + center.x;
+        StridedValue(y, strideBytes, i) = (double)yInt * scale - size + center.y;
+        StridedValue(z, strideBytes, i) = (double)zInt * scale - size + center.z;
+    }
+}
+
+#if defined(MORTON_KEYS_X86)
+MORTON_TARGET_BMI2 static void EncodeBMI2(const double* x, const double* y, const double* z, size_t strideBytes, size_t count, const Vec3D& center, double size, spatialKey* keys)
+{
+    const double frac = maxKeyDimension_d / (2.0 * size);
+    for (size_t i = 0; i < count; ++i)
+    {
+        keys[i] = keySentinel
+            | _pdep_u64(QuantizeCoordinate(StridedValue(x, strideBytes, i), center.x, size, frac), xKeyBits)
+            | _pdep_u64(QuantizeCoordinate(StridedValue(y, strideBytes, i), center.y, size, frac), yKeyBits)
+            | _pdep_u64(QuantizeCoordinate(StridedValue(z, strideBytes, i), center.z, size, frac), zKeyBits);
+    }
+}
+
+MORTON_TARGET_BMI2 static void DecodeBMI2(const spatialKey* keys, size_t count, const Vec3D& center, double size, double* x, double* y, double* z, size_t strideBytes)
+{
+    const double scale = 2.0 * size / maxKeyDimension_d;
+    for (size_t i = 0; i < count; ++i)
+    {
+        StridedValue(x, strideBytes, i) = (double)_pext_u64(keys[i], xKeyBits) * scale - size + center.x;
+        StridedValue(y, strideBytes, i) = (double)_pext_u64(keys[i], yKeyBits) * scale - size + center.y;
+        StridedValue(z, strideBytes, i) = (double)_pext_u64(keys[i], zKeyBits) * scale - size + center.z;
+    }
+}
+
+// clamp to the key grid and truncate four scaled coordinates, then spread their bits with the magic masks
+// the clamp is clampToKeyGrid lane by lane: max_pd returns its second operand, 0, for a NaN as std::max(0.0, NaN) does
+MORTON_TARGET_AVX2 static inline __m256i SpreadQuantizedAVX2(__m256d scaled)
+{
+    scaled = _mm256_min_pd(_mm256_max_pd(scaled, _mm256_setzero_pd()), _mm256_set1_pd(maxKeyDimension_d - 1.0));
+    __m256i v = _mm256_cvtepi32_epi64(_mm256_cvttpd_epi32(scaled)); // coordinates are below 2^21, so 32-bit conversion is exact
+    v = _mm256_and_si256(_mm256_or_si256(v, _mm256_slli_epi64(v, 32)), _mm256_set1_epi64x((long long)sepMasks[0]));
+    v = _mm256_and_si256(_mm256_or_si256(v, _mm256_slli_epi64(v, 16)), _mm256_set1_epi64x((long long)sepMasks[1]));
+    v = _mm256_and_si256(_mm256_or_si256(v, _mm256_slli_epi64(v, 8)), _mm256_set1_epi64x((long long)sepMasks[2]));
+    v = _mm256_and_si256(_mm256_or_si256(v, _mm256_slli_epi64(v, 4)), _mm256_set1_epi64x((long long)sepMasks[3]));
+    v = _mm256_and_si256(_mm256_or_si256(v, _mm256_slli_epi64(v, 2)), _mm256_set1_epi64x((long long)sepMasks[4]));
+    return(v);
+}
+
+MORTON_TARGET_AVX2 static inline __m256d CompactToCoordinateAVX2(__m256i v, __m256d scale, __m256d size, __m256d center)
+{
+    v = _mm256_and_si256(v, _mm256_set1_epi64x((long long)sepMasks[4]));
+    v = _mm256_and_si256(_mm256_or_si256(v, _mm256_srli_epi64(v, 2)), _mm256_set1_epi64x((long long)sepMasks[3]));
+    v = _mm256_and_si256(_mm256_or_si256(v, _mm256_srli_epi64(v, 4)), _mm256_set1_epi64x((long long)sepMasks[2]));
+    v = _mm256_and_si256(_mm256_or_si256(v, _mm256_srli_epi64(v, 8)), _mm256_set1_epi64x((long long)sepMasks[1]));
+    v = _mm256_and_si256(_mm256_or_si256(v, _mm256_srli_epi64(v, 16)), _mm256_set1_epi64x((long long)sepMasks[0]));
+    v = _mm256_and_si256(_mm256_or_si256(v, _mm256_srli_epi64(v, 32)), _mm256_set1_epi64x(0x1fffff));
+    // gather the low 32 bits of each lane into the lower half and convert those as int32
+    __m128i packed = _mm256_castsi256_si128(_mm256_permutevar8x32_epi32(v, _mm256_setr_epi32(0, 2, 4, 6, 0, 2, 4, 6)));
+    return(_mm256_add_pd(_mm256_sub_pd(_mm256_mul_pd(_mm256_cvtepi32_pd(packed), scale), size), center));
+}
+
+MORTON_TARGET_AVX2 static void EncodeAVX2(const double* x, const double* y, const double* z, size_t strideBytes, size_t count, const Vec3D& center, double size, spatialKey* keys)
+{
+    const double frac = maxKeyDimension_d / (2.0 * size);
+    const __m256d sizeVec = _mm256_set1_pd(size);
+    const __m256d fracVec = _mm256_set1_pd(frac);
+    const __m256d xCenter = _mm256_set1_pd(center.x);
+    const __m256d yCenter = _mm256_set1_pd(center.y);
+    const __m256d zCenter = _mm256_set1_pd(center.z);
+    const __m256i sentinel = _mm256_set1_epi64x((long long)keySentinel);
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4)
+    {
+        __m256d xs = _mm256_setr_pd(StridedValue(x, strideBytes, i), StridedValue(x, strideBytes, i + 1), StridedValue(x, strideBytes, i + 2), StridedValue(x, strideBytes, i + 3));
+        __m256d ys = _mm256_setr_pd(StridedValue(y, strideBytes, i), StridedValue(y, strideBytes, i + 1), StridedValue(y, strideBytes, i + 2), StridedValue(y, strideBytes, i + 3));
+        __m256d zs = _mm256_setr_pd(StridedValue(z, strideBytes, i), StridedValue(z, strideBytes, i + 1), StridedValue(z, strideBytes, i + 2), StridedValue(z, strideBytes, i + 3));
+        __m256i xBits = SpreadQuantizedAVX2(_mm256_mul_pd(_mm256_add_pd(_mm256_sub_pd(xs, xCenter), sizeVec), fracVec));
+        __m256i yBits = SpreadQuantizedAVX2(_mm256_mul_pd(_mm256_add_pd(_mm256_sub_pd(ys, yCenter), sizeVec), fracVec));
+        __m256i zBits = SpreadQuantizedAVX2(_mm256_mul_pd(_mm256_add_pd(_mm256_sub_pd(zs, zCenter), sizeVec), fracVec));
+        __m256i key = _mm256_or_si256(_mm256_or_si256(sentinel, _mm256_slli_epi64(xBits, 2)), _mm256_or_si256(_mm256_slli_epi64(yBits, 1), zBits));
+        _mm256_storeu_si256((__m256i*)(keys + i), key);
+    }
+    EncodeMagicBits(StridedPointer(x, strideBytes, i), StridedPointer(y, strideBytes, i), StridedPointer(z, strideBytes, i), strideBytes, count - i, center, size, keys + i);
+}
+
+MORTON_TARGET_AVX2 static void DecodeAVX2(const spatialKey* keys, size_t count, const Vec3D& center, double size, double* x, double* y, double* z, size_t strideBytes)
+{
+    const __m256d scale = _mm256_set1_pd(2.0 * size / maxKeyDimension_d);
+    const __m256d sizeVec = _mm256_set1_pd(size);
+    const __m256d xCenter = _mm256_set1_pd(center.x);
+    const __m256d yCenter = _mm256_set1_pd(center.y);
+    const __m256d zCenter = _mm256_set1_pd(center.z);
+    double xs[4], ys[4], zs[4];
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4)
+    {
+        __m256i key = _mm256_loadu_si256((const __m256i*)(keys + i));
+        _mm256_storeu_pd(xs, CompactToCoordinateAVX2(_mm256_srli_epi64(key, 2), scale, sizeVec, xCenter));
+        _mm256_storeu_pd(ys, CompactToCoordinateAVX2(_mm256_srli_epi64(key, 1), scale, sizeVec, yCenter));
+        _mm256_storeu_pd(zs, CompactToCoordinateAVX2(key, scale, sizeVec, zCenter));
+        for (int lane = 0; lane < 4; lane++)
+        {
+            StridedValue(x, strideBytes, i + lane) = xs[lane];
+            StridedValue(y, strideBytes, i + lane) = ys[lane];
+            StridedValue(z, strideBytes, i + lane) = zs[lane];
+        }
+    }
+    DecodeMagicBits(keys + i, count - i, center, size, StridedPointer(x, strideBytes, i), StridedPointer(y, strideBytes, i), StridedPointer(z, strideBytes, i), strideBytes);
+}
+#endif
+#endif
+
+
+/**
+ * Encode count positions into Morton keys on the calling thread.
+ *
+ * The positions are read through byte strides so the same code serves Body arrays (x = &bodies[0].position.x, stride sizeof(Body))
+ * and separate coordinate arrays (stride sizeof(double)). The key grid spans the cube [center - size, center + size], and every
+ * codec produces exactly the keys of computeMortonKey(position - center, size), also for positions outside the cube, which
+ * all of them clamp to its faces (tests/nbody-tests.cpp checks this).
+ * 128-bit keys always use the scalar encoder, the accelerated codecs work on 64-bit keys.
+ *
+ *  @param strideBytes: Distance in bytes between consecutive values of x, y and z.
+ *  @param codec: Codec to use, Codec_Auto (or a codec this CPU lacks) selects the fastest supported one.
+ */
+void EncodeMortonKeyBlock(const double* x, const double* y, const double* z, size_t strideBytes, size_t count, const Vec3D& center, double size, spatialKey* keys, KeyCodecEnum codec)
+{
+    if (count == 0)
+    {
+        return;
+    }
+    if (x == nullptr || y == nullptr || z == nullptr || keys == nullptr)
+    {
+        throw std::invalid_argument("positions or keys is a null pointer");
+    }
+#if SPATIAL_KEY_BITS == 64
+    switch (ResolveKeyCodec(codec))
+    {
+#if defined(MORTON_KEYS_X86)
+    case Codec_BMI2:
+        EncodeBMI2(x, y, z, strideBytes, count, center, size, keys);
+        return;
+    case Codec_AVX2:
+        EncodeAVX2(x, y, z, strideBytes, count, center, size, keys);
+        return;
+#endif
+    case Codec_LUT:
+        EncodeLUT(x, y, z, strideBytes, count, center, size, keys);
+        return;
+    default:
+        EncodeMagicBits(x, y, z, strideBytes, count, center, size, keys);
+        return;
+    }
+#else
+    (void)codec;
+    for (size_t i = 0; i < count; ++i)
+    {
+        keys[i] = computeMortonKey(Vec3D(StridedValue(x, strideBytes, i) - center.x, StridedValue(y, strideBytes, i) - center.y, StridedValue(z, strideBytes, i) - center.z), size);
+    }
+#endif
+}
+
+void DecodeMortonKeyBlock(const spatialKey* keys, size_t count, const Vec3D& center, double size, double* x, double* y, double* z, size_t strideBytes, KeyCodecEnum codec)
+{
+    if (count == 0)
+    {
+        return;
+    }
+    if (x == nullptr || y == nullptr || z == nullptr || keys == nullptr)
+    {
+        throw std::invalid_argument("positions or keys is a null pointer");
+    }
+#if SPATIAL_KEY_BITS == 64
+    switch (ResolveKeyCodec(codec))
+    {
+#if defined(MORTON_KEYS_X86)
+    case Codec_BMI2:
+        DecodeBMI2(keys, count, center, size, x, y, z, strideBytes);
+        return;
+    case Codec_AVX2:
+        DecodeAVX2(keys, count, center, size, x, y, z, strideBytes);
+        return;
+#endif
+    case Codec_LUT:
+        DecodeLUT(keys, count, center, size, x, y, z, strideBytes);
+        return;
+    default:
+        DecodeMagicBits(keys, count, center, size, x, y, z, strideBytes);
+        return;
+    }
+#else
+    (void)codec;
+    for (size_t i = 0; i < count; ++i)
+    {
+        Vec3D position = decodeMortonKey(keys[i], size);
+        StridedValue(x, strideBytes, i) = position.x + center.x;
+        StridedValue(y, strideBytes, i) = position.y + center.y;
+        StridedValue(z, strideBytes, i) = position.z + center.z;
+    }
+#endif
+}
+
+/**
+ * Parallel batch encode, each thread encodes the GetThreadChunk share of the positions.
+ */
+void EncodeMortonKeys(const double* x, const double* y, const double* z, size_t strideBytes, size_t count, const Vec3D& center, double size, spatialKey* keys, KeyCodecEnum codec)
+{
+    if (x == nullptr || y == nullptr || z == nullptr || keys == nullptr)
+    {
+        throw std::invalid_argument("positions or keys is a null pointer");
+    }
+    codec = ResolveKeyCodec(codec); // resolve before the threads start so the CPU query runs once
+#pragma omp parallel
+    {
+        size_t start, end;
+        GetThreadChunk(count, omp_get_thread_num(), omp_get_num_threads(), start, end);
+        EncodeMortonKeyBlock(StridedPointer(x, strideBytes, start), StridedPointer(y, strideBytes, start), StridedPointer(z, strideBytes, start), strideBytes, end - start, center, size, keys + start, codec);
+    }
+}
+
+void DecodeMortonKeys(const spatialKey* keys, size_t count, const Vec3D& center, double size, double* x, double* y, double* z, size_t strideBytes, KeyCodecEnum codec)
+{
+    if (x == nullptr || y == nullptr || z == nullptr || keys == nullptr)
+    {
+        throw std::invalid_argument("positions or keys is a null pointer");
+    }
+    codec = ResolveKeyCodec(codec);
+#pragma omp parallel
+    {
+        size_t start, end;
+        GetThreadChunk(count, omp_get_thread_num(), omp_get_num_threads(), start, end);
+        DecodeMortonKeyBlock(keys + start, end - start, center, size, StridedPointer(x, strideBytes, start), StridedPointer(y, strideBytes, start), StridedPointer(z, strideBytes, start), strideBytes, codec);
+    }
+}
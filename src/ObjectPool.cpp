@@ -1 +1,48 @@
-#include "ObjectPool.h"
+#include "ObjectPool.h"
+#include <algorithm>
+#include <vector>
+
+
+
+
+/**
+ * Slot registry behind PoolThreadSlot. Slots are handed out lowest first, so the caches in use stay at the front of each
+ * pool's array; a thread that finds all MAX_POOL_THREADS slots held gets one past them, and such overflow slots are not
+ * recycled. The registry is never destroyed, as threads may still exit after static destruction has begun.
+ */
+struct PoolSlotRegistry
+{
+    std::mutex lock;
+    std::vector<int> freeSlots; // released slots below MAX_POOL_THREADS, kept sorted in descending order
+    int nextSlot = 0;
+};
+
+static PoolSlotRegistry& GetPoolSlotRegistry()
+{
+    static PoolSlotRegistry* registry = new PoolSlotRegistry();
+    return(*registry);
+}
+
+int AcquirePoolThreadSlot()
+{
+    PoolSlotRegistry& registry = GetPoolSlotRegistry();
+    std::lock_guard<std::mutex> guard(registry.lock);
+    if (!registry.freeSlots.empty())
+    {
+        int slot = registry.freeSlots.back();
+        registry.freeSlots.pop_back();
+        return(slot);
+    }
+    return(registry.nextSlot++);
+}
+
+void ReleasePoolThreadSlot(int slot)
+{
+    if (slot >= MAX_POOL_THREADS)
+    {
+        return;
+    }
+    PoolSlotRegistry& registry = GetPoolSlotRegistry();
+    std::lock_guard<std::mutex> guard(registry.lock);
+    registry.freeSlots.insert(std::upper_bound(registry.freeSlots.begin(), registry.freeSlots.end(), slot, std::greater<int>()), slot);
+}
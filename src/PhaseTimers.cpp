@@ -0,0 +1,235 @@
+#include "PhaseTimers.h"
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <iomanip>
+#include <mutex>
+#include <vector>
+
+
+
+
+/**
+ * One thread's totals of the current step, a cache line or two of its own so the threads never share one.
+ */
+struct alignas(64) PendingPhaseTimes
+{
+    double seconds[NUM_PHASES];
+    bool timed[NUM_PHASES];
+};
+
+/**
+ * The last PHASE_TIMER_WINDOW samples of one phase, oldest overwritten first.
+ */
+struct PhaseWindow
+{
+    double samples[PHASE_TIMER_WINDOW];
+    size_t count = 0;
+    size_t next = 0;
+
+    void add(double seconds)
+    {
+        samples[next] = seconds;
+        next = (next + 1) % PHASE_TIMER_WINDOW;
+        count = std::min(count + 1, (size_t)PHASE_TIMER_WINDOW);
+    }
+};
+
+typedef std::array<PhaseWindow, NUM_PHASES> PhaseWindows;
+
+static std::atomic<bool> phaseTimersEnabled(true);
+static PendingPhaseTimes pendingTimes[MAX_PHASE_THREADS]; // written by the threads while stepping, read by CommitPhaseTimings after they joined
+
+static std::mutex windowLock; // guards everything below
+static std::vector<PhaseWindows> threadWindows; // [thread][phase]
+static PhaseWindows stepWindows; // slowest thread per step
+static size_t committedSteps = 0;
+
+
+
+
+void SetPhaseTimersEnabled(bool enabled)
+{
+    phaseTimersEnabled = enabled;
+}
+
+bool PhaseTimersEnabled()
+{
+    return(phaseTimersEnabled.load(std::memory_order_relaxed));
+}
+
+void AddPhaseTime(PhaseEnum phase, double seconds)
+{
+    int thread = omp_get_thread_num();
+    if (thread >= MAX_PHASE_THREADS)
+    {
+        return;
+    }
+    pendingTimes[thread].seconds[phase] += seconds;
+    pendingTimes[thread].timed[phase] = true;
+}
+
+void CommitPhaseTimings()
+{
+    std::lock_guard<std::mutex> guard(windowLock);
+    for (int phase = 0; phase < NUM_PHASES; phase++)
+    {
+        bool timed = false;
+        double slowest = 0.0;
+        for (int thread = 0; thread < MAX_PHASE_THREADS; thread++)
+        {
+            PendingPhaseTimes& pending = pendingTimes[thread];
+            if (!pending.timed[phase])
+            {
+                continue;
+            }
+            if ((size_t)thread >= threadWindows.size())
+            {
+                threadWindows.resize(thread + 1);
+            }
+            threadWindows[thread][phase].add(pending.seconds[phase]);
+            slowest = std::max(slowest, pending.seconds[phase]);
+            timed = true;
+            pending.seconds[phase] = 0.0;
+            pending.timed[phase] = false;
+        }
+        if (timed)
+        {
+            stepWindows[phase].add(slowest);
+        }
+    }
+    committedSteps++;
+}
+
+void ResetPhaseTimings()
+{
+    std::lock_guard<std::mutex> guard(windowLock);
+    for (int thread = 0; thread < MAX_PHASE_THREADS; thread++)
+    {
+        pendingTimes[thread] = PendingPhaseTimes();
+    }
+    threadWindows.clear();
+    stepWindows = PhaseWindows();
+    committedSteps = 0;
+}
+
+static PhaseStatistics WindowStatistics(const PhaseWindow& window)
+{
+    PhaseStatistics statistics;
+    if (window.count == 0)
+    {
+        return(statistics);
+    }
+    std::vector<double> sorted(window.samples, window.samples + window.count);
+    std::sort(sorted.begin(), sorted.end());
+    double sum = 0.0;
+    for (size_t s = 0; s < window.count; s++)
+    {
+        sum += sorted[s];
+    }
+    size_t p99Rank = (99 * window.count + 99) / 100; // nearest rank, 1-based
+    statistics.samples = window.count;
+    statistics.minSeconds = sorted[0];
+    statistics.meanSeconds = sum / window.count;
+    statistics.p99Seconds = sorted[p99Rank - 1];
+    statistics.lastSeconds = window.samples[(window.next + PHASE_TIMER_WINDOW - 1) % PHASE_TIMER_WINDOW];
+    return(statistics);
+}
+
+PhaseStatistics GetPhaseStatistics(PhaseEnum phase, int thread)
+{
+    std::lock_guard<std::mutex> guard(windowLock);
+    if (thread == PHASE_ALL_THREADS)
+    {
+        return(WindowStatistics(stepWindows[phase]));
+    }
+    if (thread < 0 || (size_t)thread >= threadWindows.size())
+    {
+        return(PhaseStatistics());
+    }
+    return(WindowStatistics(threadWindows[thread][phase]));
+}
+
+int PhaseTimerThreads()
+{
+    std::lock_guard<std::mutex> guard(windowLock);
+    return((int)threadWindows.size());
+}
+
+size_t PhaseTimerSteps()
+{
+    std::lock_guard<std::mutex> guard(windowLock);
+    return(committedSteps);
+}
+
+const char* PhaseName(PhaseEnum phase)
+{
+    static const char* names[NUM_PHASES] = { "bounds", "keys", "sort", "reorder", "build", "prune", "moments", "walk", "force", "integrate" };
+    return((phase >= 0 && phase < NUM_PHASES) ? names[phase] : "unknown");
+}
+
+
+
+
+void WritePhaseTimingsCSV(std::ostream& out)
+{
+    int threads = PhaseTimerThreads();
+    out << "phase,thread,samples,min_ms,mean_ms,p99_ms,last_ms\n";
+    out << std::fixed << std::setprecision(4);
+    for (int phase = 0; phase < NUM_PHASES; phase++)
+    {
+        for (int thread = PHASE_ALL_THREADS; thread < threads; thread++)
+        {
+            PhaseStatistics statistics = GetPhaseStatistics((PhaseEnum)phase, thread);
+            if (statistics.samples == 0)
+            {
+                continue;
+            }
+            out << PhaseName((PhaseEnum)phase) << ',';
+            if (thread == PHASE_ALL_THREADS)
+            {
+                out << "all";
+            }
+            else
+            {
+                out << thread;
+            }
+            out << ',' << statistics.samples << ',' << 1000.0 * statistics.minSeconds << ',' << 1000.0 * statistics.meanSeconds << ','
+                << 1000.0 * statistics.p99Seconds << ',' << 1000.0 * statistics.lastSeconds << '\n';
+        }
+    }
+}
+
+static void WriteStatisticsJSON(std::ostream& out, const PhaseStatistics& statistics)
+{
+    out << "\"samples\": " << statistics.samples << ", \"min_ms\": " << 1000.0 * statistics.minSeconds << ", \"mean_ms\": " << 1000.0 * statistics.meanSeconds
+        << ", \"p99_ms\": " << 1000.0 * statistics.p99Seconds << ", \"last_ms\": " << 1000.0 * statistics.lastSeconds;
+}
+
+void WritePhaseTimingsJSON(std::ostream& out)
+{
+    int threads = PhaseTimerThreads();
+    out << std::fixed << std::setprecision(4);
+    out << "{\n  \"steps\": " << PhaseTimerSteps() << ",\n  \"window\": " << PHASE_TIMER_WINDOW << ",\n  \"phases\": [";
+    for (int phase = 0; phase < NUM_PHASES; phase++)
+    {
+        out << (phase > 0 ? "," : "") << "\n    { \"phase\": \"" << PhaseName((PhaseEnum)phase) << "\", ";
+        WriteStatisticsJSON(out, GetPhaseStatistics((PhaseEnum)phase));
+        out << ",\n      \"threads\": [";
+        bool first = true;
+        for (int thread = 0; thread < threads; thread++)
+        {
+            PhaseStatistics statistics = GetPhaseStatistics((PhaseEnum)phase, thread);
+            if (statistics.samples == 0)
+            {
+                continue;
+            }
+            out << (first ? "" : ",") << "\n        { \"thread\": " << thread << ", ";
+            WriteStatisticsJSON(out, statistics);
+            out << " }";
+            first = false;
+        }
+        out << (first ? "] }" : "\n      ] }");
+    }
+    out << "\n  ]\n}\n";
+}
@@ -0,0 +1,350 @@
+#include "Render.h"
+#include <cmath>
+#include <cstdint>
+#include <algorithm>
+
+
+
+
+// Sphere shaders for the fixed-function (GL 2.1, GLSL 120) and the programmable (GL 3.2+, GLSL 150) renderers
+static const char* SPHERE_VERTEX_SHADER_120 = R"(
+#version 120
+attribute vec3 instancePosition;
+attribute float instanceMass;
+uniform float radiusPerMass;
+void main()
+{
+    gl_Position = gl_ModelViewProjectionMatrix * vec4(gl_Vertex.xyz * (instanceMass * radiusPerMass) + instancePosition, 1.0);
+}
+)";
+
+static const char* SPHERE_FRAGMENT_SHADER_120 = R"(
+#version 120
+uniform vec4 bodyColor;
+void main()
+{
+    gl_FragColor = bodyColor;
+}
+)";
+
+static const char* SPHERE_VERTEX_SHADER_150 = R"(
+#version 150
+uniform mat4 modelViewProjectionMatrix;
+uniform float radiusPerMass;
+in vec4 position;
+in vec3 instancePosition;
+in float instanceMass;
+void main()
+{
+    gl_Position = modelViewProjectionMatrix * vec4(position.xyz * (instanceMass * radiusPerMass) + instancePosition, 1.0);
+}
+)";
+
+static const char* SPHERE_FRAGMENT_SHADER_150 = R"(
+#version 150
+uniform vec4 bodyColor;
+out vec4 fragColor;
+void main()
+{
+    fragColor = bodyColor;
+}
+)";
+
+
+
+
+BodyRenderer::BodyRenderer() : sphereIndices(0), instanceCapacity(0), pointCapacity(0), instanceCount(0), pointCount(0), instanceStep(SIZE_MAX), pointStep(SIZE_MAX), lastDrawnCount(0), ready(false)
+{
+}
+
+void BodyRenderer::setup()
+{
+    bool programmable = ofIsGLProgrammableRenderer();
+    sphereShader.setupShaderFromSource(GL_VERTEX_SHADER, programmable ? SPHERE_VERTEX_SHADER_150 : SPHERE_VERTEX_SHADER_120);
+    sphereShader.setupShaderFromSource(GL_FRAGMENT_SHADER, programmable ? SPHERE_FRAGMENT_SHADER_150 : SPHERE_FRAGMENT_SHADER_120);
+    sphereShader.bindDefaults();
+    sphereShader.bindAttribute(BODY_POSITION_ATTRIBUTE, "instancePosition");
+    sphereShader.bindAttribute(BODY_MASS_ATTRIBUTE, "instanceMass");
+    ready = sphereShader.linkProgram();
+
+    ofMesh sphere = ofMesh::icosphere(1.0f, 1); // 80 triangles, a unit sphere the vertex shader scales and moves per instance
+    sphereVbo.setMesh(sphere, GL_STATIC_DRAW);
+    sphereIndices = (int)sphere.getNumIndices();
+}
+
+void BodyRenderer::draw(const BodySnapshot& snapshot, BodyRenderEnum mode)
+{
+    drawSprites(snapshot.positions.data(), snapshot.masses.data(), snapshot.positions.size(), snapshot.stepCount, mode);
+}
+
+void BodyRenderer::drawLevelOfDetail(const BodySnapshot& snapshot, BodyRenderEnum mode, const Vec3F& eye, float focalPixels, float pixelThreshold)
+{
+    if (snapshot.nodes->empty())
+    {
+        draw(snapshot, mode);
+        return;
+    }
+    SelectLevelOfDetail(snapshot, eye, focalPixels, pixelThreshold, lodPositions, lodMasses);
+    drawSprites(lodPositions.data(), lodMasses.data(), lodPositions.size(), SIZE_MAX, mode);
+}
+
+void BodyRenderer::drawSprites(const Vec3F* positions, const float* masses, size_t count, size_t step, BodyRenderEnum mode)
+{
+    lastDrawnCount = count;
+    if (count == 0)
+    {
+        return;
+    }
+    if (mode == BodyRender_Immediate || (mode == BodyRender_Instanced && !ready))
+    {
+        ofSetColor(31.875, 223.125, 63.75);
+        ofFill();
+        for (size_t i = 0; i < count; i++)
+        {
+            ofDrawSphere(positions[i].x, positions[i].y, positions[i].z, masses[i] * BODY_RADIUS_PER_MASS);
+        }
+        return;
+    }
+
+    if (mode == BodyRender_Instanced)
+    {
+        if (count > instanceCapacity)
+        {
+            sphereVbo.setAttributeData(BODY_POSITION_ATTRIBUTE, &positions[0].x, 3, (int)count, GL_DYNAMIC_DRAW, sizeof(Vec3F));
+            sphereVbo.setAttributeDivisor(BODY_POSITION_ATTRIBUTE, 1);
+            sphereVbo.setAttributeData(BODY_MASS_ATTRIBUTE, masses, 1, (int)count, GL_DYNAMIC_DRAW, sizeof(float));
+            sphereVbo.setAttributeDivisor(BODY_MASS_ATTRIBUTE, 1);
+            instanceCapacity = count;
+        }
+        else if (step == SIZE_MAX || step != instanceStep || count != instanceCount)
+        {
+            sphereVbo.updateAttributeData(BODY_POSITION_ATTRIBUTE, &positions[0].x, (int)count);
+            if (step == SIZE_MAX || instanceStep == SIZE_MAX || count != instanceCount) // the masses only change with the bodies, or between bodies and sprites
+            {
+                sphereVbo.updateAttributeData(BODY_MASS_ATTRIBUTE, masses, (int)count);
+            }
+        }
+        instanceStep = step;
+        instanceCount = count;
+
+        sphereShader.begin();
+        sphereShader.setUniform1f("radiusPerMass", BODY_RADIUS_PER_MASS);
+        sphereShader.setUniform4f("bodyColor", 31.875f / 255.0f, 223.125f / 255.0f, 63.75f / 255.0f, 1.0f);
+        sphereVbo.drawElementsInstanced(GL_TRIANGLES, sphereIndices, (int)count);
+        sphereShader.end();
+    }
+    else
+    {
+        if (count > pointCapacity)
+        {
+            pointVbo.setVertexData(&positions[0].x, 3, (int)count, GL_DYNAMIC_DRAW, sizeof(Vec3F));
+            pointCapacity = count;
+        }
+        else if (step == SIZE_MAX || step != pointStep || count != pointCount)
+        {
+            pointVbo.updateVertexData(&positions[0].x, (int)count);
+        }
+        pointStep = step;
+        pointCount = count;
+
+        ofSetColor(31.875, 223.125, 63.75);
+        glPointSize(BODY_POINT_SIZE);
+        pointVbo.draw(GL_POINTS, 0, (int)count);
+    }
+}
+
+
+
+
+void SelectLevelOfDetail(const BodySnapshot& snapshot, const Vec3F& eye, float focalPixels, float pixelThreshold, std::vector<Vec3F>& positions, std::vector<float>& masses)
+{
+    positions.clear();
+    masses.clear();
+    const std::vector<SnapshotNode>& nodes = *snapshot.nodes;
+    float ratio = pixelThreshold / focalPixels; // accept once (2 * size) / distance < ratio
+    uint32_t numNodes = (uint32_t)nodes.size();
+    uint32_t index = 0;
+    while (index < numNodes)
+    {
+        const SnapshotNode& node = nodes[index];
+        float dx = node.baryCenter.x - eye.x;
+        float dy = node.baryCenter.y - eye.y;
+        float dz = node.baryCenter.z - eye.z;
+        bool leaf = (node.skip == index + 1);
+        if (leaf || 4.0f * node.size * node.size < (dx * dx + dy * dy + dz * dz) * ratio * ratio)
+        {
+            positions.push_back(node.baryCenter);
+            masses.push_back(std::cbrt(node.mass));
+            index = node.skip;
+        }
+        else
+        {
+            index++;
+        }
+    }
+}
+
+
+
+
+TreeWireframe::TreeWireframe() : stopping(false), busy(false), resultReady(false), jobMinDepth(0), jobMaxDepth(0), jobMaxNodes(0), resultNodes(0), resultDepth(0),
+    requestedStep(SIZE_MAX), requestedMinDepth(0), requestedMaxDepth(0), requestedMaxNodes(0), vertexCapacity(0), vertexCount(0), drawnNodes(0), drawnDepth(0)
+{
+    worker = std::thread([this]() { run(); });
+}
+
+TreeWireframe::~TreeWireframe()
+{
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        stopping = true;
+    }
+    wake.notify_one();
+    worker.join();
+}
+
+void TreeWireframe::update(const BodySnapshot& snapshot, uint32_t minDepth, uint32_t maxDepth, size_t maxNodes)
+{
+    if (snapshot.nodes->empty() || (snapshot.stepCount == requestedStep && minDepth == requestedMinDepth && maxDepth == requestedMaxDepth && maxNodes == requestedMaxNodes))
+    {
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        if (busy) // try again with whichever snapshot is newest once the worker is done
+        {
+            return;
+        }
+        jobNodes = snapshot.nodes; // a reference, not a copy: the worker keeps the tree alive past the next latestSnapshot()
+        jobMinDepth = minDepth;
+        jobMaxDepth = maxDepth;
+        jobMaxNodes = maxNodes;
+        busy = true;
+    }
+    wake.notify_one();
+    requestedStep = snapshot.stepCount;
+    requestedMinDepth = minDepth;
+    requestedMaxDepth = maxDepth;
+    requestedMaxNodes = maxNodes;
+}
+
+void TreeWireframe::run()
+{
+    std::vector<Vec3F> vertices;
+    std::unique_lock<std::mutex> guard(lock);
+    while (true)
+    {
+        wake.wait(guard, [this]() { return(stopping || busy); });
+        if (stopping)
+        {
+            return;
+        }
+        guard.unlock();
+        uint32_t depth = 0;
+        size_t numNodes = BuildTreeWireframe(*jobNodes, jobMinDepth, jobMaxDepth, jobMaxNodes, vertices, depth);
+        guard.lock();
+        jobNodes.reset(); // let the simulation thread reuse the vector
+        resultVertices.swap(vertices);
+        resultNodes = numNodes;
+        resultDepth = depth;
+        resultReady = true;
+        busy = false;
+    }
+}
+
+void TreeWireframe::draw()
+{
+    bool uploaded = false;
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        if (resultReady)
+        {
+            uploadVertices.swap(resultVertices);
+            drawnNodes = resultNodes;
+            drawnDepth = resultDepth;
+            resultReady = false;
+            uploaded = true;
+        }
+    }
+    if (uploaded)
+    {
+        vertexCount = uploadVertices.size();
+        if (vertexCount > vertexCapacity)
+        {
+            lineVbo.setVertexData(&uploadVertices[0].x, 3, (int)vertexCount, GL_DYNAMIC_DRAW, sizeof(Vec3F));
+            vertexCapacity = vertexCount;
+        }
+        else if (vertexCount > 0)
+        {
+            lineVbo.updateVertexData(&uploadVertices[0].x, (int)vertexCount);
+        }
+    }
+    if (vertexCount == 0)
+    {
+        return;
+    }
+    ofSetColor(255, 255, 255, 63.75);
+    lineVbo.draw(GL_LINES, 0, (int)vertexCount);
+}
+
+size_t BuildTreeWireframe(const std::vector<SnapshotNode>& nodes, uint32_t minDepth, uint32_t maxDepth, size_t maxNodes, std::vector<Vec3F>& vertices, uint32_t& depthLimit)
+{
+    vertices.clear();
+    depthLimit = minDepth;
+    if (nodes.empty() || maxDepth < minDepth)
+    {
+        return(0);
+    }
+
+    // Keep the deepest level whose nodes, together with all the shallower selected ones, still fit under maxNodes
+    std::vector<size_t> levelCounts;
+    for (size_t n = 0; n < nodes.size(); n++)
+    {
+        if (nodes[n].depth >= levelCounts.size())
+        {
+            levelCounts.resize(nodes[n].depth + 1, 0);
+        }
+        levelCounts[nodes[n].depth]++;
+    }
+    size_t selected = 0;
+    for (uint32_t depth = minDepth; depth <= maxDepth && depth < levelCounts.size(); depth++)
+    {
+        if (selected + levelCounts[depth] > maxNodes && depth > minDepth)
+        {
+            break;
+        }
+        selected += levelCounts[depth];
+        depthLimit = depth;
+    }
+    selected = std::min(selected, maxNodes); // only when minDepth alone is over the cap, then its first nodes in pre-order are drawn
+
+    // 12 edges per cube: each corner bit pattern joined to the ones that differ in one axis
+    vertices.reserve(selected * 24);
+    size_t numNodes = 0;
+    for (size_t n = 0; n < nodes.size() && numNodes < selected; n++)
+    {
+        const SnapshotNode& node = nodes[n];
+        if (node.depth < minDepth || node.depth > depthLimit)
+        {
+            continue;
+        }
+        Vec3F corners[8];
+        for (int c = 0; c < 8; c++)
+        {
+            corners[c] = Vec3F(node.center.x + ((c & 1) ? node.size : -node.size), node.center.y + ((c & 2) ? node.size : -node.size), node.center.z + ((c & 4) ? node.size : -node.size));
+        }
+        for (int c = 0; c < 8; c++)
+        {
+            for (int axis = 1; axis < 8; axis <<= 1)
+            {
+                if (!(c & axis))
+                {
+                    vertices.push_back(corners[c]);
+                    vertices.push_back(corners[c | axis]);
+                }
+            }
+        }
+        numNodes++;
+    }
+    return(numNodes);
+}
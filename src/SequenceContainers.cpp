@@ -1 +1 @@
-#include "SequenceContainers.h"
+#include "SequenceContainers.h"
@@ -0,0 +1,212 @@
+#include "Simulation.h"
+#include <random>
+#include <cmath>
+#include <cstring>
+
+
+
+
+Simulation::Simulation() : bodiesAccelerations(nullptr), lastSortResult(Sort_Radix), stepCount(0), time(0.0)
+{
+}
+
+Simulation::~Simulation()
+{
+    FreePlacedArray(bodiesAccelerations);
+}
+
+void Simulation::initialize(const SimulationParams& _params)
+{
+    params = _params;
+    LHTree.deleteTree();
+    GenerateInitialConditions(bodies, params.numBodies, params.initialCondition, params.seed);
+    FreePlacedArray(bodiesAccelerations);
+    bodiesAccelerations = AllocatePlacedArray<Vec3D>(params.numBodies);
+    for (size_t i = 0; i < params.numBodies; i++)
+    {
+        bodiesAccelerations[i] = Vec3D(0, 0, 0);
+    }
+
+    Vec3D boundsMin, boundsMax;
+    ComputeBodyBounds(bodies, boundsMin, boundsMax);
+    rootNodeBounds = OctantBounds(boundsMin, boundsMax, ROOT_BOUNDS_PADDING);
+    ComputeBodyKeys(bodies, rootNodeBounds.center, rootNodeBounds.size, bodySortBuffers.keyBuffers, params.keyOrdering);
+    RadixSortBodies(bodies, bodySortBuffers);
+    lastSortResult = Sort_Radix;
+    traversalStatistics = TraversalStatistics();
+    stepCount = 0;
+    time = 0.0;
+    ResetPhaseTimings(); // the windows start with the first step
+}
+
+void Simulation::sortBodies()
+{
+    // Keys are generated in last step's padded root cube while the same pass measures the bodies' bounding box.
+    // Only when a body has left the cube, or the bodies have contracted well inside it, is the cube refitted and the keys redone.
+    // Until then the keys of bodies outside the cube are clamped to its faces (clampToKeyGrid).
+    Vec3D boundsMin, boundsMax;
+    size_t keyDescents = ComputeBodyKeys(bodies, rootNodeBounds.center, rootNodeBounds.size, bodySortBuffers.keyBuffers, boundsMin, boundsMax, params.keyOrdering);
+    ScopedPhaseTimer boundsTimer(Phase_Bounds);
+    bool refit = !rootNodeBounds.fitsBox(boundsMin, boundsMax, ROOT_BOUNDS_PADDING);
+    if (refit)
+    {
+        rootNodeBounds = OctantBounds(boundsMin, boundsMax, ROOT_BOUNDS_PADDING);
+    }
+    boundsTimer.stop();
+    if (refit)
+    {
+        keyDescents = ComputeBodyKeys(bodies, rootNodeBounds.center, rootNodeBounds.size, bodySortBuffers.keyBuffers, params.keyOrdering);
+    }
+    if (params.adaptiveSort)
+    {
+        lastSortResult = AdaptiveSortBodies(bodies, bodySortBuffers, keyDescents);
+    }
+    else
+    {
+        RadixSortBodies(bodies, bodySortBuffers);
+        lastSortResult = Sort_Radix;
+    }
+    if (lastSortResult != Sort_InOrder)
+    {
+        PermuteBodyAccelerations(bodiesAccelerations, bodySortBuffers, bodies.numBodies);
+    }
+}
+
+void Simulation::step()
+{
+    sortBodies();
+    ComputePositionAtHalfTimeStep(params.dt, bodies);
+    LHTree.setNodeLayout(params.nodeLayout);
+    buildLinearHashedOctreeInPlace(LHTree, bodies, rootNodeBounds);
+    ComputeHOTOctreeForce(LHTree, bodies, bodiesAccelerations, params.theta, &traversalStatistics); //this function computes the accelerations from gravity for all bodies
+    ComputeVelocityAndPosition(params.dt, bodies, bodiesAccelerations);
+    stepCount++;
+    time += params.dt;
+    CommitPhaseTimings();
+}
+
+
+
+
+/**
+ * Uniformly distributed direction, scaled to length.
+ */
+static Vec3D RandomDirection(std::mt19937& rng, double length)
+{
+    std::uniform_real_distribution<double> uniform(-1.0, 1.0);
+    std::uniform_real_distribution<double> angle(0.0, 2.0 * 3.14159265358979323846);
+    double cosTheta = uniform(rng);
+    double sinTheta = std::sqrt(1.0 - cosTheta * cosTheta);
+    double phi = angle(rng);
+    return(Vec3D(length * sinTheta * std::cos(phi), length * sinTheta * std::sin(phi), length * cosTheta));
+}
+
+static void GenerateUniformCube(BodySystem& bodies, std::mt19937& rng)
+{
+    std::uniform_real_distribution<double> position(-IC_RADIUS, IC_RADIUS);
+    std::uniform_real_distribution<double> velocity(-1.0, 1.0);
+    for (size_t i = 0; i < bodies.numBodies; i++)
+    {
+        Vec3D r(position(rng), position(rng), position(rng));
+        Vec3D v(velocity(rng), velocity(rng), velocity(rng));
+        bodies.setBody(i, Body(r, v, 1));
+    }
+}
+
+/**
+ * Aarseth, Henon and Wielen (1974): radii from the inverted cumulative mass profile, speeds by rejection from the
+ * isotropic distribution function, f(q) ~ q^2 (1 - q^2)^3.5 with q the fraction of the local escape speed.
+ */
+static void GeneratePlummer(BodySystem& bodies, std::mt19937& rng)
+{
+    const double scaleRadius = IC_RADIUS / 4.0;
+    const double totalMass = (double)bodies.numBodies;
+    std::uniform_real_distribution<double> unit(0.0, 1.0);
+    for (size_t i = 0; i < bodies.numBodies; i++)
+    {
+        double radius;
+        do
+        {
+            double massFraction = unit(rng);
+            radius = (massFraction > 0.0) ? scaleRadius / std::sqrt(std::pow(massFraction, -2.0 / 3.0) - 1.0) : 0.0;
+        } while (!(radius < 10.0 * scaleRadius)); // also rejects the infinite radius of massFraction == 1
+
+        double q, g;
+        do
+        {
+            q = unit(rng);
+            g = 0.1 * unit(rng);
+        } while (g > q * q * std::pow(1.0 - q * q, 3.5));
+        double escapeSpeed = std::sqrt(2.0 * totalMass) * std::pow(radius * radius + scaleRadius * scaleRadius, -0.25);
+
+        bodies.setBody(i, Body(RandomDirection(rng, radius), RandomDirection(rng, q * escapeSpeed), 1));
+    }
+}
+
+/**
+ * Positions uniform over the disk (radius ~ sqrt(uniform)) with a small vertical spread, velocities circular for the
+ * mass inside each body's radius, N (r / R)^2 for a uniform disk, treated as if it were a point at the center.
+ */
+static void GenerateDisk(BodySystem& bodies, std::mt19937& rng)
+{
+    const double totalMass = (double)bodies.numBodies;
+    const double thickness = IC_RADIUS / 100.0;
+    std::uniform_real_distribution<double> unit(0.0, 1.0);
+    std::uniform_real_distribution<double> height(-thickness, thickness);
+    for (size_t i = 0; i < bodies.numBodies; i++)
+    {
+        double radius = IC_RADIUS * std::sqrt(unit(rng));
+        double phi = 2.0 * 3.14159265358979323846 * unit(rng);
+        double enclosedMass = totalMass * (radius / IC_RADIUS) * (radius / IC_RADIUS);
+        double speed = (radius > 0.0) ? std::sqrt(enclosedMass / radius) : 0.0;
+
+        Vec3D r(radius * std::cos(phi), radius * std::sin(phi), height(rng));
+        Vec3D v(-speed * std::sin(phi), speed * std::cos(phi), 0);
+        bodies.setBody(i, Body(r, v, 1));
+    }
+}
+
+void GenerateInitialConditions(BodySystem& bodies, size_t numBodies, InitialConditionEnum initialCondition, uint32_t seed)
+{
+    bodies.resize(numBodies);
+    std::mt19937 rng(seed);
+    switch (initialCondition)
+    {
+    case IC_Plummer:
+        GeneratePlummer(bodies, rng);
+        break;
+    case IC_Disk:
+        GenerateDisk(bodies, rng);
+        break;
+    default:
+        GenerateUniformCube(bodies, rng);
+        break;
+    }
+}
+
+const char* InitialConditionName(InitialConditionEnum initialCondition)
+{
+    switch (initialCondition)
+    {
+    case IC_Plummer:
+        return("plummer");
+    case IC_Disk:
+        return("disk");
+    default:
+        return("cube");
+    }
+}
+
+bool ParseInitialCondition(const char* name, InitialConditionEnum& initialCondition)
+{
+    const InitialConditionEnum all[] = { IC_UniformCube, IC_Plummer, IC_Disk };
+    for (size_t c = 0; c < sizeof(all) / sizeof(all[0]); c++)
+    {
+        if (std::strcmp(name, InitialConditionName(all[c])) == 0)
+        {
+            initialCondition = all[c];
+            return(true);
+        }
+    }
+    return(false);
+}
@@ -0,0 +1,194 @@
+#include "SimulationThread.h"
+#include <future>
+#include <omp.h>
+
+
+
+
+SimulationThread::SimulationThread() : running(false), captureTree(false), paramsChanged(false), configChanged(false)
+{
+}
+
+SimulationThread::~SimulationThread()
+{
+    stop();
+}
+
+void SimulationThread::start(const SimulationParams& params, const ExecutionConfig& config)
+{
+    stop();
+    {
+        std::lock_guard<std::mutex> guard(commandLock);
+        requestedParams = params;
+        requestedConfig = config;
+        paramsChanged = false;
+        configChanged = false;
+    }
+    running = true;
+    std::promise<void> initialized;
+    std::future<void> firstSnapshot = initialized.get_future();
+    worker = std::thread([this, params, config, initialized = std::move(initialized)]() mutable
+    {
+        // Size and pin the team before the first allocation, so the first-touch placement uses the same thread chunks as every later phase
+        SetExecutionConfig(config);
+        {
+            std::lock_guard<std::mutex> guard(commandLock);
+            appliedConfig = GetExecutionConfig();
+        }
+        simulation.initialize(params);
+        publishSnapshot(0.0);
+        initialized.set_value();
+        run();
+    });
+    firstSnapshot.wait();
+}
+
+void SimulationThread::stop()
+{
+    running = false;
+    if (worker.joinable())
+    {
+        worker.join();
+    }
+}
+
+void SimulationThread::run()
+{
+    while (running.load(std::memory_order_relaxed))
+    {
+        applyPendingChanges();
+        double start = omp_get_wtime();
+        simulation.step();
+        publishSnapshot(omp_get_wtime() - start);
+    }
+}
+
+void SimulationThread::applyPendingChanges()
+{
+    std::lock_guard<std::mutex> guard(commandLock);
+    if (paramsChanged)
+    {
+        simulation.params.theta = requestedParams.theta;
+        simulation.params.dt = requestedParams.dt;
+        simulation.params.keyOrdering = requestedParams.keyOrdering;
+        simulation.params.adaptiveSort = requestedParams.adaptiveSort;
+        simulation.params.nodeLayout = requestedParams.nodeLayout;
+        paramsChanged = false;
+    }
+    if (configChanged)
+    {
+        SetExecutionConfig(requestedConfig); // the arrays keep the pages of the old team, as with any mid-run change
+        appliedConfig = GetExecutionConfig();
+        configChanged = false;
+    }
+}
+
+/**
+ * Append the subtree of the compacted node at index to nodes in pre-order, whichever layout the tree was compacted in.
+ */
+static void CaptureSubtree(const LinearHashedOctree& LHTree, uint32_t index, uint32_t depth, std::vector<SnapshotNode>& nodes)
+{
+    const HOTNode& node = LHTree.nodeArray[index];
+    size_t captured = nodes.size();
+    SnapshotNode copy;
+    copy.baryCenter = Vec3F((float)node.baryCenter.x, (float)node.baryCenter.y, (float)node.baryCenter.z);
+    copy.mass = (float)node.mass;
+    copy.center = Vec3F((float)node.nodeBounds.center.x, (float)node.nodeBounds.center.y, (float)node.nodeBounds.center.z);
+    copy.size = (float)node.nodeBounds.size;
+    copy.skip = 0;
+    copy.depth = depth;
+    nodes.push_back(copy);
+
+    if (node.childByte != 0)
+    {
+        if (LHTree.nodeLayout == NodeLayout_DepthFirst)
+        {
+            for (uint32_t child = index + 1; child < node.skip; child = LHTree.nodeArray[child].skip)
+            {
+                CaptureSubtree(LHTree, child, depth + 1, nodes);
+            }
+        }
+        else
+        {
+            uint32_t lastChild = node.firstChild + CountOctChildren(node.childByte);
+            for (uint32_t child = node.firstChild; child < lastChild; child++)
+            {
+                CaptureSubtree(LHTree, child, depth + 1, nodes);
+            }
+        }
+    }
+    nodes[captured].skip = (uint32_t)nodes.size();
+}
+
+void SimulationThread::publishSnapshot(double stepSeconds)
+{
+    BodySnapshot& snapshot = snapshots.writeBuffer();
+    const BodySystem& bodies = simulation.bodies;
+    snapshot.positions.resize(bodies.numBodies);
+    snapshot.masses.resize(bodies.numBodies);
+    for (size_t i = 0; i < bodies.numBodies; i++)
+    {
+        snapshot.positions[i] = Vec3F((float)bodies.x[i], (float)bodies.y[i], (float)bodies.z[i]);
+        snapshot.masses[i] = (float)bodies.m[i];
+    }
+
+    if (snapshot.nodes.use_count() > 1) // someone (the wireframe worker) still reads the tree this slot carried, leave it to them
+    {
+        snapshot.nodes = std::make_shared<std::vector<SnapshotNode>>();
+    }
+    std::atomic_thread_fence(std::memory_order_acquire); // pairs with the release of the last other reference before reusing the vector
+    snapshot.nodes->clear();
+    if (captureTree.load(std::memory_order_relaxed) && simulation.LHTree.isCompacted())
+    {
+        snapshot.nodes->reserve(simulation.LHTree.numNodes);
+        CaptureSubtree(simulation.LHTree, 0, 0, *snapshot.nodes);
+    }
+
+    snapshot.rootBounds = simulation.rootNodeBounds;
+    snapshot.params = simulation.params;
+    snapshot.lastSortResult = simulation.lastSortResult;
+    snapshot.traversal = simulation.traversalStatistics;
+    snapshot.stepCount = simulation.stepCount;
+    snapshot.time = simulation.time;
+    snapshot.stepSeconds = stepSeconds;
+    snapshots.publish();
+}
+
+
+
+
+void SimulationThread::setParams(const SimulationParams& params)
+{
+    std::lock_guard<std::mutex> guard(commandLock);
+    requestedParams = params;
+    paramsChanged = true;
+}
+
+SimulationParams SimulationThread::params() const
+{
+    std::lock_guard<std::mutex> guard(commandLock);
+    return(requestedParams);
+}
+
+void SimulationThread::setExecutionConfig(const ExecutionConfig& config)
+{
+    std::lock_guard<std::mutex> guard(commandLock);
+    requestedConfig = config;
+    configChanged = true;
+}
+
+ExecutionConfig SimulationThread::executionConfig() const
+{
+    std::lock_guard<std::mutex> guard(commandLock);
+    return(configChanged ? requestedConfig : appliedConfig);
+}
+
+void SimulationThread::setCaptureTree(bool capture)
+{
+    captureTree = capture;
+}
+
+const BodySnapshot& SimulationThread::latestSnapshot()
+{
+    return(snapshots.readBuffer());
+}
@@ -1,5 +1,6 @@
 
 #include "ofApp.h"
+#include <fstream>
 
 //--------------------------------------------------------------
 void ofApp::setup()
@@ -12,25 +13,19 @@ void ofApp::setup()
 	ofSetVerticalSync(true);
 	ofEnableSmoothing();
 	ofEnableDepthTest();
+	bodyRenderer.setup();
 
 
 
-	numBodies = 10000;
-	bodies = new Body[numBodies];
+	SetMemoryPlacement(Placement_FirstTouch);
 
-
-	for (size_t i = 0; i < numBodies; i++)
-	{
-		bodies[i] = Body(Vec3D(ofRandom(-1500, 1500), ofRandom(-1500, 1500), ofRandom(-1500, 1500)), Vec3D(ofRandom(-1, 1), ofRandom(-1, 1), ofRandom(-1, 1)), 1);
-	}
-
-	rootNodeBounds = { bodies, numBodies };
-	for (int i = 0; i < numBodies; i++)
-	{
-		bodies[i].bodyKey = computeMortonKey(bodies[i].position, rootNodeBounds.size);
-	}
-	RadixSortBodies(bodies, numBodies);
-	buildLinearHashedOctreeInPlace(LHTree, bodies, numBodies, rootNodeBounds);
+	SimulationParams params;
+	params.numBodies = 10000;
+	params.initialCondition = IC_UniformCube;
+	params.seed = (uint32_t)ofGetSystemTimeMillis(); // a new cloud every run, as before
+	simulationThread.setCaptureTree(visualizeTree || levelOfDetail);
+	simulationThread.start(params, executionConfig); // the simulation thread sizes and pins its own team before allocating the bodies
+	const OctantBounds& rootNodeBounds = simulationThread.latestSnapshot().rootBounds;
 
 
 	panningVelocity = ofVec3f(0, 0, 0);
@@ -43,13 +38,6 @@ void ofApp::setup()
 //--------------------------------------------------------------
 void ofApp::update()
 {
-	rootNodeBounds = { bodies, numBodies };
-	for (int i = 0; i < numBodies; i++)
-	{
-		bodies[i].bodyKey = computeMortonKey(bodies[i].position, rootNodeBounds.size);
-	}
-	RadixSortBodies(bodies, numBodies);
-
 
 
 
@@ -78,10 +66,58 @@ void ofApp::update()
 //--------------------------------------------------------------
 void ofApp::draw()
 {
+	const BodySnapshot& snapshot = simulationThread.latestSnapshot(); // the newest completed step, the simulation thread keeps stepping meanwhile
+	const SimulationParams& params = snapshot.params;
+	executionConfig = simulationThread.executionConfig();
+
 	ofSetColor(255);
 	ofDrawBitmapString("FPS: " + ofToString(ofGetFrameRate(), 2), ofGetWidth() - 200, 45);
-	ofDrawBitmapString("MAC: " + ofToString(theta, 2), ofGetWidth() - 200, 65);
-	ofDrawBitmapString("numBodies: " + ofToString(numBodies, 2), ofGetWidth() - 200, 85);
+	ofDrawBitmapString("MAC: " + ofToString(params.theta, 2), ofGetWidth() - 200, 65);
+	ofDrawBitmapString("numBodies: " + ofToString(params.numBodies, 2), ofGetWidth() - 200, 85);
+	ofDrawBitmapString("Sort: " + string(!params.adaptiveSort ? "radix" : (snapshot.lastSortResult == Sort_InOrder ? "adaptive (in order)" : (snapshot.lastSortResult == Sort_Repaired ? "adaptive (repaired)" : "adaptive (radix)"))), ofGetWidth() - 200, 105);
+	ofDrawBitmapString("Ordering: " + string(params.keyOrdering == Order_Hilbert ? "Hilbert" : "Morton") + (params.nodeLayout == NodeLayout_DepthFirst ? ", depth (experimental)" : ", breadth"), ofGetWidth() - 200, 125);
+	ofDrawBitmapString("Threads: " + ofToString(executionConfig.numThreads) + (executionConfig.affinity == Affinity_None ? " unpinned" : (executionConfig.affinity == Affinity_Compact ? " compact" : " spread")) + (executionConfig.useSMT ? " +SMT" : ""), ofGetWidth() - 200, 145);
+	ofDrawBitmapString("Step: " + ofToString(1000.0 * snapshot.stepSeconds, 1) + " ms (" + ofToString(snapshot.stepCount) + ")", ofGetWidth() - 200, 165);
+	ofDrawBitmapString("Bodies: " + string(bodyRenderMode == BodyRender_Instanced ? "instanced" : (bodyRenderMode == BodyRender_Points ? "points" : "immediate")) + (levelOfDetail ? ", LOD: " : ": ") + ofToString(bodyRenderer.drawnCount()), ofGetWidth() - 200, 185);
+	if (visualizeTree)
+	{
+		ofDrawBitmapString("Tree: " + ofToString(treeWireframe.nodeCount()) + " nodes, depth " + ofToString(wireframeMinDepth) + "-" + ofToString(treeWireframe.depthLimit()), ofGetWidth() - 200, 205);
+	}
+
+	const TraversalStatistics& traversal = snapshot.traversal;
+	interactionCount = (long)traversal.interactions();
+	numInteractions = (long)(traversal.interactionsPerBody() + 0.5);
+	ofDrawBitmapString("Interactions: " + ofToString(numInteractions) + "/body, " + ofToString(100.0 * traversal.bodyCellInteractions / std::max<double>((double)interactionCount, 1.0), 0) + "% cell", ofGetWidth() - 200, 225);
+	ofDrawBitmapString("Walk: " + ofToString(traversal.visitedNodesPerBody(), 0) + " nodes/body, list " + ofToString(traversal.maxStackDepth), ofGetWidth() - 200, 245);
+	if (showPhaseTimings) // the slowest thread's time per step, mean and p99 over the last PHASE_TIMER_WINDOW steps
+	{
+		int row = 0;
+		for (int phase = 0; phase < NUM_PHASES; phase++)
+		{
+			PhaseStatistics statistics = GetPhaseStatistics((PhaseEnum)phase);
+			if (statistics.samples == 0) // not timed in this window, e.g. prune under the subtree-parallel build, which has no prune pass
+			{
+				continue;
+			}
+			ofDrawBitmapString(string(PhaseName((PhaseEnum)phase)) + ": " + ofToString(1000.0 * statistics.meanSeconds, 2) + " ms (p99 " + ofToString(1000.0 * statistics.p99Seconds, 2) + ")", ofGetWidth() - 200, 275 + 20 * row);
+			row++;
+		}
+		ofDrawBitmapString("bounds: refit only, box in keys", ofGetWidth() - 200, 275 + 20 * row);
+	}
+
+	// Bodies per log2 bin of interaction list length, bin b holding the lists of 2^(b - 1) to 2^b - 1 interactions
+	uint64_t tallestBin = 1;
+	for (int b = 0; b < TRAVERSAL_HISTOGRAM_BINS; b++)
+	{
+		tallestBin = std::max(tallestBin, traversal.interactionHistogram[b]);
+	}
+	ofDrawBitmapString("Interactions/body, log2 bins", ofGetWidth() - 200, 495);
+	ofFill();
+	for (int b = 0; b < TRAVERSAL_HISTOGRAM_BINS; b++)
+	{
+		float height = 50.0f * traversal.interactionHistogram[b] / tallestBin;
+		ofDrawRectangle(ofGetWidth() - 200 + 6 * b, 555 - height, 5, height);
+	}
 
 	///*
 	ofPushMatrix();
@@ -94,36 +130,25 @@ void ofApp::draw()
 
 
 
-	ComputePositionAtHalfTimeStep(dt, bodies, numBodies);
-
-
-	buildLinearHashedOctreeInPlace(LHTree, bodies, numBodies, rootNodeBounds);
-
 	if (visualizeTree)
 	{
-		LHTree.visualizeTree();
+		treeWireframe.update(snapshot, wireframeMinDepth, wireframeMaxDepth, WIREFRAME_MAX_NODES); // the tree of the step's half-step positions
+		treeWireframe.draw();
 	}
 
-	HOTNode** walkList = new  HOTNode * [numBodies]; // This should be based on the depth of your tree
-	HOTNode** interactList = new  HOTNode * [numBodies];
-
-
-	Vec3D* bodiesAccelerations;
-	bodiesAccelerations = new Vec3D[numBodies];
-
-
-	ComputeHOTOctreeForce(LHTree, bodies, bodiesAccelerations, numBodies, walkList, interactList, theta); //this function computes the accelerations from gravity for all bodies
-	ComputeVelocityAndPosition(dt, bodies, numBodies, bodiesAccelerations);
-
-
-
-	delete[] walkList;
-	delete[] interactList;
-	delete[] bodiesAccelerations;
-	LHTree.deleteTree();
-
-
-	VisualizeBodies(bodies, numBodies);
+	if (levelOfDetail)
+	{
+		// The eye in world coordinates and the pixels per unit of size / distance, from the view set up above
+		glm::mat4 modelView = ofGetCurrentMatrix(OF_MATRIX_MODELVIEW);
+		glm::mat4 projection = ofGetCurrentMatrix(OF_MATRIX_PROJECTION);
+		glm::vec4 eye = glm::inverse(modelView) * glm::vec4(0, 0, 0, 1);
+		float focalPixels = projection[1][1] * ofGetViewportHeight() * 0.5f;
+		bodyRenderer.drawLevelOfDetail(snapshot, bodyRenderMode, Vec3F(eye.x, eye.y, eye.z), focalPixels, LOD_PIXEL_THRESHOLD);
+	}
+	else
+	{
+		bodyRenderer.draw(snapshot, bodyRenderMode);
+	}
 
 	ofPopMatrix();
 	//*/
@@ -155,16 +180,83 @@ void ofApp::keyPressed(int key)
 	if (key == 'v')
 	{
 		visualizeTree = !visualizeTree;
+		simulationThread.setCaptureTree(visualizeTree || levelOfDetail);
+	}
+
+	if (key == '[' || key == ']') // wireframe depth range: '[' / ']' lower and raise the deepest level drawn, '{' / '}' the shallowest
+	{
+		wireframeMaxDepth = (key == '[') ? (wireframeMaxDepth > wireframeMinDepth ? wireframeMaxDepth - 1 : wireframeMinDepth) : std::min((uint32_t)MAX_TREE_DEPTH, wireframeMaxDepth + 1);
+	}
+	if (key == '{' || key == '}')
+	{
+		wireframeMinDepth = (key == '{') ? (wireframeMinDepth > 0 ? wireframeMinDepth - 1 : 0) : std::min(wireframeMaxDepth, wireframeMinDepth + 1);
 	}
 
+	if (key == 'b') // cycle the body drawing: instanced spheres, points, one ofDrawSphere per body
+	{
+		bodyRenderMode = (bodyRenderMode == BodyRender_Instanced) ? BodyRender_Points : (bodyRenderMode == BodyRender_Points ? BodyRender_Immediate : BodyRender_Instanced);
+	}
+
+	if (key == 'l') // level of detail: nodes narrower than LOD_PIXEL_THRESHOLD pixels are drawn as one sprite at their barycenter
+	{
+		levelOfDetail = !levelOfDetail;
+		simulationThread.setCaptureTree(visualizeTree || levelOfDetail);
+	}
 
-	if (key == OF_KEY_UP)
+	if (key == 'p')
 	{
-		theta = theta + 0.1;
+		showPhaseTimings = !showPhaseTimings;
 	}
-	if (key == OF_KEY_DOWN)
+
+	if (key == 'd') // dump the phase timings, per thread, next to the app's data
+	{
+		std::ofstream csv(ofToDataPath("phase_timings.csv"));
+		WritePhaseTimingsCSV(csv);
+		std::ofstream json(ofToDataPath("phase_timings.json"));
+		WritePhaseTimingsJSON(json);
+	}
+
+	if (key == 'a')
+	{
+		SimulationParams params = simulationThread.params();
+		params.adaptiveSort = !params.adaptiveSort;
+		simulationThread.setParams(params);
+	}
+
+	if (key == 'h') // switch between Morton and Hilbert ordering, the adaptive sort falls back to radix for the one step where the order changes
+	{
+		SimulationParams params = simulationThread.params();
+		params.keyOrdering = (params.keyOrdering == Order_Morton) ? Order_Hilbert : Order_Morton;
+		simulationThread.setParams(params);
+	}
+
+	if (key == 'n') // switch the node array the force walks read between breadth-first and the experimental depth-first, from the next tree on
+	{
+		SimulationParams params = simulationThread.params();
+		params.nodeLayout = (params.nodeLayout == NodeLayout_BreadthFirst) ? NodeLayout_DepthFirst : NodeLayout_BreadthFirst;
+		simulationThread.setParams(params);
+	}
+
+	if (key == 't' || key == 'T') // 't' cycles the thread affinity (spread, compact, unpinned), 'T' toggles SMT; the team is resized to match
+	{
+		if (key == 't')
+		{
+			executionConfig.affinity = (executionConfig.affinity == Affinity_Spread) ? Affinity_Compact : (executionConfig.affinity == Affinity_Compact ? Affinity_None : Affinity_Spread);
+		}
+		else
+		{
+			executionConfig.useSMT = !executionConfig.useSMT;
+		}
+		executionConfig.numThreads = 0; // one thread per usable hardware thread of the new setting
+		simulationThread.setExecutionConfig(executionConfig); // applied by the simulation thread before its next step
+	}
+
+
+	if (key == OF_KEY_UP || key == OF_KEY_DOWN)
 	{
-		theta = theta - 0.1;
+		SimulationParams params = simulationThread.params();
+		params.theta = (key == OF_KEY_UP) ? params.theta + 0.1 : params.theta - 0.1;
+		simulationThread.setParams(params);
 	}
 	//*/
 
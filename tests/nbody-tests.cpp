@@ -0,0 +1,330 @@
+/*
+ * nbody-tests: regression checks of the simulation core, run by ctest
+ *
+ * Description:
+ * Each check prints one line, "ok" or "FAIL" with what went wrong, and main returns nonzero if any failed. The checks
+ * cover what a wrong answer would not show in nbody-sim's output:
+ *      forces: the accelerations of a step against a direct sum, for both key orderings, both node layouts and a
+ *              serial and a four-thread (subtree-parallel) build, including bodies packed into MAX_TREE_DEPTH buckets
+ *      tree: every node's count, mass and barycenter against the bodies inside its cube
+ *      sorts: the radix sort and the adaptive repair against std::sort, keys and permutation
+ *      codecs: every batch Morton codec against computeMortonKey and decodeMortonKey, including positions outside the cube
+ * The build runs them for the configured key width and, in a second copy of the core, for the other one.
+ */
+#include "Simulation.h"
+#include "MortonKeys.h"
+#include <omp.h>
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <random>
+#include <vector>
+
+
+
+
+static int failures = 0;
+
+static void Report(bool passed, const char* check, const char* detailFormat, double detail)
+{
+    std::printf("%s  %s, ", passed ? "ok  " : "FAIL", check);
+    std::printf(detailFormat, detail);
+    std::printf("\n");
+    failures += passed ? 0 : 1;
+}
+
+
+
+
+/**
+ * Largest relative error of the step's accelerations against a direct sum over the same bodies, with the kernel's softening.
+ */
+static double MaxForceError(const Simulation& simulation)
+{
+    const BodySystem& bodies = simulation.bodies;
+    const double eps2 = SOFTENING * SOFTENING;
+    double maxError = 0.0;
+    for (size_t i = 0; i < bodies.numBodies; i++)
+    {
+        double ax = 0.0, ay = 0.0, az = 0.0;
+        for (size_t j = 0; j < bodies.numBodies; j++)
+        {
+            if (j == i)
+            {
+                continue;
+            }
+            double dx = bodies.x[j] - bodies.x[i];
+            double dy = bodies.y[j] - bodies.y[i];
+            double dz = bodies.z[j] - bodies.z[i];
+            double d2 = dx * dx + dy * dy + dz * dz + eps2;
+            double f = bodies.m[j] / (d2 * std::sqrt(d2));
+            ax += f * dx;
+            ay += f * dy;
+            az += f * dz;
+        }
+        const Vec3D& a = simulation.bodiesAccelerations[i];
+        double error = std::sqrt((a.x - ax) * (a.x - ax) + (a.y - ay) * (a.y - ay) + (a.z - az) * (a.z - az)) / std::sqrt(ax * ax + ay * ay + az * az);
+        maxError = std::max(maxError, error);
+    }
+    return(maxError);
+}
+
+/**
+ * One step with dt = 0, so the tree is built on the initial positions, checked against the direct sum at a tight and a
+ * loose theta. With packCluster, the first bodies are packed closer together than the finest cell of 64-bit keys, into a
+ * bucket (128-bit keys still separate them).
+ */
+static void CheckForces(InitialConditionEnum initialCondition, KeyOrderingEnum ordering, NodeLayoutEnum layout, int threads, bool packCluster)
+{
+    static const double thetas[2] = { 0.01, 0.5 };
+    static const double tolerances[2] = { 1e-6, 5e-2 };
+    omp_set_num_threads(threads);
+    for (int t = 0; t < 2; t++)
+    {
+        SimulationParams params;
+        params.numBodies = 5000; // above SUBTREE_BUILD_MIN_BODIES, so the four-thread runs take the subtree-parallel build
+        params.theta = thetas[t];
+        params.dt = 0.0;
+        params.initialCondition = initialCondition;
+        params.keyOrdering = ordering;
+        params.nodeLayout = layout;
+        Simulation simulation;
+        simulation.initialize(params);
+        for (size_t i = 0; packCluster && i < 12; i++)
+        {
+            Vec3D position(12.34567 + 1e-6 * (i % 3), 23.45678 + 1e-6 * ((i / 3) % 2), -34.56789 + 2e-6 * (i / 6)); // far inside a 64-bit key's finest cell and the softening, far enough apart for doubles to resolve the offsets
+            simulation.bodies.setBody(i, Body(position, Vec3D(0.0, 0.0, 0.0), 1.0 + 0.1 * i));
+        }
+        simulation.step();
+
+        char check[160];
+        std::snprintf(check, sizeof(check), "forces %s %s %s-first %d thread%s%s theta %g", InitialConditionName(initialCondition), ordering == Order_Hilbert ? "Hilbert" : "Morton",
+            layout == NodeLayout_DepthFirst ? "depth" : "breadth", threads, threads == 1 ? "" : "s", packCluster ? " bucket" : "", thetas[t]);
+        double error = MaxForceError(simulation);
+        Report(error < tolerances[t], check, "max relative error %.2e", error);
+    }
+}
+
+
+/**
+ * Every node of the compacted tree against the bodies inside its cube: the same count, mass and barycenter. A node whose
+ * cube is misplaced holds other bodies than it counts, and one whose moments were summed twice or never rebuilt from its
+ * children has the wrong mass or barycenter (the tree fixes of 2d9d624).
+ */
+static void CheckTree(KeyOrderingEnum ordering, int threads)
+{
+    omp_set_num_threads(threads);
+    SimulationParams params;
+    params.numBodies = 5000;
+    params.dt = 0.0;
+    params.initialCondition = IC_Plummer;
+    params.keyOrdering = ordering;
+    Simulation simulation;
+    simulation.initialize(params);
+    simulation.step();
+
+    const BodySystem& bodies = simulation.bodies;
+    const LinearHashedOctree& tree = simulation.LHTree;
+    const double rootSize = tree.nodeArray[0].nodeBounds.size;
+    size_t wrongNodes = 0;
+    for (uint32_t n = 0; n < tree.numNodes; n++)
+    {
+        const HOTNode& node = tree.nodeArray[n];
+        long count = 0;
+        double mass = 0.0;
+        Vec3D weighted(0.0, 0.0, 0.0);
+        for (size_t i = 0; i < bodies.numBodies; i++)
+        {
+            Vec3D offset = Vec3D(bodies.x[i], bodies.y[i], bodies.z[i]) - node.nodeBounds.center;
+            if (std::fabs(offset.x) <= node.nodeBounds.size && std::fabs(offset.y) <= node.nodeBounds.size && std::fabs(offset.z) <= node.nodeBounds.size)
+            {
+                count++;
+                mass += bodies.m[i];
+                weighted += Vec3D(bodies.x[i], bodies.y[i], bodies.z[i]) * bodies.m[i];
+            }
+        }
+        Vec3D baryCenter = (mass > 0.0) ? weighted / mass : Vec3D(0.0, 0.0, 0.0);
+        bool matches = count == node.N && std::fabs(mass - node.mass) <= 1e-12 * mass && (baryCenter - node.baryCenter).vectorLength() <= 1e-12 * rootSize;
+        wrongNodes += matches ? 0 : 1;
+    }
+    char check[96];
+    std::snprintf(check, sizeof(check), "tree moments %s %d thread%s, %u nodes", ordering == Order_Hilbert ? "Hilbert" : "Morton", threads, threads == 1 ? "" : "s", tree.numNodes);
+    Report(wrongNodes == 0, check, "%.0f disagree with the bodies in their cube", (double)wrongNodes);
+}
+
+
+
+/**
+ * Whether keys[0, numKeys) are sorted like expected and every index points at its key among the original keys.
+ */
+static bool SortedLike(const KeySortBuffers& sortBuffers, const std::vector<spatialKey>& original, const std::vector<spatialKey>& expected)
+{
+    std::vector<bool> used(original.size(), false);
+    for (size_t i = 0; i < original.size(); i++)
+    {
+        size_t index = sortBuffers.indexes[i];
+        if (!(sortBuffers.keys[i] == expected[i]) || index >= original.size() || used[index] || !(original[index] == expected[i]))
+        {
+            return(false);
+        }
+        used[index] = true;
+    }
+    return(true);
+}
+
+static void LoadKeys(KeySortBuffers& sortBuffers, const std::vector<spatialKey>& keys)
+{
+    sortBuffers.reserve(keys.size());
+    sortBuffers.firstPassHistogramThreads = 0;
+    for (size_t i = 0; i < keys.size(); i++)
+    {
+        sortBuffers.keys[i] = keys[i];
+        sortBuffers.indexes[i] = i;
+    }
+}
+
+static size_t CountDescents(const std::vector<spatialKey>& keys)
+{
+    size_t descents = 0;
+    for (size_t i = 1; i < keys.size(); i++)
+    {
+        descents += (keys[i] < keys[i - 1]) ? 1 : 0;
+    }
+    return(descents);
+}
+
+static void CheckSorts(int threads)
+{
+    omp_set_num_threads(threads);
+    const size_t numKeys = 50000; // several ADAPTIVE_SORT_MIN_CHUNK chunks, so the repaired runs are merged
+    std::mt19937_64 random(12345);
+    std::uniform_real_distribution<double> coordinate(-1.0, 1.0);
+    std::vector<spatialKey> keys(numKeys);
+    for (size_t i = 0; i < numKeys; i++)
+    {
+        keys[i] = (i % 7 == 0 && i > 0) ? keys[i / 2] : computeMortonKey(Vec3D(coordinate(random), coordinate(random), coordinate(random)), 1.0); // with duplicates
+    }
+    std::vector<spatialKey> expected(keys);
+    std::sort(expected.begin(), expected.end());
+
+    KeySortBuffers sortBuffers;
+    char check[96];
+    LoadKeys(sortBuffers, keys);
+    RadixSortKeyIndexes(sortBuffers, numKeys);
+    std::snprintf(check, sizeof(check), "radix sort %d thread%s", threads, threads == 1 ? "" : "s");
+    Report(SortedLike(sortBuffers, keys, expected), check, "%.0f keys", (double)numKeys);
+
+    // Last step's order with a few keys moved a short way, as a drift does, and then scrambled past the repair limit
+    std::vector<spatialKey> drifted(expected);
+    for (size_t i = 0; i + 40 < numKeys; i += 97)
+    {
+        std::swap(drifted[i], drifted[i + 1 + i % 37]);
+    }
+    std::vector<spatialKey> scrambled(expected);
+    std::shuffle(scrambled.begin(), scrambled.end(), random);
+    const std::vector<spatialKey>* inputs[3] = { &expected, &drifted, &scrambled };
+    const AdaptiveSortEnum outcomes[3] = { Sort_InOrder, Sort_Repaired, Sort_Radix };
+    const char* names[3] = { "in order", "drifted", "scrambled" };
+    for (int c = 0; c < 3; c++)
+    {
+        LoadKeys(sortBuffers, *inputs[c]);
+        AdaptiveSortEnum outcome = AdaptiveSortKeyIndexes(sortBuffers, numKeys, CountDescents(*inputs[c]));
+        std::snprintf(check, sizeof(check), "adaptive sort %s %d thread%s", names[c], threads, threads == 1 ? "" : "s");
+        Report(outcome == outcomes[c] && SortedLike(sortBuffers, *inputs[c], expected), check, "outcome %.0f", (double)outcome);
+    }
+}
+
+
+
+
+/**
+ * Every codec this CPU supports against computeMortonKey(position - center, size) and decodeMortonKey, on positions inside
+ * the cube, out past its faces (keys are computed before the refit), on its faces and center, and on infinities and NaN.
+ * The count is odd, so the AVX2 codec's scalar tail is covered too. 128-bit keys have only the scalar encoder, the check still
+ * runs the dispatch.
+ */
+static void CheckCodecs()
+{
+    const Vec3D center(0.3, -1.7, 2.5);
+    const double size = 4.0;
+    const size_t numPositions = 10007;
+    const double edges[] = { -size, size, 0.0, -0.0, std::nextafter(-size, 0.0), std::nextafter(size, 0.0), std::nextafter(size, 2.0 * size), 1e300, -1e300,
+        HUGE_VAL, -HUGE_VAL, std::nan("") };
+    const size_t numEdges = sizeof(edges) / sizeof(edges[0]);
+    std::mt19937_64 random(6789);
+    std::uniform_real_distribution<double> coordinate(-3.0 * size, 3.0 * size);
+    std::vector<double> x(numPositions), y(numPositions), z(numPositions);
+    for (size_t i = 0; i < numPositions; i++)
+    {
+        bool paired = i < numEdges * numEdges; // the first positions pair every edge value on x and y, later ones mix them into random positions
+        x[i] = center.x + ((paired || i % 5 == 0) ? edges[i % numEdges] : coordinate(random));
+        y[i] = center.y + (paired ? edges[i / numEdges] : coordinate(random));
+        z[i] = center.z + ((i % 3 == 0) ? edges[(i / 3) % numEdges] : coordinate(random));
+    }
+    std::vector<spatialKey> expected(numPositions);
+    for (size_t i = 0; i < numPositions; i++)
+    {
+        expected[i] = computeMortonKey(Vec3D(x[i], y[i], z[i]) - center, size);
+    }
+
+    const KeyCodecEnum codecs[5] = { Codec_Auto, Codec_MagicBits, Codec_LUT, Codec_BMI2, Codec_AVX2 };
+    std::vector<spatialKey> keys(numPositions);
+    std::vector<double> decoded(3 * numPositions);
+    for (int c = 0; c < 5; c++)
+    {
+        if (!KeyCodecSupported(codecs[c]))
+        {
+            std::printf("skip  codec %s, not supported on this CPU\n", KeyCodecName(codecs[c]));
+            continue;
+        }
+        EncodeMortonKeyBlock(x.data(), y.data(), z.data(), sizeof(double), numPositions, center, size, keys.data(), codecs[c]);
+        size_t differing = 0;
+        for (size_t i = 0; i < numPositions; i++)
+        {
+            differing += (keys[i] == expected[i]) ? 0 : 1;
+        }
+        char check[96];
+        std::snprintf(check, sizeof(check), "codec %s encode", KeyCodecName(codecs[c]));
+        Report(differing == 0, check, "%.0f keys differ from computeMortonKey", (double)differing);
+
+        DecodeMortonKeyBlock(expected.data(), numPositions, center, size, &decoded[0], &decoded[1], &decoded[2], 3 * sizeof(double), codecs[c]);
+        double maxError = 0.0;
+        for (size_t i = 0; i < numPositions; i++)
+        {
+            Vec3D position = decodeMortonKey(expected[i], size) + center;
+            maxError = std::max(maxError, std::max(std::fabs(decoded[3 * i] - position.x), std::max(std::fabs(decoded[3 * i + 1] - position.y), std::fabs(decoded[3 * i + 2] - position.z))));
+        }
+        std::snprintf(check, sizeof(check), "codec %s decode", KeyCodecName(codecs[c]));
+        Report(maxError <= 1e-12 * size, check, "max difference from decodeMortonKey %.2e", maxError);
+    }
+}
+
+
+
+int main()
+{
+    std::printf("%d-bit keys\n", SPATIAL_KEY_BITS);
+    const InitialConditionEnum initialConditions[2] = { IC_UniformCube, IC_Plummer };
+    const KeyOrderingEnum orderings[2] = { Order_Morton, Order_Hilbert };
+    const NodeLayoutEnum layouts[2] = { NodeLayout_BreadthFirst, NodeLayout_DepthFirst };
+    for (int threads = 1; threads <= 4; threads += 3)
+    {
+        for (int ic = 0; ic < 2; ic++)
+        {
+            for (int o = 0; o < 2; o++)
+            {
+                for (int l = 0; l < 2; l++)
+                {
+                    CheckForces(initialConditions[ic], orderings[o], layouts[l], threads, false);
+                }
+            }
+        }
+        CheckForces(IC_Plummer, Order_Morton, NodeLayout_BreadthFirst, threads, true);
+        CheckTree(Order_Morton, threads);
+        CheckTree(Order_Hilbert, threads);
+        CheckSorts(threads);
+    }
+    CheckCodecs();
+    std::printf("%d failure%s\n", failures, failures == 1 ? "" : "s");
+    return(failures == 0 ? 0 : 1);
+}